@@ -0,0 +1,59 @@
+#ifndef COLOR_LUT_DEFINES_H
+#define COLOR_LUT_DEFINES_H
+
+#include <stdint.h>
+#include "FastLED.h"
+
+// Per-channel lookup table that folds color correction and brightness into a
+// single load per channel. This replaces the scale8 math FastLED would otherwise
+// do for every pixel, on every frame.
+//
+// There is no gamma curve: the palettes and user colors were picked on
+// FastLED's linear output, and would all shift. Dim levels stay lit through
+// scale8_video instead.
+class ColorLut {
+    private:
+        CRGB correction = CRGB(TypicalLEDStrip);
+        uint8_t brightness = 0;
+        bool valid = false;
+
+        static void fill_channel(uint8_t* table, uint8_t scale) {
+            // table[i] = scale8_video(i, scale), computed incrementally. Any non-zero
+            // input stays lit so that dim idle levels don't drop a channel and shift hue.
+            uint8_t lit = (scale != 0) ? 1 : 0;
+            uint16_t acc = 0;
+
+            table[0] = 0;
+            for (uint16_t i = 1; i < 256; i++) {
+                acc += scale;
+                table[i] = (acc >> 8) + lit;
+            }
+        }
+
+    public:
+        uint8_t red[256];
+        uint8_t green[256];
+        uint8_t blue[256];
+
+        // Rebuilds the table only when brightness actually changed.
+        void update(uint8_t brightness) {
+            if (valid && this->brightness == brightness) {
+                return;
+            }
+
+            this->brightness = brightness;
+            this->valid = true;
+
+            fill_channel(red, scale8(correction.red, brightness));
+            fill_channel(green, scale8(correction.green, brightness));
+            fill_channel(blue, scale8(correction.blue, brightness));
+        }
+
+        void apply(const CRGB& in, CRGB& out) const {
+            out.red = red[in.red];
+            out.green = green[in.green];
+            out.blue = blue[in.blue];
+        }
+};
+
+#endif
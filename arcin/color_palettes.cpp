@@ -139,42 +139,42 @@ DEFINE_GRADIENT_PALETTE(Empress_gp) {
     255, 0x59, 0x1f, 0x28,
 };
 
-void fill_from_palette(CRGBPalette256& current_palette, WS2812B_Palette palette, bool reverse_rainbow) {
+void fill_from_palette(PaletteSampler& current_palette, WS2812B_Palette palette, bool reverse_rainbow) {
     switch(palette) {
         case WS2812B_PALETTE_DREAM:
-            current_palette = PartyColors_p;
+            current_palette.set(PartyColors_p);
             break;
 
         case WS2812B_PALETTE_CANNON_BALLERS:
-            current_palette = CannonBallers_p;
+            current_palette.set(CannonBallers_p);
             break;
 
         case WS2812B_PALETTE_HAPPYSKY:
-            current_palette = CloudColors_p;
+            current_palette.set(CloudColors_p);
             break;
 
         case WS2812B_PALETTE_TROOPERS:
-            current_palette = Troopers_p;
+            current_palette.set(Troopers_p);
             break;
 
         case WS2812B_PALETTE_EMPRESS:
-            current_palette = Empress_gp;
+            current_palette.set(Empress_gp);
             break;
 
         case WS2812B_PALETTE_TRICORO:
-            current_palette = Tricoro_p;
+            current_palette.set(Tricoro_p);
             break;
 
         case WS2812B_PALETTE_BISTROVER:
-            current_palette = Bistrover_p;
+            current_palette.set(Bistrover_p);
             break;
 
         case WS2812B_PALETTE_HEROIC_VERSE:
-            current_palette = HeroicVerse_gp;
+            current_palette.set(HeroicVerse_gp);
             break;
 
         case WS2812B_PALETTE_ROOTAGE:
-            current_palette = Rootage_p;
+            current_palette.set(Rootage_p);
             break;
 
         case WS2812B_PALETTE_RAINBOW:
@@ -183,9 +183,9 @@ void fill_from_palette(CRGBPalette256& current_palette, WS2812B_Palette palette,
                 // This makes the rainbow go counter-clockwise
                 // It "looks" more correct in wave (multiple circle) configuration than the
                 // clockwise.
-                current_palette = RainbowColors_reverse_p;
+                current_palette.set(RainbowColors_reverse_p);
             } else {
-                current_palette = RainbowColors_p;
+                current_palette.set(RainbowColors_p);
             }
             
             break;
@@ -3,6 +3,7 @@
 
 #include "FastLED.h"
 #include "colorutils.h"
+#include "rgb_simd.h"
 
 typedef enum _WS2812B_Palette {
     WS2812B_PALETTE_RAINBOW,
@@ -15,6 +16,8 @@ typedef enum _WS2812B_Palette {
     WS2812B_PALETTE_ROOTAGE,
     WS2812B_PALETTE_HEROIC_VERSE,
     WS2812B_PALETTE_BISTROVER,
+
+    WS2812B_PALETTE_COUNT,
 } WS2812B_Palette;
 
 extern const TProgmemRGBPalette16 RainbowColors_reverse_p FL_PROGMEM;
@@ -28,6 +31,132 @@ extern const TProgmemRGBPalette16 Empress_p FL_PROGMEM;
 DECLARE_GRADIENT_PALETTE(HeroicVerse_gp);
 DECLARE_GRADIENT_PALETTE(Empress_gp);
 
-void fill_from_palette(CRGBPalette256& current_palette, WS2812B_Palette palette, bool reverse_rainbow);
+// Maximum number of color stops a PaletteSampler can hold. A 16-entry palette
+// needs 17 (the first entry is repeated at the end so that it wraps around).
+#define PALETTE_SAMPLER_MAX_STOPS 17
+
+// Linearly interpolates a palette from a compact list of color stops, instead of
+// expanding it into a 256-entry CRGBPalette256 (768 bytes of RAM).
+//
+// 16-entry palettes are evenly spaced, so the segment and blend fraction come
+// straight from the index. Gradient palettes search their (few) stops, and use a
+// precomputed reciprocal of each segment width instead of dividing.
+class PaletteSampler {
+    private:
+        uint8_t num_stops = 0;
+        bool uniform = false;
+        uint8_t positions[PALETTE_SAMPLER_MAX_STOPS];
+        // 0x00BBGGRR, so that a word has the same byte order as CRGB in memory
+        uint32_t colors[PALETTE_SAMPLER_MAX_STOPS];
+        // 65536 / (positions[n + 1] - positions[n]), rounded up so that the end of
+        // each segment reaches its stop color exactly
+        uint32_t inverse_widths[PALETTE_SAMPLER_MAX_STOPS];
+
+        static uint32_t pack(const CRGB& rgb) {
+            return rgb.red | (rgb.green << 8) | (rgb.blue << 16);
+        }
+
+        void add_stop(uint8_t position, const CRGB& rgb) {
+            if (PALETTE_SAMPLER_MAX_STOPS <= num_stops) {
+                return;
+            }
+            positions[num_stops] = position;
+            colors[num_stops] = pack(rgb);
+            num_stops++;
+        }
+
+        void finish_gradient() {
+            // always start at 0, and have at least two stops to blend between
+            positions[0] = 0;
+            if (num_stops < 2) {
+                positions[1] = UINT8_MAX;
+                colors[1] = colors[0];
+                num_stops = 2;
+            }
+
+            for (uint8_t stop = 0; stop + 1 < num_stops; stop++) {
+                uint8_t width = positions[stop + 1] - positions[stop];
+                inverse_widths[stop] = (width == 0) ? 0 : ((65536 + width - 1) / width);
+            }
+        }
+
+    public:
+        void set(const TProgmemRGBPalette16& palette) {
+            num_stops = 0;
+            uniform = true;
+            for (uint8_t entry = 0; entry < 16; entry++) {
+                add_stop(entry * 16, CRGB(FL_PGM_READ_DWORD_NEAR(&palette[entry])));
+            }
+            // wrap around to the first entry, same as ColorFromPalette with LINEARBLEND
+            positions[16] = 0;
+            colors[16] = colors[0];
+            num_stops = 17;
+        }
+
+        void set(TProgmemRGBGradientPalette_bytes gradient) {
+            num_stops = 0;
+            uniform = false;
+
+            const uint8_t* entry = (const uint8_t*)gradient;
+            while (true) {
+                uint8_t position = FL_PGM_READ_BYTE_NEAR(entry + 0);
+                CRGB rgb(
+                    FL_PGM_READ_BYTE_NEAR(entry + 1),
+                    FL_PGM_READ_BYTE_NEAR(entry + 2),
+                    FL_PGM_READ_BYTE_NEAR(entry + 3));
+                add_stop(position, rgb);
+
+                if (position == UINT8_MAX || PALETTE_SAMPLER_MAX_STOPS <= num_stops) {
+                    break;
+                }
+                entry += 4;
+            }
+
+            finish_gradient();
+        }
+
+        void set(const CRGB& from, const CRGB& to) {
+            num_stops = 0;
+            uniform = false;
+            add_stop(0, from);
+            add_stop(UINT8_MAX, to);
+            finish_gradient();
+        }
+
+        CRGB sample(uint8_t index) const {
+            uint8_t segment;
+            uint16_t fract;
+            if (uniform) {
+                segment = index >> 4;
+                fract = (index & 0x0F) << 4;
+            } else {
+                segment = 0;
+                while ((segment + 2 < num_stops) && (positions[segment + 1] <= index)) {
+                    segment++;
+                }
+
+                // past the last stop (if the gradient ends early), keep its color
+                uint32_t distance = index - positions[segment];
+                fract = (distance * inverse_widths[segment]) >> 8;
+                if (256 < fract || positions[segment + 1] < index) {
+                    fract = 256;
+                }
+            }
+
+            uint32_t rgb = rgb_packed_lerp(colors[segment], colors[segment + 1], fract);
+            return CRGB(rgb & 0xFF, (rgb >> 8) & 0xFF, (rgb >> 16) & 0xFF);
+        }
+
+        // Same as fill_palette with LINEARBLEND at full brightness
+        void fill(CRGB* leds, uint16_t num_leds, uint8_t start_index, uint8_t step) const {
+            uint8_t index = start_index;
+            for (uint16_t led = 0; led < num_leds; led++) {
+                leds[led] = sample(index);
+                index += step;
+            }
+        }
+};
+
+void fill_from_palette(PaletteSampler& current_palette, WS2812B_Palette palette, bool reverse_rainbow);
 
 #endif
\ No newline at end of file
@@ -31,7 +31,11 @@ typedef union _config_flags {
         uint32_t TtLedReactive: 1;
         uint32_t TtLedHid: 1;
         uint32_t Ws2812b: 1;
-        uint32_t Reserved: 18;
+        // second WS2812B strip on QE2 A; uses config_ext_t::rgb2
+        uint32_t Ws2812bStrip2: 1;
+        // SelectMultiFunction emits E2 on the first press, see multifunc.h
+        uint32_t SelectOptimisticTap: 1;
+        uint32_t Reserved: 16;
     };
 
     uint32_t AsUINT32;
@@ -72,6 +76,9 @@ typedef struct _rgb_config {
             uint8_t Multiplicity : 3;
         };
     };
+    // duration of each frame in milliseconds; 0 = derive from the number of
+    // LEDs and the measured render time
+    uint8_t FramePeriodMs;
 } rgb_config;
 
 struct config_t {
@@ -93,14 +100,163 @@ struct config_t {
     uint8_t remap_start_sel;
     uint8_t remap_b8_b9;
 
-    uint8_t reserved1[2];
+    // SelectMultiFunction tap window, in units of 10ms
+    // (0 = 500ms, or 200ms with SelectOptimisticTap)
+    uint8_t select_tap_window;
+    uint8_t reserved1;
 
     rgb_config rgb;
 
-    uint8_t reserved2[3];
+    uint8_t reserved2[2];
 };
 
 // From config_report_t.data[60]
 static_assert(sizeof(config_t) == 60, "config size mismatch");
 
+// Key-reactive zones on the WS2812B strip.
+// Zones 0-6 follow buttons 1-7, zones 7-10 follow E1-E4.
+#define RGB_ZONE_COUNT 11
+
+typedef struct _rgb_zone {
+    uint8_t FirstLed;
+    // 0 = zone is not used
+    uint8_t NumberOfLeds;
+    ColorRgb Color;
+} rgb_zone;
+
+typedef union _rgb_zone_flags {
+    struct {
+        // stay at full brightness until the button is released
+        uint8_t HoldWhilePressed: 1;
+        uint8_t Reserved: 7;
+    };
+
+    uint8_t AsUINT8;
+} rgb_zone_flags;
+
+static_assert(sizeof(rgb_zone_flags) == sizeof(uint8_t), "size mismatch");
+
+typedef struct _rgb_zone_config {
+    rgb_zone_flags Flags;
+    // fade out time, in units of 10ms
+    uint8_t DecayTime;
+    rgb_zone Zones[RGB_ZONE_COUNT];
+    uint8_t reserved[3];
+} rgb_zone_config;
+
+// Button chords for runtime mode switching (see modeswitch.h)
+#define CHORD_COUNT 10
+
+typedef enum _chord_action {
+    CHORD_ACTION_NONE,
+    // controller only <-> keyboard only
+    CHORD_ACTION_INPUT_MODE,
+    // analog -> digital -> analog (reversed) -> ...
+    CHORD_ACTION_TT_MODE,
+    // button LEDs and WS2812B on / off
+    CHORD_ACTION_LED_TOGGLE,
+    // turntable sensitivity up or down by one step
+    CHORD_ACTION_TT_SENSITIVITY_UP,
+    CHORD_ACTION_TT_SENSITIVITY_DOWN,
+    // button debounce window in ms, taken from Argument (0 = off)
+    CHORD_ACTION_DEBOUNCE,
+    // next WS2812B mode
+    CHORD_ACTION_RGB_MODE_NEXT,
+} chord_action;
+
+typedef struct _chord {
+    // raw buttons that must be held, and nothing else (0 = entry not used)
+    uint16_t Buttons;
+    // upper nibble: button to tap while Buttons are held (1-11, 0 = hold chord)
+    // lower nibble: number of taps
+    uint8_t Tap;
+    // hold chords: how long to hold; tap chords: longest gap between taps
+    // (0 = any). In units of 100ms
+    uint8_t Time;
+    uint8_t Action; // chord_action
+    uint8_t Argument;
+} __attribute__((packed)) chord;
+
+typedef struct _chord_config {
+    // all empty = use the default start + select chords
+    chord Chords[CHORD_COUNT];
+} chord_config;
+
+// Per-button tap / multi-tap / hold gestures (see multifunc.h). Indexed by the
+// remapped button bit (buttons 1-7 are 0-6, E1-E4 are 8-11).
+#define GESTURE_COUNT 12
+
+typedef struct _gesture {
+    // taps are counted for this long after the first press, in units of 10ms
+    // (0 = the button is passed through unchanged)
+    uint8_t TapWindow;
+    // how long to assert the output, in units of 10ms
+    uint8_t OutputTime: 6;
+    // keep asserting the output for as long as the button is held
+    uint8_t ExtendWhileHeld: 1;
+    // assert the one tap output on the first press, and only switch to the
+    // multi-tap output if another press arrives within the tap window
+    uint8_t Optimistic: 1;
+    // outputs (remapped button bits) for 1, 2, 3 and 4 or more taps
+    uint16_t Outputs[4];
+    // asserted while a single press is held past the tap window (0 = not used)
+    uint16_t HoldOutput;
+} __attribute__((packed)) gesture;
+
+typedef struct _gesture_config {
+    gesture Gestures[GESTURE_COUNT];
+    uint8_t reserved[36];
+} gesture_config;
+
+// Any-to-any button remapping. Sources are the 11 physical inputs (in
+// ARCIN_PIN_BUTTON_* bit order) followed by the two digital turntable
+// directions; each maps to any set of gamepad buttons. Keyboard mode follows
+// through the keycode of each gamepad button.
+#define REMAP_SOURCE_COUNT 13
+#define REMAP_SOURCE_TT_CW 11
+#define REMAP_SOURCE_TT_CCW 12
+
+typedef union _remap_flags {
+    struct {
+        // use this table instead of remap_start_sel / remap_b8_b9
+        uint8_t Enable: 1;
+        uint8_t Reserved: 7;
+    };
+
+    uint8_t AsUINT8;
+} remap_flags;
+
+static_assert(sizeof(remap_flags) == sizeof(uint8_t), "size mismatch");
+
+typedef struct _remap_config {
+    remap_flags Flags;
+    uint8_t reserved0;
+    uint16_t Buttons[REMAP_SOURCE_COUNT];
+    uint8_t reserved[32];
+} remap_config;
+
+// Settings that did not fit in config_t. Each member is one config segment,
+// starting from segment 1.
+struct config_ext_t {
+    rgb_zone_config zones;
+
+    // second WS2812B strip
+    rgb_config rgb2;
+    uint8_t reserved0[60 - sizeof(rgb_config)];
+
+    chord_config chords;
+
+    // segments 4-6
+    gesture_config gestures;
+
+    // segment 7
+    remap_config remap;
+};
+
+static_assert(sizeof(rgb_zone_config) == 60, "config segment size mismatch");
+static_assert(sizeof(chord_config) == 60, "config segment size mismatch");
+static_assert(sizeof(gesture_config) == 180, "config segment size mismatch");
+static_assert(sizeof(remap_config) == 60, "config segment size mismatch");
+static_assert(sizeof(config_ext_t) % 60 == 0, "config segment size mismatch");
+
 #endif
@@ -0,0 +1,108 @@
+#ifndef CONFIG_VALIDATE_H
+#define CONFIG_VALIDATE_H
+
+#include <stdint.h>
+#include "config.h"
+#include "inf_defines.h"
+
+// Config comes from flash, which may hold anything (a page written by older
+// firmware, or never written at all), and from the host. These bring every
+// field that is used as a count or an enum into range, so that nothing later
+// has to trust it. Plain C++, so the host can check it too.
+
+// debounce_init() divides by the window and keeps a history of 10 samples
+#define CONFIG_DEBOUNCE_TICKS_MIN 1
+#define CONFIG_DEBOUNCE_TICKS_MAX 10
+
+// Checked against the LED code in rgbmanager.h
+#define RGB_CONFIG_MAX_LEDS 180
+#define RGB_CONFIG_MODE_COUNT 11
+#define RGB_CONFIG_PALETTE_COUNT 10
+#define RGB_CONFIG_MAX_FRAME_MS 20
+
+// Chords match the 11 raw inputs, and tap one of them (1-11)
+#define CHORD_BUTTONS_ALL 0x7ff
+#define CHORD_TAP_BUTTON_MAX 11
+#define CHORD_ACTION_COUNT (CHORD_ACTION_RGB_MODE_NEXT + 1)
+
+// Gestures are indexed by remapped button bit, and no button is remapped to
+// bit 7. Their outputs go to the gamepad buttons, digital turntable included.
+#define GESTURE_UNUSED_SLOT 7
+#define GESTURE_OUTPUTS_ALL (INFINITAS_BUTTON_ALL | INFINITAS_EFFECTORS_ALL | \
+                             JOY_BUTTON_13 | JOY_BUTTON_14)
+
+// Out of range modes and palettes fall back to the first one.
+inline void rgb_config_validate(rgb_config* rgb) {
+    if (RGB_CONFIG_MAX_LEDS < rgb->NumberOfLeds) {
+        rgb->NumberOfLeds = RGB_CONFIG_MAX_LEDS;
+    }
+
+    if (RGB_CONFIG_MODE_COUNT <= rgb->Mode) {
+        rgb->Mode = 0;
+    }
+
+    if (RGB_CONFIG_PALETTE_COUNT <= rgb->ColorPalette) {
+        rgb->ColorPalette = 0;
+    }
+
+    // effects advance by at most this much per frame, so longer periods
+    // would slow them down
+    if (RGB_CONFIG_MAX_FRAME_MS < rgb->FramePeriodMs) {
+        rgb->FramePeriodMs = RGB_CONFIG_MAX_FRAME_MS;
+    }
+}
+
+// Chords that can never match are dropped, unknown actions do nothing.
+inline void chord_config_validate(chord_config* chords) {
+    for (uint8_t i = 0; i < CHORD_COUNT; i++) {
+        chord& c = chords->Chords[i];
+
+        c.Buttons &= CHORD_BUTTONS_ALL;
+        if (CHORD_TAP_BUTTON_MAX < (c.Tap >> 4)) {
+            c.Buttons = 0;
+        }
+
+        // a tap chord fires after at least one tap
+        if ((c.Tap >> 4) != 0 && (c.Tap & 0xf) == 0) {
+            c.Tap |= 1;
+        }
+
+        if (CHORD_ACTION_COUNT <= c.Action) {
+            c.Action = CHORD_ACTION_NONE;
+        }
+
+        // becomes the debounce window, 0 turns debouncing off
+        if (c.Action == CHORD_ACTION_DEBOUNCE && CONFIG_DEBOUNCE_TICKS_MAX < c.Argument) {
+            c.Argument = CONFIG_DEBOUNCE_TICKS_MAX;
+        }
+    }
+}
+
+inline void gesture_config_validate(gesture_config* gestures) {
+    gestures->Gestures[GESTURE_UNUSED_SLOT].TapWindow = 0;
+
+    for (uint8_t i = 0; i < GESTURE_COUNT; i++) {
+        gesture& g = gestures->Gestures[i];
+
+        for (uint8_t taps = 0; taps < 4; taps++) {
+            g.Outputs[taps] &= GESTURE_OUTPUTS_ALL;
+        }
+        g.HoldOutput &= GESTURE_OUTPUTS_ALL;
+    }
+}
+
+inline void config_validate(config_t* config, config_ext_t* config_ext) {
+    if (config->debounce_ticks < CONFIG_DEBOUNCE_TICKS_MIN) {
+        config->debounce_ticks = CONFIG_DEBOUNCE_TICKS_MIN;
+    } else if (CONFIG_DEBOUNCE_TICKS_MAX < config->debounce_ticks) {
+        config->debounce_ticks = CONFIG_DEBOUNCE_TICKS_MAX;
+    }
+
+    rgb_config_validate(&config->rgb);
+    rgb_config_validate(&config_ext->rgb2);
+
+    chord_config_validate(&config_ext->chords);
+    gesture_config_validate(&config_ext->gestures);
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define CONFIGLOADER_H
 
 #include <rcc/flash.h>
+#include <stdint.h>
 #include <string.h>
 
 class Configloader {
@@ -15,10 +16,10 @@ class Configloader {
             uint32_t size;
         };
         
-        uint32_t flash_addr;
+        uintptr_t flash_addr;
         
     public:
-        Configloader(uint32_t addr) : flash_addr(addr) {}
+        Configloader(uintptr_t addr) : flash_addr(addr) {}
         
         bool read(uint32_t size, void* data) {
             header_t* header = (header_t*)flash_addr;
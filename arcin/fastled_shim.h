@@ -10,7 +10,15 @@ unsigned long millis() {
 }
 
 unsigned long micros() {
-    return 0;
+    // SysTick counts down from STK.LOAD and wraps once per millisecond
+    uint32_t ms;
+    uint32_t ticks;
+    do {
+        ms = Time::time();
+        ticks = STK.LOAD - STK.VAL;
+    } while (ms != Time::time());
+
+    return (ms * 1000) + (ticks * 1000 / (STK.LOAD + 1));
 }
 
 void delay(unsigned long ms) {
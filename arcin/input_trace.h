@@ -0,0 +1,214 @@
+#ifndef INPUT_TRACE_DEFINES_H
+#define INPUT_TRACE_DEFINES_H
+
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+
+// Input trace: the raw inputs, sampled once per ms, kept in a RAM ring buffer
+// so a misfire on a real cabinet can be downloaded and replayed offline
+// through the same input pipeline (see host/replay.h).
+//
+// Only samples that differ from the previous one are stored, so the buffer
+// covers minutes of idle time but well under a second of constant scratching.
+// A sample is forced every INPUT_TRACE_KEYFRAME_MS so that the 16-bit
+// timestamps can be unwrapped, backwards from last_sample_time.
+//
+// Over the config feature report:
+//   write INPUT_TRACE_SEGMENT_CONTROL with an input_trace_control_t - start/stop
+//   write INPUT_TRACE_SEGMENT_CONTROL with no data, then read - input_trace_header_t
+//   write INPUT_TRACE_SEGMENT_READ with a uint16_t index, then read
+//       - up to INPUT_TRACE_CHUNK_SAMPLES samples starting at index, oldest first
+// Stop recording before downloading, or the samples move under the reader.
+
+#define INPUT_TRACE_SEGMENT_CONTROL 0x30
+#define INPUT_TRACE_SEGMENT_READ 0x31
+
+#define INPUT_TRACE_SAMPLES 512
+#define INPUT_TRACE_KEYFRAME_MS 16384
+#define INPUT_TRACE_CHUNK_SAMPLES 7
+
+struct input_trace_sample_t {
+    // low 16 bits of Time::time()
+    uint16_t time;
+    // active high, before remapping
+    uint16_t buttons;
+    // TIM2.CNT and TIM3.CNT
+    uint16_t qe1;
+    uint16_t qe2;
+} __attribute__((packed));
+
+#define INPUT_TRACE_CONTROL_STOP 0
+#define INPUT_TRACE_CONTROL_START 1
+
+struct input_trace_control_t {
+    uint8_t command;
+} __attribute__((packed));
+
+// flags
+#define INPUT_TRACE_RECORDING 0x01
+// samples were dropped from the start of the trace
+#define INPUT_TRACE_WRAPPED 0x02
+// analog_tt_reverse_direction, when recording started
+#define INPUT_TRACE_TT_REVERSED 0x04
+
+struct input_trace_header_t {
+    uint8_t flags;
+    uint8_t version;
+    uint16_t count;
+    uint32_t start_time;
+    uint32_t last_sample_time;
+    uint32_t stop_time;
+
+    // Pipeline state when recording started, which may differ from the
+    // config after chords were used.
+    config_flags runtime_flags;
+    int8_t qe1_sens;
+    uint8_t debounce_ticks;
+    // TIM2.ARR + 1 and TIM3.ARR + 1
+    uint16_t qe1_range;
+    uint16_t qe2_range;
+} __attribute__((packed));
+
+#define INPUT_TRACE_VERSION 1
+
+static_assert(sizeof(input_trace_header_t) <= 60, "size mismatch");
+
+struct input_trace_chunk_t {
+    uint16_t index;
+    uint16_t count;
+    input_trace_sample_t samples[INPUT_TRACE_CHUNK_SAMPLES];
+} __attribute__((packed));
+
+static_assert(sizeof(input_trace_chunk_t) <= 60, "size mismatch");
+
+class InputTrace {
+    input_trace_sample_t samples[INPUT_TRACE_SAMPLES];
+    input_trace_header_t header;
+
+    // next sample to overwrite
+    uint16_t head = 0;
+    uint32_t last_time = 0;
+    uint16_t read_index = 0;
+    bool start_requested = false;
+
+    public:
+        InputTrace() {
+            memset(&header, 0, sizeof(header));
+            header.version = INPUT_TRACE_VERSION;
+        }
+
+        bool is_recording() const {
+            return header.flags & INPUT_TRACE_RECORDING;
+        }
+
+        // Set by a start command. The main loop owns the pipeline state that
+        // goes into the header, so it does the actual start().
+        bool is_start_requested() const {
+            return start_requested;
+        }
+
+        void start(uint32_t now, const input_trace_header_t& state) {
+            start_requested = false;
+            header = state;
+            header.flags = INPUT_TRACE_RECORDING | (state.flags & INPUT_TRACE_TT_REVERSED);
+            header.version = INPUT_TRACE_VERSION;
+            header.count = 0;
+            header.start_time = now;
+            header.last_sample_time = now;
+            header.stop_time = now;
+            head = 0;
+            // the first sample is always stored
+            last_time = now - 1;
+        }
+
+        void stop(uint32_t now) {
+            if (is_recording()) {
+                header.flags &= ~INPUT_TRACE_RECORDING;
+                header.stop_time = now;
+            }
+        }
+
+        // Called from every pass of the main loop; samples once per ms.
+        void record(uint32_t now, uint16_t buttons, uint16_t qe1, uint16_t qe2) {
+            if (!is_recording() || now == last_time) {
+                return;
+            }
+            last_time = now;
+
+            if (header.count != 0) {
+                const input_trace_sample_t& last =
+                    samples[(head + INPUT_TRACE_SAMPLES - 1) % INPUT_TRACE_SAMPLES];
+
+                if (last.buttons == buttons && last.qe1 == qe1 && last.qe2 == qe2 &&
+                    now - header.last_sample_time < INPUT_TRACE_KEYFRAME_MS) {
+                    return;
+                }
+            }
+
+            samples[head] = {uint16_t(now), buttons, qe1, qe2};
+            head = (head + 1) % INPUT_TRACE_SAMPLES;
+            header.last_sample_time = now;
+
+            if (header.count < INPUT_TRACE_SAMPLES) {
+                header.count++;
+            } else {
+                header.flags |= INPUT_TRACE_WRAPPED;
+            }
+        }
+
+        bool control(const uint8_t* data, uint8_t size, uint32_t now) {
+            if (size < sizeof(input_trace_control_t)) {
+                return false;
+            }
+
+            switch (((const input_trace_control_t*)data)->command) {
+                case INPUT_TRACE_CONTROL_STOP:
+                    stop(now);
+                    return true;
+
+                case INPUT_TRACE_CONTROL_START:
+                    start_requested = true;
+                    return true;
+
+                default:
+                    return false;
+            }
+        }
+
+        bool select(const uint8_t* data, uint8_t size) {
+            if (size < sizeof(uint16_t)) {
+                return false;
+            }
+            memcpy(&read_index, data, sizeof(read_index));
+            return true;
+        }
+
+        void read_header(uint8_t* out, uint32_t now) {
+            if (is_recording()) {
+                header.stop_time = now;
+            }
+
+            memset(out, 0, 60);
+            memcpy(out, &header, sizeof(header));
+        }
+
+        void read_chunk(uint8_t* out) {
+            input_trace_chunk_t chunk;
+            memset(&chunk, 0, sizeof(chunk));
+            chunk.index = read_index;
+
+            uint16_t oldest = (head + INPUT_TRACE_SAMPLES - header.count) % INPUT_TRACE_SAMPLES;
+            while (chunk.count < INPUT_TRACE_CHUNK_SAMPLES &&
+                   read_index + chunk.count < header.count) {
+                chunk.samples[chunk.count] =
+                    samples[(oldest + read_index + chunk.count) % INPUT_TRACE_SAMPLES];
+                chunk.count++;
+            }
+
+            memset(out, 0, 60);
+            memcpy(out, &chunk, sizeof(chunk));
+        }
+};
+
+#endif
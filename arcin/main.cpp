@@ -10,6 +10,7 @@
 #include "usb_strings.h"
 #include "configloader.h"
 #include "config.h"
+#include "config_validate.h"
 
 #include "inf_defines.h"
 #include "remap.h"
@@ -18,9 +19,25 @@
 #include "modeswitch.h"
 #include "analog_button.h"
 #include "rgbmanager.h"
+#include "input_trace.h"
+#include "report_handler.h"
 
 #define DEBUG_TIMING_GAMEPAD 0
 
+// renders the LED effects at boot and reports cycles per frame; see rgb_benchmark.h
+#define DEBUG_RGB_BENCHMARK 0
+
+#if DEBUG_RGB_BENCHMARK
+#include "rgb_benchmark.h"
+#endif
+
+// times the input pipeline stages at boot; see pipeline_benchmark.h
+#define DEBUG_PIPELINE_BENCHMARK 0
+
+#if DEBUG_PIPELINE_BENCHMARK
+#include "pipeline_benchmark.h"
+#endif
+
 #define ARRAY_SIZE(x) \
     ((sizeof(x)/sizeof(0[x])) / ((size_t)(!(sizeof(x) % sizeof(0[x])))))
 
@@ -45,9 +62,6 @@ static const uint16_t infinitas_keys[] = {
 
 static uint32_t& reset_reason = *(uint32_t*)0x10000000;
 
-static bool do_reset_bootloader;
-static bool do_reset;
-
 void reset() {
     SCB.AIRCR = (0x5fa << 16) | (1 << 2); // SYSRESETREQ
 }
@@ -61,6 +75,15 @@ Configloader configloader(0x801f800);
 
 config_t config;
 
+// config segments 1 and up
+Configloader config_ext_loader(0x801e800);
+
+config_ext_t config_ext;
+
+// WS2812B effect program, uploaded through config segments
+// RGB_PROGRAM_SEGMENT_FIRST..LAST
+Configloader rgb_program_loader(0x801f000);
+
 /* 
  // origial hardware ID for arcin - expected by firmware flash
  // and the settings tool
@@ -142,109 +165,53 @@ USB_f1 usb_250hz(USB, dev_desc_p, conf_desc_p_250hz);
 bool global_led_enable = false;
 bool global_tt_hid_enable = false;
 
-RGBManager rgb_manager;
+WS2812B ws2812b_strip1(WS2812B_OUTPUT_1);
+WS2812B ws2812b_strip2(WS2812B_OUTPUT_2);
+
+RGBManager rgb_manager(ws2812b_strip1);
+RGBManager rgb_manager2(ws2812b_strip2);
+
+InputTrace input_trace;
+
+ReportHandler report_handler(
+    config, config_ext, configloader, config_ext_loader, rgb_program_loader,
+    input_trace, rgb_manager, rgb_manager2);
 
 template <>
 void interrupt<Interrupt::DMA1_Channel7>() {
     rgb_manager.irq();
 }
 
+template <>
+void interrupt<Interrupt::DMA1_Channel3>() {
+    rgb_manager2.irq();
+}
+
 timer hid_lights_expiry_timer;
 
+// Reports are handled in report_handler.h, which the host fuzzes.
 class HID_arcin : public USB_HID {
-    private:
-        bool set_feature_bootloader(bootloader_report_t* report) {
-            switch(report->func) {
-                case 0:
-                    return true;
-                
-                case 0x10: // Reset to bootloader
-                    do_reset_bootloader = true;
-                    return true;
-                
-                case 0x20: // Reset to runtime
-                    do_reset = true;
-                    return true;
-                
-                default:
-                    return false;
-            }
-        }
-        
-        bool set_feature_config(config_report_t* report) {
-            if(report->segment != 0) {
-                return false;
-            }
-            
-            configloader.write(report->size, report->data);
-            
-            return true;
-        }
-        
-        bool get_feature_config() {
-            config_report_t report = {0xc0, 0, sizeof(config)};
-            
-            memcpy(report.data, &config, sizeof(config));
-
-            usb.write(0, (uint32_t*)&report, sizeof(report));
-            
-            return true;
-        }
-    
     public:
         HID_arcin(USB_generic& usbd, desc_t rdesc) : USB_HID(usbd, rdesc, 0, 1, 64) {}
     
     protected:
         virtual bool set_output_report(uint32_t* buf, uint32_t len) {
-            if (len < sizeof(uint8_t)) {
-                return false;
-            }
-
-            uint8_t report_id = *(uint8_t*)buf;
-            if (report_id == 0x2 && len == sizeof(output_report_t)) {
-                output_report_t* report = (output_report_t*)buf;
-                set_hid_lights(report->leds);
-
-            } else if (report_id == 0x3 &&
-                       len == sizeof(output_report_rgb_t) &&
-                       config.flags.Ws2812b) {
-
-                output_report_rgb_t* report = (output_report_rgb_t*)buf;
-                rgb_manager.update_from_hid(report->rgb);
-            }
-
-            return true;
+            return report_handler.set_output_report(buf, len);
         }
         
         virtual bool set_feature_report(uint32_t* buf, uint32_t len) {
-            switch(*buf & 0xff) {
-                case 0xb0:
-                    if(len != sizeof(bootloader_report_t)) {
-                        return false;
-                    }
-                    
-                    return set_feature_bootloader((bootloader_report_t*)buf);
-                
-                case 0xc0:
-                    if(len != sizeof(config_report_t)) {
-                        return false;
-                    }
-                    
-                    return set_feature_config((config_report_t*)buf);
-                
-                default:
-                    return false;
-            }
+            return report_handler.set_feature_report(buf, len);
         }
         
         virtual bool get_feature_report(uint8_t report_id) {
-            switch(report_id) {
-                case 0xc0:
-                    return get_feature_config();
-                
-                default:
-                    return false;
+            config_report_t report;
+            if(!report_handler.get_feature_report(report_id, &report)) {
+                return false;
             }
+            
+            usb.write(0, (uint32_t*)&report, sizeof(report));
+            
+            return true;
         }
 };
 
@@ -349,17 +316,72 @@ uint32_t debug_value;
 
 #endif
 
+// Changes the counter's range. The count is reduced into the new range, or the
+// encoder would count on past ARR until the counter wraps. last_count, which the
+// next poll takes the movement from, moves along with it, so the change itself
+// doesn't show up as movement.
+void set_qe1_sensitivity(int8_t sens, uint32_t& last_count) {
+    int32_t range = (sens < 0) ? 256 * -sens : 256;
+
+    // the encoder keeps counting, so keep the read and the write together
+    asm volatile("cpsid i" ::: "memory");
+    int32_t old_range = TIM2.ARR + 1;
+    uint32_t count = TIM2.CNT;
+    TIM2.ARR = range - 1;
+    TIM2.CNT = count % range;
+    asm volatile("cpsie i" ::: "memory");
+
+    // movement since the last poll, as the main loop takes it
+    int32_t moved = count - last_count;
+    if (moved > old_range / 2) {
+        moved -= old_range;
+    } else if (moved < -old_range / 2) {
+        moved += old_range;
+    }
+
+    last_count = ((int32_t)(count % range) - moved % range + range) % range;
+}
+
+void set_debounce(bool enable, uint8_t debounce_ticks) {
+    if (enable) {
+        debounce_init(&debounce_state_keys, debounce_ticks);
+    }
+
+    // effectors always have a little bit of debouncing enabled
+    debounce_window_effectors = 4;
+
+    // Take the higher value if user has debouncing enabled
+    if (enable) {
+        debounce_window_effectors =
+            max(debounce_window_effectors, debounce_ticks);
+    }
+
+    debounce_init(&debounce_state_effectors, debounce_window_effectors);
+}
+
 int main() {
     rcc_init();
     
     // Initialize system timer.
     STK.LOAD = 72000000 / 8 / 1000; // 1000 Hz.
     STK.CTRL = 0x03;
+
+#if DEBUG_RGB_BENCHMARK
+    rgb_benchmark_run();
+#endif
+
+#if DEBUG_PIPELINE_BENCHMARK
+    pipeline_benchmark_run();
+#endif
     
     // Load config.
     configloader.read(sizeof(config), &config);
+    config_ext_loader.read(sizeof(config_ext), &config_ext);
+    config_validate(&config, &config_ext);
 
-    config_flags runtime_flags = initialize_mode_switch(config.flags);
+    config_flags runtime_flags = initialize_mode_switch(&config, &config_ext.chords);
+    init_multi_function_keys(&config_ext.gestures, runtime_flags, config.select_tap_window);
+    remap_init(config, &config_ext.remap);
 
     RCC.enable(RCC.GPIOA);
     RCC.enable(RCC.GPIOB);
@@ -411,11 +433,9 @@ int main() {
     TIM2.SMCR = 3;
     TIM2.CR1 = 1;
     
-    if(config.qe1_sens < 0) {
-        TIM2.ARR = 256 * -config.qe1_sens - 1;
-    } else {
-        TIM2.ARR = 256 - 1;
-    }
+    int8_t qe1_sens = runtime_qe1_sens;
+    uint32_t last_qe1_count = TIM2.CNT;
+    set_qe1_sensitivity(qe1_sens, last_qe1_count);
     
     TIM3.CCMR1 = (1 << 8) | (1 << 0);
     TIM3.SMCR = 3;
@@ -439,20 +459,9 @@ int main() {
 
     analog_button tt1(4, 200, true);
 
-    if (runtime_flags.DebounceEnable) {
-        debounce_init(&debounce_state_keys, config.debounce_ticks);
-    }
-
-    // effectors always have a little bit of debouncing enabled
-    debounce_window_effectors = 4;
-
-    // Take the higher value if user has debouncing enabled
-    if (runtime_flags.DebounceEnable) {
-        debounce_window_effectors =
-            max(debounce_window_effectors, config.debounce_ticks);
-    }
-
-    debounce_init(&debounce_state_effectors, debounce_window_effectors);
+    bool debounce_enable = runtime_flags.DebounceEnable;
+    uint8_t debounce_ticks = runtime_debounce_ticks;
+    set_debounce(debounce_enable, debounce_ticks);
 
     // debounce for raw input
     debounce_init(&debounce_state_raw, 4);
@@ -465,6 +474,15 @@ int main() {
         button9_led.on();
         // must be called last
         rgb_manager.init(&config.rgb);
+        report_handler.load_saved_program(rgb_manager);
+
+        rgb_manager.init_zones(&config_ext.zones);
+    }
+
+    if (config.flags.Ws2812bStrip2) {
+        // takes over QE2 A
+        rgb_manager2.init(&config_ext.rgb2);
+        report_handler.load_saved_program(rgb_manager2);
     }
 
     while(1) {
@@ -475,12 +493,12 @@ int main() {
             buttons &= (~ARCIN_PIN_BUTTON_9);
         }
         
-        if(do_reset_bootloader) {
+        if(report_handler.reset_bootloader_requested) {
             Time::sleep(10);
             reset_bootloader();
         }
         
-        if(do_reset) {
+        if(report_handler.reset_requested) {
             Time::sleep(10);
             reset();
         }
@@ -518,6 +536,29 @@ int main() {
         // [READ QE1]
         uint32_t qe1_count = TIM2.CNT;
 
+        // Counter movement since the last poll, taking wrap-around into account
+        int32_t qe1_delta = qe1_count - last_qe1_count;
+        int32_t qe1_range = TIM2.ARR + 1;
+        last_qe1_count = qe1_count;
+        if (qe1_delta > qe1_range / 2) {
+            qe1_delta -= qe1_range;
+        } else if (qe1_delta < -qe1_range / 2) {
+            qe1_delta += qe1_range;
+        }
+
+        // [TRACE] Record the raw inputs, for replaying them offline
+        if (input_trace.is_start_requested()) {
+            input_trace_header_t state = {0};
+            state.flags = analog_tt_reverse_direction ? INPUT_TRACE_TT_REVERSED : 0;
+            state.runtime_flags = runtime_flags;
+            state.qe1_sens = qe1_sens;
+            state.debounce_ticks = debounce_ticks;
+            state.qe1_range = qe1_range;
+            state.qe2_range = TIM3.ARR + 1;
+            input_trace.start(Time::time(), state);
+        }
+        input_trace.record(Time::time(), buttons, qe1_count, TIM3.CNT);
+
         // [MODE] Apply debounce to raw input & process runtime mode switching
         if (runtime_flags.ModeSwitchEnable) {
             uint16_t raw_debounced = buttons;
@@ -531,10 +572,33 @@ int main() {
 
             // Update LED options state.
             global_led_enable = !runtime_flags.LedOff;
+
+            // Apply settings changed by chords.
+            if (qe1_sens != runtime_qe1_sens) {
+                qe1_sens = runtime_qe1_sens;
+                set_qe1_sensitivity(qe1_sens, last_qe1_count);
+            }
+
+            if (debounce_enable != runtime_flags.DebounceEnable ||
+                debounce_ticks != runtime_debounce_ticks) {
+                debounce_enable = runtime_flags.DebounceEnable;
+                debounce_ticks = runtime_debounce_ticks;
+                set_debounce(debounce_enable, debounce_ticks);
+            }
+
+            if (rgb_mode_next_request) {
+                rgb_mode_next_request = false;
+                if (config.flags.Ws2812b) {
+                    rgb_manager.next_mode();
+                }
+                if (config.flags.Ws2812bStrip2) {
+                    rgb_manager2.next_mode();
+                }
+            }
         }
 
         // [REMAP]
-        uint16_t remapped = remap_buttons(config, buttons);
+        uint16_t remapped = remap_buttons(buttons);
 
         // [DEBOUNCE] Apply debounce to remapped keys
         if (runtime_flags.DebounceEnable) {
@@ -574,18 +638,24 @@ int main() {
         }
 
         if (config.flags.Ws2812b) {
+            rgb_manager.update_buttons(remapped);
+            rgb_manager.update_turntable(-qe1_delta);
             rgb_manager.update_colors(-tt1_report);
         }
 
-        // [E2 MULTI-TAP]
-        // Multi-tap processing of E2. Must be done after debounce.
-        if (runtime_flags.SelectMultiFunction) {
-            // Always clear E2 since it should not be asserted directly
-            bool is_e2_pressed = (remapped & INFINITAS_BUTTON_E2) != 0;
-            remapped &= ~(INFINITAS_BUTTON_E2);
-            remapped |= get_multi_function_keys(is_e2_pressed);
+        // Both strips only start their transfers here, so they refresh at the
+        // same time.
+        if (config.flags.Ws2812bStrip2) {
+            rgb_manager2.update_buttons(remapped);
+            rgb_manager2.update_turntable(-qe1_delta);
+            rgb_manager2.update_colors(-tt1_report);
         }
 
+        // [GESTURES]
+        // Tap / multi-tap / hold processing (E2 multi-tap by default). Must be
+        // done after debounce.
+        remapped = get_multi_function_keys(remapped);
+
         // [GAMEPAD]]
         if (usb->ep_ready(1)) {
             input_report_t report;
@@ -597,16 +667,7 @@ int main() {
             } else {
                 // [DIGITAL TT -> BUTTONS]
                 if (runtime_flags.DigitalTTEnable) {
-                    switch (tt1_report) {
-                    case -1:
-                        remapped |= JOY_BUTTON_13;
-                        break;
-                    case 1:
-                        remapped |= JOY_BUTTON_14;
-                        break;
-                    default:
-                        break;
-                    }
+                    remapped |= remap_tt(tt1_report);
                 }
 
                 report.buttons = remapped;
@@ -620,10 +681,10 @@ int main() {
                 // [ANALOG TT -> SENSITIVITY]
                 // Adjust turntable sensitivity. Must be done AFTER digital TT
                 // processing.
-                if (config.qe1_sens < 0) {
-                    qe1_count /= -config.qe1_sens;
-                } else if (config.qe1_sens > 0) {
-                    qe1_count *= config.qe1_sens;
+                if (qe1_sens < 0) {
+                    qe1_count /= -qe1_sens;
+                } else if (qe1_sens > 0) {
+                    qe1_count *= qe1_sens;
                 }
 
                 if (analog_tt_reverse_direction) {
@@ -637,6 +698,12 @@ int main() {
 
 #if DEBUG_TIMING_GAMEPAD
 
+#if DEBUG_RGB_BENCHMARK
+            debug_value = rgb_benchmark_result((Time::time() / 2000) % RGB_BENCHMARK_RESULTS);
+#elif DEBUG_PIPELINE_BENCHMARK
+            debug_value = pipeline_benchmark_result((Time::time() / 2000) % PIPELINE_BENCHMARK_RESULTS);
+#endif
+
             uint32_t nownow = Time::time();
             uint32_t delta = nownow - previous_report_time;
              report.buttons = (debug_value >> 16);
@@ -2,70 +2,199 @@
 #include "modeswitch.h"
 #include "inf_defines.h"
 
-#define MODE_SWITCH_THRESHOLD_MS 3000
+// Chords are matched against the raw buttons. The table is only searched when
+// the buttons change; on every other sample, the only work is checking whether
+// the chord that is being held has been held long enough.
+
+#define CHORD_TIME_UNIT_MS 100
+
+// Sensitivity steps, same meaning as config_t.qe1_sens
+#define TT_SENSITIVITY_MIN -8
+#define TT_SENSITIVITY_MAX 8
+
+// start+sel+1 => input mode switch (controller or keyboard)
+// start+sel+3 => turntable mode switch (analog or digital)
+// start+sel+5 => LED switch (on or off)
+const chord default_chords[] = {
+    {ARCIN_PIN_BUTTON_START | ARCIN_PIN_BUTTON_SELECT | ARCIN_PIN_BUTTON_1, 0, 30, CHORD_ACTION_INPUT_MODE, 0},
+    {ARCIN_PIN_BUTTON_START | ARCIN_PIN_BUTTON_SELECT | ARCIN_PIN_BUTTON_3, 0, 30, CHORD_ACTION_TT_MODE, 0},
+    {ARCIN_PIN_BUTTON_START | ARCIN_PIN_BUTTON_SELECT | ARCIN_PIN_BUTTON_5, 0, 30, CHORD_ACTION_LED_TOGGLE, 0},
+};
 
 void process_input_mode_switch();
 void process_tt_mode_switch();
 void process_led_mode_switch();
 
+chord chords[CHORD_COUNT];
+uint8_t chord_count = 0;
+
+// per tap chord: taps so far, and when the last one happened
+uint8_t chord_taps[CHORD_COUNT];
+uint32_t chord_last_tap_time[CHORD_COUNT];
+
 uint32_t last_capture_time = 0;
+uint16_t last_input = 0;
+uint32_t last_change_time = 0;
 
-uint16_t input_mode_switch_request = 0;
-uint16_t tt_mode_switch_request = 0;
-uint16_t led_mode_switch_request = 0;
+// hold chord matching the current buttons, if any
+int8_t held_chord = -1;
 
 config_flags original_flags = {0};
 config_flags current_flags = {0};
 
 bool analog_tt_reverse_direction = false;
 
-config_flags initialize_mode_switch(config_flags flags) {
-    original_flags = flags;
+int8_t runtime_qe1_sens = 0;
+uint8_t runtime_debounce_ticks = 0;
+bool rgb_mode_next_request = false;
+
+config_flags initialize_mode_switch(config_t* config, chord_config* config_chords) {
+    original_flags = config->flags;
     current_flags = original_flags;
+    runtime_qe1_sens = config->qe1_sens;
+    runtime_debounce_ticks = config->debounce_ticks;
+    rgb_mode_next_request = false;
+
+    // chord matching state, for when this is called again
+    last_capture_time = 0;
+    last_input = 0;
+    last_change_time = 0;
+    held_chord = -1;
+
+    chord_count = 0;
+    for (uint8_t i = 0; i < CHORD_COUNT; i++) {
+        chord_taps[i] = 0;
+        if (config_chords->Chords[i].Buttons != 0) {
+            chords[chord_count++] = config_chords->Chords[i];
+        }
+    }
+
+    if (chord_count == 0) {
+        for (uint8_t i = 0; i < sizeof(default_chords) / sizeof(chord); i++) {
+            chords[chord_count++] = default_chords[i];
+        }
+    }
+
     return original_flags;
 }
 
-config_flags process_mode_switch(uint16_t raw_input) {
-    uint32_t now = Time::time();
-    // Capture at most once per 1ms.
-    if (now == last_capture_time) {
-        return current_flags;
+static uint16_t get_tap_button(const chord& c) {
+    uint8_t button = c.Tap >> 4;
+    return (button == 0) ? 0 : (1 << (button - 1));
+}
+
+static int8_t normalize_sensitivity(int8_t sens) {
+    return (-1 <= sens && sens <= 1) ? 1 : sens;
+}
+
+static void run_chord_action(const chord& c) {
+    switch (c.Action) {
+        case CHORD_ACTION_INPUT_MODE:
+            process_input_mode_switch();
+            return;
+
+        case CHORD_ACTION_TT_MODE:
+            process_tt_mode_switch();
+            return;
+
+        case CHORD_ACTION_LED_TOGGLE:
+            process_led_mode_switch();
+            return;
+
+        case CHORD_ACTION_TT_SENSITIVITY_UP:
+            // -1, 0 and 1 all mean "unchanged", so the steps are ..., -3, -2, 1, 2, ...
+            runtime_qe1_sens = normalize_sensitivity(runtime_qe1_sens);
+            if (runtime_qe1_sens < TT_SENSITIVITY_MAX) {
+                runtime_qe1_sens = (runtime_qe1_sens == -2) ? 1 : runtime_qe1_sens + 1;
+            }
+            break;
+
+        case CHORD_ACTION_TT_SENSITIVITY_DOWN:
+            runtime_qe1_sens = normalize_sensitivity(runtime_qe1_sens);
+            if (TT_SENSITIVITY_MIN < runtime_qe1_sens) {
+                runtime_qe1_sens = (runtime_qe1_sens == 1) ? -2 : runtime_qe1_sens - 1;
+            }
+            break;
+
+        case CHORD_ACTION_DEBOUNCE:
+            current_flags.DebounceEnable = (c.Argument != 0);
+            runtime_debounce_ticks = c.Argument;
+            break;
+
+        case CHORD_ACTION_RGB_MODE_NEXT:
+            rgb_mode_next_request = true;
+            break;
+
+        case CHORD_ACTION_NONE:
+        default:
+            return;
     }
-    last_capture_time = now;
 
-    if ((raw_input & ARCIN_PIN_BUTTON_START) &&
-        (raw_input & ARCIN_PIN_BUTTON_SELECT)) {
-
-        if (raw_input & ARCIN_PIN_BUTTON_1) {
-            // start+sel+1 => input mode switch (controller or keyboard)
-            input_mode_switch_request += 1;
-        } else if (raw_input & ARCIN_PIN_BUTTON_3) {
-            // start+sel+3 => turntable mode switch (analog or digital)
-            tt_mode_switch_request += 1;
-        } else if (raw_input & ARCIN_PIN_BUTTON_5) {
-            // start+sel+5 => LED switch (on or off)
-            led_mode_switch_request += 1;
+    // actions without their own feedback just blink the chord
+    schedule_led(1000, c.Buttons | get_tap_button(c), 0);
+}
+
+static void process_input_change(uint32_t now, uint16_t input) {
+    uint16_t pressed = input & ~last_input;
+    held_chord = -1;
+
+    for (uint8_t i = 0; i < chord_count; i++) {
+        const chord& c = chords[i];
+        uint16_t tap_button = get_tap_button(c);
+
+        if (tap_button == 0) {
+            if (input == c.Buttons) {
+                held_chord = i;
+            }
+            continue;
+        }
+
+        // tap chord: count presses of the tap button while the rest is held
+        if ((input & ~tap_button) != c.Buttons) {
+            chord_taps[i] = 0;
+            continue;
+        }
+
+        if (!(pressed & tap_button)) {
+            continue;
         }
 
-    } else {
-        input_mode_switch_request = 0;
-        tt_mode_switch_request = 0;
-        led_mode_switch_request = 0;
+        uint32_t max_gap_ms = c.Time * CHORD_TIME_UNIT_MS;
+        if ((max_gap_ms != 0) && (max_gap_ms < now - chord_last_tap_time[i])) {
+            chord_taps[i] = 0;
+        }
+
+        chord_last_tap_time[i] = now;
+        chord_taps[i]++;
+
+        if ((c.Tap & 0xF) <= chord_taps[i]) {
+            chord_taps[i] = 0;
+            run_chord_action(c);
+        }
     }
+}
 
-    if (input_mode_switch_request == MODE_SWITCH_THRESHOLD_MS) {
-        process_input_mode_switch();
-        input_mode_switch_request = 0;
+config_flags process_mode_switch(uint16_t raw_input) {
+    uint32_t now = Time::time();
+    // Capture at most once per 1ms.
+    if (now == last_capture_time) {
+        return current_flags;
     }
+    last_capture_time = now;
 
-    if (tt_mode_switch_request == MODE_SWITCH_THRESHOLD_MS) {
-        process_tt_mode_switch();
-        tt_mode_switch_request = 0;
+    if (raw_input != last_input) {
+        process_input_change(now, raw_input);
+        last_input = raw_input;
+        last_change_time = now;
     }
 
-    if (led_mode_switch_request == MODE_SWITCH_THRESHOLD_MS) {
-        process_led_mode_switch();
-        led_mode_switch_request = 0;
+    // hold chords fire once, after being held for long enough
+    if (0 <= held_chord) {
+        const chord& c = chords[held_chord];
+        if (c.Time * CHORD_TIME_UNIT_MS <= now - last_change_time) {
+            held_chord = -1;
+            run_chord_action(c);
+        }
     }
     
     return current_flags;
@@ -4,10 +4,17 @@
 #include <stdint.h>
 #include "config.h"
 
-config_flags initialize_mode_switch(config_flags flags);
+config_flags initialize_mode_switch(config_t* config, chord_config* chords);
 
 config_flags process_mode_switch(uint16_t raw_input);
 
 extern bool analog_tt_reverse_direction;
 
-#endif
\ No newline at end of file
+// Runtime overrides of config_t values; changed by chords
+extern int8_t runtime_qe1_sens;
+extern uint8_t runtime_debounce_ticks;
+
+// Set when a chord asks for the next WS2812B mode; cleared by the caller
+extern bool rgb_mode_next_request;
+
+#endif
@@ -4,112 +4,228 @@
 
 extern uint32_t debug_value;
 
+// gesture times are in units of 10ms
+#define GESTURE_TIME_UNIT_MS 10
+
 // Window that begins on the first rising edge of E2
 // i.e., any multi-taps must be done within this window in order to count
 #define MULTITAP_DETECTION_WINDOW_MS 500
 
+// Shorter window used when the first press is committed immediately
+#define MULTITAP_OPTIMISTIC_WINDOW_MS 200
+
 // assert button combination for this duration
 #define EFFECTOR_COMBO_HOLD_DURATION_MS 100
 
 typedef enum _MF_CURRENT_WINDOW {
     MF_IDLE,
+    MF_OPTIMISTIC_INPUT,
     MF_CAPTURING_INPUT,
-    MF_ASSERTING_INPUT
+    MF_ASSERTING_INPUT,
+    MF_HOLDING_INPUT
 } MF_CURRENT_WINDOW;
 
-static MF_CURRENT_WINDOW current_window = MF_IDLE;
+typedef struct _gesture_state {
+    MF_CURRENT_WINDOW current_window;
+    // how many times was the button pressed during the capture window?
+    uint8_t rising_edge_count;
+    uint32_t window_close_time;
+    // end of the one tap output asserted in MF_OPTIMISTIC_INPUT
+    uint32_t output_close_time;
+    uint16_t output;
+} gesture_state;
 
-timer window_close_timer;
+static gesture gestures[GESTURE_COUNT];
+static gesture_state states[GESTURE_COUNT];
 
-// how many times was E2 pressed during the capture window?
-static uint8_t e2_rising_edge_count = 0;
+// buttons that have a gesture
+static uint16_t gesture_mask = 0;
 
-static bool last_e2_status = false;
-void capture_e2_presses(bool pressed) {
-    // rising edge (detect off-on sequence)
-    if (!last_e2_status && pressed) {
+static uint16_t last_buttons = 0;
 
-        // if we were idle, start capturing input now.
-        if (current_window == MF_IDLE) {
-            e2_rising_edge_count = 0;
-            window_close_timer.arm(MULTITAP_DETECTION_WINDOW_MS);
-            current_window = MF_CAPTURING_INPUT;
-        }
+// used as a limiter
+static uint32_t last_update_time = 0;
 
-        // count every rising edge
-        e2_rising_edge_count += 1;
-    }
+// button combination to assert
+static uint16_t buttons_being_asserted = 0;
 
-    last_e2_status = pressed;
-}
+static uint8_t hint_flags = 0;
+static uint32_t hint_time = 0;
 
-uint16_t get_multitap_output(uint8_t num_rising_edges) {
-    uint16_t button;
-    switch (num_rising_edges) {
-    case 0:
-        button = 0;
-        break;
-
-    case 1:
-        button = INFINITAS_BUTTON_E2;
-        break;
-
-    case 2:
-        button = INFINITAS_BUTTON_E3;
-        break;
-
-    case 3:
-        button = (INFINITAS_BUTTON_E2 | INFINITAS_BUTTON_E3);
-        break;
-
-    case 4:
-    default:
-        button = INFINITAS_BUTTON_E4;
-        break;
+void init_multi_function_keys(
+    const gesture_config* config, config_flags flags, uint8_t select_tap_window) {
+
+    // All state is reset, so this can be called again (host/replay.cpp does).
+    gesture_mask = 0;
+    last_buttons = 0;
+    last_update_time = 0;
+    buttons_being_asserted = 0;
+    hint_flags = 0;
+
+    for (uint8_t i = 0; i < GESTURE_COUNT; i++) {
+        gestures[i] = config->Gestures[i];
+        states[i].current_window = MF_IDLE;
+        states[i].output = 0;
+
+        if (gestures[i].TapWindow != 0) {
+            gesture_mask |= (1 << i);
+        }
     }
 
-    return button;
+    if (gesture_mask == 0 && flags.SelectMultiFunction) {
+        gesture& e2 = gestures[9];
+        e2.TapWindow = select_tap_window;
+        if (e2.TapWindow == 0) {
+            e2.TapWindow = flags.SelectOptimisticTap ?
+                (MULTITAP_OPTIMISTIC_WINDOW_MS / GESTURE_TIME_UNIT_MS) :
+                (MULTITAP_DETECTION_WINDOW_MS / GESTURE_TIME_UNIT_MS);
+        }
+        e2.Optimistic = flags.SelectOptimisticTap;
+        e2.OutputTime = EFFECTOR_COMBO_HOLD_DURATION_MS / GESTURE_TIME_UNIT_MS;
+        e2.ExtendWhileHeld = 1;
+        e2.Outputs[0] = INFINITAS_BUTTON_E2;
+        e2.Outputs[1] = INFINITAS_BUTTON_E3;
+        e2.Outputs[2] = (INFINITAS_BUTTON_E2 | INFINITAS_BUTTON_E3);
+        e2.Outputs[3] = INFINITAS_BUTTON_E4;
+        e2.HoldOutput = 0;
+        gesture_mask = INFINITAS_BUTTON_E2;
+    }
 }
 
-// used as a limiter
-static uint32_t last_update_time = 0;
-
-// button combination to assert
-static uint16_t effector_buttons_being_asserted = 0;
+void set_multi_function_hint(uint8_t flags) {
+    hint_flags = flags;
+    hint_time = Time::time();
+}
 
-uint16_t get_multi_function_keys(bool is_e2_pressed) {
-    uint32_t now = Time::time();
+static bool is_expired(uint32_t now, uint32_t time) {
+    return 0 <= (int32_t)(now - time);
+}
 
-    // Update at most once per 1ms. Otherwise, just return the last calculated
-    // result.
-    if (now == last_update_time) {
-        return effector_buttons_being_asserted;
+static void update_gesture(
+    uint32_t now, const gesture& g, gesture_state& state,
+    bool pressed, bool rising_edge, bool single_tap) {
+
+    switch (state.current_window) {
+        case MF_IDLE:
+            if (!rising_edge) {
+                break;
+            }
+
+            state.rising_edge_count = 1;
+            if (single_tap) {
+                // host says multi-taps are meaningless right now
+                state.current_window = MF_ASSERTING_INPUT;
+                state.window_close_time = now + g.OutputTime * GESTURE_TIME_UNIT_MS;
+                state.output = g.Outputs[0];
+            } else if (g.Optimistic) {
+                // commit to one tap right away, revise if another press comes
+                state.current_window = MF_OPTIMISTIC_INPUT;
+                state.window_close_time = now + g.TapWindow * GESTURE_TIME_UNIT_MS;
+                state.output_close_time = now + g.OutputTime * GESTURE_TIME_UNIT_MS;
+                state.output = g.Outputs[0];
+            } else {
+                // start capturing on the first press
+                state.current_window = MF_CAPTURING_INPUT;
+                state.window_close_time = now + g.TapWindow * GESTURE_TIME_UNIT_MS;
+            }
+            break;
+
+        case MF_OPTIMISTIC_INPUT:
+            if (rising_edge) {
+                // second press: count taps for the rest of the window
+                state.rising_edge_count += 1;
+                state.current_window = MF_CAPTURING_INPUT;
+                state.output = 0;
+            } else if (is_expired(now, state.window_close_time)) {
+                if (g.HoldOutput != 0 && pressed) {
+                    state.current_window = MF_HOLDING_INPUT;
+                    state.output = g.HoldOutput;
+                } else {
+                    // keep the one tap output for whatever is left of it
+                    state.current_window = MF_ASSERTING_INPUT;
+                    state.window_close_time = state.output_close_time;
+                }
+            } else if (!pressed && is_expired(now, state.output_close_time)) {
+                state.output = 0;
+            }
+            break;
+
+        case MF_CAPTURING_INPUT:
+            // count every rising edge
+            if (rising_edge) {
+                state.rising_edge_count += 1;
+            }
+
+            // are we past capture window?
+            if (is_expired(now, state.window_close_time)) {
+                if (g.HoldOutput != 0 && pressed && state.rising_edge_count == 1) {
+                    state.current_window = MF_HOLDING_INPUT;
+                    state.output = g.HoldOutput;
+                } else {
+                    // Start asserting button combo
+                    uint8_t taps = (state.rising_edge_count < 4) ? state.rising_edge_count : 4;
+                    state.current_window = MF_ASSERTING_INPUT;
+                    state.window_close_time = now + g.OutputTime * GESTURE_TIME_UNIT_MS;
+                    state.output = g.Outputs[taps - 1];
+                }
+            }
+            break;
+
+        case MF_ASSERTING_INPUT:
+            // are we past assertion window?
+            if (is_expired(now, state.window_close_time)) {
+                if (g.ExtendWhileHeld && pressed) {
+                    // If the button is held down, extend the timer
+                    state.window_close_time = now + g.OutputTime * GESTURE_TIME_UNIT_MS;
+                } else {
+                    state.current_window = MF_IDLE;
+                    state.output = 0;
+                }
+            }
+            break;
+
+        case MF_HOLDING_INPUT:
+            if (!pressed) {
+                state.current_window = MF_IDLE;
+                state.output = 0;
+            }
+            break;
     }
-    last_update_time = now;
+}
 
-    // capture button presses
-    if (current_window == MF_IDLE || current_window == MF_CAPTURING_INPUT) {
-        capture_e2_presses(is_e2_pressed);
+uint16_t get_multi_function_keys(uint16_t buttons) {
+    if (gesture_mask == 0) {
+        return buttons;
     }
 
-    // are we past capture window?
-    if (current_window == MF_CAPTURING_INPUT && window_close_timer.check_if_expired_reset()) {
-        // Start asserting button combo
-        current_window = MF_ASSERTING_INPUT;
-        window_close_timer.arm(EFFECTOR_COMBO_HOLD_DURATION_MS);
-        effector_buttons_being_asserted = get_multitap_output(e2_rising_edge_count);
-    }
+    uint32_t now = Time::time();
 
-    // are we past assertion window?
-    if (current_window == MF_ASSERTING_INPUT && window_close_timer.check_if_expired_reset()) {
-        if (is_e2_pressed) {
-            // If the button is held down, extend the timer
-            window_close_timer.arm(EFFECTOR_COMBO_HOLD_DURATION_MS);
-        } else {
-            current_window = MF_IDLE;
-            effector_buttons_being_asserted = 0;
+    // Update at most once per 1ms. Otherwise, just return the last calculated
+    // result.
+    if (now != last_update_time) {
+        last_update_time = now;
+
+        uint16_t rising_edges = buttons & ~last_buttons;
+        last_buttons = buttons;
+
+        bool single_tap =
+            (hint_flags & MULTIFUNC_HINT_SINGLE_TAP) &&
+            !is_expired(now, hint_time + MULTIFUNC_HINT_TIMEOUT_MS);
+
+        // one pass over every button with a gesture
+        buttons_being_asserted = 0;
+        for (uint8_t i = 0; i < GESTURE_COUNT; i++) {
+            uint16_t bit = 1 << i;
+            if (!(gesture_mask & bit)) {
+                continue;
+            }
+
+            update_gesture(
+                now, gestures[i], states[i], buttons & bit, rising_edges & bit, single_tap);
+            buttons_being_asserted |= states[i].output;
         }
     }
 
-    return effector_buttons_being_asserted;
-}
\ No newline at end of file
+    // Buttons with a gesture should not be asserted directly
+    return (buttons & ~gesture_mask) | buttons_being_asserted;
+}
@@ -4,6 +4,25 @@
 #include <stdint.h>
 #include "config.h"
 
-uint16_t get_multi_function_keys(bool is_e2_pressed);
+// Per-button gestures: each button with a gesture counts its taps within a
+// window, then asserts the configured output (or the hold output, if a single
+// press is still held). Buttons with a gesture are never passed through as is.
+//
+// With no gestures configured, SelectMultiFunction enables the original
+// E2 multi-tap: 1 tap = E2, 2 = E3, 3 = E2 + E3, 4 = E4. SelectOptimisticTap
+// makes it emit E2 on the first press instead of after the window closes.
+void init_multi_function_keys(
+    const gesture_config* config, config_flags flags, uint8_t select_tap_window);
 
-#endif
\ No newline at end of file
+// Host hint (output report 5): while MULTIFUNC_HINT_SINGLE_TAP is set, new
+// presses skip the tap window and assert the one tap output right away.
+// Expires unless refreshed within MULTIFUNC_HINT_TIMEOUT_MS.
+#define MULTIFUNC_HINT_SINGLE_TAP 0x01
+#define MULTIFUNC_HINT_TIMEOUT_MS 5000
+
+void set_multi_function_hint(uint8_t flags);
+
+// buttons are the debounced, remapped buttons. Returns them with gestures applied.
+uint16_t get_multi_function_keys(uint16_t buttons);
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef PIPELINE_BENCHMARK_DEFINES_H
+#define PIPELINE_BENCHMARK_DEFINES_H
+
+#include <stdint.h>
+#include <string.h>
+#include "analog_button.h"
+#include "config.h"
+#include "debounce.h"
+#include "inf_defines.h"
+#include "modeswitch.h"
+#include "multifunc.h"
+#include "remap.h"
+
+// Input pipeline benchmark: times each stage of the main loop, and all of
+// them with report building, one call per input sample. The same code runs in
+// the firmware, built with DEBUG_PIPELINE_BENCHMARK and timed in cycles with
+// the DWT cycle counter, and on the host (host/bench.cpp), timed in ns.
+//
+// On the host, the clock moves 1 ms per sample, so every call does the full
+// per-ms work. On the device the clock is real: most calls take the stages'
+// once-per-ms early return, which is what the main loop sees, and the max is
+// the per-ms path.
+//
+// The stages leave the chord, gesture and remap globals in a benchmark state,
+// so the firmware runs this before loading the config. With
+// DEBUG_TIMING_GAMEPAD, the results are shown on the gamepad axes one after
+// another: (index << 24) | cycles, where index is stage * 2, + 1 for the max.
+
+#define PIPELINE_BENCHMARK_SAMPLES 100000
+#define PIPELINE_BENCHMARK_RESULTS (PIPELINE_BENCHMARK_STAGES * 2)
+
+#define PIPELINE_BENCHMARK_DEMCR (*(volatile uint32_t*)0xE000EDFC)
+#define PIPELINE_BENCHMARK_DWT_CTRL (*(volatile uint32_t*)0xE0001000)
+#define PIPELINE_BENCHMARK_DWT_CYCCNT (*(volatile uint32_t*)0xE0001004)
+
+enum pipeline_benchmark_stage {
+    PIPELINE_BENCHMARK_DEBOUNCE,
+    PIPELINE_BENCHMARK_REMAP,
+    PIPELINE_BENCHMARK_ANALOG_BUTTON,
+    PIPELINE_BENCHMARK_GESTURES,
+    PIPELINE_BENCHMARK_MODE_SWITCH,
+    PIPELINE_BENCHMARK_REPORT,
+    PIPELINE_BENCHMARK_STAGES
+};
+
+const char* const pipeline_benchmark_names[PIPELINE_BENCHMARK_STAGES] = {
+    "debounce",
+    "remap_buttons",
+    "analog_button::poll",
+    "get_multi_function_keys",
+    "process_mode_switch",
+    "full report",
+};
+
+struct pipeline_benchmark_sample_t {
+    uint16_t buttons;
+    uint16_t qe1;
+};
+
+struct pipeline_benchmark_result_t {
+    uint32_t calls;
+    // clock ticks per call, without the cost of reading the clock
+    uint32_t mean;
+    // a power of two; 99% of calls took at most this long
+    uint32_t p99;
+    uint32_t max;
+    // calls over Clock::outlier ticks, left out of mean and p99
+    uint32_t outliers;
+};
+
+// keeps the results from being optimized away
+volatile uint32_t pipeline_benchmark_sink;
+
+// Synthetic player, one sample per ms: keys in turn with contact bounce, E2
+// double taps, and a turntable that spins, scratches and jitters at rest.
+inline pipeline_benchmark_sample_t pipeline_benchmark_synthetic(uint32_t ms) {
+    pipeline_benchmark_sample_t sample;
+
+    uint32_t phase = ms % 50;
+    bool pressed = phase < 30;
+    // bounce for 3ms after each edge
+    if (phase < 3 || (30 <= phase && phase < 33)) {
+        pressed = (ms * 2654435761u) >> 31;
+    }
+    sample.buttons = pressed ? (1 << ((ms / 50) % 7)) : 0;
+
+    uint32_t tap = ms % 400;
+    if (tap < 40 || (80 <= tap && tap < 120)) {
+        sample.buttons |= INFINITAS_BUTTON_E2;
+    }
+
+    uint32_t tt = ms % 3000;
+    if (tt < 1000) {
+        sample.qe1 = ms / 2;
+    } else if (tt < 2000) {
+        uint32_t t = tt % 200;
+        sample.qe1 = (t < 100) ? t : 200 - t;
+    } else {
+        sample.qe1 = (ms * 2654435761u) >> 31;
+    }
+    sample.qe1 &= 0xff;
+
+    return sample;
+}
+
+// Clock provides uint32_t now(), advance(), called once per sample, and
+// outlier, the ticks past which a call was most likely preempted.
+// Source is called with the sample index and returns a pipeline_benchmark_sample_t.
+template <typename Clock, typename Source>
+class PipelineBenchmark {
+    Source& source;
+    uint32_t count;
+    uint32_t overhead = 0;
+
+    template <typename Stage>
+    pipeline_benchmark_result_t time(Stage stage) {
+        uint64_t total = 0;
+        uint32_t max = 0;
+        uint32_t outliers = 0;
+        // calls by the number of bits in their tick count
+        uint32_t histogram[33] = {0};
+
+        for (uint32_t i = 0; i < count; i++) {
+            pipeline_benchmark_sample_t sample = source(i);
+            Clock::advance();
+
+            uint32_t start = Clock::now();
+            stage(sample);
+            uint32_t ticks = Clock::now() - start;
+
+            ticks = (ticks > overhead) ? ticks - overhead : 0;
+            if (max < ticks) {
+                max = ticks;
+            }
+            if (ticks > Clock::outlier) {
+                outliers++;
+                continue;
+            }
+            total += ticks;
+
+            uint8_t bits = 0;
+            while (bits < 32 && (ticks >> bits) != 0) {
+                bits++;
+            }
+            histogram[bits]++;
+        }
+
+        uint32_t timed = count - outliers;
+        uint32_t p99 = 0;
+        uint32_t below = 0;
+        for (uint8_t bits = 0; bits <= 32; bits++) {
+            below += histogram[bits];
+            if (uint64_t(below) * 100 >= uint64_t(timed) * 99) {
+                p99 = (bits == 0) ? 0 : uint32_t((uint64_t(1) << bits) - 1);
+                break;
+            }
+        }
+
+        return {count, timed ? uint32_t(total / timed) : 0, p99, max, outliers};
+    }
+
+    public:
+        PipelineBenchmark(Source& source, uint32_t count) : source(source), count(count) {
+            overhead = time([](const pipeline_benchmark_sample_t&) {}).mean;
+        }
+
+        pipeline_benchmark_result_t run(uint8_t stage) {
+            config_t config;
+            memset(&config, 0, sizeof(config));
+            config.flags.SelectMultiFunction = 1;
+            config.flags.ModeSwitchEnable = 1;
+            config.flags.DigitalTTEnable = 1;
+            config.flags.KeyboardEnable = 1;
+
+            static chord_config chords;
+            static gesture_config gestures;
+            static remap_config remap;
+            memset(&chords, 0, sizeof(chords));
+            memset(&gestures, 0, sizeof(gestures));
+            memset(&remap, 0, sizeof(remap));
+
+            initialize_mode_switch(&config, &chords);
+            init_multi_function_keys(&gestures, config.flags, 0);
+            remap_init(config, &remap);
+
+            debounce_state keys;
+            debounce_state effectors;
+            debounce_init(&keys, 4);
+            debounce_init(&effectors, 4);
+
+            analog_button tt1(4, 200, true);
+
+            switch (stage) {
+                case PIPELINE_BENCHMARK_DEBOUNCE:
+                    return time([&](const pipeline_benchmark_sample_t& s) {
+                        pipeline_benchmark_sink = debounce(&keys, s.buttons);
+                    });
+
+                case PIPELINE_BENCHMARK_REMAP:
+                    return time([&](const pipeline_benchmark_sample_t& s) {
+                        pipeline_benchmark_sink = remap_buttons(s.buttons);
+                    });
+
+                case PIPELINE_BENCHMARK_ANALOG_BUTTON:
+                    return time([&](const pipeline_benchmark_sample_t& s) {
+                        pipeline_benchmark_sink = tt1.poll(s.qe1);
+                    });
+
+                case PIPELINE_BENCHMARK_GESTURES:
+                    return time([&](const pipeline_benchmark_sample_t& s) {
+                        pipeline_benchmark_sink = get_multi_function_keys(s.buttons);
+                    });
+
+                case PIPELINE_BENCHMARK_MODE_SWITCH:
+                    return time([&](const pipeline_benchmark_sample_t& s) {
+                        pipeline_benchmark_sink = process_mode_switch(s.buttons).AsUINT32;
+                    });
+
+                default:
+                    // the input part of main(), with the gamepad and keyboard reports
+                    return time([&](const pipeline_benchmark_sample_t& s) {
+                        config_flags flags = process_mode_switch(s.buttons);
+
+                        uint16_t remapped = remap_buttons(s.buttons);
+                        remapped =
+                            (remapped & ~INFINITAS_BUTTON_ALL) |
+                            debounce(&keys, remapped & INFINITAS_BUTTON_ALL);
+                        remapped =
+                            (remapped & ~INFINITAS_EFFECTORS_ALL) |
+                            debounce(&effectors, remapped & INFINITAS_EFFECTORS_ALL);
+
+                        int8_t tt1_report = tt1.poll(s.qe1);
+                        remapped = get_multi_function_keys(remapped);
+
+                        if (flags.DigitalTTEnable) {
+                            remapped |= remap_tt(tt1_report);
+                        }
+                        uint8_t axis_x = flags.DigitalTTEnable ? 127 : uint8_t(s.qe1);
+
+                        uint8_t scancodes[13] = {0};
+                        uint8_t nextscan = 0;
+                        for (uint8_t i = 0; i < 11; i++) {
+                            if (remapped & (1 << i)) {
+                                scancodes[nextscan++] = config.keycodes[i];
+                            }
+                        }
+
+                        pipeline_benchmark_sink = remapped | (axis_x << 16) | scancodes[0];
+                    });
+            }
+        }
+};
+
+// [Device]
+
+struct PipelineBenchmarkCycles {
+    // nothing preempts the benchmark but interrupt handlers, which count
+    static const uint32_t outlier = 0xFFFFFFFF;
+
+    static uint32_t now() {
+        return PIPELINE_BENCHMARK_DWT_CYCCNT;
+    }
+
+    static void advance() {}
+};
+
+uint32_t pipeline_benchmark_cycles[PIPELINE_BENCHMARK_RESULTS];
+
+void pipeline_benchmark_run() {
+    PIPELINE_BENCHMARK_DEMCR |= 1 << 24; // TRCENA
+    PIPELINE_BENCHMARK_DWT_CYCCNT = 0;
+    PIPELINE_BENCHMARK_DWT_CTRL |= 1 << 0; // CYCCNTENA
+
+    auto source = pipeline_benchmark_synthetic;
+    PipelineBenchmark<PipelineBenchmarkCycles, decltype(source)>
+        benchmark(source, PIPELINE_BENCHMARK_SAMPLES);
+
+    for (uint8_t stage = 0; stage < PIPELINE_BENCHMARK_STAGES; stage++) {
+        pipeline_benchmark_result_t result = benchmark.run(stage);
+        pipeline_benchmark_cycles[stage * 2] = result.mean;
+        pipeline_benchmark_cycles[stage * 2 + 1] = result.max;
+    }
+}
+
+uint32_t pipeline_benchmark_result(uint8_t index) {
+    return (index << 24) | (pipeline_benchmark_cycles[index] & 0xFFFFFF);
+}
+
+#endif
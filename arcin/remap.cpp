@@ -1,6 +1,14 @@
 #include "remap.h"
 #include "inf_defines.h"
 
+// remap_buttons() ORs one entry from each table: the low table is indexed by
+// buttons 1-8, the high table by button 9, start and select.
+static uint16_t remap_lo[256];
+static uint16_t remap_hi[8];
+
+// [0] = CW (-1), [1] = CCW (+1)
+static uint16_t remap_tt_buttons[2];
+
 uint16_t get_effector_button(uint8_t effector_number) {
     switch(effector_number) {
     case 1:
@@ -28,26 +36,58 @@ uint16_t get_effector(uint8_t effector_number, uint16_t default_button) {
     return button;
 }
 
-uint16_t remap_buttons(config_t &config, uint16_t buttons) {
-    uint16_t remapped;
+static void compile_table(uint16_t* table, uint16_t size, const uint16_t* sources) {
+    for (uint16_t value = 0; value < size; value++) {
+        uint16_t output = 0;
+        for (uint8_t bit = 0; (1 << bit) < size; bit++) {
+            if (value & (1 << bit)) {
+                output |= sources[bit];
+            }
+        }
+        table[value] = output;
+    }
+}
 
-    // Grab the first 7 buttons (keys)
-    // The keys have the same values across raw input and infinitas input
-    remapped = buttons & INFINITAS_BUTTON_ALL;
+void remap_init(const config_t &config, const remap_config* table) {
+    uint16_t sources[REMAP_SOURCE_COUNT];
 
-    // Remap effectors
-    if (buttons & ARCIN_PIN_BUTTON_START) {
-        remapped |= get_effector((config.remap_start_sel >> 4) & 0xF, INFINITAS_BUTTON_E1);
-    }
-    if (buttons & ARCIN_PIN_BUTTON_SELECT) {
-        remapped |= get_effector((config.remap_start_sel) & 0xF, INFINITAS_BUTTON_E2);
-    }
-    if (buttons & ARCIN_PIN_BUTTON_8) {
-        remapped |= get_effector((config.remap_b8_b9 >> 4) & 0xF, INFINITAS_BUTTON_E3);
-    }
-    if (buttons & ARCIN_PIN_BUTTON_9) {
-        remapped |= get_effector((config.remap_b8_b9) & 0xF, INFINITAS_BUTTON_E4);
+    if (table->Flags.Enable) {
+        for (uint8_t i = 0; i < REMAP_SOURCE_COUNT; i++) {
+            sources[i] = table->Buttons[i];
+        }
+    } else {
+        // The keys have the same values across raw input and infinitas input
+        for (uint8_t i = 0; i < 7; i++) {
+            sources[i] = (1 << i);
+        }
+
+        // Remap effectors
+        sources[7] = get_effector((config.remap_b8_b9 >> 4) & 0xF, INFINITAS_BUTTON_E3);
+        sources[8] = get_effector((config.remap_b8_b9) & 0xF, INFINITAS_BUTTON_E4);
+        sources[9] = get_effector((config.remap_start_sel >> 4) & 0xF, INFINITAS_BUTTON_E1);
+        sources[10] = get_effector((config.remap_start_sel) & 0xF, INFINITAS_BUTTON_E2);
+        sources[REMAP_SOURCE_TT_CW] = JOY_BUTTON_13;
+        sources[REMAP_SOURCE_TT_CCW] = JOY_BUTTON_14;
     }
 
-    return remapped;
+    compile_table(remap_lo, 256, &sources[0]);
+    compile_table(remap_hi, 8, &sources[8]);
+
+    remap_tt_buttons[0] = sources[REMAP_SOURCE_TT_CW];
+    remap_tt_buttons[1] = sources[REMAP_SOURCE_TT_CCW];
+}
+
+uint16_t remap_buttons(uint16_t buttons) {
+    return remap_lo[buttons & 0xFF] | remap_hi[(buttons >> 8) & 0x7];
+}
+
+uint16_t remap_tt(int8_t tt_report) {
+    switch (tt_report) {
+    case -1:
+        return remap_tt_buttons[0];
+    case 1:
+        return remap_tt_buttons[1];
+    default:
+        return 0;
+    }
 }
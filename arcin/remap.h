@@ -4,6 +4,14 @@
 #include <stdint.h>
 #include "config.h"
 
-uint16_t remap_buttons(config_t &config, uint16_t buttons);
+// Compiles the remap table (or the legacy effector nibbles in config, when the
+// table is not enabled) into lookup tables. Call once the config is loaded.
+void remap_init(const config_t &config, const remap_config* table);
 
-#endif
\ No newline at end of file
+// Physical buttons to gamepad buttons.
+uint16_t remap_buttons(uint16_t buttons);
+
+// Digital turntable report (-1, 0, 1) to gamepad buttons.
+uint16_t remap_tt(int8_t tt_report);
+
+#endif
@@ -4,7 +4,7 @@
 #include <usb/hid.h>
 
 #include "usb_strings.h"
-#include "color.h"
+#include "reports.h"
 
 constexpr HID_Item<uint8_t> string_index(uint8_t x) {
     return hid_item(0x78, x);
@@ -154,6 +154,22 @@ auto report_desc = gamepad(
         output(0x02)
     ),
 
+    // Host-streamed WS2812B frame chunk
+    report_id(4),
+    usage_page(0xff55),
+    usage(0xf000),
+    logical_minimum(0),
+    logical_maximum(255),
+    report_size(8),
+    report_count(63),
+    output(0x02),
+
+    // Host hint for the multi-function buttons (MULTIFUNC_HINT_*)
+    report_id(5),
+    usage(0xf001),
+    report_count(1),
+    output(0x02),
+
     // Bootloader
     report_id(0xb0),
     
@@ -195,35 +211,4 @@ auto keyb_report_desc = keyboard(
     input(0x00)
 );
 
-struct input_report_t {
-    uint8_t report_id;
-    uint16_t buttons;
-    uint8_t axis_x;
-    uint8_t axis_y;
-} __attribute__((packed));
-
-struct output_report_t {
-    uint8_t report_id;
-    uint16_t leds;
-} __attribute__((packed));
-
-struct output_report_rgb_t {
-    uint8_t report_id;
-    ColorRgb rgb;
-    uint8_t Unused;
-} __attribute__((packed));
-
-struct bootloader_report_t {
-    uint8_t report_id;
-    uint8_t func;
-} __attribute__((packed));
-
-struct config_report_t {
-    uint8_t report_id;
-    uint8_t segment;
-    uint8_t size;
-    uint8_t pad;
-    uint8_t data[60];
-} __attribute__((packed));
-
 #endif
@@ -0,0 +1,264 @@
+#ifndef REPORT_HANDLER_H
+#define REPORT_HANDLER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <os/time.h>
+
+#include "config.h"
+#include "configloader.h"
+#include "inf_defines.h"
+#include "input_trace.h"
+#include "multifunc.h"
+#include "reports.h"
+#include "rgbmanager.h"
+
+// The runtime's feature and output reports: config segments, effect program
+// uploads, input trace control, the bootloader report and the LED reports.
+// Plain C++ over the controller's state, so that the host builds and fuzzes
+// this same code; the USB driver in main.cpp only hands the reports over.
+class ReportHandler {
+    private:
+        config_t& config;
+        config_ext_t& config_ext;
+        Configloader& configloader;
+        Configloader& config_ext_loader;
+        Configloader& rgb_program_loader;
+        InputTrace& input_trace;
+        RGBManager& rgb_manager;
+        RGBManager& rgb_manager2;
+
+        // segment returned by the next config feature report read
+        uint8_t config_read_segment = 0;
+
+        // WS2812B effect program, uploaded through config segments
+        // RGB_PROGRAM_SEGMENT_FIRST..LAST
+        uint8_t rgb_program_blob[RGB_PROGRAM_MAX_SIZE];
+        uint32_t rgb_program_received = 0;
+
+        bool set_feature_bootloader(bootloader_report_t* report) {
+            switch(report->func) {
+                case 0:
+                    return true;
+
+                case 0x10: // Reset to bootloader
+                    reset_bootloader_requested = true;
+                    return true;
+
+                case 0x20: // Reset to runtime
+                    reset_requested = true;
+                    return true;
+
+                default:
+                    return false;
+            }
+        }
+
+        bool set_feature_config(config_report_t* report) {
+            // size comes from the host and is used for reads out of data
+            if(report->size > sizeof(report->data)) {
+                return false;
+            }
+
+            if(report->segment >= RGB_PROGRAM_SEGMENT_FIRST &&
+               report->segment <= RGB_PROGRAM_SEGMENT_LAST) {
+                return set_feature_rgb_program(report);
+            }
+
+            if(report->segment == INPUT_TRACE_SEGMENT_CONTROL) {
+                config_read_segment = report->segment;
+                return report->size == 0 ||
+                    input_trace.control(report->data, report->size, Time::time());
+            }
+
+            if(report->segment == INPUT_TRACE_SEGMENT_READ) {
+                config_read_segment = report->segment;
+                return input_trace.select(report->data, report->size);
+            }
+
+            if(report->segment > sizeof(config_ext) / sizeof(report->data)) {
+                return false;
+            }
+
+            // Reads return whichever segment was written last. An empty write
+            // just selects the segment to read.
+            config_read_segment = report->segment;
+            if(report->size == 0) {
+                return true;
+            }
+
+            if(report->segment == 0) {
+                configloader.write(report->size, report->data);
+                return true;
+            }
+
+            uint32_t offset = (report->segment - 1) * sizeof(report->data);
+            memcpy(
+                (uint8_t*)&config_ext + offset,
+                report->data,
+                min(report->size, sizeof(report->data)));
+            config_ext_loader.write(sizeof(config_ext), &config_ext);
+
+            return true;
+        }
+
+        bool set_feature_rgb_program(config_report_t* report) {
+            // Segments must arrive in order, each one full except for the last.
+            // The first segment always starts a new upload.
+            uint32_t offset =
+                (report->segment - RGB_PROGRAM_SEGMENT_FIRST) * sizeof(report->data);
+
+            if(report->segment == RGB_PROGRAM_SEGMENT_FIRST) {
+                rgb_program_received = 0;
+            }
+
+            if(offset != rgb_program_received ||
+               report->size > sizeof(report->data) ||
+               offset + report->size > sizeof(rgb_program_blob)) {
+                rgb_program_received = 0;
+                return false;
+            }
+
+            memcpy(rgb_program_blob + offset, report->data, report->size);
+            rgb_program_received += report->size;
+
+            if(rgb_program_received < sizeof(rgb_program_header_t)) {
+                return true;
+            }
+
+            uint32_t size = rgb_program_size((rgb_program_header_t*)rgb_program_blob);
+            if(rgb_program_received < size) {
+                return true;
+            }
+
+            // Complete. Only keep programs that validate and fit the frame budget
+            // of every strip, so that no strip runs a program that isn't saved.
+            rgb_program_received = 0;
+            bool strip2 = config.flags.Ws2812bStrip2;
+            if(!rgb_manager.validate_program(rgb_program_blob, size) ||
+               (strip2 && !rgb_manager2.validate_program(rgb_program_blob, size))) {
+                return false;
+            }
+
+            rgb_manager.load_program(rgb_program_blob, size);
+            if(strip2) {
+                rgb_manager2.load_program(rgb_program_blob, size);
+            }
+
+            rgb_program_loader.write(size, rgb_program_blob);
+
+            return true;
+        }
+
+    public:
+        // set by the bootloader feature report, for the main loop to act on
+        bool reset_bootloader_requested = false;
+        bool reset_requested = false;
+
+        ReportHandler(
+            config_t& config, config_ext_t& config_ext,
+            Configloader& configloader, Configloader& config_ext_loader,
+            Configloader& rgb_program_loader, InputTrace& input_trace,
+            RGBManager& rgb_manager, RGBManager& rgb_manager2) :
+            config(config), config_ext(config_ext),
+            configloader(configloader), config_ext_loader(config_ext_loader),
+            rgb_program_loader(rgb_program_loader), input_trace(input_trace),
+            rgb_manager(rgb_manager), rgb_manager2(rgb_manager2) {}
+
+        // At boot, after the strip's init()
+        void load_saved_program(RGBManager& manager) {
+            if(rgb_program_loader.read(sizeof(rgb_program_blob), rgb_program_blob)) {
+                manager.load_program(rgb_program_blob, sizeof(rgb_program_blob));
+            }
+        }
+
+        bool set_output_report(uint32_t* buf, uint32_t len) {
+            if (len < sizeof(uint8_t)) {
+                return false;
+            }
+
+            uint8_t report_id = *(uint8_t*)buf;
+            if (report_id == 0x2 && len == sizeof(output_report_t)) {
+                output_report_t* report = (output_report_t*)buf;
+                set_hid_lights(report->leds);
+
+            } else if (report_id == 0x3 &&
+                       len == sizeof(output_report_rgb_t) &&
+                       config.flags.Ws2812b) {
+
+                output_report_rgb_t* report = (output_report_rgb_t*)buf;
+                rgb_manager.update_from_hid(report->rgb);
+
+                if (config.flags.Ws2812bStrip2) {
+                    rgb_manager2.update_from_hid(report->rgb);
+                }
+
+            } else if (report_id == 0x4 &&
+                       len == sizeof(output_report_rgb_frame_t) &&
+                       config.flags.Ws2812b) {
+
+                output_report_rgb_frame_t* report = (output_report_rgb_frame_t*)buf;
+                rgb_manager.update_frame_from_hid(
+                    report->sequence,
+                    report->offset,
+                    min(report->count, RGB_FRAME_CHUNK_LEDS),
+                    (report->flags & RGB_FRAME_FLAG_PRESENT) != 0,
+                    report->rgb);
+
+            } else if (report_id == 0x5 && len == sizeof(output_report_hint_t)) {
+                output_report_hint_t* report = (output_report_hint_t*)buf;
+                set_multi_function_hint(report->flags);
+            }
+
+            return true;
+        }
+
+        bool set_feature_report(uint32_t* buf, uint32_t len) {
+            if (len < sizeof(uint8_t)) {
+                return false;
+            }
+
+            switch(*buf & 0xff) {
+                case 0xb0:
+                    if(len != sizeof(bootloader_report_t)) {
+                        return false;
+                    }
+
+                    return set_feature_bootloader((bootloader_report_t*)buf);
+
+                case 0xc0:
+                    if(len != sizeof(config_report_t)) {
+                        return false;
+                    }
+
+                    return set_feature_config((config_report_t*)buf);
+
+                default:
+                    return false;
+            }
+        }
+
+        // Fills in the report to send, returns false for unknown reports.
+        bool get_feature_report(uint8_t report_id, config_report_t* report) {
+            if(report_id != 0xc0) {
+                return false;
+            }
+
+            *report = {0xc0, config_read_segment, sizeof(report->data)};
+
+            if(config_read_segment == 0) {
+                memcpy(report->data, &config, sizeof(config));
+            } else if(config_read_segment == INPUT_TRACE_SEGMENT_CONTROL) {
+                input_trace.read_header(report->data, Time::time());
+            } else if(config_read_segment == INPUT_TRACE_SEGMENT_READ) {
+                input_trace.read_chunk(report->data);
+            } else {
+                uint32_t offset = (config_read_segment - 1) * sizeof(report->data);
+                memcpy(report->data, (uint8_t*)&config_ext + offset, sizeof(report->data));
+            }
+
+            return true;
+        }
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef REPORTS_H
+#define REPORTS_H
+
+#include <stdint.h>
+
+#include "color.h"
+
+// Layouts of the runtime's HID reports, see report_desc.h for the
+// descriptors. Plain C++, so the host can build the report handling too.
+
+struct input_report_t {
+    uint8_t report_id;
+    uint16_t buttons;
+    uint8_t axis_x;
+    uint8_t axis_y;
+} __attribute__((packed));
+
+struct output_report_t {
+    uint8_t report_id;
+    uint16_t leds;
+} __attribute__((packed));
+
+struct output_report_rgb_t {
+    uint8_t report_id;
+    ColorRgb rgb;
+    uint8_t Unused;
+} __attribute__((packed));
+
+// Number of LEDs carried by each output_report_rgb_frame_t
+#define RGB_FRAME_CHUNK_LEDS 19
+
+// Present the assembled frame after applying this chunk
+#define RGB_FRAME_FLAG_PRESENT 0x01
+
+struct output_report_rgb_frame_t {
+    uint8_t report_id;
+    uint8_t sequence;
+    uint8_t flags;
+    uint8_t offset;
+    uint8_t count;
+    ColorRgb rgb[RGB_FRAME_CHUNK_LEDS];
+    uint8_t pad[2];
+} __attribute__((packed));
+
+static_assert(sizeof(output_report_rgb_frame_t) == 64, "size mismatch");
+
+struct output_report_hint_t {
+    uint8_t report_id;
+    uint8_t flags;
+} __attribute__((packed));
+
+struct bootloader_report_t {
+    uint8_t report_id;
+    uint8_t func;
+} __attribute__((packed));
+
+struct config_report_t {
+    uint8_t report_id;
+    uint8_t segment;
+    uint8_t size;
+    uint8_t pad;
+    uint8_t data[60];
+} __attribute__((packed));
+
+static_assert(sizeof(config_report_t) == 64, "size mismatch");
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef RGB_BEAT_DEFINES_H
+#define RGB_BEAT_DEFINES_H
+
+#include <stdint.h>
+#include "FastLED.h"
+
+// FastLED's beat and beatsin functions, with the time passed in instead of read
+// from the millisecond clock. Given the same time, they return the same values
+// as the FastLED versions (with timebase and phase offset of 0).
+
+inline uint16_t beat88_at(uint32_t ms, accum88 beats_per_minute_88) {
+    return (ms * beats_per_minute_88 * 280) >> 16;
+}
+
+inline uint16_t beat16_at(uint32_t ms, accum88 beats_per_minute) {
+    // Convert simple 8-bit BPM's to full Q8.8 accum88's if needed
+    if (beats_per_minute < 256) {
+        beats_per_minute <<= 8;
+    }
+    return beat88_at(ms, beats_per_minute);
+}
+
+inline uint8_t beat8_at(uint32_t ms, accum88 beats_per_minute) {
+    return beat16_at(ms, beats_per_minute) >> 8;
+}
+
+inline uint16_t beatsin88_at(
+    uint32_t ms, accum88 beats_per_minute_88, uint16_t lowest, uint16_t highest) {
+
+    uint16_t beatsin = sin16(beat88_at(ms, beats_per_minute_88)) + 32768;
+    return lowest + scale16(beatsin, highest - lowest);
+}
+
+inline uint16_t beatsin16_at(
+    uint32_t ms, accum88 beats_per_minute, uint16_t lowest, uint16_t highest) {
+
+    uint16_t beatsin = sin16(beat16_at(ms, beats_per_minute)) + 32768;
+    return lowest + scale16(beatsin, highest - lowest);
+}
+
+inline uint8_t beatsin8_at(
+    uint32_t ms, accum88 beats_per_minute, uint8_t lowest, uint8_t highest) {
+
+    uint8_t beatsin = sin8(beat8_at(ms, beats_per_minute));
+    return lowest + scale8(beatsin, highest - lowest);
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef RGB_BENCHMARK_DEFINES_H
+#define RGB_BENCHMARK_DEFINES_H
+
+#include <stdint.h>
+#include "FastLED.h"
+#include "ws2812b.h"
+#include "rgb_pacifica.h"
+#include "rgb_pride2015.h"
+#include "rgb_kernel_benchmark.h"
+
+// Render benchmark for the Pride and Pacifica effects, built only with
+// DEBUG_RGB_BENCHMARK. At boot, every effect renders RGB_BENCHMARK_FRAMES frames
+// (with simulated 20ms frame times) at each LED count, timed with the DWT cycle
+// counter. With DEBUG_TIMING_GAMEPAD, the results are shown on the gamepad axes
+// one after another: (index << 24) | cycles per frame, where the index is
+// effect * 3 + LED count. After those come the kernels in rgb_kernel_benchmark.h,
+// in cycles per call, at kernel * 2 (+ 1 for the scalar version).
+
+#define RGB_BENCHMARK_FRAMES 10000
+#define RGB_BENCHMARK_EFFECTS 2
+#define RGB_BENCHMARK_SIZES 3
+#define RGB_BENCHMARK_EFFECT_RESULTS (RGB_BENCHMARK_EFFECTS * RGB_BENCHMARK_SIZES)
+#define RGB_BENCHMARK_RESULTS (RGB_BENCHMARK_EFFECT_RESULTS + RGB_KERNEL_BENCHMARK_KERNELS * 2)
+
+#define RGB_BENCHMARK_DEMCR (*(volatile uint32_t*)0xE000EDFC)
+#define RGB_BENCHMARK_DWT_CTRL (*(volatile uint32_t*)0xE0001000)
+#define RGB_BENCHMARK_DWT_CYCCNT (*(volatile uint32_t*)0xE0001004)
+
+const uint8_t rgb_benchmark_sizes[RGB_BENCHMARK_SIZES] = {12, 60, 180};
+
+uint32_t rgb_benchmark_cycles[RGB_BENCHMARK_RESULTS];
+
+struct RgbBenchmarkCycles {
+    static uint32_t now() {
+        return RGB_BENCHMARK_DWT_CYCCNT;
+    }
+};
+
+void rgb_benchmark_run() {
+    static CRGB leds[WS2812B_MAX_LEDS];
+    static CRGB scratch[WS2812B_MAX_LEDS];
+
+    RGB_BENCHMARK_DEMCR |= 1 << 24; // TRCENA
+    RGB_BENCHMARK_DWT_CYCCNT = 0;
+    RGB_BENCHMARK_DWT_CTRL |= 1 << 0; // CYCCNTENA
+
+    for (uint8_t size = 0; size < RGB_BENCHMARK_SIZES; size++) {
+        uint8_t num_leds = rgb_benchmark_sizes[size];
+        Pride2015Effect pride;
+        PacificaEffect pacifica;
+
+        uint32_t start = RGB_BENCHMARK_DWT_CYCCNT;
+        for (uint32_t frame = 0; frame < RGB_BENCHMARK_FRAMES; frame++) {
+            pride.render(leds, scratch, num_leds, frame * 20);
+        }
+        rgb_benchmark_cycles[size] =
+            (RGB_BENCHMARK_DWT_CYCCNT - start) / RGB_BENCHMARK_FRAMES;
+
+        start = RGB_BENCHMARK_DWT_CYCCNT;
+        for (uint32_t frame = 0; frame < RGB_BENCHMARK_FRAMES; frame++) {
+            pacifica.render(leds, scratch, num_leds, frame * 20);
+        }
+        rgb_benchmark_cycles[RGB_BENCHMARK_SIZES + size] =
+            (RGB_BENCHMARK_DWT_CYCCNT - start) / RGB_BENCHMARK_FRAMES;
+    }
+
+    for (uint8_t kernel = 0; kernel < RGB_KERNEL_BENCHMARK_KERNELS; kernel++) {
+        uint32_t* result = &rgb_benchmark_cycles[RGB_BENCHMARK_EFFECT_RESULTS + kernel * 2];
+        result[0] = rgb_kernel_benchmark_time<RgbBenchmarkCycles>(kernel, true);
+        result[1] = rgb_kernel_benchmark_time<RgbBenchmarkCycles>(kernel, false);
+    }
+}
+
+uint32_t rgb_benchmark_result(uint8_t index) {
+    return (index << 24) | (rgb_benchmark_cycles[index] & 0xFFFFFF);
+}
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef RGB_KERNEL_BENCHMARK_DEFINES_H
+#define RGB_KERNEL_BENCHMARK_DEFINES_H
+
+#include <stdint.h>
+#include "FastLED.h"
+#include "rgb_simd.h"
+
+// Benchmark of the packed kernels in rgb_simd.h against the per-channel CRGB
+// code they replaced, over a full strip. The same code runs in the firmware,
+// as part of rgb_benchmark.h and timed in cycles with the DWT cycle counter,
+// and on the host (host/rgbbench.cpp), timed in ns. Each result is the mean
+// over RGB_KERNEL_BENCHMARK_ROUNDS calls; divide by RGB_KERNEL_BENCHMARK_LEDS
+// for the cost per pixel.
+
+#define RGB_KERNEL_BENCHMARK_LEDS 180
+#define RGB_KERNEL_BENCHMARK_ROUNDS 1000
+
+enum rgb_kernel_benchmark_kernel {
+    RGB_KERNEL_BENCHMARK_ADD,
+    RGB_KERNEL_BENCHMARK_SCALE,
+    RGB_KERNEL_BENCHMARK_FADE,
+    RGB_KERNEL_BENCHMARK_LERP,
+    RGB_KERNEL_BENCHMARK_BLEND,
+    RGB_KERNEL_BENCHMARK_BLEND_SOLID,
+    RGB_KERNEL_BENCHMARK_KERNELS
+};
+
+const char* const rgb_kernel_benchmark_names[RGB_KERNEL_BENCHMARK_KERNELS] = {
+    "add",
+    "scale",
+    "fade_to_black",
+    "lerp",
+    "blend",
+    "blend_solid",
+};
+
+// keeps the results from being optimized away
+volatile uint8_t rgb_kernel_benchmark_sink;
+
+// leds is changed in place, other is only read. param varies between rounds,
+// so that no round can be hoisted out of the loop.
+inline void rgb_kernel_benchmark_packed(
+    uint8_t kernel, CRGB* leds, const CRGB* other, uint8_t param) {
+
+    const uint16_t n = RGB_KERNEL_BENCHMARK_LEDS;
+    switch (kernel) {
+        case RGB_KERNEL_BENCHMARK_ADD:
+            rgb_add(leds, other, n);
+            break;
+        case RGB_KERNEL_BENCHMARK_SCALE:
+            rgb_scale(leds, n, param);
+            break;
+        case RGB_KERNEL_BENCHMARK_FADE:
+            rgb_fade_to_black(leds, n, param);
+            break;
+        case RGB_KERNEL_BENCHMARK_LERP:
+            rgb_lerp(leds, leds, other, n, param);
+            break;
+        case RGB_KERNEL_BENCHMARK_BLEND:
+            rgb_blend(leds, other, n, param);
+            break;
+        default:
+            rgb_blend_solid(leds, n, other[0], param);
+            break;
+    }
+}
+
+inline void rgb_kernel_benchmark_scalar(
+    uint8_t kernel, CRGB* leds, const CRGB* other, uint8_t param) {
+
+    const uint16_t n = RGB_KERNEL_BENCHMARK_LEDS;
+    for (uint16_t i = 0; i < n; i++) {
+        switch (kernel) {
+            case RGB_KERNEL_BENCHMARK_ADD:
+                leds[i] += other[i];
+                break;
+            case RGB_KERNEL_BENCHMARK_SCALE:
+                leds[i].nscale8(param);
+                break;
+            case RGB_KERNEL_BENCHMARK_FADE:
+                leds[i].fadeToBlackBy(param);
+                break;
+            case RGB_KERNEL_BENCHMARK_LERP:
+                for (uint8_t c = 0; c < 3; c++) {
+                    leds[i].raw[c] = (leds[i].raw[c] * (256 - param) + other[i].raw[c] * param) >> 8;
+                }
+                break;
+            case RGB_KERNEL_BENCHMARK_BLEND:
+                nblend(leds[i], other[i], param);
+                break;
+            default:
+                nblend(leds[i], other[0], param);
+                break;
+        }
+    }
+}
+
+inline void rgb_kernel_benchmark_fill(CRGB* leds, CRGB* other) {
+    for (uint16_t i = 0; i < RGB_KERNEL_BENCHMARK_LEDS; i++) {
+        leds[i] = CRGB(i, i * 7, i * 13);
+        other[i] = CRGB(255 - i, i * 3, i * 11);
+    }
+}
+
+// Clock provides uint32_t now(). Returns clock ticks per call.
+template <typename Clock>
+uint32_t rgb_kernel_benchmark_time(uint8_t kernel, bool packed) {
+    static CRGB leds[RGB_KERNEL_BENCHMARK_LEDS];
+    static CRGB other[RGB_KERNEL_BENCHMARK_LEDS];
+    rgb_kernel_benchmark_fill(leds, other);
+
+    uint32_t start = Clock::now();
+    for (uint32_t round = 0; round < RGB_KERNEL_BENCHMARK_ROUNDS; round++) {
+        // 200-255 keeps the strip from fading out to all zeros
+        uint8_t param = 200 + (round % 56);
+        if (packed) {
+            rgb_kernel_benchmark_packed(kernel, leds, other, param);
+        } else {
+            rgb_kernel_benchmark_scalar(kernel, leds, other, param);
+        }
+    }
+    uint32_t ticks = Clock::now() - start;
+
+    rgb_kernel_benchmark_sink = leds[kernel].red;
+    return ticks / RGB_KERNEL_BENCHMARK_ROUNDS;
+}
+
+// Largest difference in any channel between one call of the packed and the
+// scalar version, over every param.
+inline uint8_t rgb_kernel_benchmark_difference(uint8_t kernel) {
+    static CRGB packed[RGB_KERNEL_BENCHMARK_LEDS];
+    static CRGB scalar[RGB_KERNEL_BENCHMARK_LEDS];
+    static CRGB other[RGB_KERNEL_BENCHMARK_LEDS];
+    uint8_t difference = 0;
+
+    for (uint16_t param = 0; param < 256; param++) {
+        rgb_kernel_benchmark_fill(packed, other);
+        rgb_kernel_benchmark_fill(scalar, other);
+        rgb_kernel_benchmark_packed(kernel, packed, other, param);
+        rgb_kernel_benchmark_scalar(kernel, scalar, other, param);
+
+        for (uint16_t i = 0; i < RGB_KERNEL_BENCHMARK_LEDS; i++) {
+            for (uint8_t c = 0; c < 3; c++) {
+                uint8_t d = (packed[i].raw[c] > scalar[i].raw[c]) ?
+                    packed[i].raw[c] - scalar[i].raw[c] : scalar[i].raw[c] - packed[i].raw[c];
+                if (difference < d) {
+                    difference = d;
+                }
+            }
+        }
+    }
+
+    return difference;
+}
+
+#endif
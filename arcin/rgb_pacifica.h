@@ -2,6 +2,8 @@
 #define RGB_PACIFICA_DEFINES_H
 
 #include "FastLED.h"
+#include "rgb_beat.h"
+#include "rgb_simd.h"
 
 //////////////////////////////////////////////////////////////////////////
 //
@@ -28,99 +30,112 @@
 // These three custom blue-green color palettes were inspired by the colors found in
 // the waters off the southern coast of California, https://goo.gl/maps/QQgd97jjHesHZVxQ7
 //
-CRGBPalette16 pacifica_palette_1 = 
+const CRGBPalette16 pacifica_palette_1 = 
     { 0x000507, 0x000409, 0x00030B, 0x00030D, 0x000210, 0x000212, 0x000114, 0x000117, 
       0x000019, 0x00001C, 0x000026, 0x000031, 0x00003B, 0x000046, 0x14554B, 0x28AA50 };
-CRGBPalette16 pacifica_palette_2 = 
+const CRGBPalette16 pacifica_palette_2 = 
     { 0x000507, 0x000409, 0x00030B, 0x00030D, 0x000210, 0x000212, 0x000114, 0x000117, 
       0x000019, 0x00001C, 0x000026, 0x000031, 0x00003B, 0x000046, 0x0C5F52, 0x19BE5F };
-CRGBPalette16 pacifica_palette_3 = 
+const CRGBPalette16 pacifica_palette_3 = 
     { 0x000208, 0x00030E, 0x000514, 0x00061A, 0x000820, 0x000927, 0x000B2D, 0x000C33, 
       0x000E39, 0x001040, 0x001450, 0x001860, 0x001C70, 0x002080, 0x1040BF, 0x2060FF };
 
-void pacifica_one_layer( CRGB* leds, int num_leds, CRGBPalette16& p, uint16_t cistart, uint16_t wavescale, uint8_t bri, uint16_t ioff);
-void pacifica_add_whitecaps( CRGB* leds, int num_leds );
-void pacifica_deepen_colors( CRGB* leds, int num_leds );
+// All state lives in the object and time is passed in, so the output only
+// depends on the sequence of frame times.
+class PacificaEffect {
+  // the four "color index start" counters, one for each wave layer
+  uint16_t cistart1 = 0, cistart2 = 0, cistart3 = 0, cistart4 = 0;
+  uint32_t last_ms = 0;
+  bool running = false;
 
-void animation_pacifica( CRGB* leds, int num_leds )
-{
-  // Increment the four "color index start" counters, one for each wave layer.
-  // Each is incremented at a different speed, and the speeds vary over time.
-  static uint16_t sCIStart1, sCIStart2, sCIStart3, sCIStart4;
-  static uint32_t sLastms = 0;
-  uint32_t ms = GET_MILLIS();
-  uint32_t deltams = ms - sLastms;
-  sLastms = ms;
-  uint16_t speedfactor1 = beatsin16(3, 179, 269);
-  uint16_t speedfactor2 = beatsin16(4, 179, 269);
-  uint32_t deltams1 = (deltams * speedfactor1) / 256;
-  uint32_t deltams2 = (deltams * speedfactor2) / 256;
-  uint32_t deltams21 = (deltams1 + deltams2) / 2;
-  sCIStart1 += (deltams1 * beatsin88(1011,10,13));
-  sCIStart2 -= (deltams21 * beatsin88(777,8,11));
-  sCIStart3 -= (deltams1 * beatsin88(501,5,7));
-  sCIStart4 -= (deltams2 * beatsin88(257,4,6));
-
-  // Clear out the LED array to a dim background blue-green
-  fill_solid( leds, num_leds, CRGB( 2, 6, 10));
-
-  // Render each of four layers, with different scales and speeds, that vary over time
-  pacifica_one_layer( leds, num_leds, pacifica_palette_1, sCIStart1, beatsin16( 3, 11 * 256, 14 * 256), beatsin8( 10, 70, 130), 0-beat16( 301) );
-  pacifica_one_layer( leds, num_leds, pacifica_palette_2, sCIStart2, beatsin16( 4,  6 * 256,  9 * 256), beatsin8( 17, 40,  80), beat16( 401) );
-  pacifica_one_layer( leds, num_leds, pacifica_palette_3, sCIStart3, 6 * 256, beatsin8( 9, 10,38), 0-beat16(503));
-  pacifica_one_layer( leds, num_leds, pacifica_palette_3, sCIStart4, 5 * 256, beatsin8( 8, 10,28), beat16(601));
-
-  // Add brighter 'whitecaps' where the waves lines up more
-  pacifica_add_whitecaps(leds, num_leds);
-
-  // Deepen the blues and greens a bit
-  pacifica_deepen_colors(leds, num_leds);
-}
+  // Add one layer of waves into the led array
+  static void one_layer(CRGB* leds, CRGB* scratch, uint8_t num_leds, const CRGBPalette16& p, uint16_t cistart, uint16_t wavescale, uint8_t bri, uint16_t ioff)
+  {
+    uint16_t ci = cistart;
+    uint16_t waveangle = ioff;
+    uint16_t wavescale_half = (wavescale / 2) + 20;
+    for( uint16_t i = 0; i < num_leds; i++) {
+      waveangle += 250;
+      uint16_t s16 = sin16( waveangle ) + 32768;
+      uint16_t cs = scale16( s16 , wavescale_half ) + wavescale_half;
+      ci += cs;
+      uint16_t sindex16 = sin16( ci) + 32768;
+      uint8_t sindex8 = scale16( sindex16, 240);
+      scratch[i] = ColorFromPalette( p, sindex8, bri, LINEARBLEND);
+    }
 
-// Add one layer of waves into the led array
-void pacifica_one_layer(CRGB* leds, int num_leds, CRGBPalette16& p, uint16_t cistart, uint16_t wavescale, uint8_t bri, uint16_t ioff)
-{
-  uint16_t ci = cistart;
-  uint16_t waveangle = ioff;
-  uint16_t wavescale_half = (wavescale / 2) + 20;
-  for( uint16_t i = 0; i < num_leds; i++) {
-    waveangle += 250;
-    uint16_t s16 = sin16( waveangle ) + 32768;
-    uint16_t cs = scale16( s16 , wavescale_half ) + wavescale_half;
-    ci += cs;
-    uint16_t sindex16 = sin16( ci) + 32768;
-    uint8_t sindex8 = scale16( sindex16, 240);
-    CRGB c = ColorFromPalette( p, sindex8, bri, LINEARBLEND);
-    leds[i] += c;
+    rgb_add( leds, scratch, num_leds);
   }
-}
 
-// Add extra 'white' to areas where the four layers of light have lined up brightly
-void pacifica_add_whitecaps(CRGB* leds, int num_leds)
-{
-  uint8_t basethreshold = beatsin8( 9, 55, 65);
-  uint8_t wave = beat8( 7 );
+  // Add extra 'white' to areas where the four layers of light have lined up brightly
+  static void add_whitecaps(CRGB* leds, uint8_t num_leds, uint32_t ms)
+  {
+    uint8_t basethreshold = beatsin8_at( ms, 9, 55, 65);
+    uint8_t wave = beat8_at( ms, 7 );
   
-  for( uint16_t i = 0; i < num_leds; i++) {
-    uint8_t threshold = scale8( sin8( wave), 20) + basethreshold;
-    wave += 7;
-    uint8_t l = leds[i].getAverageLight();
-    if( l > threshold) {
-      uint8_t overage = l - threshold;
-      uint8_t overage2 = qadd8( overage, overage);
-      leds[i] += CRGB( overage, overage2, qadd8( overage2, overage2));
+    for( uint16_t i = 0; i < num_leds; i++) {
+      uint8_t threshold = scale8( sin8( wave), 20) + basethreshold;
+      wave += 7;
+      uint8_t l = leds[i].getAverageLight();
+      if( l > threshold) {
+        uint8_t overage = l - threshold;
+        uint8_t overage2 = qadd8( overage, overage);
+        leds[i] += CRGB( overage, overage2, qadd8( overage2, overage2));
+      }
+    }
+  }
+
+  // Deepen the blues and greens
+  static void deepen_colors(CRGB* leds, uint8_t num_leds)
+  {
+    for( uint16_t i = 0; i < num_leds; i++) {
+      leds[i].blue = scale8( leds[i].blue,  145); 
+      leds[i].green= scale8( leds[i].green, 200); 
+      leds[i] |= CRGB( 2, 5, 7);
     }
   }
-}
 
-// Deepen the blues and greens
-void pacifica_deepen_colors(CRGB* leds, int num_leds)
-{
-  for( uint16_t i = 0; i < num_leds; i++) {
-    leds[i].blue = scale8( leds[i].blue,  145); 
-    leds[i].green= scale8( leds[i].green, 200); 
-    leds[i] |= CRGB( 2, 5, 7);
+public:
+  void reset() {
+    cistart1 = cistart2 = cistart3 = cistart4 = 0;
+    running = false;
+  }
+
+  // scratch must hold num_leds; each wave layer is rendered there before being
+  // added on top of leds.
+  void render( CRGB* leds, CRGB* scratch, uint8_t num_leds, uint32_t ms )
+  {
+    // Increment the four "color index start" counters, one for each wave layer.
+    // Each is incremented at a different speed, and the speeds vary over time.
+    // The first frame after a reset does not move.
+    uint32_t deltams = running ? (ms - last_ms) : 0;
+    last_ms = ms;
+    running = true;
+    uint16_t speedfactor1 = beatsin16_at(ms, 3, 179, 269);
+    uint16_t speedfactor2 = beatsin16_at(ms, 4, 179, 269);
+    uint32_t deltams1 = (deltams * speedfactor1) / 256;
+    uint32_t deltams2 = (deltams * speedfactor2) / 256;
+    uint32_t deltams21 = (deltams1 + deltams2) / 2;
+    cistart1 += (deltams1 * beatsin88_at(ms, 1011,10,13));
+    cistart2 -= (deltams21 * beatsin88_at(ms, 777,8,11));
+    cistart3 -= (deltams1 * beatsin88_at(ms, 501,5,7));
+    cistart4 -= (deltams2 * beatsin88_at(ms, 257,4,6));
+
+    // Clear out the LED array to a dim background blue-green
+    fill_solid( leds, num_leds, CRGB( 2, 6, 10));
+
+    // Render each of four layers, with different scales and speeds, that vary over time
+    one_layer( leds, scratch, num_leds, pacifica_palette_1, cistart1, beatsin16_at( ms, 3, 11 * 256, 14 * 256), beatsin8_at( ms, 10, 70, 130), 0-beat16_at( ms, 301) );
+    one_layer( leds, scratch, num_leds, pacifica_palette_2, cistart2, beatsin16_at( ms, 4,  6 * 256,  9 * 256), beatsin8_at( ms, 17, 40,  80), beat16_at( ms, 401) );
+    one_layer( leds, scratch, num_leds, pacifica_palette_3, cistart3, 6 * 256, beatsin8_at( ms, 9, 10,38), 0-beat16_at( ms, 503));
+    one_layer( leds, scratch, num_leds, pacifica_palette_3, cistart4, 5 * 256, beatsin8_at( ms, 8, 10,28), beat16_at( ms, 601));
+
+    // Add brighter 'whitecaps' where the waves lines up more
+    add_whitecaps(leds, num_leds, ms);
+
+    // Deepen the blues and greens a bit
+    deepen_colors(leds, num_leds);
   }
-}
+};
 
 #endif
@@ -1,7 +1,9 @@
 #ifndef RGB_PRIDE2015_DEFINES_H
-#define RGB_PRIDE2015 DEFINES_H
+#define RGB_PRIDE2015_DEFINES_H
 
 #include "FastLED.h"
+#include "rgb_beat.h"
+#include "rgb_simd.h"
 
 // from FastLED example:
 
@@ -9,44 +11,59 @@
 // Animated, ever-changing rainbows.
 // by Mark Kriegsman
 
-void animation_pride_2015(CRGB* leds, int num_leds) {
-  static uint16_t sPseudotime = 0;
-  static uint16_t sLastMillis = 0;
-  static uint16_t sHue16 = 0;
+// All state lives in the object and time is passed in, so the output only
+// depends on the sequence of frame times.
+class Pride2015Effect {
+  uint16_t pseudotime = 0;
+  uint16_t hue16 = 0;
+  uint32_t last_ms = 0;
+  bool running = false;
 
-  uint8_t sat8 = beatsin88( 87, 220, 250);
-  uint8_t brightdepth = beatsin88( 341, 96, 224);
-  uint16_t brightnessthetainc16 = beatsin88( 203, (25 * 256), (40 * 256));
-  uint8_t msmultiplier = beatsin88(147, 23, 60);
+public:
+  void reset() {
+    pseudotime = 0;
+    hue16 = 0;
+    running = false;
+  }
+
+  // scratch must hold num_leds; the new colors are rendered there and then blended
+  // into leds all at once.
+  void render(CRGB* leds, CRGB* scratch, uint8_t num_leds, uint32_t ms) {
+    uint8_t sat8 = beatsin88_at( ms, 87, 220, 250);
+    uint8_t brightdepth = beatsin88_at( ms, 341, 96, 224);
+    uint16_t brightnessthetainc16 = beatsin88_at( ms, 203, (25 * 256), (40 * 256));
+    uint8_t msmultiplier = beatsin88_at( ms, 147, 23, 60);
 
-  uint16_t hue16 = sHue16;//gHue * 256;
-  uint16_t hueinc16 = beatsin88(113, 1, 3000);
+    uint16_t hue = hue16;
+    uint16_t hueinc16 = beatsin88_at( ms, 113, 1, 3000);
 
-  uint16_t ms = GET_MILLIS();
-  uint16_t deltams = ms - sLastMillis ;
-  sLastMillis  = ms;
-  sPseudotime += deltams * msmultiplier;
-  sHue16 += deltams * beatsin88( 400, 5,9);
-  uint16_t brightnesstheta16 = sPseudotime;
+    // the first frame after a reset does not move
+    uint16_t deltams = running ? (ms - last_ms) : 0;
+    last_ms = ms;
+    running = true;
+    pseudotime += deltams * msmultiplier;
+    hue16 += deltams * beatsin88_at( ms, 400, 5, 9);
+    uint16_t brightnesstheta16 = pseudotime;
 
-  for( uint16_t i = 0 ; i < num_leds; i++) {
-    hue16 += hueinc16;
-    uint8_t hue8 = hue16 / 256;
+    for( uint16_t i = 0 ; i < num_leds; i++) {
+      hue += hueinc16;
+      uint8_t hue8 = hue / 256;
 
-    brightnesstheta16  += brightnessthetainc16;
-    uint16_t b16 = sin16( brightnesstheta16  ) + 32768;
+      brightnesstheta16  += brightnessthetainc16;
+      uint16_t b16 = sin16( brightnesstheta16  ) + 32768;
 
-    uint16_t bri16 = (uint32_t)((uint32_t)b16 * (uint32_t)b16) / 65536;
-    uint8_t bri8 = (uint32_t)(((uint32_t)bri16) * brightdepth) / 65536;
-    bri8 += (255 - brightdepth);
+      uint16_t bri16 = (uint32_t)((uint32_t)b16 * (uint32_t)b16) / 65536;
+      uint8_t bri8 = (uint32_t)(((uint32_t)bri16) * brightdepth) / 65536;
+      bri8 += (255 - brightdepth);
 
-    CRGB newcolor = CHSV( hue8, sat8, bri8);
+      uint16_t pixelnumber = i;
+      pixelnumber = (num_leds-1) - pixelnumber;
 
-    uint16_t pixelnumber = i;
-    pixelnumber = (num_leds-1) - pixelnumber;
+      scratch[pixelnumber] = CHSV( hue8, sat8, bri8);
+    }
 
-    nblend( leds[pixelnumber], newcolor, 64);
+    rgb_blend( leds, scratch, num_leds, 64);
   }
-}
+};
 
 #endif
@@ -0,0 +1,394 @@
+#include <string.h>
+#include "rgb_program.h"
+
+// Rough cost of each instruction on the Cortex-M4, including dispatch
+static const uint8_t op_cycles[RGB_OP_TOTAL] = {
+    4,  // END
+    8,  // LOAD
+    8,  // MOVE
+    10, // ADD
+    10, // SUB
+    10, // MUL
+    10, // ADDI
+    10, // SHR
+    10, // SHL
+    10, // AND
+    10, // OR
+    10, // XOR
+    12, // MIN
+    12, // MAX
+    12, // SCALE8
+    12, // QADD8
+    20, // SIN8
+    16, // QUAD8
+    24, // BEAT8
+    16, // RAND8
+    60, // PALETTE
+    90, // HSV
+    6,  // SKIP
+    8,  // SKIPZ
+    8,  // SKIPNZ
+};
+
+static bool is_writable(uint8_t reg, bool pixel_program) {
+    if (reg < RGB_REG_GLOBAL_0) {
+        return true;
+    }
+
+    if (reg < RGB_REG_TIME) {
+        return !pixel_program;
+    }
+
+    if (RGB_REG_RED <= reg && reg < RGB_REG_TOTAL) {
+        return pixel_program;
+    }
+
+    return false;
+}
+
+static bool is_readable(uint8_t reg) {
+    return reg < RGB_REG_TOTAL;
+}
+
+static uint8_t clamp8(int16_t value) {
+    if (value < 0) {
+        return 0;
+    }
+
+    if (UINT8_MAX < value) {
+        return UINT8_MAX;
+    }
+
+    return value;
+}
+
+// Validates one program. When code is non-null, also writes out the compiled
+// instructions.
+bool RgbProgram::compile(
+    const rgb_program_instruction_t* source,
+    uint8_t length,
+    bool pixel_program,
+    compiled_t* code,
+    uint32_t& cycles) {
+
+    if (RGB_PROGRAM_MAX_INSTRUCTIONS < length) {
+        return false;
+    }
+
+    cycles = 0;
+    for (uint8_t pc = 0; pc < length; pc++) {
+        const rgb_program_instruction_t& in = source[pc];
+        int16_t imm = 0;
+        bool valid;
+
+        switch (in.op) {
+            case RGB_OP_END:
+                valid = true;
+                break;
+
+            case RGB_OP_LOAD:
+                valid = is_writable(in.d, pixel_program);
+                imm = (int16_t)((in.a << 8) | in.b);
+                break;
+
+            case RGB_OP_MOVE:
+            case RGB_OP_SIN8:
+            case RGB_OP_QUAD8:
+            case RGB_OP_BEAT8:
+                valid = is_writable(in.d, pixel_program) && is_readable(in.a);
+                break;
+
+            case RGB_OP_ADD:
+            case RGB_OP_SUB:
+            case RGB_OP_MUL:
+            case RGB_OP_AND:
+            case RGB_OP_OR:
+            case RGB_OP_XOR:
+            case RGB_OP_MIN:
+            case RGB_OP_MAX:
+            case RGB_OP_SCALE8:
+            case RGB_OP_QADD8:
+                valid =
+                    is_writable(in.d, pixel_program) &&
+                    is_readable(in.a) &&
+                    is_readable(in.b);
+                break;
+
+            case RGB_OP_ADDI:
+                valid = is_writable(in.d, pixel_program) && is_readable(in.a);
+                imm = (int8_t)in.b;
+                break;
+
+            case RGB_OP_SHR:
+            case RGB_OP_SHL:
+                valid = is_writable(in.d, pixel_program) && is_readable(in.a) && (in.b < 16);
+                imm = in.b;
+                break;
+
+            case RGB_OP_RAND8:
+                valid = is_writable(in.d, pixel_program);
+                break;
+
+            case RGB_OP_PALETTE:
+                valid = pixel_program && is_readable(in.a) && is_readable(in.b);
+                break;
+
+            case RGB_OP_HSV:
+                valid =
+                    pixel_program &&
+                    is_readable(in.d) &&
+                    is_readable(in.a) &&
+                    is_readable(in.b);
+                break;
+
+            case RGB_OP_SKIP:
+            case RGB_OP_SKIPZ:
+            case RGB_OP_SKIPNZ:
+                // forward only, and never past the end
+                imm = pc + 1 + in.b;
+                valid =
+                    (in.op == RGB_OP_SKIP || is_readable(in.a)) &&
+                    (imm <= length);
+                break;
+
+            default:
+                valid = false;
+                break;
+        }
+
+        if (!valid) {
+            return false;
+        }
+
+        // Assume every instruction runs; skips can only make it faster.
+        cycles += op_cycles[in.op];
+
+        if (code) {
+            code[pc].op = in.op;
+            code[pc].d = in.d;
+            code[pc].a = in.a;
+            code[pc].b = in.b;
+            code[pc].imm = imm;
+        }
+    }
+
+    return true;
+}
+
+bool RgbProgram::validate(const uint8_t* blob, uint32_t size, uint8_t num_leds) {
+    if (size < sizeof(rgb_program_header_t)) {
+        return false;
+    }
+
+    const rgb_program_header_t* header = (const rgb_program_header_t*)blob;
+    if (header->magic != RGB_PROGRAM_MAGIC || header->version != RGB_PROGRAM_VERSION) {
+        return false;
+    }
+
+    if (size < rgb_program_size(header)) {
+        return false;
+    }
+
+    const rgb_program_instruction_t* frame_source =
+        (const rgb_program_instruction_t*)(blob + sizeof(rgb_program_header_t));
+    const rgb_program_instruction_t* pixel_source = frame_source + header->frame_length;
+
+    uint32_t frame_cycles;
+    uint32_t pixel_cycles;
+    if (!compile(frame_source, header->frame_length, false, nullptr, frame_cycles) ||
+        !compile(pixel_source, header->pixel_length, true, nullptr, pixel_cycles)) {
+        return false;
+    }
+
+    return frame_cycles + (pixel_cycles * num_leds) <= RGB_PROGRAM_CYCLE_BUDGET;
+}
+
+bool RgbProgram::load(const uint8_t* blob, uint32_t size, uint8_t num_leds) {
+    // validate everything before touching the loaded program
+    if (!validate(blob, size, num_leds)) {
+        return false;
+    }
+
+    const rgb_program_header_t* header = (const rgb_program_header_t*)blob;
+    const rgb_program_instruction_t* frame_source =
+        (const rgb_program_instruction_t*)(blob + sizeof(rgb_program_header_t));
+    const rgb_program_instruction_t* pixel_source = frame_source + header->frame_length;
+
+    compile(frame_source, header->frame_length, false, frame_code, frame_cycles);
+    compile(pixel_source, header->pixel_length, true, pixel_code, pixel_cycles);
+    frame_length = header->frame_length;
+    pixel_length = header->pixel_length;
+
+    memset(regs, 0, sizeof(regs));
+    loaded = true;
+
+    return true;
+}
+
+void RgbProgram::run(const compiled_t* code, uint8_t length, const PaletteSampler& palette) {
+    int16_t* r = regs;
+
+    for (uint8_t reg = RGB_REG_LOCAL_0; reg < RGB_REG_GLOBAL_0; reg++) {
+        r[reg] = 0;
+    }
+
+    uint8_t pc = 0;
+    while (pc < length) {
+        const compiled_t& in = code[pc++];
+        switch (in.op) {
+            case RGB_OP_END:
+                return;
+
+            case RGB_OP_LOAD:
+                r[in.d] = in.imm;
+                break;
+
+            case RGB_OP_MOVE:
+                r[in.d] = r[in.a];
+                break;
+
+            case RGB_OP_ADD:
+                r[in.d] = r[in.a] + r[in.b];
+                break;
+
+            case RGB_OP_SUB:
+                r[in.d] = r[in.a] - r[in.b];
+                break;
+
+            case RGB_OP_MUL:
+                r[in.d] = r[in.a] * r[in.b];
+                break;
+
+            case RGB_OP_ADDI:
+                r[in.d] = r[in.a] + in.imm;
+                break;
+
+            case RGB_OP_SHR:
+                r[in.d] = r[in.a] >> in.imm;
+                break;
+
+            case RGB_OP_SHL:
+                // shifting a negative int16_t is undefined; shift the bits instead
+                r[in.d] = (int16_t)((uint16_t)r[in.a] << in.imm);
+                break;
+
+            case RGB_OP_AND:
+                r[in.d] = r[in.a] & r[in.b];
+                break;
+
+            case RGB_OP_OR:
+                r[in.d] = r[in.a] | r[in.b];
+                break;
+
+            case RGB_OP_XOR:
+                r[in.d] = r[in.a] ^ r[in.b];
+                break;
+
+            case RGB_OP_MIN:
+                r[in.d] = (r[in.a] < r[in.b]) ? r[in.a] : r[in.b];
+                break;
+
+            case RGB_OP_MAX:
+                r[in.d] = (r[in.a] > r[in.b]) ? r[in.a] : r[in.b];
+                break;
+
+            case RGB_OP_SCALE8:
+                r[in.d] = scale8(r[in.a], r[in.b]);
+                break;
+
+            case RGB_OP_QADD8:
+                r[in.d] = qadd8(r[in.a], r[in.b]);
+                break;
+
+            case RGB_OP_SIN8:
+                r[in.d] = sin8(r[in.a]);
+                break;
+
+            case RGB_OP_QUAD8:
+                r[in.d] = quadwave8(r[in.a]);
+                break;
+
+            case RGB_OP_BEAT8:
+                // same as beat8(), but driven by the program's clock
+                r[in.d] = ((time_ms * (uint32_t)(uint16_t)r[in.a] * 280) >> 16) & 0xFF;
+                break;
+
+            case RGB_OP_RAND8:
+                r[in.d] = random8();
+                break;
+
+            case RGB_OP_PALETTE:
+                {
+                    CRGB rgb = palette.sample(r[in.a]);
+                    rgb.nscale8_video(r[in.b]);
+                    r[RGB_REG_RED] = rgb.red;
+                    r[RGB_REG_GREEN] = rgb.green;
+                    r[RGB_REG_BLUE] = rgb.blue;
+                }
+                break;
+
+            case RGB_OP_HSV:
+                {
+                    CRGB rgb = CHSV(r[in.d], r[in.a], r[in.b]);
+                    r[RGB_REG_RED] = rgb.red;
+                    r[RGB_REG_GREEN] = rgb.green;
+                    r[RGB_REG_BLUE] = rgb.blue;
+                }
+                break;
+
+            case RGB_OP_SKIP:
+                pc = in.imm;
+                break;
+
+            case RGB_OP_SKIPZ:
+                if (r[in.a] == 0) {
+                    pc = in.imm;
+                }
+                break;
+
+            case RGB_OP_SKIPNZ:
+                if (r[in.a] != 0) {
+                    pc = in.imm;
+                }
+                break;
+
+            default:
+                return;
+        }
+    }
+}
+
+void RgbProgram::render(
+    CRGB* leds,
+    uint8_t num_leds,
+    const rgb_program_inputs_t& inputs,
+    const PaletteSampler& palette) {
+
+    if (!loaded) {
+        return;
+    }
+
+    time_ms = inputs.time_ms;
+    regs[RGB_REG_TIME] = (int16_t)inputs.time_ms;
+    regs[RGB_REG_DELTA] = inputs.delta_ms;
+    regs[RGB_REG_TT] = inputs.tt;
+    regs[RGB_REG_BUTTONS] = inputs.buttons;
+    regs[RGB_REG_INDEX] = 0;
+    regs[RGB_REG_COUNT] = num_leds;
+
+    run(frame_code, frame_length, palette);
+
+    for (uint8_t led = 0; led < num_leds; led++) {
+        regs[RGB_REG_INDEX] = led;
+        regs[RGB_REG_RED] = 0;
+        regs[RGB_REG_GREEN] = 0;
+        regs[RGB_REG_BLUE] = 0;
+
+        run(pixel_code, pixel_length, palette);
+
+        leds[led] = CRGB(
+            clamp8(regs[RGB_REG_RED]),
+            clamp8(regs[RGB_REG_GREEN]),
+            clamp8(regs[RGB_REG_BLUE]));
+    }
+}
@@ -0,0 +1,173 @@
+#ifndef RGB_PROGRAM_DEFINES_H
+#define RGB_PROGRAM_DEFINES_H
+
+#include <stdint.h>
+#include "FastLED.h"
+#include "color_palettes.h"
+
+// Data-driven LED effects.
+//
+// An effect is a pair of tiny programs: the frame program runs once per frame,
+// the pixel program runs once for every LED. Both operate on a shared file of
+// 16-bit registers. Programs are uploaded as a blob over the config feature
+// report (see RGB_PROGRAM_SEGMENT_FIRST), validated and compiled once, and then
+// interpreted every frame.
+//
+// There are no backward jumps, so a program can never take longer than its
+// instruction count; the compiler uses that to reject programs that would blow
+// the frame budget for the configured number of LEDs.
+
+#define RGB_PROGRAM_MAGIC 0x5052 // "RP"
+#define RGB_PROGRAM_VERSION 1
+
+#define RGB_PROGRAM_MAX_INSTRUCTIONS 64
+
+// Worst case cycles the frame + pixel programs may take, per frame (1ms @ 72MHz)
+#define RGB_PROGRAM_CYCLE_BUDGET 72000
+
+// Config feature report segments carrying the program blob, 60 bytes each
+#define RGB_PROGRAM_SEGMENT_FIRST 0x10
+#define RGB_PROGRAM_SEGMENT_LAST  0x19
+
+struct rgb_program_header_t {
+    uint16_t magic;
+    uint8_t version;
+    // number of instructions in the frame program, then the pixel program
+    uint8_t frame_length;
+    uint8_t pixel_length;
+    uint8_t reserved[3];
+} __attribute__((packed));
+
+// total size of a program blob, given its header
+inline uint32_t rgb_program_size(const rgb_program_header_t* header) {
+    return sizeof(rgb_program_header_t) + (header->frame_length + header->pixel_length) * 4;
+}
+
+// op, dest register, two operands (registers or immediates depending on op)
+struct rgb_program_instruction_t {
+    uint8_t op;
+    uint8_t d;
+    uint8_t a;
+    uint8_t b;
+} __attribute__((packed));
+
+#define RGB_PROGRAM_MAX_SIZE \
+    (sizeof(rgb_program_header_t) + \
+     (2 * RGB_PROGRAM_MAX_INSTRUCTIONS * sizeof(rgb_program_instruction_t)))
+
+static_assert(
+    RGB_PROGRAM_MAX_SIZE <= (RGB_PROGRAM_SEGMENT_LAST - RGB_PROGRAM_SEGMENT_FIRST + 1) * 60,
+    "not enough config segments for the largest program");
+
+typedef enum _RGB_Program_Register {
+    // scratch, cleared before every run of a program
+    RGB_REG_LOCAL_0 = 0,
+    // kept across frames; only the frame program may write them
+    RGB_REG_GLOBAL_0 = 8,
+
+    // inputs (read only)
+    RGB_REG_TIME = 16,  // milliseconds, low 16 bits
+    RGB_REG_DELTA,      // milliseconds since the previous frame
+    RGB_REG_TT,         // turntable activity, [-127, 127]
+    RGB_REG_BUTTONS,    // remapped button bitmap
+    RGB_REG_INDEX,      // LED index (0 in the frame program)
+    RGB_REG_COUNT,      // number of LEDs
+
+    // outputs (pixel program only), clamped to [0, 255]
+    RGB_REG_RED = 24,
+    RGB_REG_GREEN,
+    RGB_REG_BLUE,
+
+    RGB_REG_TOTAL
+} RGB_Program_Register;
+
+typedef enum _RGB_Program_Op {
+    RGB_OP_END,     // stop
+    RGB_OP_LOAD,    // d = (a << 8) | b
+    RGB_OP_MOVE,    // d = a
+    RGB_OP_ADD,     // d = a + b
+    RGB_OP_SUB,     // d = a - b
+    RGB_OP_MUL,     // d = a * b
+    RGB_OP_ADDI,    // d = a + (int8_t)b
+    RGB_OP_SHR,     // d = a >> b (immediate)
+    RGB_OP_SHL,     // d = a << b (immediate)
+    RGB_OP_AND,     // d = a & b
+    RGB_OP_OR,      // d = a | b
+    RGB_OP_XOR,     // d = a ^ b
+    RGB_OP_MIN,     // d = min(a, b)
+    RGB_OP_MAX,     // d = max(a, b)
+    RGB_OP_SCALE8,  // d = scale8(a, b)
+    RGB_OP_QADD8,   // d = qadd8(a, b)
+    RGB_OP_SIN8,    // d = sin8(a)
+    RGB_OP_QUAD8,   // d = quadwave8(a)
+    RGB_OP_BEAT8,   // d = beat8(a), using the program's clock
+    RGB_OP_RAND8,   // d = random8()
+    RGB_OP_PALETTE, // outputs = palette[a] scaled by b (pixel program only)
+    RGB_OP_HSV,     // outputs = CHSV(d, a, b) (pixel program only)
+    RGB_OP_SKIP,    // skip the next b instructions (immediate)
+    RGB_OP_SKIPZ,   // if a == 0, skip the next b instructions (immediate)
+    RGB_OP_SKIPNZ,  // if a != 0, skip the next b instructions (immediate)
+
+    RGB_OP_TOTAL
+} RGB_Program_Op;
+
+struct rgb_program_inputs_t {
+    uint32_t time_ms;
+    uint16_t delta_ms;
+    int8_t tt;
+    uint16_t buttons;
+};
+
+class RgbProgram {
+    private:
+        // Validated and pre-decoded instruction; immediates are widened and skip
+        // distances are resolved to absolute targets.
+        struct compiled_t {
+            uint8_t op;
+            uint8_t d;
+            uint8_t a;
+            uint8_t b;
+            int16_t imm;
+        };
+
+        compiled_t frame_code[RGB_PROGRAM_MAX_INSTRUCTIONS];
+        compiled_t pixel_code[RGB_PROGRAM_MAX_INSTRUCTIONS];
+        uint8_t frame_length = 0;
+        uint8_t pixel_length = 0;
+        uint32_t frame_cycles = 0;
+        uint32_t pixel_cycles = 0;
+        bool loaded = false;
+
+        int16_t regs[RGB_REG_TOTAL];
+        uint32_t time_ms = 0;
+
+        static bool compile(
+            const rgb_program_instruction_t* source,
+            uint8_t length,
+            bool pixel_program,
+            compiled_t* code,
+            uint32_t& cycles);
+
+        void run(const compiled_t* code, uint8_t length, const PaletteSampler& palette);
+
+    public:
+        // Checks that a program blob is well formed and fits the frame budget for
+        // num_leds, without loading it.
+        static bool validate(const uint8_t* blob, uint32_t size, uint8_t num_leds);
+
+        // Validates and compiles a program blob. The currently loaded program is
+        // left untouched if this fails.
+        bool load(const uint8_t* blob, uint32_t size, uint8_t num_leds);
+
+        bool is_loaded() {
+            return loaded;
+        }
+
+        void render(
+            CRGB* leds,
+            uint8_t num_leds,
+            const rgb_program_inputs_t& inputs,
+            const PaletteSampler& palette);
+};
+
+#endif
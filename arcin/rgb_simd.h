@@ -0,0 +1,159 @@
+#ifndef RGB_SIMD_DEFINES_H
+#define RGB_SIMD_DEFINES_H
+
+#include <stdint.h>
+#include <string.h>
+#include "FastLED.h"
+
+// Packed-pixel kernels for LED buffers.
+//
+// A CRGB array is just 3 * num_leds bytes, and every kernel here treats each
+// channel the same way, so the buffer is processed four channels (one 32-bit
+// word) at a time regardless of pixel boundaries. The leftover 0-3 bytes are
+// handled one channel at a time.
+//
+// On the Cortex-M4 the saturating add maps to UQADD8. Scaling and blending use
+// a single 32-bit multiply for two 8-bit lanes spread out to 16 bits each. A
+// portable version of every primitive is used for non-ARM builds.
+
+static inline uint32_t rgb_load_word(const uint8_t* p) {
+    // unaligned word access is fine on Cortex-M4 (and on the host)
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+static inline void rgb_store_word(uint8_t* p, uint32_t word) {
+    memcpy(p, &word, sizeof(word));
+}
+
+// Per-byte saturating add
+static inline uint32_t rgb_packed_qadd8(uint32_t a, uint32_t b) {
+#if defined(__ARM_FEATURE_SIMD32)
+    uint32_t result;
+    asm("uqadd8 %0, %1, %2" : "=r" (result) : "r" (a), "r" (b));
+    return result;
+#else
+    uint32_t low = (a & 0x7F7F7F7F) + (b & 0x7F7F7F7F);
+    uint32_t sum = low ^ ((a ^ b) & 0x80808080);
+    uint32_t carry = ((a & b) | ((a | b) & ~sum)) & 0x80808080;
+    return sum | ((carry >> 7) * 0xFF);
+#endif
+}
+
+// Per-byte (x * scale) >> 8, with scale in [0, 256]. Each product fits in 16 bits,
+// so even and odd bytes are scaled two at a time.
+static inline uint32_t rgb_packed_scale(uint32_t word, uint16_t scale) {
+    uint32_t even = (((word & 0x00FF00FF) * scale) >> 8) & 0x00FF00FF;
+    uint32_t odd = (((word >> 8) & 0x00FF00FF) * scale) & 0xFF00FF00;
+    return even | odd;
+}
+
+// Per-byte (a * (256 - fract) + b * fract) >> 8, with fract in [0, 256]
+static inline uint32_t rgb_packed_lerp(uint32_t a, uint32_t b, uint16_t fract) {
+    uint16_t keep = 256 - fract;
+    uint32_t even =
+        (((a & 0x00FF00FF) * keep + (b & 0x00FF00FF) * fract) >> 8) & 0x00FF00FF;
+    uint32_t odd =
+        (((a >> 8) & 0x00FF00FF) * keep + ((b >> 8) & 0x00FF00FF) * fract) & 0xFF00FF00;
+    return even | odd;
+}
+
+// leds[i] += src[i], saturating (i.e., CRGB::operator+=)
+inline void rgb_add(CRGB* leds, const CRGB* src, uint16_t num_leds) {
+    uint8_t* dst = (uint8_t*)leds;
+    const uint8_t* s = (const uint8_t*)src;
+    uint16_t len = num_leds * 3;
+    uint16_t i = 0;
+
+    for (; i + 4 <= len; i += 4) {
+        rgb_store_word(dst + i, rgb_packed_qadd8(rgb_load_word(dst + i), rgb_load_word(s + i)));
+    }
+    for (; i < len; i++) {
+        dst[i] = qadd8(dst[i], s[i]);
+    }
+}
+
+// leds[i].nscale8(scale)
+inline void rgb_scale(CRGB* leds, uint16_t num_leds, uint8_t scale) {
+    uint8_t* dst = (uint8_t*)leds;
+    uint16_t len = num_leds * 3;
+    uint16_t scale_fixed = (uint16_t)scale + 1;
+    uint16_t i = 0;
+
+    for (; i + 4 <= len; i += 4) {
+        rgb_store_word(dst + i, rgb_packed_scale(rgb_load_word(dst + i), scale_fixed));
+    }
+    for (; i < len; i++) {
+        dst[i] = (dst[i] * scale_fixed) >> 8;
+    }
+}
+
+// leds[i].fadeToBlackBy(fade)
+inline void rgb_fade_to_black(CRGB* leds, uint16_t num_leds, uint8_t fade) {
+    rgb_scale(leds, num_leds, UINT8_MAX - fade);
+}
+
+// out[i] = a[i] + (b[i] - a[i]) * fract / 256, with fract in [0, 256]
+// out may alias a or b.
+inline void rgb_lerp(CRGB* out, const CRGB* a, const CRGB* b, uint16_t num_leds, uint16_t fract) {
+    uint8_t* dst = (uint8_t*)out;
+    const uint8_t* sa = (const uint8_t*)a;
+    const uint8_t* sb = (const uint8_t*)b;
+    uint16_t len = num_leds * 3;
+    uint16_t keep = 256 - fract;
+    uint16_t i = 0;
+
+    for (; i + 4 <= len; i += 4) {
+        rgb_store_word(
+            dst + i, rgb_packed_lerp(rgb_load_word(sa + i), rgb_load_word(sb + i), fract));
+    }
+    for (; i < len; i++) {
+        dst[i] = (sa[i] * keep + sb[i] * fract) >> 8;
+    }
+}
+
+// nblend(leds[i], overlay[i], amount)
+inline void rgb_blend(CRGB* leds, const CRGB* overlay, uint16_t num_leds, uint8_t amount) {
+    if (amount == 0) {
+        return;
+    }
+
+    // 255 means "all overlay", same as nblend
+    uint16_t fract = (amount == UINT8_MAX) ? 256 : amount;
+    rgb_lerp(leds, leds, overlay, num_leds, fract);
+}
+
+// nblend(leds[i], color, amount)
+// A solid color repeats every 12 bytes, i.e. every three words.
+inline void rgb_blend_solid(CRGB* leds, uint16_t num_leds, const CRGB& color, uint8_t amount) {
+    if (amount == 0) {
+        return;
+    }
+
+    uint16_t fract = (amount == UINT8_MAX) ? 256 : amount;
+    uint16_t keep = 256 - fract;
+    uint8_t* dst = (uint8_t*)leds;
+    uint16_t len = num_leds * 3;
+    uint16_t i = 0;
+
+    uint32_t r = color.red;
+    uint32_t g = color.green;
+    uint32_t b = color.blue;
+    const uint32_t pattern[3] = {
+        r | (g << 8) | (b << 16) | (r << 24),
+        g | (b << 8) | (r << 16) | (g << 24),
+        b | (r << 8) | (g << 16) | (b << 24),
+    };
+
+    uint8_t phase = 0;
+    for (; i + 4 <= len; i += 4) {
+        rgb_store_word(dst + i, rgb_packed_lerp(rgb_load_word(dst + i), pattern[phase], fract));
+        phase = (phase == 2) ? 0 : phase + 1;
+    }
+    for (; i < len; i++) {
+        dst[i] = (dst[i] * keep + color.raw[i % 3] * fract) >> 8;
+    }
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef RGB_TT_ACTIVITY_DEFINES_H
+#define RGB_TT_ACTIVITY_DEFINES_H
+
+#include <stdint.h>
+
+// Turntable speed, in encoder ticks per second, that counts as full activity.
+// This is roughly a brisk scratch.
+#define TT_ACTIVITY_FULL_SCALE 512
+
+// Time constants for smoothing the turntable speed. The speed is low-pass
+// filtered, and activity follows its peak, decaying over the configured fade out
+// time (or RELEASE_MS, if none).
+#define TT_ACTIVITY_SMOOTHING_MS 15
+#define TT_ACTIVITY_RELEASE_MS 60
+
+// Turns the encoder ticks counted over each frame into turntable activity,
+// [-127, 127], proportional to the smoothed speed. Frames may be any length.
+// Plain C++, so the host can replay recorded spins through it (see
+// host/rgbtest.cpp).
+class TurntableActivity {
+    private:
+        // the smoothed speed and its decaying peak, in ticks per second (24.8
+        // fixed point)
+        int32_t velocity = 0;
+        int32_t envelope = 0;
+
+        static int32_t magnitude(int32_t value) {
+            return (value < 0) ? -value : value;
+        }
+
+        // Exponential smoothing with a time constant that does not depend on the
+        // frame rate: alpha = dt / (tau + dt)
+        static int32_t smooth(int32_t value, int32_t target, uint32_t tau_ms, uint32_t elapsed_ms) {
+            // less than one tick per second is as good as there
+            if (magnitude(target - value) < 256) {
+                return target;
+            }
+
+            int64_t alpha = ((int64_t)elapsed_ms << 16) / (tau_ms + elapsed_ms);
+            return value + (int32_t)(((int64_t)(target - value) * alpha) >> 16);
+        }
+
+    public:
+        int8_t update(int32_t ticks, uint32_t elapsed_ms, uint16_t fade_out_ms) {
+            int32_t sample = ticks * (1000 << 8) / (int32_t)((elapsed_ms != 0) ? elapsed_ms : 1);
+            velocity = smooth(velocity, sample, TT_ACTIVITY_SMOOTHING_MS, elapsed_ms);
+
+            // follow the speed right away when it goes up (or reverses), and decay
+            // when it goes down. Exponential decay is mostly done after three time
+            // constants.
+            if ((magnitude(envelope) <= magnitude(velocity)) ||
+                ((envelope < 0) != (velocity < 0))) {
+                envelope = velocity;
+            } else {
+                uint32_t release_ms = fade_out_ms / 3;
+                if (release_ms < TT_ACTIVITY_RELEASE_MS) {
+                    release_ms = TT_ACTIVITY_RELEASE_MS;
+                }
+                envelope = smooth(envelope, velocity, release_ms, elapsed_ms);
+            }
+
+            int32_t activity = envelope * 127 / (TT_ACTIVITY_FULL_SCALE << 8);
+            if (activity < -127) {
+                return -127;
+            }
+            if (127 < activity) {
+                return 127;
+            }
+            return activity;
+        }
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef RGB_ZONES_DEFINES_H
+#define RGB_ZONES_DEFINES_H
+
+#include <stdint.h>
+#include "FastLED.h"
+#include "config.h"
+#include "inf_defines.h"
+#include "rgb_simd.h"
+
+// Key-reactive zones. Each zone is a fixed range of the strip that flashes in
+// its own color when the button is pressed, then fades back to the effect
+// underneath.
+//
+// Per frame, only the zone intensities are updated, and each lit zone is blended
+// over its own range of LEDs. The cost is proportional to the number of lit
+// LEDs, not to the length of the strip.
+
+class RgbZones {
+    struct zone_t {
+        CRGB color;
+        uint8_t first_led;
+        uint8_t num_leds;
+        uint16_t button;
+        // 8.8 fixed point, 0xFFFF = fully lit
+        uint16_t intensity;
+    };
+
+    zone_t zones[RGB_ZONE_COUNT];
+    uint8_t num_zones = 0;
+    bool hold = false;
+    // how much intensity is lost every millisecond
+    uint16_t decay_per_ms = UINT16_MAX;
+
+    // presses that started since the last frame, so that short presses are
+    // never missed
+    uint16_t pressed = 0;
+    uint16_t buttons = 0;
+
+    static uint16_t button_for_zone(uint8_t zone) {
+        // buttons 1-7 are bits 0-6, E1-E4 are bits 8-11
+        return (zone < 7) ? (1 << zone) : (INFINITAS_BUTTON_E1 << (zone - 7));
+    }
+
+    // Blends a zone into the frame. Zones are fixed to the strip, so the frame
+    // range is found by undoing the rotation and direction that are applied
+    // when the frame is shown.
+    static void render_zone(
+        CRGB* leds, uint8_t num_leds, uint8_t right_shift, bool reversed, const zone_t& zone) {
+
+        if (num_leds <= zone.first_led) {
+            return;
+        }
+
+        uint8_t count = min(zone.num_leds, num_leds - zone.first_led);
+        uint8_t amount = zone.intensity >> 8;
+
+        uint8_t start = zone.first_led;
+        if (reversed) {
+            start = num_leds - zone.first_led - count;
+        }
+        start = (start + num_leds - (right_shift % num_leds)) % num_leds;
+
+        uint8_t head = min(count, num_leds - start);
+        rgb_blend_solid(leds + start, head, zone.color, amount);
+        rgb_blend_solid(leds, count - head, zone.color, amount);
+    }
+
+    public:
+        void init(const rgb_zone_config* config) {
+            num_zones = 0;
+            hold = config->Flags.HoldWhilePressed;
+
+            // 0 means "turn off right away"
+            decay_per_ms = UINT16_MAX;
+            if (0 < config->DecayTime) {
+                decay_per_ms = UINT16_MAX / (config->DecayTime * 10);
+            }
+
+            for (uint8_t i = 0; i < RGB_ZONE_COUNT; i++) {
+                const rgb_zone& source = config->Zones[i];
+                if (source.NumberOfLeds == 0) {
+                    continue;
+                }
+
+                zone_t& zone = zones[num_zones++];
+                zone.color = CRGB(source.Color.Red, source.Color.Green, source.Color.Blue);
+                zone.first_led = source.FirstLed;
+                zone.num_leds = source.NumberOfLeds;
+                zone.button = button_for_zone(i);
+                zone.intensity = 0;
+            }
+        }
+
+        bool is_enabled() {
+            return 0 < num_zones;
+        }
+
+        // debounced, remapped buttons; called every poll
+        void update_buttons(uint16_t buttons) {
+            pressed |= buttons & ~this->buttons;
+            this->buttons = buttons;
+        }
+
+        void update(uint32_t elapsed_ms) {
+            uint32_t decay = elapsed_ms * decay_per_ms;
+            uint16_t held = hold ? buttons : 0;
+
+            for (uint8_t i = 0; i < num_zones; i++) {
+                zone_t& zone = zones[i];
+                if ((pressed | held) & zone.button) {
+                    zone.intensity = UINT16_MAX;
+                } else if (zone.intensity <= decay) {
+                    zone.intensity = 0;
+                } else {
+                    zone.intensity -= decay;
+                }
+            }
+
+            pressed = 0;
+        }
+
+        void render(CRGB* leds, uint8_t num_leds, uint8_t right_shift, bool reversed) {
+            for (uint8_t i = 0; i < num_zones; i++) {
+                if (zones[i].intensity != 0) {
+                    render_zone(leds, num_leds, right_shift, reversed, zones[i]);
+                }
+            }
+        }
+};
+
+#endif
@@ -2,28 +2,47 @@
 #define RGBMANAGER_DEFINES_H
 
 #include <stdint.h>
+#include <string.h>
 #include <os/time.h>
 #include "fastled_shim.h"
 #include "FastLED.h"
 #include "ws2812b.h"
 #include "color.h"
+#include "config_validate.h"
 #include "color_palettes.h"
+#include "color_lut.h"
+#include "rgb_beat.h"
 #include "rgb_pacifica.h"
 #include "rgb_pride2015.h"
+#include "rgb_program.h"
+#include "rgb_tt_activity.h"
+#include "rgb_zones.h"
 
 extern uint32_t debug_value;
 
-WS2812B ws2812b_global;
-
 // duration of each frame, in milliseconds
 //
 // https://github.com/FastLED/FastLED/wiki/Interrupt-problems
 // Each pixel takes 30 microseconds.
+//  12 LEDs =  360 us = 0.4ms
 //  60 LEDs = 1800 us = 1.8ms
 // 180 LEDs = 5400 us = 5.4ms
-// So 20ms is more than enough to handle the worst case.
+// Unless the user picks a frame period, it is derived from the transfer time and
+// the measured render time, leaving at least half of each frame for input processing.
+// 20ms (the original fixed frame period) is more than enough to handle the worst case.
+
+#define RGB_MANAGER_MIN_FRAME_MS 4
+#define RGB_MANAGER_MAX_FRAME_MS 20
+
+// Effects were originally tuned at a fixed 20ms per frame; per-frame increments are
+// scaled relative to this so that they look the same at any frame rate.
+#define RGB_MANAGER_REFERENCE_FRAME_MS 20
+
+// HID lights and frames keep the effects off for this long after the last report
+#define RGB_MANAGER_HID_TIMEOUT_MS 5000
 
-#define RGB_MANAGER_FRAME_MS 20
+#define WS2812B_US_PER_LED 30
+#define WS2812B_US_RESET 50
 
 extern bool global_led_enable;
 
@@ -69,8 +88,19 @@ typedef enum _WS2812B_Mode {
 
     WS2812B_MODE_PRIDE,
     WS2812B_MODE_PACIFICA,
+
+    // user-uploaded effect program (see rgb_program.h); falls back to 1 if no
+    // valid program was uploaded
+    WS2812B_MODE_PROGRAM,
+
+    WS2812B_MODE_COUNT,
 } WS2812B_Mode;
 
+static_assert(RGB_CONFIG_MODE_COUNT == WS2812B_MODE_COUNT, "mode count mismatch");
+static_assert(RGB_CONFIG_PALETTE_COUNT == WS2812B_PALETTE_COUNT, "palette count mismatch");
+static_assert(RGB_CONFIG_MAX_LEDS == WS2812B_MAX_LEDS, "LED count mismatch");
+static_assert(RGB_CONFIG_MAX_FRAME_MS == RGB_MANAGER_MAX_FRAME_MS, "frame period mismatch");
+
 void crgb_from_colorrgb(ColorRgb color, CRGB& crgb) {
     crgb = CRGB(color.Red, color.Green, color.Blue);
 }
@@ -100,31 +130,66 @@ void get_divisions(uint8_t multiplicity, uint8_t num_leds, uint8_t dot1, uint8_t
     }
 }
 
+// Intermediate buffer for effects that render a layer and then blend it in,
+// and for drawing zones over a frame. Shared by both strips: they render one
+// after the other from the main loop, and nothing is kept here between calls.
+CRGB rgb_manager_scratch[WS2812B_MAX_LEDS];
+
+// Host-streamed frames are assembled here, then presented all at once. Only
+// the first strip takes them (see arcin/main.cpp).
+CRGB rgb_manager_hid_frame[WS2812B_MAX_LEDS];
+
 class RGBManager {
 
+    // the output this instance renders to
+    WS2812B& strip;
+
     CRGB leds[WS2812B_MAX_LEDS];
     uint8_t num_leds;
 
+    // host-streamed frames, see rgb_manager_hid_frame
+    uint8_t hid_frame_sequence = 0;
+    // time of the last chunk; 0 until the first one
+    uint32_t hid_frame_time = 0;
+
+    // A frame that came while the strip was still sending the one before is
+    // shown again from leds once the strip is free.
+    enum {
+        PENDING_NONE,
+        PENDING_SHOW,
+        PENDING_WITHOUT_DIMMING,
+    } pending = PENDING_NONE;
+
     uint32_t last_hid_report = 0;
-    uint32_t last_outdated_hid_check = 0;
+    uint32_t last_frame_time = 0;
+
+    // frame pacing. user_frame_period_ms of 0 means "auto"
+    uint8_t user_frame_period_ms = 0;
+    uint8_t frame_period_ms = RGB_MANAGER_MAX_FRAME_MS;
+    uint32_t frame_elapsed_ms = 0;
+    uint32_t render_time_us = 0;
 
     // reacting to tt movement (stationary / moving)
-    // any movement instantly increases it to -127 or +127
-    // no movement - slowly reaches 0 over time
+    // proportional to the smoothed turntable speed, [-127, 127]
     int8_t tt_activity = 0;
-    uint32_t last_tt_activity_time = 0;
     uint16_t tt_fade_out_time = 0;
     int8_t previous_tt = 0;
 
+    // encoder ticks since the last frame
+    int32_t tt_ticks = 0;
+    TurntableActivity tt_speed;
+
     // user-defined color mode
     WS2812B_Mode rgb_mode = WS2812B_MODE_SINGLE_COLOR;
     rgb_config_flags flags = {0};
     uint8_t multiplicity = 0;
+    WS2812B_Palette palette = (WS2812B_Palette)0;
 
     // user-defined modifiers
     uint8_t default_darkness = 0;
     uint8_t idle_brightness = 0;
     accum88 idle_animation_speed = 0;
+    uint8_t raw_idle_animation_speed = 0;
 
     // ranges are [-100, 100]
     // divide by 10 to get actual multiplier (100 => 10x) from UI   
@@ -143,10 +208,26 @@ class RGBManager {
 
     // shift values that modify colors, ranges from [0, UINT16_MAX]
     uint16_t shift_value = 0;
+    int32_t shift_remainder = 0;
     uint32_t tt_time_travel_base_ms = 0;
+    uint8_t tt_time_travel_fraction = 0;
 
     // for palette-based RGB modes
-    CRGBPalette256 current_palette;
+    PaletteSampler current_palette;
+
+    // for WS2812B_MODE_PRIDE and WS2812B_MODE_PACIFICA
+    Pride2015Effect pride;
+    PacificaEffect pacifica;
+
+    // for WS2812B_MODE_PROGRAM
+    RgbProgram program;
+    uint16_t buttons = 0;
+
+    // key-reactive zones, drawn over every effect
+    RgbZones zones;
+
+    // color correction + brightness, rebuilt only when brightness changes
+    ColorLut lut;
 
     private:    
         void update_static(CRGB& rgb) {
@@ -173,13 +254,32 @@ class RGBManager {
             return scale8(brightness, UINT8_MAX - default_darkness);
         }
 
+        bool is_hid_active(uint32_t now) {
+            return (last_hid_report != 0) && ((now - last_hid_report) < RGB_MANAGER_HID_TIMEOUT_MS);
+        }
+
         void show() {
-            FastLED.setBrightness(calculate_brightness());
-            show_without_dimming();
+            // rebuilds only if the brightness differs from the last frame's
+            lut.update(calculate_brightness());
+
+            // Zones are drawn on a copy, since some effects build on the previous
+            // frame. They never cover frames sent by the host.
+            if (zones.is_enabled() && !is_hid_active(Time::time())) {
+                memcpy(rgb_manager_scratch, leds, num_leds * sizeof(CRGB));
+                zones.render(
+                    rgb_manager_scratch,
+                    num_leds,
+                    strip.get_right_shift(),
+                    strip.is_order_reversed());
+                pending = strip.show(rgb_manager_scratch, lut) ? PENDING_NONE : PENDING_SHOW;
+                return;
+            }
+
+            pending = strip.show(leds, lut) ? PENDING_NONE : PENDING_SHOW;
         }
 
         void show_without_dimming() {
-            FastLED.show();
+            pending = strip.show(leds, lut) ? PENDING_NONE : PENDING_WITHOUT_DIMMING;
         }
 
         void set_off() {
@@ -238,6 +338,7 @@ class RGBManager {
         
         void set_mode(WS2812B_Mode rgb_mode, WS2812B_Palette palette, uint8_t multiplicity) {
             this->rgb_mode = rgb_mode;
+            this->palette = palette;
             this->multiplicity = max(1, multiplicity);
 
             // seed random
@@ -245,15 +346,19 @@ class RGBManager {
             random16_add_entropy(serial_num());
             current_random8 = random8();
 
+            pride.reset();
+            pacifica.reset();
+
             // pre-initialize color palette
             switch(rgb_mode) {
                 case WS2812B_MODE_TWO_COLOR_FADE:
-                    current_palette = CRGBPalette256(rgb_primary, rgb_secondary);
+                    current_palette.set(rgb_primary, rgb_secondary);
                     break;
 
                 case WS2812B_MODE_RANDOM_HUE:
                 case WS2812B_MODE_STATIC_RAINBOW:
                 case WS2812B_MODE_RAINBOW_WAVE:                
+                case WS2812B_MODE_PROGRAM:
                     set_palette(rgb_mode, palette);
                     break;
 
@@ -262,50 +367,18 @@ class RGBManager {
             }
         }
         
-        void update_turntable_activity(uint32_t now, int8_t tt) {
-            // Detect TT activity; framerate dependent, of course.
-            switch (tt) {
-                case 1:
-                    tt_activity = 127;
-                    last_tt_activity_time = now;
-                    break;
-
-                case -1:
-                    tt_activity = -127;
-                    last_tt_activity_time = now;
-                    break;
-
-                case 0:
-                default:
-                    if (last_tt_activity_time == 0) {
-                        tt_activity = 0;
-                    } else if (tt_activity != 0) {
-                        uint16_t time_since_last_tt = now - last_tt_activity_time;
-                        if (time_since_last_tt < tt_fade_out_time) {
-                            uint16_t delta = tt_fade_out_time - time_since_last_tt;
-                            int16_t temp = tt_activity;
-                            if (temp > 0) {
-                                temp = 
-                                    ((int16_t)127) * delta / tt_fade_out_time;
-                            } else {
-                                temp = 
-                                    ((int16_t)-127) * delta / tt_fade_out_time;
-                            }
-
-                            tt_activity = temp;
-
-                        } else {
-                            tt_activity = 0;
-                        }
-                    }
-                    break;
-            }
+        void update_turntable_activity(int32_t ticks) {
+            tt_activity = tt_speed.update(ticks, frame_elapsed_ms, tt_fade_out_time);
 
             // while turntable animation is active, pause idle animation by "stopping"
             // time progression. We always *increment* here to cancel out the effect of the
-            // wall-clock.
+            // wall-clock. Keep the fractional part around, since short frames would
+            // otherwise round down to nothing.
             if (tt_activity != 0) {
-                tt_time_travel_base_ms += scale8(RGB_MANAGER_FRAME_MS, quadwave8(abs(tt_activity)));
+                uint32_t travel =
+                    frame_elapsed_ms * quadwave8(abs(tt_activity)) + tt_time_travel_fraction;
+                tt_time_travel_base_ms += (travel >> 8);
+                tt_time_travel_fraction = travel & 0xFF;
             }
         }
 
@@ -320,7 +393,34 @@ class RGBManager {
         }
 
         void update_shift(int8_t tt_multiplier) {
-            shift_value += calculate_shift(tt_multiplier);
+            // scale by the frame duration so that the rotation speed does not depend on
+            // the frame rate
+            int32_t shift =
+                calculate_shift(tt_multiplier) * (int32_t)frame_elapsed_ms + shift_remainder;
+            shift_value += shift / RGB_MANAGER_REFERENCE_FRAME_MS;
+            shift_remainder = shift % RGB_MANAGER_REFERENCE_FRAME_MS;
+        }
+
+        void update_frame_period(uint32_t frame_start_us) {
+            // track the worst case render time, decaying slowly so that a single slow
+            // frame does not pin the frame rate forever
+            uint32_t render_us = micros() - frame_start_us;
+            render_time_us -= render_time_us / 16;
+            if (render_time_us < render_us) {
+                render_time_us = render_us;
+            }
+
+            uint32_t transfer_us = num_leds * WS2812B_US_PER_LED + WS2812B_US_RESET;
+            uint32_t period_ms;
+            if (user_frame_period_ms == 0) {
+                period_ms = (2 * (render_time_us + transfer_us) + 999) / 1000;
+                period_ms = min(max(period_ms, RGB_MANAGER_MIN_FRAME_MS), RGB_MANAGER_MAX_FRAME_MS);
+            } else {
+                // never go faster than the strip can be refreshed
+                period_ms = max(user_frame_period_ms, (transfer_us + 999) / 1000);
+            }
+
+            frame_period_ms = period_ms;
         }
 
         void next_random8() {
@@ -346,7 +446,14 @@ class RGBManager {
         }
 
     public:
-        void init(rgb_config* config) {
+        RGBManager(WS2812B& strip) : strip(strip) {}
+
+        void init(const rgb_config* source) {
+            // the host renderer passes whatever it was given
+            rgb_config validated = *source;
+            rgb_config_validate(&validated);
+            const rgb_config* config = &validated;
+
             // parse flags
             this->flags = config->Flags;
             this->tt_fade_out_time = 0;
@@ -364,6 +471,7 @@ class RGBManager {
             this->default_darkness = config->Darkness;
             this->idle_brightness = config->IdleBrightness;
 
+            this->raw_idle_animation_speed = config->IdleAnimationSpeed;
             this->idle_animation_speed =
                 calculate_adjusted_speed((WS2812B_Mode)config->Mode, config->IdleAnimationSpeed);
             
@@ -374,15 +482,37 @@ class RGBManager {
                 (WS2812B_Palette)config->ColorPalette,
                 config->Multiplicity);
 
-            this->num_leds = config->NumberOfLeds;
-            ws2812b_global.init(config->NumberOfLeds, config->Flags.FlipDirection);
-            FastLED.addLeds<ArcinController>(leds, num_leds);
-            FastLED.setCorrection(TypicalLEDStrip);
-            // we can't afford to call into FastLED too often, so disable temporal dithering
-            FastLED.setDither(DISABLE_DITHER);
+            // update_colors() caps the elapsed time at RGB_MANAGER_MAX_FRAME_MS,
+            // so a longer period would slow the effects down
+            this->user_frame_period_ms = config->FramePeriodMs;
+            if (0 < this->user_frame_period_ms) {
+                this->user_frame_period_ms = min(
+                    max(this->user_frame_period_ms, RGB_MANAGER_MIN_FRAME_MS),
+                    RGB_MANAGER_MAX_FRAME_MS);
+            }
+
+            strip.init(config->NumberOfLeds, config->Flags.FlipDirection);
+            this->num_leds = strip.get_num_leds();
+            this->pending = PENDING_NONE;
+            this->hid_frame_time = 0;
+            // color correction and brightness are applied through the lookup table as
+            // the frame is copied out, so FastLED's controller (and its temporal
+            // dithering) is not used at all
+            lut.update(calculate_brightness());
             set_off();
         }
 
+        // Switches to the next mode, keeping all other settings (until reset)
+        void next_mode() {
+            WS2812B_Mode next = (WS2812B_Mode)((rgb_mode + 1) % WS2812B_MODE_COUNT);
+            idle_animation_speed = calculate_adjusted_speed(next, raw_idle_animation_speed);
+            set_mode(next, palette, multiplicity);
+        }
+
+        void init_zones(const rgb_zone_config* config) {
+            zones.init(config);
+        }
+
         void update_from_hid(ColorRgb color) {
             if (!global_led_enable || !flags.EnableHidControl) {
                 return;
@@ -394,18 +524,97 @@ class RGBManager {
             this->update_static(crgb);
         }
 
+        // The frame budget is checked against the configured number of LEDs (or
+        // the maximum, before init).
+        uint8_t program_budget_leds() {
+            return (num_leds == 0) ? WS2812B_MAX_LEDS : num_leds;
+        }
+
+        // Checks an effect program without loading it.
+        bool validate_program(const uint8_t* blob, uint32_t size) {
+            return RgbProgram::validate(blob, size, program_budget_leds());
+        }
+
+        // Validates and compiles an effect program.
+        bool load_program(const uint8_t* blob, uint32_t size) {
+            return program.load(blob, size, program_budget_leds());
+        }
+
+        // debounced, remapped buttons (input for effect programs and zones)
+        void update_buttons(uint16_t buttons) {
+            this->buttons = buttons;
+            zones.update_buttons(buttons);
+        }
+
+        // Receives one chunk of a host-streamed frame. Chunks are written into a back
+        // buffer, and the whole frame is shown only when the host asks for it.
+        void update_frame_from_hid(
+            uint8_t sequence, uint8_t offset, uint8_t count, bool present, ColorRgb* colors) {
+
+            if (!global_led_enable || !flags.EnableHidControl) {
+                return;
+            }
+            uint32_t now = Time::time();
+            last_hid_report = now;
+
+            // The first chunk, or the first after the host went quiet, starts
+            // the sequence wherever the host's counter is.
+            if (hid_frame_time == 0 || RGB_MANAGER_HID_TIMEOUT_MS <= now - hid_frame_time) {
+                hid_frame_sequence = sequence;
+            }
+            hid_frame_time = now;
+
+            // a chunk from an older frame arrived late; drop it
+            if ((int8_t)(sequence - hid_frame_sequence) < 0) {
+                return;
+            }
+            hid_frame_sequence = sequence;
+
+            for (uint8_t i = 0; i < count; i++) {
+                uint16_t led = offset + i;
+                if (num_leds <= led) {
+                    break;
+                }
+                crgb_from_colorrgb(colors[i], rgb_manager_hid_frame[led]);
+            }
+
+            if (present) {
+                memcpy(leds, rgb_manager_hid_frame, num_leds * sizeof(CRGB));
+                strip.set_right_shift(0);
+                show();
+            }
+        }
+
+        // Raw turntable movement, in encoder ticks (clockwise is positive). Called
+        // every poll; the total is consumed once per frame.
+        void update_turntable(int32_t ticks) {
+            tt_ticks += ticks;
+        }
+
         // tt +1 is clockwise, -1 is counter-clockwise
         void update_colors(int8_t tt) {
-            // prevent frequent updates - use 20ms as the framerate. This framerate will have
-            // downstream effects on the various color algorithms below.
+            if (pending != PENDING_NONE && !strip.is_busy()) {
+                if (pending == PENDING_SHOW) {
+                    show();
+                } else {
+                    show_without_dimming();
+                }
+            }
+
+            // prevent frequent updates. The algorithms below scale their per-frame
+            // progression by frame_elapsed_ms, so the frame period can vary freely.
             uint32_t now = Time::time();
-            if ((now - last_outdated_hid_check) < RGB_MANAGER_FRAME_MS) {
+            if ((now - last_frame_time) < frame_period_ms) {
                 return;
             }
-            last_outdated_hid_check = now;
+            uint32_t elapsed_ms = min(now - last_frame_time, RGB_MANAGER_MAX_FRAME_MS);
+            last_frame_time = now;
+
+            int32_t ticks = tt_ticks;
+            tt_ticks = 0;
 
             // if there was a HID report recently, don't take over control
-            if ((last_hid_report != 0) && ((now - last_hid_report) < 5000)) {
+            if (is_hid_active(now)) {
                 return;
             }
             if (!global_led_enable) {
@@ -413,22 +622,37 @@ class RGBManager {
                 return;
             }
 
+            uint32_t frame_start_us = micros();
+            render_frame(now, elapsed_ms, tt, ticks);
+            update_frame_period(frame_start_us);
+        }
+
+        // Renders and shows one frame. All time comes from the arguments, so the
+        // same sequence of calls always produces the same frames (see
+        // host/effect_render.h).
+        // tt is the digital turntable state, ticks the encoder movement since the
+        // previous frame.
+        void render_frame(uint32_t now, uint32_t elapsed_ms, int8_t tt, int32_t ticks) {
+            frame_elapsed_ms = elapsed_ms;
+
             if (flags.ReactToTt){
-                update_turntable_activity(now, tt);
+                update_turntable_activity(ticks);
             }
 
+            zones.update(frame_elapsed_ms);
+
             switch(rgb_mode) {
                 case WS2812B_MODE_STATIC_RAINBOW:
                 {
                     // +20 seems good
                     update_shift(20);
 
-                    uint8_t index = beat8(idle_animation_speed, tt_time_travel_base_ms);
+                    uint8_t index = beat8_at(now - tt_time_travel_base_ms, idle_animation_speed);
 
                     // +20 seems good
                     index += (shift_value >> 8);
 
-                    CRGB color = ColorFromPalette(current_palette, index);
+                    CRGB color = current_palette.sample(index);
                     this->update_static(color);
                 }
                 break;
@@ -442,19 +666,11 @@ class RGBManager {
 
                     // we actually want to go "backwards" so that each color seem to be rotating clockwise.
                     uint8_t start_index =
-                        UINT8_MAX - beat8(idle_animation_speed, tt_time_travel_base_ms);
+                        UINT8_MAX - beat8_at(now - tt_time_travel_base_ms, idle_animation_speed);
 
                     start_index += (shift_value >> 8);
 
-                    fill_palette(
-                        leds,
-                        num_leds,
-                        start_index,
-                        step,
-                        current_palette,
-                        UINT8_MAX,
-                        LINEARBLEND
-                        );
+                    current_palette.fill(leds, num_leds, start_index, step);
                     show();
                 }
                 break;
@@ -464,8 +680,9 @@ class RGBManager {
                     // +60 seems good
                     update_shift(60);
 
-                    const uint16_t beat = beat16(idle_animation_speed, tt_time_travel_base_ms) + shift_value;
-                    ws2812b_global.set_right_shift(pick_led_number(num_leds, beat));
+                    const uint16_t beat =
+                        beat16_at(now - tt_time_travel_base_ms, idle_animation_speed) + shift_value;
+                    strip.set_right_shift(pick_led_number(num_leds, beat));
                     uint8_t color_index = 0;
                     for (uint8_t led = 0; led < num_leds; led++) {
                         leds[led] = get_user_color(color_index + 1);
@@ -485,10 +702,10 @@ class RGBManager {
                         progress = quadwave8(abs(tt_activity));
                     } else {
                         // reverse sawtooth (spike and ease out) + smoothing
-                        progress = UINT8_MAX - ease8InOutQuad(beat8(idle_animation_speed));
+                        progress = UINT8_MAX - ease8InOutQuad(beat8_at(now, idle_animation_speed));
                     }
 
-                    CRGB rgb = ColorFromPalette(current_palette, progress);
+                    CRGB rgb = current_palette.sample(progress);
                     this->update_static(rgb);
                 }
                 break;
@@ -496,17 +713,17 @@ class RGBManager {
                 case WS2812B_MODE_RANDOM_HUE:
                 {
                     if (this->flags.ReactToTt) {
-                        if ((this->previous_tt == 0) && (124 <= abs(tt_activity))) {
+                        if ((this->previous_tt == 0) && (tt != 0)) {
                             // TT triggered, time to pick a new hue value
                             next_random8();
                         }
 
-                        CRGB rgb = ColorFromPalette(current_palette, current_random8);
+                        CRGB rgb = current_palette.sample(current_random8);
                         this->update_static(rgb);
 
                     } else {
                         // sawtooth (drop to 0 and ease up) + smoothing
-                        uint8_t darkness = ease8InOutQuad(beat8(idle_animation_speed));
+                        uint8_t darkness = ease8InOutQuad(beat8_at(now, idle_animation_speed));
 
                         // detect spikes
                         if (darkness < previous_value) {
@@ -514,7 +731,7 @@ class RGBManager {
                         }
                         previous_value = darkness;
 
-                        CRGB rgb = ColorFromPalette(current_palette, current_random8);
+                        CRGB rgb = current_palette.sample(current_random8);
                         rgb.fadeToBlackBy(darkness);
                         this->update_static(rgb);
                     }
@@ -532,8 +749,9 @@ class RGBManager {
                     uint8_t dot3;
                     get_divisions(multiplicity, num_leds, dot1, dot2, dot3);
 
-                    const uint16_t beat = beat16(idle_animation_speed, tt_time_travel_base_ms) + shift_value;
-                    ws2812b_global.set_right_shift(pick_led_number(num_leds, beat));
+                    const uint16_t beat =
+                        beat16_at(now - tt_time_travel_base_ms, idle_animation_speed) + shift_value;
+                    strip.set_right_shift(pick_led_number(num_leds, beat));
 
                     CRGB current_color;
                     uint8_t current_division = 1;
@@ -570,18 +788,35 @@ class RGBManager {
 
                 case WS2812B_MODE_PRIDE:
                 {
-                    animation_pride_2015(leds, num_leds);
+                    pride.render(leds, rgb_manager_scratch, num_leds, now);
                     this->show();
                 }
                 break;
 
                 case WS2812B_MODE_PACIFICA:
                 {
-                    animation_pacifica(leds, num_leds);
+                    pacifica.render(leds, rgb_manager_scratch, num_leds, now);
                     this->show();
                 }
                 break;
 
+                case WS2812B_MODE_PROGRAM:
+                {
+                    if (program.is_loaded()) {
+                        rgb_program_inputs_t inputs;
+                        inputs.time_ms = now;
+                        inputs.delta_ms = frame_elapsed_ms;
+                        inputs.tt = tt_activity;
+                        inputs.buttons = buttons;
+
+                        program.render(leds, num_leds, inputs, current_palette);
+                        this->show();
+                    } else {
+                        this->update_static(rgb_primary);
+                    }
+                }
+                break;
+
                 case WS2812B_MODE_SINGLE_COLOR:
                 default:
                 {
@@ -590,7 +825,7 @@ class RGBManager {
                         // fade in/out
                         this->update_static(rgb_primary);
                     } else {
-                        uint8_t brightness = beatsin8(idle_animation_speed, 20);
+                        uint8_t brightness = beatsin8_at(now, idle_animation_speed, 20, UINT8_MAX);
                         CRGB rgb = rgb_primary;
                         rgb.fadeToBlackBy(UINT8_MAX - brightness);
                         this->update_static(rgb);
@@ -604,8 +839,24 @@ class RGBManager {
             }
         }
 
+        // Makes the random hues repeatable. This seeds FastLED's one generator,
+        // which every strip draws from, so only the host renderer uses it.
+        void seed(uint16_t seed) {
+            random16_set_seed(seed);
+            current_random8 = random8();
+        }
+
+        // The frame as sent to the strip, after color correction and brightness
+        const CRGB* get_output() {
+            return strip.leds;
+        }
+
+        uint8_t get_num_leds() {
+            return num_leds;
+        }
+
         void irq() {
-            ws2812b_global.irq();
+            strip.irq();
         }
 };
 
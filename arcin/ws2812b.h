@@ -7,6 +7,7 @@
 #include "FastLED.h"
 #include "color.h"
 #include "color_palettes.h"
+#include "color_lut.h"
 
 #define min(x, y) (((x) < (y)) ? (x) : (y))
 #define max(a,b) (((a) > (b)) ? (a) : (b))
@@ -15,8 +16,25 @@
 #define WS2812B_MAX_LEDS 180
 #define WS2812B_DEFAULT_LEDS 12
 
+// Each output has its own timer and DMA channel, so strips transfer concurrently.
+typedef enum _WS2812B_Output {
+    // PB8 (button 9), TIM4 CH3, DMA1 channel 7 (TIM4_UP)
+    WS2812B_OUTPUT_1,
+
+    // PA6 (QE2 A), TIM16 CH1, DMA1 channel 3 (TIM16_UP)
+    WS2812B_OUTPUT_2,
+
+    // no hardware; shown frames are only kept in leds (see host/effect_render.h)
+    WS2812B_OUTPUT_CAPTURE,
+} WS2812B_Output;
+
 class WS2812B {
     private:
+        WS2812B_Output output;
+        // index into DMA1.reg.C, i.e. DMA channel - 1
+        uint8_t dma_channel = 0;
+        uint32_t ccr_address = 0;
+
         uint8_t dmabuf[WS2812B_DMA_BUFFER_LEN];
         volatile uint32_t cnt;
         volatile bool busy;
@@ -27,10 +45,10 @@ class WS2812B {
         void schedule_dma() {
             cnt--;
             
-            DMA1.reg.C[6].NDTR = WS2812B_DMA_BUFFER_LEN;
-            DMA1.reg.C[6].MAR = (uint32_t)&dmabuf;
-            DMA1.reg.C[6].PAR = (uint32_t)&TIM4.CCR3;
-            DMA1.reg.C[6].CR =
+            DMA1.reg.C[dma_channel].NDTR = WS2812B_DMA_BUFFER_LEN;
+            DMA1.reg.C[dma_channel].MAR = (uint32_t)(uintptr_t)&dmabuf;
+            DMA1.reg.C[dma_channel].PAR = ccr_address;
+            DMA1.reg.C[dma_channel].CR =
                 (0 << 10) | (1 << 8) | (1 << 7) | (0 << 6) | (1 << 4) | (1 << 1) | (1 << 0);
         }
 
@@ -59,23 +77,11 @@ class WS2812B {
             dmabuf[n] = 0;
         }
         
-    public:
-        CRGB leds[WS2812B_MAX_LEDS];
-
-        void init(uint8_t num_leds, bool order_reversed) {
-            this->busy = false;
-            this->cnt = 0;
-
-            // num_leds should be [1, MAX]
-            this->num_leds = min(num_leds, WS2812B_MAX_LEDS);
-            if (this->num_leds == 0) {
-                this->num_leds = WS2812B_DEFAULT_LEDS;
-            }
-            this->order_reversed = order_reversed;
+        void init_output_1() {
+            dma_channel = 6;
+            ccr_address = (uint32_t)(uintptr_t)&TIM4.CCR3;
 
             RCC.enable(RCC.TIM4);
-            RCC.enable(RCC.DMA1);
-            
             Interrupt::enable(Interrupt::DMA1_Channel7);
             
             TIM4.ARR = (72000000 / 800000) - 1; // period = 90, 0 = 29, 1 = 58
@@ -90,12 +96,68 @@ class WS2812B {
             GPIOB[8].set_pull(Pin::PullNone);
 
             TIM4.CR1 = 1 << 0;
+        }
+
+        void init_output_2() {
+            dma_channel = 2;
+            ccr_address = (uint32_t)(uintptr_t)&TIM16.CCR1;
+
+            RCC.enable(RCC.TIM16);
+            Interrupt::enable(Interrupt::DMA1_Channel3);
+
+            TIM16.ARR = (72000000 / 800000) - 1; // same timing as output 1
+            TIM16.CCR1 = 0;
+
+            TIM16.CCMR1 = (6 << 4) | (1 << 3);
+            TIM16.CCER = 1 << 0;
+            TIM16.BDTR = 1 << 15; // MOE, outputs stay off without it
+            TIM16.DIER = 1 << 8;
+
+            GPIOA[6].set_af(1);
+            GPIOA[6].set_mode(Pin::AF);
+            GPIOA[6].set_pull(Pin::PullNone);
+
+            TIM16.CR1 = 1 << 0;
+        }
+
+    public:
+        CRGB leds[WS2812B_MAX_LEDS];
+
+        WS2812B(WS2812B_Output output) : output(output) {}
+
+        void init(uint8_t num_leds, bool order_reversed) {
+            this->busy = false;
+            this->cnt = 0;
+
+            // num_leds should be [1, MAX]
+            this->num_leds = min(num_leds, WS2812B_MAX_LEDS);
+            if (this->num_leds == 0) {
+                this->num_leds = WS2812B_DEFAULT_LEDS;
+            }
+            this->order_reversed = order_reversed;
+
+            if (output == WS2812B_OUTPUT_CAPTURE) {
+                return;
+            }
+
+            RCC.enable(RCC.DMA1);
+
+            switch (output) {
+                case WS2812B_OUTPUT_1:
+                default:
+                    init_output_1();
+                    break;
+
+                case WS2812B_OUTPUT_2:
+                    init_output_2();
+                    break;
+            }
             
             Time::sleep(1);
         }
 
         void show() {
-            if (busy) {
+            if (busy || output == WS2812B_OUTPUT_CAPTURE) {
                 return;
             }
             busy = true;
@@ -104,6 +166,39 @@ class WS2812B {
             schedule_dma();
         }
 
+        // Copies a frame into the output buffer through the color lookup table,
+        // applying rotation and direction, then starts the transfer. The DMA
+        // interrupt reads the output buffer while a transfer runs, so then
+        // nothing is copied and this returns false; show the frame again once
+        // is_busy() clears.
+        bool show(const CRGB* frame, const ColorLut& lut) {
+            if (busy) {
+                return false;
+            }
+
+            uint8_t index = this->right_shift % this->num_leds;
+            for (uint8_t led = 0; led < this->num_leds; led++) {
+                uint8_t target = index;
+                if (this->order_reversed) {
+                    target = (this->num_leds - 1) - index;
+                }
+
+                lut.apply(frame[led], this->leds[target]);
+
+                index++;
+                if (index == this->num_leds) {
+                    index = 0;
+                }
+            }
+
+            show();
+            return true;
+        }
+
+        bool is_busy() {
+            return busy;
+        }
+
         uint8_t get_num_leds() {
             return this->num_leds;
         }
@@ -121,8 +216,8 @@ class WS2812B {
         }
 
         void irq() {
-            DMA1.reg.C[6].CR = 0;
-            DMA1.reg.IFCR = 1 << 24;
+            DMA1.reg.C[dma_channel].CR = 0;
+            DMA1.reg.IFCR = 1 << (4 * dma_channel); // GIFx
             
             if (cnt) {
                 set_color(this->leds[this->num_leds - this->cnt]);
@@ -133,39 +228,4 @@ class WS2812B {
         }
 };
 
-extern WS2812B ws2812b_global;
-
-template<EOrder RGB_ORDER = RGB>
-class ArcinController : public CPixelLEDController<RGB_ORDER> {
-    public:
-        virtual void init() { }
-
-    protected:
-        virtual void showPixels(PixelController<RGB_ORDER> & pixels) {
-            uint8_t count = 0;
-            while (pixels.has(1)) {
-                uint8_t r = pixels.loadAndScale0();
-                uint8_t g = pixels.loadAndScale1();
-                uint8_t b = pixels.loadAndScale2();
-
-                uint8_t index = count;
-                index =
-                    (((uint16_t)index) + ws2812b_global.get_right_shift()) %
-                    ws2812b_global.get_num_leds();
-
-                if (ws2812b_global.is_order_reversed()) {
-                    index = (ws2812b_global.get_num_leds() - 1) - index;
-                }
-
-                ws2812b_global.leds[index] = CRGB(r, g, b);
-
-                count += 1;
-                pixels.advanceData();
-                pixels.stepDithering();
-            }
-
-            ws2812b_global.show();
-        }
-};
-
 #endif
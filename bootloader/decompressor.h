@@ -0,0 +1,119 @@
+#ifndef DECOMPRESSOR_H
+#define DECOMPRESSOR_H
+
+#include <stdint.h>
+
+#include "flashloader.h"
+
+#define LZ_WINDOW 1024
+
+// Decoder for the stream sent after "Flash prepare, compressed" (see
+// lzpack.py), writing to a Flashloader. Each output report is a length byte
+// followed by up to 63 bytes of the stream, which is a sequence of:
+//   0x00-0x7f: n + 1 literal bytes follow
+//   0x80-0xff: copy (n & 0x7f) + 3 bytes, starting (next two bytes, LE) + 1
+//              bytes back
+class Decompressor {
+	private:
+		Flashloader& flashloader;
+		
+		enum State {
+			Token,
+			Literal,
+			OffsetLow,
+			OffsetHigh,
+		};
+		
+		State state;
+		uint32_t count;
+		uint16_t offset;
+		
+		uint8_t history[LZ_WINDOW];
+		uint16_t history_pos;
+		
+		uint32_t out[16];
+		uint32_t out_len;
+		
+		bool put(uint8_t b) {
+			history[history_pos] = b;
+			history_pos = (history_pos + 1) & (LZ_WINDOW - 1);
+			
+			((uint8_t*)out)[out_len++] = b;
+			if(out_len == sizeof(out)) {
+				out_len = 0;
+				return flashloader.write_block(sizeof(out), out);
+			}
+			
+			return true;
+		}
+	
+	public:
+		bool active;
+		
+		Decompressor(Flashloader& flashloader) : flashloader(flashloader), active(false) {}
+		
+		void reset() {
+			state = Token;
+			history_pos = 0;
+			out_len = 0;
+		}
+		
+		bool write(uint32_t size, const uint8_t* data) {
+			for(uint32_t i = 0; i < size; i++) {
+				uint8_t b = data[i];
+				
+				switch(state) {
+					case Token:
+						count = (b & 0x7f) + 1;
+						state = (b & 0x80) ? OffsetLow : Literal;
+						break;
+					
+					case Literal:
+						if(!put(b)) {
+							return false;
+						}
+						if(--count == 0) {
+							state = Token;
+						}
+						break;
+					
+					case OffsetLow:
+						offset = b;
+						state = OffsetHigh;
+						break;
+					
+					case OffsetHigh:
+						offset = (offset | (b << 8)) + 1;
+						if(offset > LZ_WINDOW) {
+							return false;
+						}
+						
+						// Matches are at least 3 bytes.
+						for(count += 2; count; count--) {
+							if(!put(history[(history_pos - offset) & (LZ_WINDOW - 1)])) {
+								return false;
+							}
+						}
+						state = Token;
+						break;
+				}
+			}
+			
+			return true;
+		}
+		
+		// Writes out whatever is left of the last report.
+		bool flush() {
+			if(out_len & 1) {
+				((uint8_t*)out)[out_len++] = 0xff;
+			}
+			
+			bool ok = !out_len || flashloader.write_block(out_len, out);
+			
+			reset();
+			
+			return ok;
+		}
+};
+
+#endif
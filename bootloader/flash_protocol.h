@@ -0,0 +1,52 @@
+#ifndef FLASH_PROTOCOL_H
+#define FLASH_PROTOCOL_H
+
+#include <stdint.h>
+
+// The bootloader's flashing protocol and image trailer. Plain C++, so host
+// tools share it (see host/protocol.h).
+
+// Input report, sent whenever it changes. A host may stream the next page, or
+// seek, while pages_received - pages_written < FLASH_PAGE_BUFFERS.
+struct flash_status_t {
+	uint8_t flags;
+	uint8_t pages_received;
+	uint8_t pages_written;
+	
+	// result of the last FLASH_FUNC_PAGE_CRC query (0xff = none)
+	uint8_t crc_page;
+	uint32_t crc;
+} __attribute__((packed, aligned(4)));
+
+#define FLASH_STATUS_PREPARED 0x01
+#define FLASH_STATUS_BUSY 0x02
+#define FLASH_STATUS_ERROR 0x80
+
+#define FLASH_PAGE_SIZE 2048
+#define FLASH_PAGE_BUFFERS 2
+#define FLASH_PAGE_COUNT ((0x8020000 - 0x8002000) / FLASH_PAGE_SIZE)
+
+// Function codes carrying a page number in the low 6 bits
+#define FLASH_FUNC_SEEK 0x40
+#define FLASH_FUNC_PAGE_CRC 0x80
+#define FLASH_FUNC_PAGE_MASK 0x3f
+
+// Written by the flasher into the last 16 bytes of the firmware region
+// (see arcin.ld). Images without it are booted as before.
+struct image_trailer_t {
+	uint32_t magic;
+	// bytes from 0x8002000 covered by crc
+	uint32_t length;
+	uint32_t crc;
+	// 0xffff until the bootloader has checked crc, then 0
+	uint16_t verified;
+	uint16_t reserved;
+};
+
+#define IMAGE_TRAILER_MAGIC 0x4e435241 // "ARCN"
+
+// Flashing clears the low half of the magic first, so an interrupted update
+// is never booted.
+#define IMAGE_TRAILER_MAGIC_INVALIDATED (IMAGE_TRAILER_MAGIC & 0xffff0000)
+
+#endif
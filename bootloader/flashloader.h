@@ -0,0 +1,294 @@
+#ifndef FLASHLOADER_DEFINES_H
+#define FLASHLOADER_DEFINES_H
+
+#include <stdint.h>
+#include <rcc/flash.h>
+
+#include "flash_protocol.h"
+
+// Flash must be unlocked and idle.
+void program_halfword(uint32_t addr, uint16_t value) {
+	FLASH.CR = 1 << 0; // PG
+	
+	*(volatile uint16_t*)(uintptr_t)addr = value;
+	
+	while(FLASH.SR & (1 << 0)); // BSY
+	
+	FLASH.CR = 0;
+}
+
+static const volatile image_trailer_t& image_trailer = *(image_trailer_t*)0x801e7f0;
+
+enum ImageState {
+	IMAGE_LEGACY,
+	IMAGE_INVALID,
+	IMAGE_UNVERIFIED,
+	IMAGE_VERIFIED,
+};
+
+ImageState image_state() {
+	if(image_trailer.magic == IMAGE_TRAILER_MAGIC_INVALIDATED) {
+		return IMAGE_INVALID;
+	}
+	
+	if(image_trailer.magic != IMAGE_TRAILER_MAGIC) {
+		return IMAGE_LEGACY;
+	}
+	
+	if(image_trailer.length > (uint32_t)(uintptr_t)&image_trailer - 0x8002000) {
+		return IMAGE_INVALID;
+	}
+	
+	return image_trailer.verified ? IMAGE_UNVERIFIED : IMAGE_VERIFIED;
+}
+
+// CRC-32 of one firmware page, from the hardware CRC unit (see main.cpp)
+uint32_t page_crc(uint8_t page);
+
+// Reports are collected into page buffers. A full page is erased and
+// programmed from the main loop one halfword per call, so USB keeps being
+// serviced and the host can stream the next page in the meantime.
+class Flashloader {
+	private:
+		enum State {
+			Idle,
+			Erasing,
+			Programming,
+		};
+		
+		bool prepared;
+		bool error;
+		State state;
+		
+		// next address to receive
+		uint32_t addr;
+		
+		uint16_t page_buf[FLASH_PAGE_BUFFERS][FLASH_PAGE_SIZE / 2];
+		uint32_t page_addr[FLASH_PAGE_BUFFERS];
+		uint32_t page_len[FLASH_PAGE_BUFFERS];
+		
+		// buffer being filled, buffer being programmed and full buffers
+		uint8_t fill;
+		uint8_t prog;
+		uint8_t queued;
+		uint32_t prog_offset;
+		
+		uint8_t pages_received;
+		uint8_t pages_written;
+		
+		uint8_t crc_page;
+		uint32_t crc;
+		
+		void submit() {
+			fill = (fill + 1) % FLASH_PAGE_BUFFERS;
+			queued++;
+			pages_received++;
+		}
+		
+		// Queues the page being filled, if anything was written to it. With
+		// every buffer queued, fill is the page being programmed and nothing
+		// is being filled: write_block() drains before it writes again.
+		void submit_partial() {
+			if(queued < FLASH_PAGE_BUFFERS && page_len[fill]) {
+				submit();
+			}
+		}
+		
+		void drain() {
+			while(queued) {
+				process();
+			}
+		}
+	
+	public:
+		Flashloader() : prepared(false), error(false), state(Idle), queued(0), crc_page(0xff), crc(0) {}
+		
+		bool prepare() {
+			addr = 0x8002000;
+			prepared = true;
+			error = false;
+			state = Idle;
+			fill = prog = queued = 0;
+			page_len[0] = page_len[1] = 0;
+			pages_received = pages_written = 0;
+			
+			// Unlock flash.
+			FLASH.KEYR = 0x45670123;
+			FLASH.KEYR = 0xCDEF89AB;
+			
+			// Programming 0 over programmed flash is allowed.
+			if(image_trailer.magic == IMAGE_TRAILER_MAGIC) {
+				program_halfword((uint32_t)(uintptr_t)&image_trailer.magic, 0);
+			}
+			
+			return true;
+		}
+		
+		bool write_block(uint32_t size, void* data) {
+			if(!prepared) {
+				return false;
+			}
+			
+			if(size & 1) {
+				return false;
+			}
+			
+			if(addr + size > 0x8020000) {
+				return false;
+			}
+			
+			// Hosts without flow control just get blocked here.
+			if(queued == FLASH_PAGE_BUFFERS) {
+				drain();
+			}
+			
+			if(page_len[fill] == 0) {
+				page_addr[fill] = addr;
+			}
+			
+			uint16_t* src = (uint16_t*)data;
+			uint16_t* dest = &page_buf[fill][page_len[fill] / 2];
+			
+			for(uint32_t n = 0; n < size; n += 2) {
+				*dest++ = *src++;
+			}
+			
+			page_len[fill] += size;
+			addr += size;
+			
+			if(!(addr & (FLASH_PAGE_SIZE - 1))) {
+				submit();
+			}
+			
+			return true;
+		}
+		
+		// A seek queues the page being filled, so it needs a free buffer.
+		bool can_seek() {
+			return prepared && queued < FLASH_PAGE_BUFFERS;
+		}
+		
+		// Continue writing at the start of another page, so unchanged pages can
+		// be skipped.
+		bool seek(uint8_t page) {
+			if(!can_seek() || page >= FLASH_PAGE_COUNT) {
+				return false;
+			}
+			
+			submit_partial();
+			
+			addr = 0x8002000 + page * FLASH_PAGE_SIZE;
+			
+			return true;
+		}
+		
+		bool query_crc(uint8_t page) {
+			if(page >= FLASH_PAGE_COUNT) {
+				return false;
+			}
+			
+			// The page may still be queued for programming.
+			drain();
+			
+			crc_page = page;
+			crc = page_crc(page);
+			
+			return true;
+		}
+		
+		// Advances page programming by one step; call from the main loop.
+		void process() {
+			if(!queued || (FLASH.SR & (1 << 0))) { // BSY
+				return;
+			}
+			
+			if(FLASH.SR & ((1 << 4) | (1 << 2))) { // WRPRTERR, PGERR
+				error = true;
+				FLASH.SR = (1 << 4) | (1 << 2);
+			}
+			
+			switch(state) {
+				case Idle:
+					// Erase page.
+					FLASH.CR = 1 << 1; // PER
+					FLASH.AR = page_addr[prog];
+					FLASH.CR = (1 << 6) | (1 << 1); // STRT, PER
+					
+					prog_offset = 0;
+					state = Erasing;
+					break;
+				
+				case Erasing:
+					FLASH.SR = 1 << 5; // EOP
+					FLASH.CR = 1 << 0; // PG
+					state = Programming;
+					break;
+				
+				case Programming:
+					if(prog_offset < page_len[prog]) {
+						*(volatile uint16_t*)(uintptr_t)(page_addr[prog] + prog_offset) = page_buf[prog][prog_offset / 2];
+						prog_offset += 2;
+						break;
+					}
+					
+					FLASH.CR = 0;
+					page_len[prog] = 0;
+					prog = (prog + 1) % FLASH_PAGE_BUFFERS;
+					queued--;
+					pages_written++;
+					state = Idle;
+					break;
+			}
+		}
+		
+		bool finish() {
+			if(!prepared) {
+				return false;
+			}
+			
+			// Hosts without flow control finish right after their last
+			// report, so the queued pages are programmed first, as in
+			// write_block().
+			drain();
+			
+			// Program the last, partial page.
+			submit_partial();
+			
+			drain();
+			
+			// Flashers that do not write a trailer leave a legacy image.
+			if(image_trailer.magic == IMAGE_TRAILER_MAGIC_INVALIDATED) {
+				program_halfword((uint32_t)(uintptr_t)&image_trailer.magic + 2, 0);
+			}
+			
+			prepared = false;
+			
+			FLASH.CR = 1 << 7; // LOCK
+			
+			return !error;
+		}
+		
+		bool is_prepared() {
+			return prepared;
+		}
+		
+		flash_status_t status() {
+			flash_status_t s = {0, pages_received, pages_written, crc_page, crc};
+			
+			if(prepared) {
+				s.flags |= FLASH_STATUS_PREPARED;
+			}
+			
+			if(queued) {
+				s.flags |= FLASH_STATUS_BUSY;
+			}
+			
+			if(error) {
+				s.flags |= FLASH_STATUS_ERROR;
+			}
+			
+			return s;
+		}
+};
+
+#endif
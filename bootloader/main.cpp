@@ -7,11 +7,17 @@
 #include <usb/descriptor.h>
 #include <usb/hid.h>
 
+#include "flashloader.h"
+#include "decompressor.h"
+
 static uint32_t& reset_reason = *(uint32_t*)0x10000000;
 static const uint32_t* firmware_vtors = (uint32_t*)0x8002000;
 
 static bool do_reset;
 
+// Set by normal_boot() for an image that is bootable once its CRC checks out.
+static bool verify_pending;
+
 void reset() {
 	SCB.AIRCR = (0x5fa << 16) | (1 << 2); // SYSRESETREQ
 }
@@ -32,9 +38,11 @@ auto report_desc = pack(
 			report_count(1),
 			
 			usage(0xb007),
-			input(0x02), // Status
+			report_count(8),
+			input(0x02), // Status (flash_status_t)
 			
 			usage(0xb007),
+			report_count(1),
 			feature(0x02), // Function
 			
 			usage(0xb007),
@@ -68,78 +76,77 @@ static Pin led2 = GPIOA[9];
 
 USB_f1 usb(USB, dev_desc_p, conf_desc_p);
 
-class Flashloader {
-	private:
-		bool state;
-		uint32_t addr;
+struct CRC_t {
+	volatile uint32_t DR;
+	volatile uint32_t IDR;
+	volatile uint32_t CR;
+	uint32_t _reserved;
+	volatile uint32_t INIT;
+	volatile uint32_t POL;
+};
+
+static CRC_t& CRC = *(CRC_t*)0x40023000;
+
+// CRC-32 of a word aligned range of flash, using the same bit order and final
+// XOR as zlib so hosts can compare it against crc32() of the image.
+uint32_t flash_crc(uint32_t addr, uint32_t length) {
+	const uint32_t* src = (const uint32_t*)addr;
+	const uint32_t* end = (const uint32_t*)(addr + (length & ~15));
 	
-	public:
-		Flashloader() : state(false) {}
-		
-		bool prepare() {
-			addr = 0x8002000;
-			state = true;
-			
-			// Unlock flash.
-			FLASH.KEYR = 0x45670123;
-			FLASH.KEYR = 0xCDEF89AB;
-			
+	CRC.CR = (1 << 7) | (3 << 5) | (1 << 0); // REV_OUT, REV_IN by word, RESET
+	
+	while(src < end) {
+		CRC.DR = src[0];
+		CRC.DR = src[1];
+		CRC.DR = src[2];
+		CRC.DR = src[3];
+		src += 4;
+	}
+	
+	for(uint32_t n = 0; n < (length & 15) / 4; n++) {
+		CRC.DR = *src++;
+	}
+	
+	return ~CRC.DR;
+}
+
+uint32_t page_crc(uint8_t page) {
+	return flash_crc(0x8002000 + page * FLASH_PAGE_SIZE, FLASH_PAGE_SIZE);
+}
+
+// Checks the image CRC and records the result, so later boots only read the
+// trailer. Returns true for images that may be booted.
+bool verify_image() {
+	switch(image_state()) {
+		case IMAGE_LEGACY:
+		case IMAGE_VERIFIED:
 			return true;
-		}
 		
-		bool write_block(uint32_t size, void* data) {
-			if(!state) {
-				return false;
-			}
-			
-			if(size & 1) {
-				return false;
-			}
-			
-			if(addr + size > 0x8020000) {
-				return false;
-			}
-			
-			if(!(addr & (2048 - 1))) {
-				// Erase page.
-				
-				FLASH.CR = 1 << 1; // PER
-				FLASH.AR = addr;
-				FLASH.CR = (1 << 6) | (1 << 1); // STRT, PER
-				
-				while(FLASH.SR & (1 << 0)); // BSY
-				
-				FLASH.SR &= ~(1 << 5); // EOP
-				FLASH.CR = 0;
-			}
-			
-			uint16_t* src = (uint16_t*)data;
-			uint16_t* dest = (uint16_t*)addr;
-			
-			for(uint32_t n = 0; n < size; n += 2) {
-				FLASH.CR = 1 << 0; // PG
-				
-				*dest++ = *src++;
-				
-				while(FLASH.SR & (1 << 0)); // BSY
-			}
-			
-			
-			addr += size;
-			return true;
-		}
+		case IMAGE_INVALID:
+			return false;
 		
-		bool finish() {
-			state = false;
-			
-			FLASH.CR = 1 << 7; // LOCK
-			
-			return true;
-		}
-};
+		case IMAGE_UNVERIFIED:
+			break;
+	}
+	
+	if(flash_crc(0x8002000, image_trailer.length) != image_trailer.crc) {
+		return false;
+	}
+	
+	FLASH.KEYR = 0x45670123;
+	FLASH.KEYR = 0xCDEF89AB;
+	
+	program_halfword((uint32_t)&image_trailer.verified, 0);
+	
+	FLASH.CR = 1 << 7; // LOCK
+	
+	return true;
+}
 
 Flashloader flashloader;
 
+Decompressor decompressor(flashloader);
+
 class HID_bootloader : public USB_HID {
 	public:
 		HID_bootloader(USB_generic& usbd, desc_t rdesc) : USB_HID(usbd, rdesc, 0, 1, 64) {}
@@ -150,6 +157,11 @@ class HID_bootloader : public USB_HID {
 				return false;
 			}
 			
+			if(decompressor.active) {
+				uint8_t* data = (uint8_t*)buf;
+				return data[0] < len && decompressor.write(data[0], data + 1);
+			}
+			
 			return flashloader.write_block(len, buf);
 		}
 		
@@ -158,7 +170,26 @@ class HID_bootloader : public USB_HID {
 				return false;
 			}
 			
-			switch(*buf & 0xff) {
+			uint8_t func = *buf & 0xff;
+			
+			if((func & ~FLASH_FUNC_PAGE_MASK) == FLASH_FUNC_SEEK) {
+				if(!flashloader.can_seek()) {
+					return false;
+				}
+				
+				// The compressed stream restarts at the new page.
+				if(decompressor.active && !decompressor.flush()) {
+					return false;
+				}
+				
+				return flashloader.seek(func & FLASH_FUNC_PAGE_MASK);
+			}
+			
+			if((func & ~FLASH_FUNC_PAGE_MASK) == FLASH_FUNC_PAGE_CRC) {
+				return flashloader.query_crc(func & FLASH_FUNC_PAGE_MASK);
+			}
+			
+			switch(func) {
 				case 0:
 					return true;
 				
@@ -170,11 +201,27 @@ class HID_bootloader : public USB_HID {
 					return true;
 				
 				case 0x20: // Flash prepare
+					decompressor.active = false;
 					return flashloader.prepare();
 				
 				case 0x21: // Flash finish
+					if(decompressor.active) {
+						decompressor.active = false;
+						if(!decompressor.flush()) {
+							flashloader.finish();
+							return false;
+						}
+					}
 					return flashloader.finish();
 				
+				case 0x22: // Flash prepare, compressed
+					decompressor.reset();
+					decompressor.active = true;
+					return flashloader.prepare();
+				
+				case 0x23: // Verify image trailer
+					return !flashloader.is_prepared() && image_state() != IMAGE_LEGACY && verify_image();
+				
 				default:
 					return false;
 			}
@@ -270,6 +317,21 @@ bool normal_boot() {
 		return false;
 	}
 	
+	// An image written since the last boot is checked against its trailer
+	// after the clock switch, see main(). Later boots only read the trailer.
+	switch(image_state()) {
+		case IMAGE_LEGACY:
+		case IMAGE_VERIFIED:
+			break;
+		
+		case IMAGE_INVALID:
+			return false;
+		
+		case IMAGE_UNVERIFIED:
+			verify_pending = true;
+			return false;
+	}
+	
 	// No reason to enter bootloader.
 	return true;
 }
@@ -293,6 +355,17 @@ int main() {
 	
 	rcc_init();
 	
+	RCC.AHBENR |= 1 << 6; // CRCEN
+	
+	// At 72 MHz the CRC of a full image takes a couple of ms, against about
+	// 10 ms on the 8 MHz reset clock. The firmware expects to start from
+	// reset, so a good image is booted by resetting again, once it is marked
+	// verified; otherwise every boot would check it.
+	if(verify_pending && verify_image() && image_state() == IMAGE_VERIFIED) {
+		reset();
+		while(1);
+	}
+	
 	// Initialize system timer.
 	STK.LOAD = 72000000 / 8 / 1000; // 1000 Hz.
 	STK.CTRL = 0x03;
@@ -310,9 +383,29 @@ int main() {
 	usb_pu.on();
 	
 	
+	flash_status_t last_status = {0xff};
+	uint32_t last_status_time = 0;
+	
 	while(1) {
 		usb.process();
 		
+		flashloader.process();
+		
+		// Report flash status on change, and every 100ms.
+		flash_status_t status = flashloader.status();
+		if(usb.ep_ready(1) && (
+			status.flags != last_status.flags ||
+			status.pages_received != last_status.pages_received ||
+			status.pages_written != last_status.pages_written ||
+			status.crc_page != last_status.crc_page ||
+			status.crc != last_status.crc ||
+			Time::time() - last_status_time >= 100)) {
+			
+			usb.write(1, (uint32_t*)&status, sizeof(status));
+			last_status = status;
+			last_status_time = Time::time();
+		}
+		
 		if(do_reset) {
 			Time::sleep(10);
 			reset();
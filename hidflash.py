@@ -2,8 +2,84 @@
 
 from hidapi import hidapi
 from elftools.elf.elffile import ELFFile
+from lzpack import compress_pages
 
-import ctypes, time, sys
+import ctypes, time, struct, sys, zlib
+
+PAGE_SIZE = 2048
+
+# Pages the bootloader can hold while it is programming, see flash_status_t
+PAGE_BUFFERS = 2
+
+STATUS_ERROR = 0x80
+
+# Function codes taking a page number in the low 6 bits
+FUNC_SEEK = 0x40
+FUNC_PAGE_CRC = 0x80
+
+FUNC_VERIFY = 0x23
+
+# Image trailer in the last 16 bytes of the firmware region, see arcin.ld
+TRAILER_ADDRESS = 0x801e7f0
+TRAILER_MAGIC = 0x4e435241
+TRAILER_PAGE = (TRAILER_ADDRESS - 0x8002000) // PAGE_SIZE
+TRAILER_OFFSET = (TRAILER_ADDRESS - 0x8002000) % PAGE_SIZE
+
+def read_status(dev, timeout):
+	'''Returns the newest (flags, pages_received, pages_written, crc_page, crc)
+	status report, or None if none arrived within timeout milliseconds.
+	crc_page is None for bootloaders without CRC queries.'''
+	data = ctypes.create_string_buffer(8)
+	status = None
+	
+	while True:
+		length = hidapi.hid_read_timeout(dev, data, 8, timeout)
+		if length < 3:
+			return status
+		
+		raw = bytearray(data.raw)
+		if length >= 8:
+			crc = raw[4] | (raw[5] << 8) | (raw[6] << 16) | (raw[7] << 24)
+			status = (raw[0], raw[1], raw[2], raw[3], crc)
+		else:
+			status = (raw[0], raw[1], raw[2], None, None)
+		timeout = 0
+
+def wait_written(dev, status, queued, in_flight):
+	'''Waits until no more than in_flight of the queued pages are still being
+	programmed, returns the newest status.'''
+	wait_start = time.time()
+	while (queued - status[2]) & 0xff > in_flight:
+		status = read_status(dev, 1000) or status
+		
+		if status[0] & STATUS_ERROR:
+			raise RuntimeError('Programming failed.')
+		
+		if time.time() - wait_start > 5:
+			raise RuntimeError('Timed out waiting for the bootloader.')
+	
+	return status
+
+def send_function(dev, func, error):
+	if hidapi.hid_send_feature_report(dev, ctypes.c_char_p('\x00' + chr(func)), 2) != 2:
+		raise RuntimeError(error)
+
+def query_crc(dev, page):
+	'''Returns the bootloader's CRC-32 of a firmware page.'''
+	read_status(dev, 0)
+	send_function(dev, FUNC_PAGE_CRC | page, 'CRC query failed.')
+	
+	deadline = time.time() + 1
+	while time.time() < deadline:
+		status = read_status(dev, 200)
+		if status and status[3] == page:
+			return status[4]
+	
+	raise RuntimeError('CRC query timed out.')
+
+if len(sys.argv) < 2:
+	print 'Usage: %s firmware.elf [--full] [--raw]' % sys.argv[0]
+	sys.exit(1)
 
 e = ELFFile(open(sys.argv[1]))
 
@@ -56,21 +132,136 @@ if not dev:
 
 print 'Found bootloader device, starting flashing.'
 
-# Prepare
-if hidapi.hid_send_feature_report(dev, ctypes.c_char_p('\x00\x20'), 2) != 2:
+# Prepare, compressed if the bootloader supports it
+compressed = '--raw' not in sys.argv[2:] and \
+	hidapi.hid_send_feature_report(dev, ctypes.c_char_p('\x00\x22'), 2) == 2
+
+if not compressed and hidapi.hid_send_feature_report(dev, ctypes.c_char_p('\x00\x20'), 2) != 2:
 	raise RuntimeError('Prepare failed.')
 
+# Older bootloaders do not send status reports and block on every write instead.
+status = read_status(dev, 500)
+flow_control = status is not None
+
+if not flow_control:
+	print 'Bootloader has no flow control, flashing one report at a time.'
+
+start = time.time()
+
+pages = [buf[i:i + PAGE_SIZE] for i in range(0, len(buf), PAGE_SIZE)]
+
+# Bootloaders that can seek also check the image trailer, which is written
+# last. Pages that are None are not sent.
+trailer = flow_control and status[3] is not None
+
+if trailer:
+	if len(buf) > TRAILER_ADDRESS - 0x8002000:
+		raise RuntimeError('Image overlaps the trailer.')
+	
+	pages += [None] * (TRAILER_PAGE + 1 - len(pages))
+	pages[TRAILER_PAGE] = (pages[TRAILER_PAGE] or '').ljust(TRAILER_OFFSET, '\xff') + \
+		struct.pack('<IIIHH', TRAILER_MAGIC, len(buf), zlib.crc32(buf) & 0xffffffff, 0xffff, 0xffff)
+
+unchanged = set(index for index, page in enumerate(pages) if page is None)
+
+# Skip pages that are already on the device. The tail of a partial last page
+# is erased flash. The trailer page is always rewritten, since preparing
+# invalidated it.
+if trailer and '--full' not in sys.argv[2:]:
+	for index, page in enumerate(pages):
+		if page is None or index == TRAILER_PAGE:
+			continue
+		
+		crc = zlib.crc32(page + '\xff' * (PAGE_SIZE - len(page))) & 0xffffffff
+		if query_crc(dev, index) == crc:
+			unchanged.add(index)
+	
+	sent = [index for index, page in enumerate(pages) if page is not None]
+	print '%d of %d pages unchanged.' % (len(unchanged.intersection(sent)), len(sent))
+
+# Each run of changed pages is one compressed stream, split so that every page
+# starts in a new report. The bootloader restarts the stream on every seek.
+chunks = {}
+if compressed:
+	index = 0
+	while index < len(pages):
+		if index in unchanged:
+			index += 1
+			continue
+		
+		# A partial page ends the run, the next page starts on a seek.
+		end = index
+		while end < len(pages) and end not in unchanged:
+			end += 1
+			if len(pages[end - 1]) < PAGE_SIZE:
+				break
+		
+		for offset, chunk in enumerate(compress_pages(''.join(pages[index:end]), PAGE_SIZE)):
+			chunks[index + offset] = str(chunk)
+		index = end
+	
+	sent = sum(len(chunk) for chunk in chunks.values())
+	total = sum(len(pages[index]) for index in chunks)
+	print 'Sending %d bytes compressed to %d.' % (total, sent)
+
+# The bootloader rejects seeking without a free page buffer. A partial page is
+# only queued by the next seek, or by finishing.
+next_index = 0
+pages_queued = 0
+partial = False
+
 # Flash
-while buf:
-	if hidapi.hid_write(dev, ctypes.c_char_p('\x00' + buf[:64]), 65) != 65:
-		raise RuntimeError('Writing failed.')
-	buf = buf[64:]
+for index, page in enumerate(pages):
+	if index in unchanged:
+		continue
+	
+	if index != next_index:
+		if flow_control:
+			status = wait_written(dev, status, pages_queued, PAGE_BUFFERS - 1)
+		send_function(dev, FUNC_SEEK | index, 'Seek failed.')
+		pages_queued += partial
+		partial = False
+	
+	# Wait until the bootloader has a free page buffer.
+	if flow_control:
+		status = wait_written(dev, status, pages_queued, PAGE_BUFFERS - 1)
+	
+	if compressed:
+		# length byte, then up to 63 bytes of the stream
+		chunk = chunks[index]
+		reports = []
+		while chunk:
+			reports.append(chr(len(chunk[:63])) + chunk[:63].ljust(63, '\0'))
+			chunk = chunk[63:]
+	else:
+		reports = [page[i:i + 64] for i in range(0, len(page), 64)]
+	
+	for report in reports:
+		if hidapi.hid_write(dev, ctypes.c_char_p('\x00' + report), 65) != 65:
+			raise RuntimeError('Writing failed.')
+	
+	# The image is padded to whole reports.
+	if len(page) < PAGE_SIZE:
+		partial = True
+		next_index = None
+	else:
+		pages_queued += 1
+		next_index = index + 1
+
+# Finish. The bootloader programs queued pages before finishing, waiting here
+# reports programming errors and timeouts the same way as above.
+if flow_control:
+	status = wait_written(dev, status, pages_queued, 0)
 
-# Finish
 if hidapi.hid_send_feature_report(dev, ctypes.c_char_p('\x00\x21'), 2) != 2:
 	raise RuntimeError('Finish failed.')
 
-print 'Flashing finished, resetting to runtime.'
+# Check the whole image against the trailer on the device.
+if trailer:
+	send_function(dev, FUNC_VERIFY, 'Verification failed.')
+	print 'Image verified.'
+
+print 'Flashing finished in %.1f s, resetting to runtime.' % (time.time() - start)
 
 # Reset
 if hidapi.hid_send_feature_report(dev, ctypes.c_char_p('\x00\x11'), 2) != 2:
@@ -0,0 +1,308 @@
+#ifndef ARCIN_HOST_FASTLED_H
+#define ARCIN_HOST_FASTLED_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Stands in for FastLED when the LED effect sources are built for the host.
+// Only the part the effects use is here: the portable C versions of FastLED's
+// 8/16-bit math (with FASTLED_SCALE8_FIXED and FASTLED_BLEND_FIXED, the
+// defaults), CRGB, CHSV with the rainbow conversion, random8 and the 16-entry
+// palettes. Nothing is written to a strip.
+
+typedef uint16_t accum88;
+typedef uint16_t fract16;
+
+inline uint8_t qadd8(uint8_t i, uint8_t j) {
+    unsigned int t = i + j;
+    return (t > 255) ? 255 : t;
+}
+
+inline uint8_t qsub8(uint8_t i, uint8_t j) {
+    int t = i - j;
+    return (t < 0) ? 0 : t;
+}
+
+inline uint8_t scale8(uint8_t i, uint8_t scale) {
+    return ((uint16_t)i * (1 + (uint16_t)scale)) >> 8;
+}
+
+inline uint8_t scale8_video(uint8_t i, uint8_t scale) {
+    return (((int)i * (int)scale) >> 8) + ((i && scale) ? 1 : 0);
+}
+
+inline uint16_t scale16(uint16_t i, uint16_t scale) {
+    return ((uint32_t)i * (1 + (uint32_t)scale)) / 65536;
+}
+
+inline uint8_t blend8(uint8_t a, uint8_t b, uint8_t amount_of_b) {
+    uint16_t partial = (a << 8) | b;
+    partial += b * amount_of_b;
+    partial -= a * amount_of_b;
+    return partial >> 8;
+}
+
+inline uint16_t lerp16by16(uint16_t a, uint16_t b, uint16_t frac) {
+    if (b > a) {
+        return a + scale16(b - a, frac);
+    }
+    return a - scale16(a - b, frac);
+}
+
+inline int16_t sin16(uint16_t theta) {
+    static const uint16_t base[] = {0, 6393, 12539, 18204, 23170, 27245, 30273, 32137};
+    static const uint8_t slope[] = {49, 48, 44, 38, 31, 23, 14, 4};
+
+    uint16_t offset = (theta & 0x3FFF) >> 3;
+    if (theta & 0x4000) {
+        offset = 2047 - offset;
+    }
+
+    uint8_t section = offset / 256;
+    uint8_t secoffset8 = (uint8_t)offset / 2;
+    int16_t y = slope[section] * secoffset8 + base[section];
+    if (theta & 0x8000) {
+        y = -y;
+    }
+    return y;
+}
+
+inline uint8_t sin8(uint8_t theta) {
+    static const uint8_t b_m16_interleave[] = {0, 49, 49, 41, 90, 27, 117, 10};
+
+    uint8_t offset = theta;
+    if (theta & 0x40) {
+        offset = 255 - offset;
+    }
+    offset &= 0x3F;
+
+    uint8_t secoffset = offset & 0x0F;
+    if (theta & 0x40) {
+        secoffset++;
+    }
+
+    const uint8_t* p = b_m16_interleave + (offset >> 4) * 2;
+    uint8_t mx = (p[1] * secoffset) >> 4;
+    int8_t y = mx + p[0];
+    if (theta & 0x80) {
+        y = -y;
+    }
+    return y + 128;
+}
+
+inline uint8_t triwave8(uint8_t in) {
+    if (in & 0x80) {
+        in = 255 - in;
+    }
+    return in << 1;
+}
+
+inline uint8_t ease8InOutQuad(uint8_t i) {
+    uint8_t j = (i & 0x80) ? 255 - i : i;
+    uint8_t jj2 = scale8(j, j) << 1;
+    return (i & 0x80) ? 255 - jj2 : jj2;
+}
+
+inline uint8_t quadwave8(uint8_t in) {
+    return ease8InOutQuad(triwave8(in));
+}
+
+// FastLED's one global generator
+extern uint16_t rand16seed;
+
+inline uint16_t random16() {
+    rand16seed = rand16seed * 2053 + 13849;
+    return rand16seed;
+}
+
+inline uint8_t random8() {
+    random16();
+    return (uint8_t)((uint8_t)(rand16seed & 0xFF) + (uint8_t)(rand16seed >> 8));
+}
+
+inline uint8_t random8(uint8_t lim) {
+    return (random8() * lim) >> 8;
+}
+
+inline uint8_t random8(uint8_t min, uint8_t lim) {
+    return random8(lim - min) + min;
+}
+
+inline void random16_set_seed(uint16_t seed) {
+    rand16seed = seed;
+}
+
+inline void random16_add_entropy(uint16_t entropy) {
+    rand16seed += entropy;
+}
+
+struct CRGB;
+
+struct CHSV {
+    uint8_t hue;
+    uint8_t sat;
+    uint8_t val;
+
+    CHSV() {}
+    CHSV(uint8_t hue, uint8_t sat, uint8_t val) : hue(hue), sat(sat), val(val) {}
+};
+
+void hsv2rgb_rainbow(const CHSV& hsv, CRGB& rgb);
+
+struct CRGB {
+    union {
+        struct {
+            uint8_t red;
+            uint8_t green;
+            uint8_t blue;
+        };
+        uint8_t raw[3];
+    };
+
+    typedef enum {
+        Black = 0x000000,
+        Blue = 0x0000FF,
+        DarkBlue = 0x00008B,
+        DarkGreen = 0x006400,
+        DarkOliveGreen = 0x556B2F,
+        DarkOrange = 0xFF8C00,
+        DimGray = 0x696969,
+        ForestGreen = 0x228B22,
+        Gold = 0xFFD700,
+        Gray = 0x808080,
+        Green = 0x008000,
+        LightBlue = 0xADD8E6,
+        LightYellow = 0xFFFFE0,
+        OliveDrab = 0x6B8E23,
+        Red = 0xFF0000,
+        SkyBlue = 0x87CEEB,
+        White = 0xFFFFFF,
+        Yellow = 0xFFFF00,
+    } HTMLColorCode;
+
+    CRGB() {}
+    CRGB(uint8_t r, uint8_t g, uint8_t b) : red(r), green(g), blue(b) {}
+    CRGB(uint32_t code) : red(code >> 16), green(code >> 8), blue(code) {}
+    CRGB(HTMLColorCode code) : CRGB((uint32_t)code) {}
+
+    CRGB(const CHSV& hsv) {
+        hsv2rgb_rainbow(hsv, *this);
+    }
+
+    CRGB& operator=(const CHSV& hsv) {
+        hsv2rgb_rainbow(hsv, *this);
+        return *this;
+    }
+
+    uint8_t& operator[](uint8_t x) {
+        return raw[x];
+    }
+
+    const uint8_t& operator[](uint8_t x) const {
+        return raw[x];
+    }
+
+    CRGB& operator+=(const CRGB& rhs) {
+        red = qadd8(red, rhs.red);
+        green = qadd8(green, rhs.green);
+        blue = qadd8(blue, rhs.blue);
+        return *this;
+    }
+
+    CRGB& operator|=(const CRGB& rhs) {
+        if (rhs.red > red) red = rhs.red;
+        if (rhs.green > green) green = rhs.green;
+        if (rhs.blue > blue) blue = rhs.blue;
+        return *this;
+    }
+
+    CRGB& nscale8(uint8_t scale) {
+        red = scale8(red, scale);
+        green = scale8(green, scale);
+        blue = scale8(blue, scale);
+        return *this;
+    }
+
+    CRGB& nscale8_video(uint8_t scale) {
+        red = scale8_video(red, scale);
+        green = scale8_video(green, scale);
+        blue = scale8_video(blue, scale);
+        return *this;
+    }
+
+    CRGB& fadeToBlackBy(uint8_t fade) {
+        return nscale8(255 - fade);
+    }
+
+    uint8_t getAverageLight() const {
+        return scale8(red, 85) + scale8(green, 85) + scale8(blue, 85);
+    }
+};
+
+inline bool operator==(const CRGB& a, const CRGB& b) {
+    return a.red == b.red && a.green == b.green && a.blue == b.blue;
+}
+
+inline bool operator!=(const CRGB& a, const CRGB& b) {
+    return !(a == b);
+}
+
+inline CRGB& nblend(CRGB& existing, const CRGB& overlay, uint8_t amount) {
+    if (amount == 0) {
+        return existing;
+    }
+    if (amount == 255) {
+        existing = overlay;
+        return existing;
+    }
+
+    existing.red = blend8(existing.red, overlay.red, amount);
+    existing.green = blend8(existing.green, overlay.green, amount);
+    existing.blue = blend8(existing.blue, overlay.blue, amount);
+    return existing;
+}
+
+inline void fill_solid(CRGB* leds, int num_leds, const CRGB& color) {
+    for (int i = 0; i < num_leds; i++) {
+        leds[i] = color;
+    }
+}
+
+#define TypicalLEDStrip 0xFFB0F0
+
+// Flash is just memory on the host
+#define FL_PROGMEM
+#define FL_PGM_READ_BYTE_NEAR(x) (*(const uint8_t*)(x))
+#define FL_PGM_READ_DWORD_NEAR(x) (*(const uint32_t*)(x))
+
+typedef uint32_t TProgmemRGBPalette16[16];
+typedef uint8_t TProgmemRGBGradientPalette_byte;
+typedef const TProgmemRGBGradientPalette_byte* TProgmemRGBGradientPalette_bytes;
+
+#define DEFINE_GRADIENT_PALETTE(name) \
+    extern const TProgmemRGBGradientPalette_byte name[] FL_PROGMEM =
+#define DECLARE_GRADIENT_PALETTE(name) \
+    extern const TProgmemRGBGradientPalette_byte name[] FL_PROGMEM
+
+extern const TProgmemRGBPalette16 CloudColors_p;
+extern const TProgmemRGBPalette16 PartyColors_p;
+extern const TProgmemRGBPalette16 RainbowColors_p;
+
+typedef enum {
+    NOBLEND = 0,
+    LINEARBLEND = 1,
+} TBlendType;
+
+struct CRGBPalette16 {
+    CRGB entries[16];
+
+    const CRGB& operator[](uint8_t x) const {
+        return entries[x];
+    }
+};
+
+CRGB ColorFromPalette(
+    const CRGBPalette16& pal, uint8_t index, uint8_t brightness = 255,
+    TBlendType blend_type = LINEARBLEND);
+
+#endif
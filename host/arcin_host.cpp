@@ -0,0 +1,556 @@
+#include "arcin_host.h"
+#include "image.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string.h>
+#include <thread>
+
+#define PROFILE_MAGIC "ARCNPRF1"
+#define TRACE_MAGIC "ARCNTRC1"
+
+using std::chrono::steady_clock;
+
+void Profile::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    uint32_t sizes[2] = {sizeof(config), sizeof(config_ext)};
+
+    out.write(PROFILE_MAGIC, 8);
+    out.write((const char*)sizes, sizeof(sizes));
+    out.write((const char*)&config, sizeof(config));
+    out.write((const char*)&config_ext, sizeof(config_ext));
+
+    if (!out) {
+        throw ArcinError("cannot write " + path);
+    }
+}
+
+Profile Profile::load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[8];
+    uint32_t sizes[2];
+
+    in.read(magic, sizeof(magic));
+    in.read((char*)sizes, sizeof(sizes));
+    if (!in || memcmp(magic, PROFILE_MAGIC, 8) != 0) {
+        throw ArcinError(path + " is not a profile");
+    }
+
+    // Profiles from older or newer tools: missing settings stay zero.
+    Profile profile;
+    memset(&profile, 0, sizeof(profile));
+
+    std::vector<char> config(sizes[0]), config_ext(sizes[1]);
+    in.read(config.data(), config.size());
+    in.read(config_ext.data(), config_ext.size());
+    if (!in) {
+        throw ArcinError(path + " is truncated");
+    }
+
+    memcpy(&profile.config, config.data(), std::min(config.size(), sizeof(profile.config)));
+    memcpy(&profile.config_ext, config_ext.data(), std::min(config_ext.size(), sizeof(profile.config_ext)));
+
+    return profile;
+}
+
+void Trace::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    uint32_t sizes[4] = {
+        sizeof(header), sizeof(config), sizeof(config_ext), (uint32_t)samples.size()};
+
+    out.write(TRACE_MAGIC, 8);
+    out.write((const char*)sizes, sizeof(sizes));
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)&config, sizeof(config));
+    out.write((const char*)&config_ext, sizeof(config_ext));
+    out.write((const char*)samples.data(), samples.size() * sizeof(input_trace_sample_t));
+    out.write((const char*)times.data(), times.size() * sizeof(uint32_t));
+
+    if (!out) {
+        throw ArcinError("cannot write " + path);
+    }
+}
+
+Trace Trace::load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[8];
+    uint32_t sizes[4];
+
+    in.read(magic, sizeof(magic));
+    in.read((char*)sizes, sizeof(sizes));
+    if (!in || memcmp(magic, TRACE_MAGIC, 8) != 0) {
+        throw ArcinError(path + " is not an input trace");
+    }
+
+    // Same rule as profiles: missing settings stay zero.
+    Trace trace;
+    memset(&trace.header, 0, sizeof(trace.header));
+    memset(&trace.config, 0, sizeof(trace.config));
+    memset(&trace.config_ext, 0, sizeof(trace.config_ext));
+
+    std::vector<char> header(sizes[0]), config(sizes[1]), config_ext(sizes[2]);
+    trace.samples.resize(sizes[3]);
+    trace.times.resize(sizes[3]);
+
+    in.read(header.data(), header.size());
+    in.read(config.data(), config.size());
+    in.read(config_ext.data(), config_ext.size());
+    in.read((char*)trace.samples.data(), trace.samples.size() * sizeof(input_trace_sample_t));
+    in.read((char*)trace.times.data(), trace.times.size() * sizeof(uint32_t));
+    if (!in) {
+        throw ArcinError(path + " is truncated");
+    }
+
+    memcpy(&trace.header, header.data(), std::min(header.size(), sizeof(trace.header)));
+    memcpy(&trace.config, config.data(), std::min(config.size(), sizeof(trace.config)));
+    memcpy(&trace.config_ext, config_ext.data(), std::min(config_ext.size(), sizeof(trace.config_ext)));
+
+    return trace;
+}
+
+Controller::Controller(std::unique_ptr<Transport> transport) : transport(std::move(transport)) {}
+
+// [Runtime]
+
+void Controller::write_segment(uint8_t segment, const uint8_t* data, uint8_t size) {
+    config_report_t report;
+    memset(&report, 0, sizeof(report));
+    report.report_id = CONFIG_REPORT_ID;
+    report.segment = segment;
+    report.size = size;
+    memcpy(report.data, data, std::min<size_t>(size, sizeof(report.data)));
+
+    if (transport->send_feature_report((uint8_t*)&report, sizeof(report)) < 0) {
+        throw ArcinError(name() + ": writing config segment " + std::to_string(segment) + " failed");
+    }
+}
+
+void Controller::read_segment(uint8_t segment, uint8_t* data) {
+    // An empty write selects the segment to read.
+    write_segment(segment, nullptr, 0);
+    read_selected(segment, data);
+}
+
+void Controller::read_selected(uint8_t segment, uint8_t* data) {
+    config_report_t report;
+    memset(&report, 0, sizeof(report));
+    report.report_id = CONFIG_REPORT_ID;
+
+    if (transport->get_feature_report((uint8_t*)&report, sizeof(report)) < (int)sizeof(report)) {
+        throw ArcinError(name() + ": reading config segment " + std::to_string(segment) + " failed");
+    }
+
+    memcpy(data, report.data, sizeof(report.data));
+}
+
+config_t Controller::read_config() {
+    config_t config;
+    read_segment(0, (uint8_t*)&config);
+    return config;
+}
+
+void Controller::write_config(const config_t& config) {
+    write_segment(0, (const uint8_t*)&config, sizeof(config));
+}
+
+config_ext_t Controller::read_config_ext() {
+    config_ext_t config_ext;
+
+    for (uint8_t i = 0; i < sizeof(config_ext) / CONFIG_SEGMENT_SIZE; i++) {
+        read_segment(i + 1, (uint8_t*)&config_ext + i * CONFIG_SEGMENT_SIZE);
+    }
+
+    return config_ext;
+}
+
+void Controller::write_config_ext(const config_ext_t& config_ext) {
+    for (uint8_t i = 0; i < sizeof(config_ext) / CONFIG_SEGMENT_SIZE; i++) {
+        write_segment(i + 1, (const uint8_t*)&config_ext + i * CONFIG_SEGMENT_SIZE, CONFIG_SEGMENT_SIZE);
+    }
+}
+
+Profile Controller::read_profile() {
+    Profile profile;
+    profile.config = read_config();
+    profile.config_ext = read_config_ext();
+    return profile;
+}
+
+void Controller::write_profile(const Profile& profile) {
+    write_config(profile.config);
+    write_config_ext(profile.config_ext);
+}
+
+void Controller::reset() {
+    uint8_t report[2] = {BOOTLOADER_REPORT_ID, RUNTIME_FUNC_RESET};
+    if (transport->send_feature_report(report, sizeof(report)) < 0) {
+        throw ArcinError(name() + ": reset failed");
+    }
+}
+
+void Controller::reset_to_bootloader() {
+    uint8_t report[2] = {BOOTLOADER_REPORT_ID, RUNTIME_FUNC_RESET_BOOTLOADER};
+    if (transport->send_feature_report(report, sizeof(report)) < 0) {
+        throw ArcinError(name() + ": reset to bootloader failed");
+    }
+}
+
+size_t Controller::stream_inputs(
+    std::chrono::milliseconds duration,
+    const std::function<bool(const InputSample&)>& on_sample) {
+
+    steady_clock::time_point end = steady_clock::now() + duration;
+    size_t count = 0;
+
+    while (steady_clock::now() < end) {
+        uint8_t data[64];
+        int timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - steady_clock::now()).count();
+        int length = transport->read(data, sizeof(data), std::max(timeout, 0));
+
+        if (length < 0) {
+            throw ArcinError(name() + ": reading input reports failed");
+        }
+        if (length < (int)sizeof(input_report_t) || data[0] != INPUT_REPORT_ID) {
+            continue;
+        }
+
+        input_report_t report;
+        memcpy(&report, data, sizeof(report));
+
+        InputSample sample = {steady_clock::now(), report.buttons, report.axis_x, report.axis_y};
+        count++;
+
+        if (!on_sample(sample)) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+LatencyStats Controller::measure_latency(int count) {
+    std::vector<double> samples;
+    uint8_t data[CONFIG_SEGMENT_SIZE];
+
+    for (int i = 0; i < count; i++) {
+        steady_clock::time_point start = steady_clock::now();
+        read_segment(0, data);
+        samples.push_back(
+            std::chrono::duration<double, std::micro>(steady_clock::now() - start).count());
+    }
+
+    LatencyStats stats = {count, 0, 0, 0, 0};
+    if (samples.empty()) {
+        return stats;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    stats.min_us = samples.front();
+    stats.max_us = samples.back();
+    stats.p99_us = samples[(samples.size() - 1) * 99 / 100];
+    for (double s : samples) {
+        stats.mean_us += s / samples.size();
+    }
+
+    return stats;
+}
+
+void Controller::start_trace() {
+    input_trace_control_t control = {INPUT_TRACE_CONTROL_START};
+    write_segment(INPUT_TRACE_SEGMENT_CONTROL, (const uint8_t*)&control, sizeof(control));
+}
+
+Trace Controller::download_trace() {
+    Trace trace;
+
+    input_trace_control_t control = {INPUT_TRACE_CONTROL_STOP};
+    write_segment(INPUT_TRACE_SEGMENT_CONTROL, (const uint8_t*)&control, sizeof(control));
+
+    uint8_t data[CONFIG_SEGMENT_SIZE];
+    read_segment(INPUT_TRACE_SEGMENT_CONTROL, data);
+    memcpy(&trace.header, data, sizeof(trace.header));
+    if (trace.header.version != INPUT_TRACE_VERSION) {
+        throw ArcinError(name() + ": firmware does not record input traces");
+    }
+
+    while (trace.samples.size() < trace.header.count) {
+        uint16_t index = trace.samples.size();
+        write_segment(INPUT_TRACE_SEGMENT_READ, (const uint8_t*)&index, sizeof(index));
+        read_selected(INPUT_TRACE_SEGMENT_READ, data);
+
+        input_trace_chunk_t chunk;
+        memcpy(&chunk, data, sizeof(chunk));
+        if (chunk.index != index || chunk.count == 0 || chunk.count > INPUT_TRACE_CHUNK_SAMPLES) {
+            throw ArcinError(name() + ": reading input trace failed");
+        }
+        trace.samples.insert(trace.samples.end(), chunk.samples, chunk.samples + chunk.count);
+    }
+    trace.samples.resize(trace.header.count);
+
+    // Sample times are 16 bits, with at most INPUT_TRACE_KEYFRAME_MS between
+    // samples. Unwrap them backwards from the last one.
+    trace.times.resize(trace.samples.size());
+    uint32_t time = trace.header.last_sample_time;
+    for (size_t i = trace.samples.size(); i-- > 0;) {
+        trace.times[i] = time;
+        if (i > 0) {
+            time -= uint16_t(trace.samples[i].time - trace.samples[i - 1].time);
+        }
+    }
+
+    trace.config = read_config();
+    trace.config_ext = read_config_ext();
+
+    return trace;
+}
+
+// [Bootloader]
+
+int Controller::read_status(int timeout_ms, flash_status_t& status) {
+    uint8_t data[sizeof(flash_status_t)];
+    int found = 0;
+
+    // Keep the newest report.
+    while (true) {
+        int length = transport->read(data, sizeof(data), timeout_ms);
+        if (length < 3) {
+            return found;
+        }
+
+        memset(&status, 0, sizeof(status));
+        memcpy(&status, data, length);
+        found = length;
+        timeout_ms = 0;
+    }
+}
+
+void Controller::send_function(uint8_t func, const char* error) {
+    uint8_t report[2] = {0, func};
+    if (transport->send_feature_report(report, sizeof(report)) < 0) {
+        throw ArcinError(name() + ": " + error);
+    }
+}
+
+uint32_t Controller::query_crc(uint8_t page) {
+    flash_status_t status;
+    read_status(0, status);
+    send_function(BOOTLOADER_FUNC_PAGE_CRC | page, "CRC query failed");
+
+    steady_clock::time_point deadline = steady_clock::now() + std::chrono::seconds(1);
+    while (steady_clock::now() < deadline) {
+        if (read_status(200, status) && status.crc_page == page) {
+            return status.crc;
+        }
+    }
+
+    throw ArcinError(name() + ": CRC query timed out");
+}
+
+void Controller::boot() {
+    send_function(BOOTLOADER_FUNC_RESET, "reset failed");
+}
+
+// Same protocol as hidflash.py.
+FlashResult Controller::flash(const std::vector<uint8_t>& image, const FlashOptions& options) {
+    if (!is_bootloader()) {
+        throw ArcinError(name() + ": not in bootloader mode");
+    }
+
+    steady_clock::time_point start = steady_clock::now();
+    FlashResult result = {0, 0, 0, false, 0};
+
+    // Prepare, compressed if the bootloader supports it
+    uint8_t prepare[2] = {0, BOOTLOADER_FUNC_PREPARE_COMPRESSED};
+    bool compressed = options.compress && transport->send_feature_report(prepare, sizeof(prepare)) >= 0;
+    if (!compressed) {
+        send_function(BOOTLOADER_FUNC_PREPARE, "prepare failed");
+    }
+
+    // Older bootloaders do not send status reports and block on every write.
+    // Those that can seek also check the image trailer.
+    flash_status_t status;
+    int status_length = read_status(500, status);
+    bool flow_control = status_length > 0;
+    bool trailer = status_length >= (int)sizeof(flash_status_t);
+
+    // Pages by index; the trailer page is written last.
+    std::map<uint32_t, std::vector<uint8_t>> pages;
+    for (size_t i = 0; i < image.size(); i += FLASH_PAGE_SIZE) {
+        pages[i / FLASH_PAGE_SIZE].assign(
+            image.begin() + i, image.begin() + std::min(i + FLASH_PAGE_SIZE, image.size()));
+    }
+
+    uint32_t trailer_page = (IMAGE_TRAILER_ADDRESS - FIRMWARE_BASE) / FLASH_PAGE_SIZE;
+    uint32_t trailer_offset = (IMAGE_TRAILER_ADDRESS - FIRMWARE_BASE) % FLASH_PAGE_SIZE;
+
+    if (trailer) {
+        image_trailer_t t = {
+            IMAGE_TRAILER_MAGIC, (uint32_t)image.size(), crc32(image.data(), image.size()), 0xffff, 0xffff};
+
+        std::vector<uint8_t>& page = pages[trailer_page];
+        page.resize(trailer_offset, 0xff);
+        page.insert(page.end(), (uint8_t*)&t, (uint8_t*)&t + sizeof(t));
+    }
+
+    result.pages = pages.size();
+
+    // Skip pages that are already on the device. The trailer page is always
+    // rewritten, since preparing invalidated it.
+    if (trailer && options.diff) {
+        for (auto it = pages.begin(); it != pages.end();) {
+            std::vector<uint8_t> padded = it->second;
+            padded.resize(FLASH_PAGE_SIZE, 0xff);
+
+            if (it->first != trailer_page &&
+                query_crc(it->first) == crc32(padded.data(), padded.size())) {
+                it = pages.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Each run of consecutive pages is one compressed stream.
+    std::map<uint32_t, std::vector<uint8_t>> chunks;
+    if (compressed) {
+        for (auto it = pages.begin(); it != pages.end();) {
+            uint32_t first = it->first;
+            std::vector<uint8_t> run;
+
+            // A partial page ends the run, the next page starts on a seek.
+            uint32_t next = first;
+            while (it != pages.end() && it->first == next) {
+                run.insert(run.end(), it->second.begin(), it->second.end());
+                bool partial = it->second.size() < FLASH_PAGE_SIZE;
+                ++it;
+                next++;
+                if (partial) {
+                    break;
+                }
+            }
+
+            std::vector<std::vector<uint8_t>> compressed_pages = lz_compress_pages(run, FLASH_PAGE_SIZE);
+            for (size_t i = 0; i < compressed_pages.size(); i++) {
+                chunks[first + i] = compressed_pages[i];
+            }
+        }
+    }
+
+    // Waits until no more than in_flight of the queued pages are still being
+    // programmed. The bootloader rejects seeking without a free page buffer;
+    // it programs queued pages itself before finishing, but waiting reports
+    // errors and timeouts the same way.
+    auto wait_written = [&](uint8_t queued, uint8_t in_flight) {
+        steady_clock::time_point wait_start = steady_clock::now();
+        while (flow_control && (uint8_t)(queued - status.pages_written) > in_flight) {
+            read_status(1000, status);
+
+            if (status.flags & FLASH_STATUS_ERROR) {
+                throw ArcinError(name() + ": programming failed");
+            }
+            if (steady_clock::now() - wait_start > std::chrono::seconds(5)) {
+                throw ArcinError(name() + ": timed out waiting for the bootloader");
+            }
+        }
+    };
+
+    // A partial page is only queued by the next seek, or by finishing.
+    uint32_t next_index = 0;
+    uint8_t pages_queued = 0;
+    bool partial = false;
+
+    for (auto& page : pages) {
+        if (page.first != next_index) {
+            wait_written(pages_queued, FLASH_PAGE_BUFFERS - 1);
+            send_function(BOOTLOADER_FUNC_SEEK | page.first, "seek failed");
+            pages_queued += partial;
+            partial = false;
+        }
+
+        // Wait until the bootloader has a free page buffer.
+        wait_written(pages_queued, FLASH_PAGE_BUFFERS - 1);
+
+        std::vector<std::vector<uint8_t>> reports;
+        if (compressed) {
+            // length byte, then up to 63 bytes of the stream
+            const std::vector<uint8_t>& chunk = chunks[page.first];
+            for (size_t i = 0; i < chunk.size(); i += 63) {
+                size_t n = std::min<size_t>(63, chunk.size() - i);
+                std::vector<uint8_t> report(64, 0);
+                report[0] = n;
+                std::copy(chunk.begin() + i, chunk.begin() + i + n, report.begin() + 1);
+                reports.push_back(report);
+            }
+        } else {
+            for (size_t i = 0; i < page.second.size(); i += 64) {
+                reports.push_back(std::vector<uint8_t>(
+                    page.second.begin() + i, page.second.begin() + std::min(i + 64, page.second.size())));
+                reports.back().resize(64, 0);
+            }
+        }
+
+        for (auto& report : reports) {
+            report.insert(report.begin(), 0);
+            if (transport->write(report.data(), report.size()) != (int)report.size()) {
+                throw ArcinError(name() + ": writing failed");
+            }
+            result.bytes_sent += 64;
+        }
+
+        // Raw pages are padded to whole reports.
+        size_t received = compressed ? page.second.size() : reports.size() * 64;
+        if (received < FLASH_PAGE_SIZE) {
+            partial = true;
+            next_index = ~0u;
+        } else {
+            pages_queued++;
+            next_index = page.first + 1;
+        }
+        result.pages_sent++;
+
+        if (options.progress) {
+            options.progress(result.pages_sent, pages.size());
+        }
+    }
+
+    wait_written(pages_queued, 0);
+    send_function(BOOTLOADER_FUNC_FINISH, "finish failed");
+
+    // Check the whole image against the trailer on the device.
+    if (trailer) {
+        send_function(BOOTLOADER_FUNC_VERIFY, "verification failed");
+        result.verified = true;
+    }
+
+    result.seconds = std::chrono::duration<double>(steady_clock::now() - start).count();
+    return result;
+}
+
+std::vector<std::string> run_parallel(
+    std::vector<std::unique_ptr<Controller>>& controllers,
+    const std::function<void(Controller&)>& fn) {
+
+    std::vector<std::string> errors(controllers.size());
+    std::vector<std::thread> threads;
+
+    for (size_t i = 0; i < controllers.size(); i++) {
+        threads.push_back(std::thread([&, i]() {
+            try {
+                fn(*controllers[i]);
+            } catch (std::exception& e) {
+                errors[i] = e.what();
+                if (errors[i].empty()) {
+                    errors[i] = "failed";
+                }
+            }
+        }));
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return errors;
+}
@@ -0,0 +1,149 @@
+#ifndef ARCIN_HOST_H
+#define ARCIN_HOST_H
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "protocol.h"
+#include "transport.h"
+#include "input_trace.h"
+
+class ArcinError : public std::runtime_error {
+    public:
+        explicit ArcinError(const std::string& what) : std::runtime_error(what) {}
+};
+
+// Everything the configuration tool stores on the controller.
+struct Profile {
+    config_t config;
+    config_ext_t config_ext;
+
+    void save(const std::string& path) const;
+    static Profile load(const std::string& path);
+};
+
+// Raw inputs recorded by the firmware (see arcin/input_trace.h), with the
+// settings they were recorded with.
+struct Trace {
+    input_trace_header_t header;
+    config_t config;
+    config_ext_t config_ext;
+    std::vector<input_trace_sample_t> samples;
+    // full device time of each sample
+    std::vector<uint32_t> times;
+
+    void save(const std::string& path) const;
+    static Trace load(const std::string& path);
+};
+
+struct FlashOptions {
+    // use the bootloader's compressed transfer, if it has one
+    bool compress = true;
+    // skip pages whose CRC already matches
+    bool diff = true;
+    // called with (pages done, pages to send)
+    std::function<void(size_t, size_t)> progress;
+};
+
+struct FlashResult {
+    size_t pages;
+    size_t pages_sent;
+    size_t bytes_sent;
+    bool verified;
+    double seconds;
+};
+
+struct InputSample {
+    std::chrono::steady_clock::time_point time;
+    uint16_t buttons;
+    uint8_t axis_x;
+    uint8_t axis_y;
+};
+
+struct LatencyStats {
+    int count;
+    double min_us;
+    double mean_us;
+    double p99_us;
+    double max_us;
+};
+
+// One arcin, in runtime or bootloader mode. Errors are thrown as ArcinError.
+class Controller {
+    private:
+        std::unique_ptr<Transport> transport;
+
+        // Returns the length of the newest status report, 0 if none arrived.
+        int read_status(int timeout_ms, flash_status_t& status);
+        void send_function(uint8_t func, const char* error);
+        uint32_t query_crc(uint8_t page);
+
+        // Reads a segment that was selected by a write with data.
+        void read_selected(uint8_t segment, uint8_t* data);
+
+    public:
+        explicit Controller(std::unique_ptr<Transport> transport);
+
+        Transport& get_transport() {
+            return *transport;
+        }
+
+        std::string name() const {
+            return transport->name();
+        }
+
+        bool is_bootloader() const {
+            return transport->is_bootloader();
+        }
+
+        // [Runtime]
+
+        // Config segments are CONFIG_SEGMENT_SIZE bytes: 0 is config_t, 1 and
+        // up are config_ext_t. A written config_t only takes effect after
+        // reset().
+        void read_segment(uint8_t segment, uint8_t* data);
+        void write_segment(uint8_t segment, const uint8_t* data, uint8_t size);
+
+        config_t read_config();
+        void write_config(const config_t& config);
+        config_ext_t read_config_ext();
+        void write_config_ext(const config_ext_t& config_ext);
+
+        Profile read_profile();
+        void write_profile(const Profile& profile);
+
+        void reset();
+        void reset_to_bootloader();
+
+        // Calls on_sample for every input report until it returns false or
+        // duration has passed. Returns the number of reports.
+        size_t stream_inputs(
+            std::chrono::milliseconds duration,
+            const std::function<bool(const InputSample&)>& on_sample);
+
+        // Round trip time of config feature reports.
+        LatencyStats measure_latency(int count);
+
+        // Input trace recording. download_trace() stops recording first.
+        void start_trace();
+        Trace download_trace();
+
+        // [Bootloader]
+
+        FlashResult flash(const std::vector<uint8_t>& image, const FlashOptions& options = FlashOptions());
+
+        // Leaves the bootloader for the runtime.
+        void boot();
+};
+
+// Runs fn on every controller, each on its own thread. Returns one message per
+// controller, empty if fn returned normally.
+std::vector<std::string> run_parallel(
+    std::vector<std::unique_ptr<Controller>>& controllers,
+    const std::function<void(Controller&)>& fn);
+
+#endif
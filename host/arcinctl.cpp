@@ -0,0 +1,594 @@
+// Command line tool for one or many arcins; see BUILDING.md.
+
+#include <algorithm>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#include "arcin_host.h"
+#include "encoder_test.h"
+#include "image.h"
+#include "latency.h"
+#include "replay.h"
+#include "sim_device.h"
+
+static std::mutex print_lock;
+
+static void usage() {
+    fprintf(stderr,
+        "usage: arcinctl [--sim N] [--device PATH] COMMAND [ARGS]\n"
+        "\n"
+        "  list                        list controllers\n"
+        "  config                      show label and flags\n"
+        "  segment N                   dump config segment N\n"
+        "  profile-save FILE           save the first controller's settings\n"
+        "  profile-load FILE           write settings to every controller\n"
+        "  flash IMAGE [--raw] [--full]\n"
+        "                              flash every controller (ELF or binary)\n"
+        "  monitor [SECONDS]           stream input reports\n"
+        "  latency [COUNT]             time config feature report round trips\n"
+        "  trace-start                 start recording raw inputs\n"
+        "  trace-save FILE             stop recording and save the trace\n"
+        "  trace FILE [SECONDS]        record for a while, then save\n"
+        "  replay TRACE [--profile FILE] [--compare FILE]\n"
+        "                              run a trace through the input pipeline;\n"
+        "                              --compare shows where FILE's settings differ\n"
+        "  latency-sim [COUNT] [--profile FILE]\n"
+        "                              simulated input to report latency for\n"
+        "                              every polling and debounce mode\n"
+        "  latency-test [COUNT]        the same, measured with a test board\n"
+        "  tt-sim [--profile FILE]     encoder curves through the input pipeline\n"
+        "  tt-test                     check turntable tracking with a test board\n"
+        "\n"
+        "--sim N uses N simulated controllers instead of USB devices.\n");
+    exit(2);
+}
+
+static std::vector<std::unique_ptr<Controller>> open_controllers(
+    int sim_count, const std::string& device, bool bootloader_only) {
+
+    std::vector<std::unique_ptr<Controller>> controllers;
+
+    if (sim_count) {
+        for (int i = 0; i < sim_count; i++) {
+            controllers.emplace_back(new Controller(
+                std::unique_ptr<Transport>(new SimulatedArcin(i))));
+        }
+        return controllers;
+    }
+
+    for (const DeviceInfo& info : enumerate_devices()) {
+        if ((!device.empty() && info.path != device) ||
+            (bootloader_only && !info.bootloader)) {
+            continue;
+        }
+        controllers.emplace_back(new Controller(open_device(info)));
+    }
+
+    return controllers;
+}
+
+static int report_errors(
+    std::vector<std::unique_ptr<Controller>>& controllers,
+    const std::vector<std::string>& errors) {
+
+    int failed = 0;
+    for (size_t i = 0; i < errors.size(); i++) {
+        if (!errors[i].empty()) {
+            fprintf(stderr, "%s: %s\n", controllers[i]->name().c_str(), errors[i].c_str());
+            failed++;
+        }
+    }
+
+    if (controllers.size() > 1) {
+        printf("%zu of %zu controllers ok\n", controllers.size() - failed, controllers.size());
+    }
+    return failed ? 1 : 0;
+}
+
+static void print_config(Controller& controller) {
+    config_t config = controller.read_config();
+    char label[sizeof(config.label) + 1] = {0};
+    memcpy(label, config.label, sizeof(config.label));
+
+    std::lock_guard<std::mutex> guard(print_lock);
+    printf("%s: label \"%s\", flags 0x%08x, qe1_sens %d, debounce %d\n",
+        controller.name().c_str(), label, (unsigned)config.flags.AsUINT32,
+        config.qe1_sens, config.debounce_ticks);
+}
+
+static bool same_output(const ReplayFrame& a, const ReplayFrame& b) {
+    return memcmp(&a.report, &b.report, sizeof(a.report)) == 0 &&
+        memcmp(a.scancodes, b.scancodes, sizeof(a.scancodes)) == 0;
+}
+
+static void print_frame(const ReplayFrame& frame) {
+    printf("buttons 0x%04x tt %3d keys", frame.report.buttons, frame.report.axis_x);
+    for (uint8_t code : frame.scancodes) {
+        if (code) {
+            printf(" %02x", code);
+        }
+    }
+}
+
+static int replay(const std::vector<std::string>& args) {
+    Trace trace = Trace::load(args[1]);
+    std::string profile_path, compare_path;
+
+    for (size_t i = 2; i + 1 < args.size(); i += 2) {
+        if (args[i] == "--profile") {
+            profile_path = args[i + 1];
+        } else if (args[i] == "--compare") {
+            compare_path = args[i + 1];
+        } else {
+            usage();
+        }
+    }
+
+    std::vector<ReplayFrame> frames;
+    if (profile_path.empty()) {
+        frames = replay_trace(trace);
+    } else {
+        Profile profile = Profile::load(profile_path);
+        frames = replay_trace(trace, profile.config, profile.config_ext);
+    }
+
+    printf("%zu samples, %zu ms%s\n", trace.samples.size(), frames.size(),
+        (trace.header.flags & INPUT_TRACE_WRAPPED) ? ", start of the trace was dropped" : "");
+
+    if (compare_path.empty()) {
+        for (size_t i = 0; i < frames.size(); i++) {
+            if (i > 0 && same_output(frames[i], frames[i - 1]) && frames[i].raw == frames[i - 1].raw) {
+                continue;
+            }
+            printf("%8u ms: raw 0x%04x -> ", frames[i].time - frames[0].time, frames[i].raw);
+            print_frame(frames[i]);
+            printf("\n");
+        }
+        return 0;
+    }
+
+    Profile other = Profile::load(compare_path);
+    std::vector<ReplayFrame> other_frames = replay_trace(trace, other.config, other.config_ext);
+
+    size_t differ = 0;
+    bool last_same = true;
+    for (size_t i = 0; i < frames.size(); i++) {
+        bool same = same_output(frames[i], other_frames[i]);
+        if (!same) {
+            differ++;
+        }
+        // print where the outputs start or stop differing
+        if (same != last_same) {
+            printf("%8u ms: raw 0x%04x -> ", frames[i].time - frames[0].time, frames[i].raw);
+            print_frame(frames[i]);
+            printf(" | ");
+            print_frame(other_frames[i]);
+            printf("\n");
+        }
+        last_same = same;
+    }
+
+    printf("%zu of %zu ms differ\n", differ, frames.size());
+    return 0;
+}
+
+// Polling and debounce modes compared by latency-sim and latency-test
+struct LatencyMode {
+    bool poll_250hz;
+    // 0 for off
+    uint8_t debounce_ticks;
+};
+
+static const LatencyMode latency_modes[] = {
+    {false, 0}, {false, 3}, {false, 5}, {false, 10},
+    {true, 0}, {true, 3}, {true, 5}, {true, 10},
+};
+
+static void apply_latency_mode(config_t& config, const LatencyMode& mode) {
+    config.flags.PollAt250Hz = mode.poll_250hz;
+    config.flags.DebounceEnable = mode.debounce_ticks != 0;
+    if (mode.debounce_ticks) {
+        config.debounce_ticks = mode.debounce_ticks;
+    }
+}
+
+static void print_histogram(const char* name, const LatencyHistogram& histogram) {
+    std::vector<uint32_t> bins = histogram.bins();
+    uint32_t most = *std::max_element(bins.begin(), bins.end());
+
+    printf("  %s:\n", name);
+    for (size_t i = 0; i < bins.size(); i++) {
+        if (!bins[i]) {
+            continue;
+        }
+        printf("    %5zu us%s %6u ", i * LATENCY_BIN_US, (i + 1 == bins.size()) ? "+" : " ", bins[i]);
+        for (uint32_t n = 0; n < (bins[i] * 40 + most - 1) / most; n++) {
+            printf("#");
+        }
+        printf("\n");
+    }
+}
+
+static void print_latency(const LatencyMode& mode, const LatencyResult& result) {
+    static const char* const input_names[LATENCY_INPUTS] = {
+        "1", "2", "3", "4", "5", "6", "7", "8", "9", "start", "sel", "TT",
+    };
+
+    printf("%s Hz, debounce ", mode.poll_250hz ? "250" : "1000");
+    if (mode.debounce_ticks) {
+        printf("%u ms\n", mode.debounce_ticks);
+    } else {
+        printf("off\n");
+    }
+
+    printf("  %-5s %6s %6s %8s %8s %8s %8s\n", "input", "n", "missed", "min us", "mean us", "p99 us", "max us");
+    for (int i = 0; i < LATENCY_INPUTS; i++) {
+        const LatencyHistogram& h = result.inputs[i];
+        printf("  %-5s %6zu %6u %8u %8.0f %8u %8u\n", input_names[i], h.samples.size(), h.missed,
+            h.min(), h.mean(), h.percentile(99), h.max());
+    }
+
+    print_histogram("keys", result.keys());
+    print_histogram("turntable", result.inputs[LATENCY_INPUT_TT]);
+    printf("\n");
+}
+
+static int latency_sim(const std::vector<std::string>& args) {
+    int count = 20;
+    Profile profile;
+    memset(&profile, 0, sizeof(profile));
+    profile.config.flags.DigitalTTEnable = 1;
+
+    for (size_t i = 1; i < args.size(); i++) {
+        if (args[i] == "--profile" && i + 1 < args.size()) {
+            profile = Profile::load(args[++i]);
+        } else {
+            count = atoi(args[i].c_str());
+        }
+    }
+
+    std::vector<LatencyStimulus> script = latency_script(count, 1);
+
+    for (const LatencyMode& mode : latency_modes) {
+        config_t config = profile.config;
+        apply_latency_mode(config, mode);
+
+        // the firmware's ms clock is not tied to the frames
+        std::vector<LatencyArrival> arrivals = simulate_latency(config, profile.config_ext, script, 500);
+        print_latency(mode, correlate_latency(script, arrivals));
+    }
+
+    return 0;
+}
+
+// Writes config to the first controller and resets it, for the test board
+// commands.
+static void switch_config(
+    std::vector<std::unique_ptr<Controller>>& controllers,
+    int sim_count, const std::string& device, const config_t& config) {
+
+    controllers[0]->write_config(config);
+    controllers[0]->reset();
+
+    if (!sim_count) {
+        controllers.clear();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        controllers = open_controllers(sim_count, device, false);
+        if (controllers.empty()) {
+            throw ArcinError("the controller did not come back after a reset");
+        }
+    }
+}
+
+// Runs every mode on the first controller, whose inputs are wired to the test
+// board's outputs. Settings are restored afterwards.
+static int latency_test(
+    std::vector<std::unique_ptr<Controller>>& controllers,
+    int sim_count, const std::string& device, int count) {
+
+    std::unique_ptr<TestBoard> board = open_test_board();
+    if (!board) {
+        fprintf(stderr, "no test board found\n");
+        return 1;
+    }
+
+    config_t saved = controllers[0]->read_config();
+    std::vector<LatencyStimulus> script = latency_script(count, 1);
+
+    for (const LatencyMode& mode : latency_modes) {
+        config_t config = saved;
+        apply_latency_mode(config, mode);
+        switch_config(controllers, sim_count, device, config);
+
+        std::vector<LatencyStimulus> stimuli;
+        std::vector<LatencyArrival> arrivals;
+        measure_end_to_end(*controllers[0], *board, script, stimuli, arrivals);
+        print_latency(mode, correlate_latency(stimuli, arrivals));
+    }
+
+    switch_config(controllers, sim_count, device, saved);
+    return 0;
+}
+
+// Prints a line per case, returns whether it passed.
+static bool print_encoder(const EncoderCase& test, const EncoderResult& result) {
+    printf("%-24s axis %3d/%3d counts, lag %5.2f ms, end %s, tt %3u/%4u wrong  %s\n",
+        test.name, result.axis_error, result.axis_tolerance, result.lag_ms,
+        result.final_ok ? "ok " : "off", result.tt_wrong, result.tt_checked,
+        result.ok() ? "ok" : "FAIL");
+    return result.ok();
+}
+
+// Both the axis and the digital turntable in the report, one count per step.
+static void apply_encoder_settings(config_t& config) {
+    config.flags.DigitalTTEnable = 1;
+    config.flags.AnalogTTForceEnable = 1;
+    config.qe1_sens = 0;
+}
+
+static int tt_sim(const std::vector<std::string>& args) {
+    Profile profile;
+    memset(&profile, 0, sizeof(profile));
+
+    if (args.size() == 3 && args[1] == "--profile") {
+        profile = Profile::load(args[2]);
+    } else if (args.size() != 1) {
+        usage();
+    }
+    apply_encoder_settings(profile.config);
+
+    int failed = 0;
+    for (const EncoderCase& test : encoder_cases()) {
+        EncoderRun run = simulate_encoder(profile.config, profile.config_ext, test);
+        failed += !print_encoder(test, check_encoder(test, run));
+    }
+    return failed ? 1 : 0;
+}
+
+// Plays every case into the first controller. Settings are restored afterwards.
+static int tt_test(
+    std::vector<std::unique_ptr<Controller>>& controllers,
+    int sim_count, const std::string& device) {
+
+    std::unique_ptr<TestBoard> board = open_test_board();
+    if (!board) {
+        fprintf(stderr, "no test board found\n");
+        return 1;
+    }
+
+    Profile saved = controllers[0]->read_profile();
+    config_t config = saved.config;
+    apply_encoder_settings(config);
+    switch_config(controllers, sim_count, device, config);
+
+    int failed = 0;
+    for (const EncoderCase& test : encoder_cases()) {
+        EncoderRun run = measure_encoder(*controllers[0], *board, config, saved.config_ext, test);
+        failed += !print_encoder(test, check_encoder(test, run));
+    }
+
+    switch_config(controllers, sim_count, device, saved.config);
+    return failed ? 1 : 0;
+}
+
+static int flash(
+    std::vector<std::unique_ptr<Controller>>& controllers,
+    int sim_count, const std::string& device, const std::string& path,
+    const FlashOptions& options) {
+
+    std::vector<uint8_t> image = load_image(path);
+
+    // Runtime controllers reset to the bootloader and come back as new USB
+    // devices. Simulated ones switch in place.
+    bool reopen = false;
+    for (auto& controller : controllers) {
+        if (!controller->is_bootloader()) {
+            controller->reset_to_bootloader();
+            reopen = !sim_count;
+        }
+    }
+
+    if (reopen) {
+        controllers.clear();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        controllers = open_controllers(sim_count, device, true);
+    }
+
+    std::vector<std::string> errors = run_parallel(controllers, [&](Controller& controller) {
+        FlashResult result = controller.flash(image, options);
+        controller.boot();
+
+        std::lock_guard<std::mutex> guard(print_lock);
+        printf("%s: sent %zu of %zu pages (%zu bytes) in %.2f s%s\n",
+            controller.name().c_str(), result.pages_sent, result.pages,
+            result.bytes_sent, result.seconds, result.verified ? ", verified" : "");
+    });
+
+    return report_errors(controllers, errors);
+}
+
+int main(int argc, char** argv) {
+    int sim_count = 0;
+    std::string device;
+    std::vector<std::string> args;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--sim") && i + 1 < argc) {
+            sim_count = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--device") && i + 1 < argc) {
+            device = argv[++i];
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+
+    if (args.empty()) {
+        usage();
+    }
+
+    const std::string& command = args[0];
+
+    try {
+        // Replays run offline.
+        if (command == "replay") {
+            if (args.size() < 2) {
+                usage();
+            }
+            return replay(args);
+        }
+
+        if (command == "latency-sim") {
+            return latency_sim(args);
+        }
+
+        if (command == "tt-sim") {
+            return tt_sim(args);
+        }
+
+        std::vector<std::unique_ptr<Controller>> controllers =
+            open_controllers(sim_count, device, false);
+
+        if (controllers.empty()) {
+            fprintf(stderr, "no controllers found\n");
+            return 1;
+        }
+
+        if (command == "list") {
+            for (auto& controller : controllers) {
+                printf("%s%s\n", controller->name().c_str(),
+                    controller->is_bootloader() ? " (bootloader)" : "");
+            }
+            return 0;
+        }
+
+        if (command == "flash") {
+            if (args.size() < 2) {
+                usage();
+            }
+
+            FlashOptions options;
+            for (size_t i = 2; i < args.size(); i++) {
+                if (args[i] == "--raw") {
+                    options.compress = false;
+                } else if (args[i] == "--full") {
+                    options.diff = false;
+                } else {
+                    usage();
+                }
+            }
+
+            return flash(controllers, sim_count, device, args[1], options);
+        }
+
+        // Everything else talks to the runtime.
+        for (auto& controller : controllers) {
+            if (controller->is_bootloader()) {
+                fprintf(stderr, "%s is in bootloader mode\n", controller->name().c_str());
+                return 1;
+            }
+        }
+
+        if (command == "config") {
+            return report_errors(controllers, run_parallel(controllers, print_config));
+        }
+
+        if (command == "segment" && args.size() == 2) {
+            uint8_t data[CONFIG_SEGMENT_SIZE];
+            controllers[0]->read_segment(atoi(args[1].c_str()), data);
+
+            for (size_t i = 0; i < sizeof(data); i++) {
+                printf("%02x%s", data[i], (i % 16 == 15) ? "\n" : " ");
+            }
+            printf("\n");
+            return 0;
+        }
+
+        if (command == "profile-save" && args.size() == 2) {
+            controllers[0]->read_profile().save(args[1]);
+            printf("saved %s from %s\n", args[1].c_str(), controllers[0]->name().c_str());
+            return 0;
+        }
+
+        if (command == "profile-load" && args.size() == 2) {
+            Profile profile = Profile::load(args[1]);
+
+            return report_errors(controllers, run_parallel(controllers, [&](Controller& controller) {
+                controller.write_profile(profile);
+                controller.reset();
+            }));
+        }
+
+        if (command == "monitor") {
+            int seconds = args.size() > 1 ? atoi(args[1].c_str()) : 5;
+
+            return report_errors(controllers, run_parallel(controllers, [&](Controller& controller) {
+                uint16_t last_buttons = 0xffff;
+                size_t count = controller.stream_inputs(
+                    std::chrono::seconds(seconds), [&](const InputSample& sample) {
+                        if (sample.buttons != last_buttons && controllers.size() == 1) {
+                            printf("%s: buttons 0x%04x tt %3d\n",
+                                controller.name().c_str(), sample.buttons, sample.axis_x);
+                        }
+                        last_buttons = sample.buttons;
+                        return true;
+                    });
+
+                std::lock_guard<std::mutex> guard(print_lock);
+                printf("%s: %zu reports, %.0f Hz\n",
+                    controller.name().c_str(), count, (double)count / seconds);
+            }));
+        }
+
+        if (command == "latency") {
+            int count = args.size() > 1 ? atoi(args[1].c_str()) : 100;
+
+            return report_errors(controllers, run_parallel(controllers, [&](Controller& controller) {
+                LatencyStats stats = controller.measure_latency(count);
+
+                std::lock_guard<std::mutex> guard(print_lock);
+                printf("%s: %d round trips, min %.0f us, mean %.0f us, p99 %.0f us, max %.0f us\n",
+                    controller.name().c_str(), stats.count,
+                    stats.min_us, stats.mean_us, stats.p99_us, stats.max_us);
+            }));
+        }
+
+        if (command == "latency-test") {
+            int count = args.size() > 1 ? atoi(args[1].c_str()) : 20;
+            return latency_test(controllers, sim_count, device, count);
+        }
+
+        if (command == "tt-test") {
+            return tt_test(controllers, sim_count, device);
+        }
+
+        if (command == "trace-start") {
+            return report_errors(controllers, run_parallel(controllers, [&](Controller& controller) {
+                controller.start_trace();
+            }));
+        }
+
+        if ((command == "trace-save" && args.size() == 2) || (command == "trace" && args.size() >= 2)) {
+            if (command == "trace") {
+                int seconds = args.size() > 2 ? atoi(args[2].c_str()) : 5;
+                controllers[0]->start_trace();
+                std::this_thread::sleep_for(std::chrono::seconds(seconds));
+            }
+
+            Trace trace = controllers[0]->download_trace();
+            trace.save(args[1]);
+            printf("saved %zu samples from %s to %s\n",
+                trace.samples.size(), controllers[0]->name().c_str(), args[1].c_str());
+            return 0;
+        }
+
+        usage();
+    } catch (std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
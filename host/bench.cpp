@@ -0,0 +1,144 @@
+// Host benchmark of the firmware's input pipeline, see
+// arcin/pipeline_benchmark.h. Prints ns per call for every stage, and the
+// number of heap allocations made while it ran, which must be zero. Calls
+// that took over 20 us were preempted; they only count towards the max.
+//
+//   arcinbench [SAMPLES] [--trace FILE]
+//
+// With --trace, the samples come from a recorded input trace, one per ms,
+// repeated as needed.
+
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arcin_host.h"
+#include "pipeline_benchmark.h"
+
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+struct HostClock {
+    static const uint32_t outlier = 20000;
+
+    static uint32_t now() {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void advance() {
+        Time::host_time++;
+    }
+};
+
+struct SyntheticSource {
+    pipeline_benchmark_sample_t operator()(uint32_t i) {
+        return pipeline_benchmark_synthetic(i);
+    }
+};
+
+struct TraceSource {
+    std::vector<pipeline_benchmark_sample_t> samples;
+
+    explicit TraceSource(const Trace& trace) {
+        for (size_t i = 0; i < trace.samples.size(); i++) {
+            uint32_t end = (i + 1 < trace.samples.size()) ? trace.times[i + 1] : trace.times[i] + 1;
+            for (uint32_t ms = trace.times[i]; ms != end; ms++) {
+                samples.push_back({trace.samples[i].buttons, trace.samples[i].qe1});
+            }
+        }
+    }
+
+    pipeline_benchmark_sample_t operator()(uint32_t i) {
+        return samples[i % samples.size()];
+    }
+};
+
+template <typename Source>
+static int run(Source& source, uint32_t count) {
+    PipelineBenchmark<HostClock, Source> benchmark(source, count);
+
+    printf("%-24s %10s %10s %10s %10s %10s %8s\n",
+        "stage", "calls", "ns/call", "p99 ns <=", "max ns", "preempted", "allocs");
+
+    int failed = 0;
+    for (uint8_t stage = 0; stage < PIPELINE_BENCHMARK_STAGES; stage++) {
+        size_t before = allocations;
+        pipeline_benchmark_result_t result = benchmark.run(stage);
+        size_t allocated = allocations - before;
+
+        printf("%-24s %10u %10u %10u %10u %10u %8zu\n",
+            pipeline_benchmark_names[stage], result.calls, result.mean, result.p99,
+            result.max, result.outliers, allocated);
+
+        if (allocated) {
+            failed = 1;
+        }
+    }
+
+    if (failed) {
+        fprintf(stderr, "the pipeline allocated memory\n");
+    }
+    return failed;
+}
+
+int main(int argc, char** argv) {
+    uint32_t count = 2000000;
+    const char* trace_path = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else {
+            count = atoi(argv[i]);
+        }
+    }
+
+    try {
+        if (trace_path) {
+            TraceSource source(Trace::load(trace_path));
+            if (source.samples.empty()) {
+                fprintf(stderr, "%s has no samples\n", trace_path);
+                return 1;
+            }
+            printf("%zu ms of recorded input\n", source.samples.size());
+            return run(source, count);
+        }
+
+        SyntheticSource source;
+        return run(source, count);
+    } catch (std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
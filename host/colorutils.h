@@ -0,0 +1,7 @@
+#ifndef ARCIN_HOST_COLORUTILS_H
+#define ARCIN_HOST_COLORUTILS_H
+
+// FastLED's colorutils.h; its part of the stand-in lives in FastLED.h.
+#include "FastLED.h"
+
+#endif
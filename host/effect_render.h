@@ -0,0 +1,86 @@
+#ifndef ARCIN_HOST_EFFECT_RENDER_H
+#define ARCIN_HOST_EFFECT_RENDER_H
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "led_hardware.h"
+#include "rgbmanager.h"
+
+// Renders the LED effects on the host: the firmware's RGBManager, driving a
+// WS2812B_OUTPUT_CAPTURE strip, with simulated frame times and a scripted
+// turntable. The random hues are seeded the same way every time, so the same
+// settings always give the same frames.
+//
+// rgbmanager.h brings in arcin/fastled_shim.h, which defines millis() and
+// friends, so only one source file of a program may include this.
+
+#define EFFECT_RENDER_SEED 1337
+
+// Turn the turntable by ticks_per_frame for the given number of frames
+struct SpinStep {
+    uint32_t frames;
+    int32_t ticks_per_frame;
+};
+
+class EffectRender {
+    private:
+        // RGBManager is a few KB, too much for the stack
+        std::unique_ptr<WS2812B> capture{new WS2812B(WS2812B_OUTPUT_CAPTURE)};
+        std::unique_ptr<RGBManager> manager{new RGBManager(*capture)};
+
+        std::vector<SpinStep> spin;
+        size_t step = 0;
+        uint32_t step_frame = 0;
+
+        uint32_t frame_ms;
+        uint32_t now = 0;
+
+    public:
+        // after the last step, the turntable stays still
+        EffectRender(const rgb_config& config, uint32_t frame_ms, const std::vector<SpinStep>& spin)
+            : spin(spin), frame_ms(frame_ms ? frame_ms : 1) {
+            manager->init(&config);
+            manager->seed(EFFECT_RENDER_SEED);
+        }
+
+        bool load_program(const uint8_t* blob, uint32_t size) {
+            return manager->load_program(blob, size);
+        }
+
+        // Renders the next frame, returns how long that took in ns
+        uint32_t render_next() {
+            int32_t ticks = 0;
+            while (step < spin.size()) {
+                if (step_frame < spin[step].frames) {
+                    ticks = spin[step].ticks_per_frame;
+                    step_frame++;
+                    break;
+                }
+                step++;
+                step_frame = 0;
+            }
+
+            // same sign convention as the digital turntable
+            int8_t tt = (0 < ticks) ? 1 : ((ticks < 0) ? -1 : 0);
+
+            now += frame_ms;
+
+            using namespace std::chrono;
+            auto start = steady_clock::now();
+            manager->render_frame(now, frame_ms, tt, ticks);
+            return duration_cast<nanoseconds>(steady_clock::now() - start).count();
+        }
+
+        // The frame as sent to the strip, after color correction and brightness
+        const CRGB* leds() {
+            return manager->get_output();
+        }
+
+        uint8_t num_leds() {
+            return manager->get_num_leds();
+        }
+};
+
+#endif
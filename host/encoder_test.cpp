@@ -0,0 +1,258 @@
+#include "encoder_test.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <thread>
+
+#include "modeswitch.h"
+#include "remap.h"
+#include "replay.h"
+
+using std::chrono::steady_clock;
+
+std::vector<EncoderCase> encoder_cases() {
+    return {
+        {"spin +100/s", QE_CURVE_CONSTANT, 100, 0, 1000},
+        {"spin -100/s", QE_CURVE_CONSTANT, -100, 0, 1000},
+        {"spin +1000/s", QE_CURVE_CONSTANT, 1000, 0, 1000},
+        {"spin -1000/s", QE_CURVE_CONSTANT, -1000, 0, 1000},
+        {"spin +4000/s", QE_CURVE_CONSTANT, 4000, 0, 1000},
+        {"spin -4000/s", QE_CURVE_CONSTANT, -4000, 0, 1000},
+        {"spin +10000/s", QE_CURVE_CONSTANT, 10000, 0, 1000},
+        {"spin -10000/s", QE_CURVE_CONSTANT, -10000, 0, 1000},
+        {"scratch 2000/s 400 ms", QE_CURVE_SCRATCH, 2000, 400, 2000},
+        {"scratch 8000/s 200 ms", QE_CURVE_SCRATCH, 8000, 200, 1000},
+        {"jitter 20 ms", QE_CURVE_JITTER, 0, 20, 1000},
+        {"jitter 2 ms", QE_CURVE_JITTER, 0, 2, 500},
+    };
+}
+
+// [Check]
+
+namespace {
+
+// The digital turntable is left alone this long after the curve starts, and
+// in a scratch while the encoder moves slower than half its top speed.
+const double TT_SETTLE_MS = 50;
+
+// Lags tried when fitting the axis to the encoder
+const double LAG_MIN_MS = -2;
+const double LAG_MAX_MS = 10;
+const double LAG_STEP_MS = 0.25;
+
+// Where the curve has the encoder at time t, in ms since the start.
+class CurvePath {
+    QeCurve curve;
+    // position at the start of every ms
+    std::vector<int32_t> positions;
+
+    public:
+        explicit CurvePath(const EncoderCase& test) {
+            curve.start(test.curve, test.velocity, test.period_ms);
+            positions.push_back(0);
+
+            int8_t steps[QE_CURVE_SLOTS_PER_MS];
+            for (uint32_t ms = 0; ms < test.duration_ms; ms++) {
+                curve.next_ms(steps);
+                positions.push_back(curve.position);
+            }
+        }
+
+        double position(double t) const {
+            if (t <= 0) {
+                return 0;
+            }
+            if (t >= positions.size() - 1) {
+                return positions.back();
+            }
+
+            size_t ms = size_t(t);
+            return positions[ms] + (positions[ms + 1] - positions[ms]) * (t - ms);
+        }
+
+        int32_t velocity(double t) const {
+            return curve.velocity_at(uint32_t(std::max(t, 0.0)));
+        }
+};
+
+}
+
+bool EncoderResult::ok() const {
+    // a few reports may catch the turntable while it turns around
+    return axis_error <= axis_tolerance && final_ok && tt_wrong * 20 <= tt_checked;
+}
+
+EncoderResult check_encoder(const EncoderCase& test, const EncoderRun& run) {
+    CurvePath path(test);
+    EncoderResult result;
+
+    // Axis counts since the start, unwrapped. Reports are close enough
+    // together that the axis moves less than half its range between them.
+    std::vector<double> axis;
+    uint8_t last = run.start_axis;
+    int32_t counts = 0;
+    for (const EncoderSample& sample : run.samples) {
+        counts += int8_t(sample.axis_x - last);
+        last = sample.axis_x;
+        axis.push_back(counts);
+    }
+
+    // The reports trail the encoder by up to a report interval, and more on
+    // hardware, where their times are when the host read them.
+    int32_t top_speed = abs(test.velocity);
+    result.axis_tolerance = 2 + top_speed * (run.report_interval_ms + 1) / 1000;
+    result.axis_error = INT32_MAX;
+    result.lag_ms = 0;
+
+    for (double lag = LAG_MIN_MS; lag <= LAG_MAX_MS; lag += LAG_STEP_MS) {
+        double error = 0;
+        for (size_t i = 0; i < run.samples.size(); i++) {
+            double t = run.samples[i].time_ms;
+            if (t < 0 || t > test.duration_ms) {
+                continue;
+            }
+            error = std::max(error, fabs(axis[i] - path.position(t - lag)));
+        }
+
+        if (int32_t(ceil(error)) < result.axis_error) {
+            result.axis_error = int32_t(ceil(error));
+            result.lag_ms = lag;
+        }
+    }
+
+    result.final_ok = uint8_t(run.final_axis - run.start_axis) == uint8_t(run.final_position);
+
+    result.tt_wrong = 0;
+    result.tt_checked = 0;
+    uint16_t tt_both = run.tt_cw | run.tt_ccw;
+
+    for (const EncoderSample& sample : run.samples) {
+        double t = sample.time_ms - result.lag_ms;
+        if (!tt_both || t < TT_SETTLE_MS || t > test.duration_ms) {
+            continue;
+        }
+
+        if (test.curve == QE_CURVE_JITTER) {
+            // single steps stay inside the deadzone
+            result.tt_checked++;
+            if (sample.buttons & tt_both) {
+                result.tt_wrong++;
+            }
+            continue;
+        }
+
+        int32_t velocity = path.velocity(t);
+        if (velocity == 0 || abs(velocity) * 2 < top_speed) {
+            continue;
+        }
+
+        // counting up is the turntable's +1, see remap_tt()
+        uint16_t expected = (velocity > 0) ? run.tt_ccw : run.tt_cw;
+        result.tt_checked++;
+        if ((sample.buttons & tt_both) != expected) {
+            result.tt_wrong++;
+        }
+    }
+
+    return result;
+}
+
+// [Simulation]
+
+EncoderRun simulate_encoder(const config_t& config, const config_ext_t& config_ext, const EncoderCase& test) {
+    std::lock_guard<std::mutex> guard(firmware_logic_lock);
+
+    EncoderRun run;
+    run.report_interval_ms = 1;
+
+    Time::host_time = 1000;
+    InputPipeline pipeline(config, config_ext);
+    analog_tt_reverse_direction = false;
+    run.tt_cw = remap_tt(-1);
+    run.tt_ccw = remap_tt(1);
+
+    ReplayFrame frame;
+    pipeline.run(0, 0, frame);
+    run.start_axis = frame.report.axis_x;
+
+    QeCurve curve;
+    curve.start(test.curve, test.velocity, test.period_ms);
+
+    // TIM2 with qe1_sens 0 counts 0-255
+    int8_t steps[QE_CURVE_SLOTS_PER_MS];
+    for (uint32_t ms = 1; ms <= test.duration_ms; ms++) {
+        curve.next_ms(steps);
+        Time::host_time++;
+        pipeline.run(0, curve.position & 0xff, frame);
+        run.samples.push_back({double(ms), frame.report.buttons, frame.report.axis_x});
+    }
+
+    run.final_axis = frame.report.axis_x;
+    run.final_position = curve.position;
+    return run;
+}
+
+// [Hardware]
+
+namespace {
+
+// Returns the axis of the last report in the next ms milliseconds.
+uint8_t settled_axis(Controller& controller, int ms) {
+    bool seen = false;
+    uint8_t axis = 0;
+
+    controller.stream_inputs(std::chrono::milliseconds(ms), [&](const InputSample& sample) {
+        axis = sample.axis_x;
+        seen = true;
+        return true;
+    });
+
+    if (!seen) {
+        throw ArcinError(controller.name() + ": no input reports");
+    }
+    return axis;
+}
+
+}
+
+EncoderRun measure_encoder(
+    Controller& controller, TestBoard& board,
+    const config_t& config, const config_ext_t& config_ext, const EncoderCase& test) {
+
+    EncoderRun run;
+    run.report_interval_ms = config.flags.PollAt250Hz ? 4 : 1;
+
+    {
+        std::lock_guard<std::mutex> guard(firmware_logic_lock);
+        remap_init(config, &config_ext.remap);
+        run.tt_cw = remap_tt(-1);
+        run.tt_ccw = remap_tt(1);
+    }
+
+    // also lets the digital turntable's sustain from the case before run out
+    run.start_axis = settled_axis(controller, 300);
+
+    steady_clock::time_point before = steady_clock::now();
+    board.play_curve(test.curve, test.velocity, test.period_ms);
+    steady_clock::time_point start = before + (steady_clock::now() - before) / 2;
+
+    controller.stream_inputs(std::chrono::milliseconds(test.duration_ms), [&](const InputSample& sample) {
+        double ms = std::chrono::duration<double, std::milli>(sample.time - start).count();
+        run.samples.push_back({ms, sample.buttons, sample.axis_x});
+        return true;
+    });
+
+    board.stop_curve();
+    test_board_curve_status_t status = board.curve_status();
+    for (int tries = 0; status.playing; tries++) {
+        if (tries == 10) {
+            throw ArcinError("the test board did not stop the curve");
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        status = board.curve_status();
+    }
+
+    run.final_position = status.position;
+    run.final_axis = settled_axis(controller, 50);
+    return run;
+}
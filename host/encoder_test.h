@@ -0,0 +1,79 @@
+#ifndef ARCIN_HOST_ENCODER_TEST_H
+#define ARCIN_HOST_ENCODER_TEST_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "arcin_host.h"
+#include "testboard.h"
+#include "../test/qe_curve.h"
+
+// Turntable tracking: the test board plays an encoder curve and the
+// controller's reports are checked against where the encoder was. The analog
+// axis has to follow the encoder's position, apart from a small lag, and end
+// exactly where the board stopped; the digital turntable has to show the
+// direction of travel, or nothing while the encoder only jitters.
+//
+// The controller needs DigitalTTEnable and AnalogTTForceEnable for both to
+// be in the report, and qe1_sens 0, one count per step.
+
+struct EncoderCase {
+    const char* name;
+    uint8_t curve;
+    int16_t velocity;
+    uint16_t period_ms;
+    uint32_t duration_ms;
+};
+
+// Constant spins from crawling to fast scratching in both directions, back
+// and forth scratches and jitter at rest.
+std::vector<EncoderCase> encoder_cases();
+
+// A report, ms after the curve started
+struct EncoderSample {
+    double time_ms;
+    uint16_t buttons;
+    uint8_t axis_x;
+};
+
+struct EncoderRun {
+    std::vector<EncoderSample> samples;
+    // axis before the curve started and once it had stopped
+    uint8_t start_axis;
+    uint8_t final_axis;
+    // net steps the board made
+    int32_t final_position;
+    // report buttons for the digital turntable's two directions
+    uint16_t tt_cw;
+    uint16_t tt_ccw;
+    // ms between reports
+    uint32_t report_interval_ms;
+};
+
+struct EncoderResult {
+    // largest difference between axis and encoder, in counts, at the lag
+    // that fits best
+    int32_t axis_error;
+    int32_t axis_tolerance;
+    double lag_ms;
+    bool final_ok;
+    // reports with the wrong digital turntable direction, of those checked
+    uint32_t tt_wrong;
+    uint32_t tt_checked;
+
+    bool ok() const;
+};
+
+EncoderResult check_encoder(const EncoderCase& test, const EncoderRun& run);
+
+// The case run through the input pipeline built for the host, one pass and
+// one report per ms.
+EncoderRun simulate_encoder(const config_t& config, const config_ext_t& config_ext, const EncoderCase& test);
+
+// The case played by the board, with the controller's reports. The
+// controller runs with config and config_ext.
+EncoderRun measure_encoder(
+    Controller& controller, TestBoard& board,
+    const config_t& config, const config_ext_t& config_ext, const EncoderCase& test);
+
+#endif
@@ -0,0 +1,353 @@
+// Tests of the bootloader's page buffering (bootloader/flashloader.h) and
+// decompression (bootloader/decompressor.h), built for the host. The firmware region is mapped at its address on the
+// controller, and the flash controller stand-in in rcc/flash.h never reports
+// busy or an error, so pages are programmed as soon as process() gets to them.
+// Erasing is left out: every test starts from a blank region and writes each
+// page once.
+//
+//   arcinflashtest
+
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <vector>
+
+#include "image.h"
+#include "../bootloader/decompressor.h"
+
+uint32_t page_crc(uint8_t page) {
+    return crc32((const uint8_t*)(uintptr_t)(0x8002000 + page * FLASH_PAGE_SIZE), FLASH_PAGE_SIZE);
+}
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+uint8_t* const flash_base = (uint8_t*)0x8000000;
+const uint32_t flash_size = 0x20000;
+
+uint8_t* page_at(uint32_t page) {
+    return flash_base + 0x2000 + page * FLASH_PAGE_SIZE;
+}
+
+// A blank firmware region, and pages with a pattern of their own
+struct Image {
+    std::vector<std::vector<uint8_t>> pages;
+
+    Image() : pages(FLASH_PAGE_COUNT) {
+        memset(flash_base, 0xff, flash_size);
+    }
+
+    const std::vector<uint8_t>& write(Flashloader& loader, uint32_t page, uint32_t size) {
+        std::vector<uint8_t>& data = pages[page];
+        data.resize(size);
+        for (uint32_t i = 0; i < size; i++) {
+            data[i] = page * 31 + i * 7 + (i >> 8);
+        }
+
+        for (uint32_t i = 0; i < size; i += 64) {
+            uint8_t report[64];
+            uint32_t n = (size - i < 64) ? size - i : 64;
+            memcpy(report, data.data() + i, n);
+            check(loader.write_block(n, report), "a write was rejected");
+        }
+        return data;
+    }
+
+    // Every page holds what was written to it, and the others are still blank
+    bool matches() const {
+        for (uint32_t page = 0; page < FLASH_PAGE_COUNT; page++) {
+            const uint8_t* flash = page_at(page);
+            const std::vector<uint8_t>& data = pages[page];
+            if (memcmp(flash, data.data(), data.size()) != 0) {
+                printf("page %u differs\n", page);
+                return false;
+            }
+            for (uint32_t i = data.size(); i < FLASH_PAGE_SIZE; i++) {
+                if (flash[i] != 0xff) {
+                    printf("page %u is written past its end\n", page);
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+};
+
+// Runs the main loop until the host would see no more than in_flight pages
+// still queued, as a host waiting on the status reports does.
+void wait_written(Flashloader& loader, uint8_t in_flight) {
+    flash_status_t status = loader.status();
+    while ((uint8_t)(status.pages_received - status.pages_written) > in_flight) {
+        loader.process();
+        status = loader.status();
+    }
+}
+
+// Two full pages fill both buffers, as a host without flow control leaves
+// them; finish() must program them once each.
+void test_finish_full() {
+    Image image;
+    Flashloader loader;
+    loader.prepare();
+
+    image.write(loader, 0, FLASH_PAGE_SIZE);
+    image.write(loader, 1, FLASH_PAGE_SIZE);
+    flash_status_t status = loader.status();
+    check(status.pages_received == 2 && status.pages_written == 0, "two pages are not queued");
+
+    check(loader.finish(), "finish failed");
+    status = loader.status();
+    check(status.pages_received == 2, "finish queued a page that was never filled");
+    check(status.pages_written == 2, "finish programmed a page twice");
+    check(image.matches(), "finish with both buffers full");
+}
+
+// Seeking with both buffers full is rejected, and queues nothing once a
+// buffer is free.
+void test_seek_full() {
+    Image image;
+    Flashloader loader;
+    loader.prepare();
+
+    image.write(loader, 0, FLASH_PAGE_SIZE);
+    image.write(loader, 1, FLASH_PAGE_SIZE);
+    check(!loader.seek(5), "seek with both buffers full was accepted");
+
+    wait_written(loader, FLASH_PAGE_BUFFERS - 1);
+    check(loader.seek(5), "seek failed");
+    check(loader.status().pages_received == 2, "seek queued a page that was never filled");
+
+    image.write(loader, 5, FLASH_PAGE_SIZE);
+    image.write(loader, 6, 100);
+    check(loader.finish(), "finish failed");
+
+    flash_status_t status = loader.status();
+    check(status.pages_received == 4 && status.pages_written == 4, "pages lost or repeated");
+    check(image.matches(), "seek with both buffers full");
+}
+
+// A partial page before a seek is programmed on its own.
+void test_seek_partial() {
+    Image image;
+    Flashloader loader;
+    loader.prepare();
+
+    image.write(loader, 0, FLASH_PAGE_SIZE);
+    image.write(loader, 1, 640);
+    check(loader.seek(3), "seek failed");
+    image.write(loader, 3, FLASH_PAGE_SIZE);
+    check(loader.finish(), "finish failed");
+
+    flash_status_t status = loader.status();
+    check(status.pages_received == 3 && status.pages_written == 3, "pages lost or repeated");
+    check(image.matches(), "seek after a partial page");
+}
+
+// Random runs of pages, skipped pages and partial pages, with the main loop
+// getting anywhere from no to plenty of steps in between.
+void test_random_streams() {
+    std::mt19937 random(1337);
+
+    for (int run = 0; run < 200; run++) {
+        Image image;
+        Flashloader loader;
+        loader.prepare();
+
+        uint8_t pages = 0;
+        uint32_t next = 0;
+        for (uint32_t page = 0; page < 24; page++) {
+            if (random() % 4 == 0) {
+                continue;
+            }
+            if (page != next) {
+                wait_written(loader, FLASH_PAGE_BUFFERS - 1);
+                check(loader.seek(page), "seek failed");
+            }
+
+            bool partial = random() % 5 == 0;
+            image.write(loader, page, partial ? 2 * (1 + random() % (FLASH_PAGE_SIZE / 2 - 1)) : FLASH_PAGE_SIZE);
+            pages++;
+            // a partial page goes out at the next seek, which the next page
+            // always needs
+            next = partial ? FLASH_PAGE_COUNT : page + 1;
+
+            for (uint32_t steps = random() % 3 ? 0 : random() % 5000; steps; steps--) {
+                loader.process();
+            }
+        }
+
+        check(loader.finish(), "finish failed");
+        flash_status_t status = loader.status();
+        if (status.pages_received != pages || status.pages_written != pages) {
+            printf("FAIL: run %d: %u pages sent, %u received, %u written\n",
+                run, pages, status.pages_received, status.pages_written);
+            failures++;
+        }
+        if (!image.matches()) {
+            printf("FAIL: run %d\n", run);
+            failures++;
+        }
+    }
+}
+
+void test_query_crc() {
+    Image image;
+    Flashloader loader;
+    loader.prepare();
+
+    // the page is still queued when the CRC is asked for
+    loader.seek(2);
+    const std::vector<uint8_t>& data = image.write(loader, 2, FLASH_PAGE_SIZE);
+    check(loader.query_crc(2), "CRC query failed");
+    flash_status_t status = loader.status();
+    check(status.crc_page == 2 && status.crc == crc32(data.data(), data.size()),
+        "CRC of a queued page");
+    check(loader.finish(), "finish failed");
+}
+
+// Runs of random bytes and repeats from up to 1100 bytes back, over two full
+// pages and an odd partial one.
+std::vector<uint8_t> lz_test_data() {
+    std::vector<uint8_t> data;
+    uint32_t x = 1;
+    auto next = [&]() {
+        x = (x * 1103515245 + 12345) & 0x7fffffff;
+        return x >> 16;
+    };
+
+    while (data.size() < 2 * FLASH_PAGE_SIZE + 405) {
+        uint32_t r = next();
+        if (data.size() < 140 || r % 4 == 0) {
+            data.push_back(next());
+        } else {
+            uint32_t offset = 1 + next() % std::min<uint32_t>(data.size(), 1100);
+            uint32_t length = 3 + next() % 140;
+            for (uint32_t i = 0; i < length; i++) {
+                data.push_back(data[data.size() - offset]);
+            }
+        }
+    }
+    data.resize(2 * FLASH_PAGE_SIZE + 405);
+    return data;
+}
+
+// lzpack.compress_pages(data, 2048) for the same data, generated in Python
+// with the same steps, one chunk per page.
+const uint8_t lzpack_stream[] = {
+    0x7f, 0x7e, 0x6b, 0xfb, 0xfb, 0xf6, 0xdf, 0x1c, 0x87, 0xbf, 0xde, 0x72,
+    0x47, 0x66, 0x59, 0x88, 0x59, 0x56, 0x7b, 0x85, 0xd8, 0x54, 0x2f, 0xae,
+    0x5b, 0x02, 0x98, 0xe3, 0x76, 0x5f, 0x99, 0x1f, 0x36, 0x43, 0x4d, 0xfa,
+    0xa6, 0xe4, 0x8e, 0x29, 0x4e, 0x56, 0x70, 0xfb, 0xb1, 0x05, 0xc5, 0xdc,
+    0xcd, 0x3b, 0x99, 0xd3, 0x9d, 0x9f, 0xb5, 0x06, 0x98, 0xb2, 0x1e, 0x32,
+    0x31, 0x52, 0x95, 0x36, 0x57, 0x39, 0x16, 0x88, 0xf5, 0x7c, 0x5c, 0xbb,
+    0x71, 0x0f, 0x59, 0x01, 0x2f, 0x3d, 0xc0, 0xa5, 0x0d, 0x33, 0x7e, 0x8f,
+    0xe6, 0x74, 0x3a, 0xc3, 0x11, 0x64, 0xdb, 0xe0, 0xe1, 0xbf, 0x00, 0xa2,
+    0x25, 0x21, 0x87, 0x62, 0xa8, 0x7e, 0x09, 0x94, 0xb0, 0xa9, 0x5a, 0x46,
+    0x80, 0xcf, 0x0c, 0xa5, 0xd8, 0xfb, 0xeb, 0x79, 0x72, 0x92, 0x80, 0xa6,
+    0x85, 0xd7, 0x90, 0xab, 0x44, 0x66, 0x9c, 0x25, 0x5e, 0x0b, 0xba, 0x60,
+    0x4b, 0x7e, 0xa9, 0x57, 0x71, 0xca, 0xe5, 0x33, 0x88, 0x66, 0xd9, 0x5f,
+    0x00, 0x96, 0x5c, 0x00, 0xe3, 0xe9, 0x00, 0xa0, 0x28, 0x00, 0xe1, 0xbb,
+    0x00, 0xa3, 0x95, 0x00, 0xda, 0x55, 0x00, 0xa2, 0x5a, 0x00, 0x01, 0xcc,
+    0xfd, 0xc1, 0x54, 0x00, 0x00, 0x7b, 0xeb, 0x43, 0x01, 0xca, 0xa6, 0x00,
+    0x96, 0xaf, 0x00, 0x9d, 0x61, 0x02, 0xf0, 0x57, 0x00, 0xff, 0xd7, 0x01,
+    0x02, 0x99, 0xd3, 0x0d, 0xe4, 0x77, 0x00, 0xed, 0x0f, 0x00, 0x01, 0x69,
+    0x7c, 0xd9, 0x6a, 0x01, 0xc3, 0x1f, 0x02, 0xde, 0x47, 0x02, 0xb7, 0x8e,
+    0x00, 0x00, 0x50, 0x9a, 0xed, 0x01, 0x00, 0xad, 0xe0, 0xfa, 0x00, 0xff,
+    0xe2, 0x00, 0x83, 0x7a, 0x00, 0x94, 0x0b, 0x00, 0xcb, 0x0b, 0x00, 0xdb,
+    0xdc, 0x00, 0x80, 0x41, 0x00, 0xce, 0x70, 0x01, 0x00, 0x6b, 0x88, 0x98,
+    0x00, 0xe6, 0x11, 0x03, 0xff, 0x4e, 0x01, 0x88, 0x4e, 0x01, 0x81, 0x71,
+    0x00, 0x00, 0xd1, 0xf1, 0xca, 0x00, 0x80, 0xc9, 0x00, 0x04, 0xdc, 0xcd,
+    0x7b, 0x9c, 0x25, 0xf3, 0x21, 0x03, 0x8f, 0x95, 0x00, 0xff, 0x3f, 0x02,
+    0x85, 0xa7, 0x00, 0xff, 0x20, 0x01, 0x83, 0x20, 0x01, 0xaa, 0x02, 0x01,
+    0x00, 0x01, 0xff, 0xc8, 0x00, 0x81, 0xc8, 0x00, 0x95, 0x32, 0x00, 0x00,
+    0x2e, 0x9d, 0x99, 0x02, 0xa5, 0x81, 0x00, 0xac, 0x51, 0x01, 0xa0, 0x3f,
+    0x03, 0x9a, 0x71, 0x00, 0x95, 0x49, 0x02, 0xd5, 0xed, 0x02, 0xa1, 0xd0,
+    0x03, 0x01, 0x32, 0xda, 0xe6, 0x6c, 0x00, 0xea, 0x89, 0x02, 0x95, 0x5b,
+    0x00, 0x87, 0xee, 0x00, 0xcf, 0x00, 0x00, 0x00, 0x3a, 0x8f, 0x12, 0x00,
+    0x00, 0x50, 0xe8, 0x79, 0x03, 0x84, 0x57, 0x00, 0x00, 0x5a, 0x8c, 0x64,
+    0x01, 0x8d, 0x91, 0x00, 0x96, 0xdf, 0x01, 0x88, 0xa5, 0x02, 0x8c, 0xca,
+    0x00, 0xf4, 0xa7, 0x02, 0x00, 0xde, 0xd5, 0x33, 0x03, 0x98, 0xa1, 0x00,
+    0xb3, 0x00, 0x00, 0x01, 0xe7, 0x08, 0x95, 0xdd, 0x00,
+};
+
+const uint32_t lzpack_chunk_sizes[] = {236, 129, 40};
+
+// The bootloader's Decompressor on lzpack.py's stream, sent 63 bytes per
+// report as hosts do. The host's own compressor must match lzpack.py.
+void test_decompress_lzpack() {
+    std::vector<uint8_t> data = lz_test_data();
+
+    std::vector<std::vector<uint8_t>> chunks;
+    const uint8_t* stream = lzpack_stream;
+    for (uint32_t size : lzpack_chunk_sizes) {
+        chunks.push_back(std::vector<uint8_t>(stream, stream + size));
+        stream += size;
+    }
+    check(lz_compress_pages(data, FLASH_PAGE_SIZE) == chunks, "lz_compress_pages() differs from lzpack.py");
+
+    Image image;
+    Flashloader loader;
+    Decompressor decompressor(loader);
+    loader.prepare();
+    decompressor.reset();
+
+    for (uint32_t page = 0; page < chunks.size(); page++) {
+        wait_written(loader, FLASH_PAGE_BUFFERS - 1);
+
+        const std::vector<uint8_t>& chunk = chunks[page];
+        for (uint32_t i = 0; i < chunk.size(); i += 63) {
+            uint32_t n = std::min<uint32_t>(63, chunk.size() - i);
+            check(decompressor.write(n, chunk.data() + i), "a report was rejected");
+        }
+
+        uint32_t start = page * FLASH_PAGE_SIZE;
+        image.pages[page].assign(
+            data.begin() + start, data.begin() + std::min<uint32_t>(start + FLASH_PAGE_SIZE, data.size()));
+    }
+
+    check(decompressor.flush(), "flush failed");
+    check(loader.finish(), "finish failed");
+    check(image.matches(), "decompressed image");
+
+    // a match reaching back past the window
+    const uint8_t bad[] = {0x00, 0x55, 0x80, 0x00, 0x04};
+    loader.prepare();
+    decompressor.reset();
+    check(!decompressor.write(sizeof(bad), bad), "a match past the window was accepted");
+    loader.finish();
+}
+
+}
+
+int main() {
+    void* mapped = mmap(flash_base, flash_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (mapped != flash_base) {
+        printf("can't map the flash at %p\n", flash_base);
+        return 1;
+    }
+
+    test_finish_full();
+    test_seek_full();
+    test_seek_partial();
+    test_random_streams();
+    test_query_crc();
+    test_decompress_lzpack();
+
+    if (failures) {
+        printf("%d failed\n", failures);
+        return 1;
+    }
+    printf("all passed\n");
+    return 0;
+}
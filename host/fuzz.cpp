@@ -0,0 +1,340 @@
+// libFuzzer target for what the firmware parses from flash and from the
+// host: config pages, the saved effect program, and every feature and output
+// report through the firmware's own handler (arcin/report_handler.h), followed
+// by input through the pipeline and the LED effects built from the result.
+//
+// An input is a config page, a config_ext page and an effect program page, as
+// Configloader left them in flash, followed by commands; missing bytes read as
+// erased flash.
+
+#include <memory>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "configloader.h"
+#include "config_validate.h"
+#include "multifunc.h"
+#include "replay.h"
+#include "led_hardware.h"
+// last, arcin/ws2812b.h defines min and max
+#include "report_handler.h"
+
+// Output report 2 drives the button LEDs from main.cpp.
+void set_hid_lights(uint16_t leds) {}
+
+namespace {
+
+// Configloader's header: magic and size
+const size_t CONFIG_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+// commands after the pages
+enum {
+    // buttons (2 bytes), qe1, ms to advance the clock by
+    FUZZ_INPUT,
+    // even: config feature report (63 bytes after the report ID), then a
+    // read of the selected segment; odd: bootloader feature report (1 byte)
+    FUZZ_FEATURE,
+    // report ID 2 + n % 4, then 63 bytes; the report's own length unless
+    // n & 0x80, then the length is the next byte % 65
+    FUZZ_OUTPUT,
+    // reload the config pages, as after a reset
+    FUZZ_RESET,
+    FUZZ_COMMANDS
+};
+
+// Enough for the input trace's keyframes and the gesture windows to come
+// into play, while keeping an input quick to run.
+const int FUZZ_MAX_COMMANDS = 4096;
+
+void check(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "arcinfuzz: %s\n", what);
+        abort();
+    }
+}
+
+// The fuzzer's input, handed out in pieces.
+class FuzzInput {
+    const uint8_t* data;
+    size_t size;
+
+    public:
+        FuzzInput(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+        bool empty() const {
+            return size == 0;
+        }
+
+        void take(void* out, size_t n, uint8_t fill) {
+            size_t available = min(n, size);
+            if (available != 0) {
+                memcpy(out, data, available);
+            }
+            memset((uint8_t*)out + available, fill, n - available);
+            data += available;
+            size -= available;
+        }
+
+        uint8_t byte() {
+            uint8_t b;
+            take(&b, 1, 0);
+            return b;
+        }
+};
+
+void check_config(const config_t& config, const config_ext_t& config_ext) {
+    check(CONFIG_DEBOUNCE_TICKS_MIN <= config.debounce_ticks &&
+        config.debounce_ticks <= CONFIG_DEBOUNCE_TICKS_MAX, "debounce_ticks out of range");
+
+    for (const rgb_config* rgb : {&config.rgb, &config_ext.rgb2}) {
+        check(rgb->NumberOfLeds <= RGB_CONFIG_MAX_LEDS, "NumberOfLeds out of range");
+        check(rgb->Mode < RGB_CONFIG_MODE_COUNT, "Mode out of range");
+        check(rgb->ColorPalette < RGB_CONFIG_PALETTE_COUNT, "ColorPalette out of range");
+        check(rgb->FramePeriodMs <= RGB_CONFIG_MAX_FRAME_MS, "FramePeriodMs out of range");
+    }
+
+    for (const chord& c : config_ext.chords.Chords) {
+        check(!(c.Buttons & ~CHORD_BUTTONS_ALL), "chord Buttons out of range");
+        check((c.Tap >> 4) <= CHORD_TAP_BUTTON_MAX || c.Buttons == 0, "chord Tap button out of range");
+        check((c.Tap >> 4) == 0 || (c.Tap & 0xf) != 0, "tap chord without taps");
+        check(c.Action < CHORD_ACTION_COUNT, "chord Action out of range");
+        check(c.Action != CHORD_ACTION_DEBOUNCE || c.Argument <= CONFIG_DEBOUNCE_TICKS_MAX,
+            "chord debounce Argument out of range");
+    }
+
+    check(config_ext.gestures.Gestures[GESTURE_UNUSED_SLOT].TapWindow == 0, "unused gesture enabled");
+    for (const gesture& g : config_ext.gestures.Gestures) {
+        for (uint16_t output : g.Outputs) {
+            check(!(output & ~GESTURE_OUTPUTS_ALL), "gesture Outputs out of range");
+        }
+        check(!(g.HoldOutput & ~GESTURE_OUTPUTS_ALL), "gesture HoldOutput out of range");
+    }
+}
+
+// The controller's state as main() in arcin/main.cpp sets it up, with host
+// buffers for the flash pages and capture strips for the LEDs.
+class FuzzDevice {
+    uint32_t config_page[FLASH_PAGE_SIZE / sizeof(uint32_t)];
+    uint32_t config_ext_page[FLASH_PAGE_SIZE / sizeof(uint32_t)];
+    uint32_t rgb_program_page[FLASH_PAGE_SIZE / sizeof(uint32_t)];
+
+    Configloader configloader{uintptr_t(config_page)};
+    Configloader config_ext_loader{uintptr_t(config_ext_page)};
+    Configloader rgb_program_loader{uintptr_t(rgb_program_page)};
+
+    config_t config;
+    config_ext_t config_ext;
+
+    InputTrace input_trace;
+    std::unique_ptr<InputPipeline> pipeline;
+    uint8_t last_qe1 = 0;
+
+    // a few KB each, too much for the stack
+    std::unique_ptr<WS2812B> strip1, strip2;
+    std::unique_ptr<RGBManager> rgb_manager, rgb_manager2;
+    std::unique_ptr<ReportHandler> reports;
+
+    public:
+        FuzzDevice(FuzzInput& input) {
+            memset(config_page, 0xff, sizeof(config_page));
+            memset(config_ext_page, 0xff, sizeof(config_ext_page));
+            memset(rgb_program_page, 0xff, sizeof(rgb_program_page));
+            input.take(config_page, CONFIG_HEADER_SIZE + sizeof(config_t), 0xff);
+            input.take(config_ext_page, CONFIG_HEADER_SIZE + sizeof(config_ext_t), 0xff);
+            input.take(rgb_program_page, CONFIG_HEADER_SIZE + RGB_PROGRAM_MAX_SIZE, 0xff);
+            reset();
+        }
+
+        // As main() in arcin/main.cpp.
+        void reset() {
+            memset(&config, 0, sizeof(config));
+            memset(&config_ext, 0, sizeof(config_ext));
+            configloader.read(sizeof(config), &config);
+            config_ext_loader.read(sizeof(config_ext), &config_ext);
+            config_validate(&config, &config_ext);
+            check_config(config, config_ext);
+
+            input_trace = InputTrace();
+            pipeline.reset(new InputPipeline(config, config_ext));
+
+            strip1.reset(new WS2812B(WS2812B_OUTPUT_CAPTURE));
+            strip2.reset(new WS2812B(WS2812B_OUTPUT_CAPTURE));
+            rgb_manager.reset(new RGBManager(*strip1));
+            rgb_manager2.reset(new RGBManager(*strip2));
+            reports.reset(new ReportHandler(
+                config, config_ext, configloader, config_ext_loader, rgb_program_loader,
+                input_trace, *rgb_manager, *rgb_manager2));
+
+            if (config.flags.Ws2812b) {
+                rgb_manager->init(&config.rgb);
+                reports->load_saved_program(*rgb_manager);
+                rgb_manager->init_zones(&config_ext.zones);
+            }
+            if (config.flags.Ws2812bStrip2) {
+                rgb_manager2->init(&config_ext.rgb2);
+                reports->load_saved_program(*rgb_manager2);
+            }
+        }
+
+        void input(uint16_t buttons, uint8_t qe1, uint8_t ms) {
+            Time::host_time += ms;
+
+            ReplayFrame frame;
+            pipeline->run(buttons, qe1, frame);
+
+            if (input_trace.is_start_requested()) {
+                input_trace_header_t state;
+                memset(&state, 0, sizeof(state));
+                state.runtime_flags = frame.runtime_flags;
+                state.debounce_ticks = config.debounce_ticks;
+                input_trace.start(Time::time(), state);
+            }
+            input_trace.record(Time::time(), buttons, qe1, 0);
+
+            int8_t qe1_delta = qe1 - last_qe1;
+            last_qe1 = qe1;
+            int8_t tt = (0 < qe1_delta) ? 1 : ((qe1_delta < 0) ? -1 : 0);
+            if (config.flags.Ws2812b) {
+                rgb_manager->update_buttons(frame.report.buttons);
+                rgb_manager->update_turntable(qe1_delta);
+                rgb_manager->update_colors(tt);
+            }
+            if (config.flags.Ws2812bStrip2) {
+                rgb_manager2->update_buttons(frame.report.buttons);
+                rgb_manager2->update_turntable(qe1_delta);
+                rgb_manager2->update_colors(tt);
+            }
+        }
+
+        bool feature(uint32_t* report, uint32_t len) {
+            return reports->set_feature_report(report, len);
+        }
+
+        void read_config() {
+            config_report_t read;
+            check(reports->get_feature_report(CONFIG_REPORT_ID, &read), "config read failed");
+        }
+
+        bool output(uint32_t* report, uint32_t len) {
+            return reports->set_output_report(report, len);
+        }
+};
+
+void run(const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> guard(firmware_logic_lock);
+
+    Time::host_time = 1000;
+    FuzzInput input(data, size);
+    FuzzDevice device(input);
+
+    for (int i = 0; i < FUZZ_MAX_COMMANDS && !input.empty(); i++) {
+        switch (input.byte() % FUZZ_COMMANDS) {
+            case FUZZ_INPUT: {
+                uint16_t buttons;
+                input.take(&buttons, sizeof(buttons), 0);
+                uint8_t qe1 = input.byte();
+                device.input(buttons, qe1, input.byte() % 16);
+                break;
+            }
+
+            case FUZZ_FEATURE: {
+                uint32_t report[sizeof(config_report_t) / sizeof(uint32_t)];
+                uint8_t* bytes = (uint8_t*)report;
+                if (input.byte() & 1) {
+                    bytes[0] = BOOTLOADER_REPORT_ID;
+                    bytes[1] = input.byte();
+                    device.feature(report, sizeof(bootloader_report_t));
+                } else {
+                    bytes[0] = CONFIG_REPORT_ID;
+                    input.take(bytes + 1, sizeof(report) - 1, 0);
+                    device.feature(report, sizeof(report));
+                    device.read_config();
+                }
+                break;
+            }
+
+            case FUZZ_OUTPUT: {
+                static const uint32_t lengths[] = {
+                    sizeof(output_report_t), sizeof(output_report_rgb_t),
+                    sizeof(output_report_rgb_frame_t), sizeof(output_report_hint_t)};
+
+                uint8_t n = input.byte();
+                uint32_t len = (n & 0x80) ? input.byte() % 65 : lengths[n % 4];
+                uint32_t report[64 / sizeof(uint32_t)];
+                uint8_t* bytes = (uint8_t*)report;
+                bytes[0] = 2 + n % 4;
+                input.take(bytes + 1, sizeof(report) - 1, 0);
+                device.output(report, len);
+                break;
+            }
+
+            case FUZZ_RESET:
+                device.reset();
+                break;
+        }
+    }
+}
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    run(data, size);
+    return 0;
+}
+
+#ifdef ARCIN_FUZZ_STANDALONE
+
+// Without libFuzzer: runs the files given, or random inputs.
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            FILE* f = fopen(argv[i], "rb");
+            if (!f) {
+                perror(argv[i]);
+                return 1;
+            }
+
+            std::vector<uint8_t> data;
+            int c;
+            while ((c = fgetc(f)) != EOF) {
+                data.push_back(c);
+            }
+            fclose(f);
+
+            run(data.data(), data.size());
+        }
+        printf("%d inputs ok\n", argc - 1);
+        return 0;
+    }
+
+    std::mt19937 random(1);
+    const int runs = 20000;
+    for (int i = 0; i < runs; i++) {
+        std::vector<uint8_t> data(random() % 4096);
+        for (uint8_t& b : data) {
+            b = random();
+        }
+
+        // a valid header on most inputs, so that the fields behind it get
+        // through to the validation
+        size_t ext = CONFIG_HEADER_SIZE + sizeof(config_t);
+        size_t program = ext + CONFIG_HEADER_SIZE + sizeof(config_ext_t);
+        uint32_t config_header[2] = {0xc0ff600d, uint32_t(random() % 128)};
+        uint32_t config_ext_header[2] = {0xc0ff600d, uint32_t(random() % 512)};
+        uint32_t program_header[2] = {0xc0ff600d, uint32_t(random() % 1024)};
+        if (i % 4 != 0 && data.size() >= program + CONFIG_HEADER_SIZE) {
+            memcpy(&data[0], config_header, CONFIG_HEADER_SIZE);
+            memcpy(&data[ext], config_ext_header, CONFIG_HEADER_SIZE);
+            memcpy(&data[program], program_header, CONFIG_HEADER_SIZE);
+        }
+
+        run(data.data(), data.size());
+    }
+    printf("%d random inputs ok\n", runs);
+    return 0;
+}
+
+#endif
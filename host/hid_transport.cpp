@@ -0,0 +1,105 @@
+#include "transport.h"
+#include "protocol.h"
+
+#include <stdexcept>
+
+#ifdef ARCIN_HOST_HIDAPI
+
+#include <hidapi/hidapi.h>
+#include <mutex>
+
+// hid_init() and hid_enumerate() are not thread safe.
+static std::mutex hidapi_lock;
+
+class HidTransport : public Transport {
+    private:
+        hid_device* dev;
+        DeviceInfo info;
+
+    public:
+        HidTransport(hid_device* dev, const DeviceInfo& info) : dev(dev), info(info) {}
+
+        ~HidTransport() {
+            hid_close(dev);
+        }
+
+        int send_feature_report(const uint8_t* data, size_t size) {
+            return hid_send_feature_report(dev, data, size);
+        }
+
+        int get_feature_report(uint8_t* data, size_t size) {
+            return hid_get_feature_report(dev, data, size);
+        }
+
+        int write(const uint8_t* data, size_t size) {
+            return hid_write(dev, data, size);
+        }
+
+        int read(uint8_t* data, size_t size, int timeout_ms) {
+            return hid_read_timeout(dev, data, size, timeout_ms);
+        }
+
+        bool is_bootloader() const {
+            return info.bootloader;
+        }
+
+        std::string name() const {
+            return info.path;
+        }
+};
+
+static void add_devices(
+    std::vector<DeviceInfo>& devices, uint16_t vid, uint16_t pid, bool bootloader) {
+
+    hid_device_info* list = hid_enumerate(vid, pid);
+
+    for (hid_device_info* it = list; it; it = it->next) {
+        DeviceInfo info;
+        info.path = it->path;
+        for (const wchar_t* c = it->serial_number; c && *c; c++) {
+            info.serial += (char)*c;
+        }
+        info.bootloader = bootloader;
+        devices.push_back(info);
+    }
+
+    hid_free_enumeration(list);
+}
+
+std::vector<DeviceInfo> enumerate_devices() {
+    std::lock_guard<std::mutex> guard(hidapi_lock);
+    std::vector<DeviceInfo> devices;
+
+    if (hid_init() != 0) {
+        throw std::runtime_error("hid_init failed");
+    }
+
+    add_devices(devices, ARCIN_VID, ARCIN_PID, false);
+    add_devices(devices, ARCIN_GENERIC_VID, ARCIN_GENERIC_PID, false);
+    add_devices(devices, ARCIN_BOOTLOADER_VID, ARCIN_BOOTLOADER_PID, true);
+
+    return devices;
+}
+
+std::unique_ptr<Transport> open_device(const DeviceInfo& info) {
+    std::lock_guard<std::mutex> guard(hidapi_lock);
+
+    hid_device* dev = hid_open_path(info.path.c_str());
+    if (!dev) {
+        throw std::runtime_error("cannot open " + info.path);
+    }
+
+    return std::unique_ptr<Transport>(new HidTransport(dev, info));
+}
+
+#else
+
+std::vector<DeviceInfo> enumerate_devices() {
+    return std::vector<DeviceInfo>();
+}
+
+std::unique_ptr<Transport> open_device(const DeviceInfo& info) {
+    throw std::runtime_error("built without hidapi, cannot open " + info.path);
+}
+
+#endif
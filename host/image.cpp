@@ -0,0 +1,207 @@
+#include "image.h"
+#include "protocol.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string.h>
+
+#define LZ_WINDOW 1024
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (0x7f + LZ_MIN_MATCH)
+#define LZ_MAX_LITERALS 0x80
+#define LZ_MAX_CANDIDATES 16
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc) {
+    static uint32_t table[256];
+
+    if (!table[1]) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int bit = 0; bit < 8; bit++) {
+                c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+            }
+            table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint32_t read32(const std::vector<uint8_t>& file, size_t offset) {
+    if (offset + 4 > file.size()) {
+        throw std::runtime_error("truncated ELF file");
+    }
+    return file[offset] | (file[offset + 1] << 8) |
+           (file[offset + 2] << 16) | ((uint32_t)file[offset + 3] << 24);
+}
+
+static uint16_t read16(const std::vector<uint8_t>& file, size_t offset) {
+    if (offset + 2 > file.size()) {
+        throw std::runtime_error("truncated ELF file");
+    }
+    return file[offset] | (file[offset + 1] << 8);
+}
+
+std::vector<uint8_t> load_image(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("cannot open " + path);
+    }
+
+    std::vector<uint8_t> file(
+        (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::vector<uint8_t> image;
+
+    if (file.size() >= 4 && memcmp(file.data(), "\x7f" "ELF", 4) == 0) {
+        // ELF32, little endian: PT_LOAD segments by physical address
+        uint32_t phoff = read32(file, 28);
+        uint16_t phentsize = read16(file, 42);
+        uint16_t phnum = read16(file, 44);
+
+        std::map<uint32_t, std::pair<uint32_t, uint32_t>> segments;
+        for (uint16_t i = 0; i < phnum; i++) {
+            size_t ph = phoff + i * phentsize;
+            if (read32(file, ph) != 1) { // PT_LOAD
+                continue;
+            }
+            uint32_t offset = read32(file, ph + 4);
+            uint32_t paddr = read32(file, ph + 12);
+            uint32_t filesz = read32(file, ph + 16);
+            if (offset + filesz > file.size()) {
+                throw std::runtime_error("truncated ELF file");
+            }
+            segments[paddr] = std::make_pair(offset, filesz);
+        }
+
+        for (auto& segment : segments) {
+            uint32_t lma = segment.first;
+            uint32_t offset = segment.second.first;
+            uint32_t size = segment.second.second;
+
+            // Workaround for LD aligning segments to a larger boundary than 8k.
+            if (lma == 0x8000000 && size >= 0x2000) {
+                lma += 0x2000;
+                offset += 0x2000;
+                size -= 0x2000;
+            }
+
+            if (size == 0) {
+                continue;
+            }
+            if (lma < FIRMWARE_BASE + image.size()) {
+                throw std::runtime_error("ELF segment outside of the firmware region");
+            }
+
+            image.resize(lma - FIRMWARE_BASE, 0);
+            image.insert(image.end(), &file[offset], &file[offset] + size);
+        }
+    } else {
+        image = file;
+    }
+
+    // Align to 64B
+    image.resize((image.size() + 63) & ~63, 0);
+
+    if (image.size() > IMAGE_TRAILER_ADDRESS - FIRMWARE_BASE) {
+        throw std::runtime_error("image does not fit in the firmware region");
+    }
+
+    return image;
+}
+
+std::vector<std::vector<uint8_t>> lz_compress_pages(
+    const std::vector<uint8_t>& data, size_t page_size) {
+
+    std::vector<std::vector<uint8_t>> chunks;
+    std::map<uint32_t, std::vector<size_t>> candidates;
+
+    auto insert = [&](size_t pos) {
+        if (pos + LZ_MIN_MATCH <= data.size()) {
+            uint32_t key = data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16);
+            std::vector<size_t>& positions = candidates[key];
+            positions.push_back(pos);
+            if (positions.size() > LZ_MAX_CANDIDATES) {
+                positions.erase(positions.begin());
+            }
+        }
+    };
+
+    for (size_t start = 0; start < data.size(); start += page_size) {
+        size_t end = std::min(start + page_size, data.size());
+        std::vector<uint8_t> out;
+        std::vector<uint8_t> literals;
+
+        auto flush_literals = [&]() {
+            if (!literals.empty()) {
+                out.push_back(literals.size() - 1);
+                out.insert(out.end(), literals.begin(), literals.end());
+                literals.clear();
+            }
+        };
+
+        size_t pos = start;
+        while (pos < end) {
+            size_t best_len = 0;
+            size_t best_offset = 0;
+            size_t limit = std::min<size_t>(LZ_MAX_MATCH, end - pos);
+
+            if (limit >= LZ_MIN_MATCH) {
+                uint32_t key = data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16);
+                auto found = candidates.find(key);
+                if (found != candidates.end()) {
+                    for (auto it = found->second.rbegin(); it != found->second.rend(); ++it) {
+                        size_t offset = pos - *it;
+                        if (offset > LZ_WINDOW) {
+                            break;
+                        }
+
+                        size_t length = 0;
+                        while (length < limit && data[*it + length] == data[pos + length]) {
+                            length++;
+                        }
+
+                        if (length > best_len) {
+                            best_len = length;
+                            best_offset = offset;
+                            if (length == limit) {
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (best_len >= LZ_MIN_MATCH) {
+                flush_literals();
+                out.push_back(0x80 | (best_len - LZ_MIN_MATCH));
+                out.push_back((best_offset - 1) & 0xff);
+                out.push_back((best_offset - 1) >> 8);
+
+                for (size_t p = pos; p < pos + best_len; p++) {
+                    insert(p);
+                }
+                pos += best_len;
+            } else {
+                literals.push_back(data[pos]);
+                insert(pos);
+                pos++;
+
+                if (literals.size() == LZ_MAX_LITERALS) {
+                    flush_literals();
+                }
+            }
+        }
+
+        flush_literals();
+        chunks.push_back(out);
+    }
+
+    return chunks;
+}
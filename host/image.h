@@ -0,0 +1,21 @@
+#ifndef ARCIN_HOST_IMAGE_H
+#define ARCIN_HOST_IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// CRC-32 as computed by zlib and by the bootloader's hardware CRC setup.
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
+
+// Loads a firmware image starting at FIRMWARE_BASE, from an ELF file (like
+// hidflash.py) or a raw binary, padded to 64 bytes.
+std::vector<uint8_t> load_image(const std::string& path);
+
+// Compresses data into one chunk per page for the bootloader's Decompressor,
+// the same as lzpack.py.
+std::vector<std::vector<uint8_t>> lz_compress_pages(
+    const std::vector<uint8_t>& data, size_t page_size);
+
+#endif
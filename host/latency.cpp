@@ -0,0 +1,287 @@
+#include "latency.h"
+
+#include <algorithm>
+#include <random>
+#include <string.h>
+#include <thread>
+
+#include "modeswitch.h"
+#include "replay.h"
+
+using std::chrono::steady_clock;
+
+// [LatencyHistogram]
+
+void LatencyHistogram::add(const LatencyHistogram& other) {
+    samples.insert(samples.end(), other.samples.begin(), other.samples.end());
+    missed += other.missed;
+}
+
+uint32_t LatencyHistogram::min() const {
+    return samples.empty() ? 0 : *std::min_element(samples.begin(), samples.end());
+}
+
+uint32_t LatencyHistogram::max() const {
+    return samples.empty() ? 0 : *std::max_element(samples.begin(), samples.end());
+}
+
+double LatencyHistogram::mean() const {
+    double total = 0;
+    for (uint32_t sample : samples) {
+        total += sample;
+    }
+    return samples.empty() ? 0 : total / samples.size();
+}
+
+uint32_t LatencyHistogram::percentile(double p) const {
+    if (samples.empty()) {
+        return 0;
+    }
+
+    std::vector<uint32_t> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    return sorted[std::min(sorted.size() - 1, size_t(sorted.size() * p / 100))];
+}
+
+std::vector<uint32_t> LatencyHistogram::bins() const {
+    std::vector<uint32_t> bins(LATENCY_BINS);
+    for (uint32_t sample : samples) {
+        bins[std::min<uint32_t>(sample / LATENCY_BIN_US, LATENCY_BINS - 1)]++;
+    }
+    return bins;
+}
+
+LatencyHistogram LatencyResult::keys() const {
+    LatencyHistogram keys;
+    for (int i = 0; i < LATENCY_INPUT_TT; i++) {
+        keys.add(inputs[i]);
+    }
+    return keys;
+}
+
+// [Script]
+
+std::vector<LatencyStimulus> latency_script(int count, uint32_t seed) {
+    std::vector<LatencyStimulus> script;
+    std::mt19937 random(seed);
+
+    // start a while in, so the pipeline has settled
+    uint32_t ms = 100;
+    int8_t tt_direction = 1;
+
+    for (int i = 0; i < count; i++) {
+        for (uint8_t input = 0; input < LATENCY_INPUTS; input++) {
+            if (input == LATENCY_INPUT_TT) {
+                script.push_back({ms * 1000 + uint32_t(random() % 1000), input, 0,
+                    int8_t(tt_direction * LATENCY_TT_STEPS)});
+                tt_direction = -tt_direction;
+                ms += LATENCY_TT_GAP_MS;
+                continue;
+            }
+
+            script.push_back({ms * 1000 + uint32_t(random() % 1000), input, uint16_t(1 << input), 0});
+            ms += LATENCY_KEY_GAP_MS;
+            script.push_back({ms * 1000 + uint32_t(random() % 1000), input, 0, 0});
+            ms += LATENCY_KEY_GAP_MS;
+        }
+    }
+
+    return script;
+}
+
+// [Simulation]
+
+std::vector<LatencyArrival> simulate_latency(
+    const config_t& config, const config_ext_t& config_ext,
+    const std::vector<LatencyStimulus>& stimuli, uint32_t dut_phase_us) {
+
+    std::vector<LatencyArrival> arrivals;
+    if (stimuli.empty()) {
+        return arrivals;
+    }
+
+    std::lock_guard<std::mutex> guard(firmware_logic_lock);
+
+    // firmware ms clock at bus time t
+    auto dut_ms = [&](uint32_t t) {
+        return (t + 1000000 - dut_phase_us % 1000) / 1000;
+    };
+
+    Time::host_time = dut_ms(0);
+    InputPipeline pipeline(config, config_ext);
+    analog_tt_reverse_direction = false;
+
+    uint16_t buttons = 0;
+    // TIM2 with the default sensitivity counts 0-255
+    uint32_t qe1_count = 0;
+
+    ReplayFrame frame;
+    pipeline.run(buttons, qe1_count, frame);
+    input_report_t pending = frame.report;
+
+    uint32_t interval = config.flags.PollAt250Hz ? 4000 : 1000;
+    uint32_t end = stimuli.back().time_us + LATENCY_TT_GAP_MS * 1000;
+
+    uint32_t next_tick = dut_phase_us % 1000;
+    uint32_t next_transaction = LATENCY_SIM_TRANSACTION_US;
+    size_t next = 0;
+
+    // The pipeline only changes on a clock tick or an input change, and the
+    // report is taken at the transactions, so those are the only times it
+    // needs to run.
+    while (true) {
+        uint32_t t = std::min(next_tick, next_transaction);
+        if (next < stimuli.size()) {
+            t = std::min(t, stimuli[next].time_us);
+        }
+        if (t > end) {
+            break;
+        }
+
+        Time::host_time = dut_ms(t);
+
+        while (next < stimuli.size() && stimuli[next].time_us == t) {
+            buttons = stimuli[next].buttons;
+            qe1_count = (qe1_count + stimuli[next].qe) & 0xff;
+            next++;
+        }
+
+        pipeline.run(buttons, qe1_count, frame);
+
+        if (t == next_transaction) {
+            arrivals.push_back({t, pending});
+            // filled by the next pass of the main loop
+            pending = frame.report;
+            next_transaction += interval;
+        }
+        if (t == next_tick) {
+            next_tick += 1000;
+        }
+    }
+
+    return arrivals;
+}
+
+// [Analysis]
+
+LatencyResult correlate_latency(
+    const std::vector<LatencyStimulus>& stimuli,
+    const std::vector<LatencyArrival>& arrivals) {
+
+    LatencyResult result;
+    size_t a = 0;
+
+    for (size_t i = 0; i < stimuli.size(); i++) {
+        const LatencyStimulus& stimulus = stimuli[i];
+        LatencyHistogram& histogram = result.inputs[stimulus.input];
+
+        while (a < arrivals.size() && arrivals[a].time_us <= stimulus.time_us) {
+            a++;
+        }
+        if (a == 0) {
+            histogram.missed++;
+            continue;
+        }
+
+        const input_report_t& baseline = arrivals[a - 1].report;
+        uint32_t until = (i + 1 < stimuli.size()) ? stimuli[i + 1].time_us : UINT32_MAX;
+
+        bool seen = false;
+        for (size_t j = a; j < arrivals.size() && arrivals[j].time_us < until; j++) {
+            if (memcmp(&arrivals[j].report, &baseline, sizeof(baseline)) != 0) {
+                uint32_t frame_end = (arrivals[j].time_us / 1000 + 1) * 1000;
+                histogram.samples.push_back(frame_end - stimulus.time_us);
+                seen = true;
+                break;
+            }
+        }
+
+        if (!seen) {
+            histogram.missed++;
+        }
+    }
+
+    return result;
+}
+
+// [Hardware]
+
+namespace {
+
+// Unwraps the 11-bit USB frame number. Calls must be less than a second apart.
+class FrameClock {
+    uint32_t frames = 0;
+    uint16_t last = 0;
+    bool started = false;
+
+    public:
+        uint32_t unwrap(uint16_t frame) {
+            frame &= 0x7ff;
+            if (!started) {
+                started = true;
+                // leave room for frames before the first one
+                frames = 2048 + frame;
+                last = frame;
+                return frames;
+            }
+
+            uint16_t ahead = (frame - last) & 0x7ff;
+            if (ahead < 1024) {
+                frames += ahead;
+                last = frame;
+                return frames;
+            }
+            return frames - ((last - frame) & 0x7ff);
+        }
+};
+
+}
+
+void measure_end_to_end(
+    Controller& dut, TestBoard& board, const std::vector<LatencyStimulus>& script,
+    std::vector<LatencyStimulus>& stimuli, std::vector<LatencyArrival>& arrivals) {
+
+    FrameClock clock;
+    board.set_buttons(0);
+    uint8_t sequence = board.last_event().sequence;
+
+    for (size_t i = 0; i < script.size(); i++) {
+        const LatencyStimulus& step = script[i];
+        uint32_t gap_ms = (i + 1 < script.size())
+            ? (script[i + 1].time_us - step.time_us) / 1000 : LATENCY_TT_GAP_MS;
+
+        // Empty the report queue, so that the reports read below carry the
+        // time they arrived.
+        dut.stream_inputs(std::chrono::milliseconds(5), [](const InputSample&) { return true; });
+
+        steady_clock::time_point before = steady_clock::now();
+        test_board_frame_time_t now = board.frame_time();
+        steady_clock::time_point after = steady_clock::now();
+
+        steady_clock::time_point anchor = before + (after - before) / 2;
+        uint32_t anchor_us = clock.unwrap(now.frame) * 1000 + now.offset_us;
+
+        board.schedule_stimulus(step.buttons, step.qe, step.time_us % 1000);
+
+        dut.stream_inputs(std::chrono::milliseconds(gap_ms), [&](const InputSample& sample) {
+            LatencyArrival arrival;
+            arrival.time_us = anchor_us + std::chrono::duration_cast<std::chrono::microseconds>(
+                sample.time - anchor).count();
+            arrival.report = {INPUT_REPORT_ID, sample.buttons, sample.axis_x, sample.axis_y};
+            arrivals.push_back(arrival);
+            return true;
+        });
+
+        test_board_event_t event = board.last_event();
+        if (event.sequence == sequence) {
+            throw ArcinError("the test board did not apply a stimulus");
+        }
+        sequence = event.sequence;
+
+        LatencyStimulus applied = step;
+        applied.time_us = clock.unwrap(event.frame) * 1000 + event.offset_us;
+        stimuli.push_back(applied);
+    }
+
+    board.set_buttons(0);
+}
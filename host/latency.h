@@ -0,0 +1,100 @@
+#ifndef ARCIN_HOST_LATENCY_H
+#define ARCIN_HOST_LATENCY_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "arcin_host.h"
+#include "testboard.h"
+
+// End-to-end input latency: from a change on the controller's inputs to the
+// end of the USB frame in which the input report carrying it reaches the
+// host. Times are in bus us, frame number * 1000 + offset into the frame,
+// with frame numbers unwrapped.
+//
+// On hardware, a test board (test/main.cpp) applies each stimulus at a chosen
+// offset after a start of frame and reports when it did; report arrivals are
+// placed on the same clock through the board's frame counter. The same
+// stimuli also run through the firmware's input pipeline built for the host,
+// with the USB polling and the pipeline's once per ms sampling simulated, so
+// the analysis can be checked without hardware and settings compared offline.
+
+// inputs 0-10 are buttons 1-9, start and select, 11 is the turntable
+#define LATENCY_INPUTS 12
+#define LATENCY_INPUT_TT 11
+
+#define LATENCY_BIN_US 250
+#define LATENCY_BINS 64
+
+struct LatencyStimulus {
+    uint32_t time_us;
+    uint8_t input;
+    // test board state from this time on
+    uint16_t buttons;
+    // encoder steps to make
+    int8_t qe;
+};
+
+struct LatencyArrival {
+    uint32_t time_us;
+    input_report_t report;
+};
+
+struct LatencyHistogram {
+    // latency of each stimulus that was seen, in us
+    std::vector<uint32_t> samples;
+    // stimuli that did not change the report before the next one
+    uint32_t missed = 0;
+
+    void add(const LatencyHistogram& other);
+
+    uint32_t min() const;
+    uint32_t max() const;
+    double mean() const;
+    uint32_t percentile(double p) const;
+
+    // counts per LATENCY_BIN_US, the last bin holds everything beyond
+    std::vector<uint32_t> bins() const;
+};
+
+struct LatencyResult {
+    LatencyHistogram inputs[LATENCY_INPUTS];
+
+    // all buttons together
+    LatencyHistogram keys() const;
+};
+
+// count presses and releases of every input, in turn, each at a random
+// offset into its frame. Buttons are held for LATENCY_KEY_GAP_MS. The
+// turntable alternates direction, LATENCY_TT_GAP_MS apart so that the digital
+// turntable's sustain has run out before the next step.
+#define LATENCY_KEY_GAP_MS 40
+#define LATENCY_TT_GAP_MS 300
+#define LATENCY_TT_STEPS 8
+
+std::vector<LatencyStimulus> latency_script(int count, uint32_t seed);
+
+// The reports the firmware would send for the stimuli: an IN transaction
+// LATENCY_SIM_TRANSACTION_US into every frame, or every fourth with
+// PollAt250Hz, each carrying the report built right after the one before it.
+// The firmware's ms clock ticks dut_phase_us into every frame.
+#define LATENCY_SIM_TRANSACTION_US 50
+
+std::vector<LatencyArrival> simulate_latency(
+    const config_t& config, const config_ext_t& config_ext,
+    const std::vector<LatencyStimulus>& stimuli, uint32_t dut_phase_us);
+
+// Matches every stimulus with the first report after it that differs from
+// the last one before it.
+LatencyResult correlate_latency(
+    const std::vector<LatencyStimulus>& stimuli,
+    const std::vector<LatencyArrival>& arrivals);
+
+// Runs the script on hardware. Returns the stimuli as the board applied them,
+// and the reports as they arrived. Arrival frames come from host read times,
+// which trail the transaction, so an arrival can land one frame late.
+void measure_end_to_end(
+    Controller& dut, TestBoard& board, const std::vector<LatencyStimulus>& script,
+    std::vector<LatencyStimulus>& stimuli, std::vector<LatencyArrival>& arrivals);
+
+#endif
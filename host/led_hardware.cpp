@@ -0,0 +1,10 @@
+#include "led_hardware.h"
+
+HostRegisters TIM4, TIM16, STK;
+HostDma DMA1;
+HostRcc RCC;
+HostGpio GPIOA, GPIOB;
+
+// arcin/main.cpp's, which rgbmanager.h reads
+bool global_led_enable = true;
+uint32_t debug_value;
@@ -0,0 +1,67 @@
+#ifndef ARCIN_HOST_LED_HARDWARE_H
+#define ARCIN_HOST_LED_HARDWARE_H
+
+#include <stdint.h>
+
+// Stands in for the laks peripherals that arcin/ws2812b.h and
+// arcin/fastled_shim.h program, so that RGBManager builds for the host. Like
+// arcin/main.cpp, include this before rgbmanager.h. On the host every strip is
+// a WS2812B_OUTPUT_CAPTURE, which never touches them.
+
+struct HostRegisters {
+    uint32_t ARR, CCR1, CCR3, CCMR1, CCMR2, CCER, BDTR, DIER, CR1;
+    uint32_t LOAD, VAL;
+};
+
+extern HostRegisters TIM4, TIM16, STK;
+
+struct HostDma {
+    struct {
+        struct {
+            uint32_t CR, NDTR, PAR, MAR;
+        } C[7];
+        uint32_t IFCR;
+    } reg;
+};
+
+extern HostDma DMA1;
+
+struct HostRcc {
+    enum { DMA1, TIM4, TIM16 };
+
+    void enable(int) {}
+};
+
+extern HostRcc RCC;
+
+namespace Interrupt {
+    enum { DMA1_Channel3, DMA1_Channel7 };
+
+    inline void enable(int) {}
+}
+
+struct Pin {
+    enum { AF };
+    enum { PullNone };
+
+    void set_af(int) {}
+    void set_mode(int) {}
+    void set_pull(int) {}
+};
+
+struct HostGpio {
+    Pin pins[16];
+
+    Pin& operator[](int pin) {
+        return pins[pin];
+    }
+};
+
+extern HostGpio GPIOA, GPIOB;
+
+// as in arcin/usb_strings.h, for seeding random8()
+inline uint32_t serial_num() {
+    return 0x41524349; // "ARCI"
+}
+
+#endif
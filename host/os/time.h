@@ -0,0 +1,19 @@
+#ifndef ARCIN_HOST_OS_TIME_H
+#define ARCIN_HOST_OS_TIME_H
+
+#include <stdint.h>
+
+// Stands in for laks' os/time.h when firmware sources are built for the host.
+// The clock only moves when the replay moves it.
+namespace Time {
+    extern uint32_t host_time;
+
+    inline uint32_t time() {
+        return host_time;
+    }
+
+    // Nothing on the host waits for hardware.
+    inline void sleep(uint32_t ms) {}
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef ARCIN_HOST_PROTOCOL_H
+#define ARCIN_HOST_PROTOCOL_H
+
+#include <stdint.h>
+#include "config.h"
+#include "reports.h"
+#include "../bootloader/flash_protocol.h"
+
+// USB IDs. The runtime uses the Infinitas controller IDs unless the firmware
+// was built for generic hardware IDs.
+#define ARCIN_VID 0x1ccf
+#define ARCIN_PID 0x8048
+#define ARCIN_GENERIC_VID 0x1d50
+#define ARCIN_GENERIC_PID 0x6080
+#define ARCIN_BOOTLOADER_VID 0x1d50
+#define ARCIN_BOOTLOADER_PID 0x6084
+
+// Runtime reports, see arcin/reports.h
+#define INPUT_REPORT_ID 0x01
+#define BOOTLOADER_REPORT_ID 0xb0
+#define CONFIG_REPORT_ID 0xc0
+
+#define CONFIG_SEGMENT_SIZE 60
+
+// Functions of the runtime's bootloader feature report
+#define RUNTIME_FUNC_RESET_BOOTLOADER 0x10
+#define RUNTIME_FUNC_RESET 0x20
+
+// Bootloader functions, see bootloader/main.cpp. Status reports, page
+// buffers and the image trailer are in bootloader/flash_protocol.h.
+#define BOOTLOADER_FUNC_RESET 0x11
+#define BOOTLOADER_FUNC_PREPARE 0x20
+#define BOOTLOADER_FUNC_FINISH 0x21
+#define BOOTLOADER_FUNC_PREPARE_COMPRESSED 0x22
+#define BOOTLOADER_FUNC_VERIFY 0x23
+#define BOOTLOADER_FUNC_SEEK 0x40
+#define BOOTLOADER_FUNC_PAGE_CRC 0x80
+#define BOOTLOADER_FUNC_PAGE_MASK 0x3f
+
+#define FIRMWARE_BASE 0x8002000
+#define FIRMWARE_END 0x8020000
+#define FIRMWARE_PAGE_COUNT ((FIRMWARE_END - FIRMWARE_BASE) / FLASH_PAGE_SIZE)
+
+// Image trailer, see arcin/arcin.ld
+#define IMAGE_TRAILER_ADDRESS 0x801e7f0
+
+// Config pages, see arcin/main.cpp
+#define CONFIG_EXT_ADDRESS 0x801e800
+#define CONFIG_ADDRESS 0x801f800
+
+#endif
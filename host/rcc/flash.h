@@ -0,0 +1,40 @@
+#ifndef ARCIN_HOST_RCC_FLASH_H
+#define ARCIN_HOST_RCC_FLASH_H
+
+#include <stdint.h>
+
+// Stands in for laks' rcc/flash.h when Configloader or the bootloader's
+// Flashloader is built for the host. A Configloader there points at a buffer
+// instead of a flash page: reads work as on the controller, and writes program
+// the buffer directly, with erasing and the flash controller left out.
+
+// Address register. Every page erase writes its address here just before
+// setting STRT, so a host that does emulate erasing (the simulated arcin) sets
+// erase.
+struct FLASH_AR_t {
+    volatile uint32_t value;
+    void (*erase)(uint32_t addr);
+
+    void operator=(uint32_t addr) {
+        value = addr;
+        if (erase) {
+            erase(addr);
+        }
+    }
+};
+
+struct FLASH_t {
+    volatile uint32_t ACR;
+    volatile uint32_t KEYR;
+    volatile uint32_t OPTKEYR;
+    volatile uint32_t SR;
+    volatile uint32_t CR;
+    FLASH_AR_t AR;
+    volatile uint32_t RESERVED;
+    volatile uint32_t OBR;
+    volatile uint32_t WRPR;
+};
+
+static FLASH_t FLASH;
+
+#endif
@@ -0,0 +1,222 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include "analog_button.h"
+#include "debounce.h"
+#include "inf_defines.h"
+#include "modeswitch.h"
+#include "multifunc.h"
+#include "remap.h"
+
+std::mutex firmware_logic_lock;
+
+uint32_t Time::host_time = 0;
+
+// Lights are not simulated.
+void schedule_led(uint16_t time_from_now_ms, uint16_t leds_a, uint16_t leds_b) {}
+
+// Same as arcin/main.cpp
+static const uint16_t infinitas_keys[] = {
+    INFINITAS_BUTTON_1,
+    INFINITAS_BUTTON_2,
+    INFINITAS_BUTTON_3,
+    INFINITAS_BUTTON_4,
+    INFINITAS_BUTTON_5,
+    INFINITAS_BUTTON_6,
+    INFINITAS_BUTTON_7,
+    INFINITAS_BUTTON_E1,
+    INFINITAS_BUTTON_E2,
+    INFINITAS_BUTTON_E3,
+    INFINITAS_BUTTON_E4
+};
+
+// [InputPipeline]
+
+InputPipeline::InputPipeline(const config_t& config, const config_ext_t& config_ext) : config(config) {
+    config_t boot_config = config;
+    runtime_flags = initialize_mode_switch(&boot_config, (chord_config*)&config_ext.chords);
+    init_multi_function_keys(&config_ext.gestures, runtime_flags, config.select_tap_window);
+    remap_init(config, &config_ext.remap);
+
+    qe1_sens = runtime_qe1_sens;
+    debounce_enable = runtime_flags.DebounceEnable;
+    debounce_ticks = runtime_debounce_ticks;
+    set_debounce(debounce_enable, debounce_ticks);
+    debounce_init(&debounce_state_raw, 4);
+}
+
+void InputPipeline::set_debounce(bool enable, uint8_t ticks) {
+    if (enable) {
+        debounce_init(&debounce_state_keys, ticks);
+    }
+
+    uint8_t window_effectors = 4;
+    if (enable) {
+        window_effectors = std::max(window_effectors, ticks);
+    }
+
+    debounce_init(&debounce_state_effectors, window_effectors);
+}
+
+void InputPipeline::run(uint16_t buttons, uint32_t qe1_count, ReplayFrame& frame) {
+    if (config.flags.Ws2812b) {
+        buttons &= (~ARCIN_PIN_BUTTON_9);
+    }
+
+    // [MODE]
+    if (runtime_flags.ModeSwitchEnable) {
+        uint16_t debounce_mask = (INFINITAS_BUTTON_ALL | INFINITAS_EFFECTORS_ALL);
+        uint16_t raw_debounced =
+            (buttons & ~debounce_mask) |
+            (debounce(&debounce_state_raw, buttons & debounce_mask));
+
+        runtime_flags = process_mode_switch(raw_debounced);
+        qe1_sens = runtime_qe1_sens;
+
+        if (debounce_enable != runtime_flags.DebounceEnable ||
+            debounce_ticks != runtime_debounce_ticks) {
+            debounce_enable = runtime_flags.DebounceEnable;
+            debounce_ticks = runtime_debounce_ticks;
+            set_debounce(debounce_enable, debounce_ticks);
+        }
+    }
+
+    // [REMAP]
+    uint16_t remapped = remap_buttons(buttons);
+
+    // [DEBOUNCE]
+    if (runtime_flags.DebounceEnable) {
+        uint16_t debounce_mask = INFINITAS_BUTTON_ALL;
+        remapped =
+            (remapped & ~debounce_mask) |
+            (debounce(&debounce_state_keys, remapped & debounce_mask));
+    }
+
+    {
+        uint16_t debounce_mask = INFINITAS_EFFECTORS_ALL;
+        remapped =
+            (remapped & ~debounce_mask) |
+            (debounce(&debounce_state_effectors, remapped & debounce_mask));
+    }
+
+    // [DIGITAL QE1]
+    int8_t tt1_report = tt1.poll(qe1_count);
+
+    // [GESTURES]
+    remapped = get_multi_function_keys(remapped);
+
+    // [GAMEPAD]
+    input_report_t& report = frame.report;
+    report.report_id = INPUT_REPORT_ID;
+
+    if (runtime_flags.JoyInputForceDisable) {
+        report.buttons = 0;
+    } else {
+        if (runtime_flags.DigitalTTEnable) {
+            remapped |= remap_tt(tt1_report);
+        }
+        report.buttons = remapped;
+    }
+
+    if (runtime_flags.JoyInputForceDisable ||
+        (runtime_flags.DigitalTTEnable && !runtime_flags.AnalogTTForceEnable)) {
+        report.axis_x = uint8_t(127);
+    } else {
+        uint32_t count = qe1_count;
+        if (qe1_sens < 0) {
+            count /= -qe1_sens;
+        } else if (qe1_sens > 0) {
+            count *= qe1_sens;
+        }
+
+        if (analog_tt_reverse_direction) {
+            report.axis_x = uint8_t(255 - count);
+        } else {
+            report.axis_x = uint8_t(count);
+        }
+    }
+
+    report.axis_y = 127;
+
+    // [KEYBOARD]
+    memset(frame.scancodes, 0, sizeof(frame.scancodes));
+    uint8_t nextscan = 0;
+
+    if (runtime_flags.KeyboardEnable) {
+        for (uint8_t i = 0; i < sizeof(infinitas_keys) / sizeof(infinitas_keys[0]); i++) {
+            if (remapped & infinitas_keys[i]) {
+                frame.scancodes[nextscan++] = config.keycodes[i];
+            }
+        }
+
+        if (tt1_report == -1) {
+            frame.scancodes[nextscan++] = config.keycodes[11];
+        } else if (tt1_report == 1) {
+            frame.scancodes[nextscan++] = config.keycodes[12];
+        }
+    }
+
+    frame.runtime_flags = runtime_flags;
+}
+
+namespace {
+
+std::vector<ReplayFrame> run_replay(
+    const Trace& trace, const config_t& config, const config_ext_t& config_ext,
+    bool recorded_state) {
+
+    std::vector<ReplayFrame> frames;
+    if (trace.samples.empty()) {
+        return frames;
+    }
+
+    std::lock_guard<std::mutex> guard(firmware_logic_lock);
+
+    uint32_t start = trace.times.front();
+    uint32_t end = std::max(trace.header.stop_time, trace.times.back());
+    Time::host_time = start;
+
+    // Chords, gestures and the turntable compare times, so the pipeline is
+    // built at the time of the first sample.
+    InputPipeline pipeline(config, config_ext);
+    analog_tt_reverse_direction =
+        recorded_state && (trace.header.flags & INPUT_TRACE_TT_REVERSED);
+
+    size_t next = 0;
+    input_trace_sample_t sample = trace.samples.front();
+
+    for (uint32_t now = start; now - start <= end - start; now++) {
+        Time::host_time = now;
+        while (next < trace.samples.size() && trace.times[next] - start <= now - start) {
+            sample = trace.samples[next++];
+        }
+
+        ReplayFrame frame;
+        frame.time = now;
+        frame.raw = sample.buttons;
+        pipeline.run(sample.buttons, sample.qe1, frame);
+        frames.push_back(frame);
+    }
+
+    return frames;
+}
+
+}
+
+std::vector<ReplayFrame> replay_trace(const Trace& trace) {
+    // Start from the runtime state, which chords may have moved away from the config.
+    config_t config = trace.config;
+    config.flags = trace.header.runtime_flags;
+    config.qe1_sens = trace.header.qe1_sens;
+    config.debounce_ticks = trace.header.debounce_ticks;
+
+    return run_replay(trace, config, trace.config_ext, true);
+}
+
+std::vector<ReplayFrame> replay_trace(
+    const Trace& trace, const config_t& config, const config_ext_t& config_ext) {
+
+    return run_replay(trace, config, config_ext, false);
+}
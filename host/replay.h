@@ -0,0 +1,68 @@
+#ifndef ARCIN_HOST_REPLAY_H
+#define ARCIN_HOST_REPLAY_H
+
+#include <mutex>
+#include <vector>
+
+#include "arcin_host.h"
+#include "analog_button.h"
+#include "debounce.h"
+
+// What the firmware would have sent in one ms.
+struct ReplayFrame {
+    uint32_t time;
+    // raw buttons from the trace
+    uint16_t raw;
+    // after chords, as used for the rest of the pipeline
+    config_flags runtime_flags;
+    input_report_t report;
+    uint8_t scancodes[13];
+};
+
+// The input part of main() in arcin/main.cpp, with the state main() keeps in
+// locals and file globals: chords, remap, debounce, digital turntable,
+// gestures and report building. Callers hold firmware_logic_lock, set
+// Time::host_time (see os/time.h) and call run() at least once per ms.
+class InputPipeline {
+    const config_t& config;
+
+    config_flags runtime_flags;
+    int8_t qe1_sens;
+    bool debounce_enable;
+    uint8_t debounce_ticks;
+
+    debounce_state debounce_state_raw;
+    debounce_state debounce_state_keys;
+    debounce_state debounce_state_effectors;
+
+    analog_button tt1{4, 200, true};
+
+    void set_debounce(bool enable, uint8_t ticks);
+
+    public:
+        // Starts over the firmware globals; config must outlive the pipeline.
+        InputPipeline(const config_t& config, const config_ext_t& config_ext);
+
+        void run(uint16_t buttons, uint32_t qe1_count, ReplayFrame& frame);
+};
+
+// Runs a trace through the firmware's input pipeline, built for the host from
+// the same sources: chords, remap, debounce, digital turntable, gestures and
+// report building, in the order of main() in arcin/main.cpp. There is one
+// pass per ms, from the first sample until recording stopped; the firmware
+// runs several passes per ms, but debounce only samples once per ms and the
+// rest are time based, so the result is the same. Host hints (output report 5)
+// are not recorded and so not replayed.
+//
+// The pipeline starts from the state recorded in the trace header.
+std::vector<ReplayFrame> replay_trace(const Trace& trace);
+
+// The same, with other settings; the trace's runtime state is ignored.
+std::vector<ReplayFrame> replay_trace(
+    const Trace& trace, const config_t& config, const config_ext_t& config_ext);
+
+// The firmware sources keep their state in globals. Anything running them
+// (the replay, the simulated controllers) holds this lock.
+extern std::mutex firmware_logic_lock;
+
+#endif
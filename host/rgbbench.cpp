@@ -0,0 +1,154 @@
+// Host benchmark of the LED kernels, see arcin/rgb_kernel_benchmark.h. Prints
+// ns per pixel for the packed kernels and for the CRGB code they replaced, and
+// the largest difference in any channel between the two. Then replays a spin
+// through turntable activity (arcin/rgb_tt_activity.h), one update per frame,
+// and prints ns per update and the activity it reached.
+//
+//   arcinrgbbench [--trace FILE] [--frame MS]
+//
+// The spin is a synthetic scratch, or with --trace, the turntable from a
+// recorded input trace. Frames are 10ms unless --frame says otherwise.
+//
+// The host runs the portable versions of the packed primitives, so these
+// compare the algorithms, not UQADD8; DEBUG_RGB_BENCHMARK has the cycles on
+// the device.
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "arcin_host.h"
+#include "rgb_kernel_benchmark.h"
+#include "rgb_tt_activity.h"
+
+struct HostClock {
+    static uint32_t now() {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+// Encoder ticks in each ms of a trace, as the firmware hands them to the LEDs
+// (counter-clockwise is positive on the encoder, clockwise for the LEDs).
+static std::vector<int32_t> trace_spin(const Trace& trace) {
+    std::vector<int32_t> spin;
+    int32_t range = trace.header.qe1_range ? trace.header.qe1_range : 256;
+
+    for (size_t i = 0; i + 1 < trace.samples.size(); i++) {
+        int32_t delta = int32_t(trace.samples[i + 1].qe1) - trace.samples[i].qe1;
+        if (delta > range / 2) {
+            delta -= range;
+        } else if (delta < -range / 2) {
+            delta += range;
+        }
+
+        spin.insert(spin.end(), trace.times[i + 1] - trace.times[i] - 1, 0);
+        spin.push_back(-delta);
+    }
+    return spin;
+}
+
+// A scratch back and forth, speeding up to twice full scale, then a stop
+static std::vector<int32_t> synthetic_spin() {
+    std::vector<int32_t> spin;
+    for (uint32_t ms = 0; ms < 10000; ms++) {
+        uint32_t t = ms % 400;
+        int32_t speed = (ms / 400 + 1) * TT_ACTIVITY_FULL_SCALE / 12;
+        int32_t ticks_per_s = (t < 200) ? speed : -speed;
+        spin.push_back(((ms + 1) * ticks_per_s) / 1000 - (ms * ticks_per_s) / 1000);
+    }
+    spin.insert(spin.end(), 2000, 0);
+    return spin;
+}
+
+static void bench_tt_activity(const std::vector<int32_t>& spin, uint32_t frame_ms) {
+    std::vector<int32_t> frames;
+    for (size_t start = 0; start + frame_ms <= spin.size(); start += frame_ms) {
+        int32_t ticks = 0;
+        for (size_t t = start; t < start + frame_ms; t++) {
+            ticks += spin[t];
+        }
+        frames.push_back(ticks);
+    }
+    if (frames.empty()) {
+        printf("the spin is shorter than a frame\n");
+        return;
+    }
+
+    // best of a few runs, the others were preempted or still warming up
+    uint32_t best = UINT32_MAX;
+    int8_t peak = 0;
+    uint32_t active = 0;
+    for (int run = 0; run < 20; run++) {
+        TurntableActivity tt;
+        peak = 0;
+        active = 0;
+
+        uint32_t start = HostClock::now();
+        for (int32_t ticks : frames) {
+            int8_t activity = tt.update(ticks, frame_ms, 400);
+            peak = (abs(peak) < abs(activity)) ? activity : peak;
+            active += (activity != 0);
+        }
+        uint32_t ns = HostClock::now() - start;
+        best = (ns < best) ? ns : best;
+    }
+
+    printf("\n%zu ms of turntable in %ums frames: %.1f ns/update, peak activity %d, "
+        "active in %u of %zu frames\n",
+        spin.size(), frame_ms, double(best) / frames.size(), peak, active, frames.size());
+}
+
+int main(int argc, char** argv) {
+    const char* trace_path = nullptr;
+    uint32_t frame_ms = 10;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (!strcmp(argv[i], "--frame") && i + 1 < argc) {
+            frame_ms = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--trace FILE] [--frame MS]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (frame_ms == 0) {
+        frame_ms = 1;
+    }
+
+    std::vector<int32_t> spin;
+    try {
+        spin = trace_path ? trace_spin(Trace::load(trace_path)) : synthetic_spin();
+    } catch (std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    printf("%-16s %12s %12s %8s %10s\n",
+        "kernel", "packed ns/px", "scalar ns/px", "speedup", "max diff");
+
+    for (uint8_t kernel = 0; kernel < RGB_KERNEL_BENCHMARK_KERNELS; kernel++) {
+        // best of a few runs, the others were preempted or still warming up
+        uint32_t packed = UINT32_MAX;
+        uint32_t scalar = UINT32_MAX;
+        for (int run = 0; run < 20; run++) {
+            uint32_t p = rgb_kernel_benchmark_time<HostClock>(kernel, true);
+            uint32_t s = rgb_kernel_benchmark_time<HostClock>(kernel, false);
+            packed = (p < packed) ? p : packed;
+            scalar = (s < scalar) ? s : scalar;
+        }
+
+        printf("%-16s %12.2f %12.2f %7.1fx %10u\n",
+            rgb_kernel_benchmark_names[kernel],
+            double(packed) / RGB_KERNEL_BENCHMARK_LEDS,
+            double(scalar) / RGB_KERNEL_BENCHMARK_LEDS,
+            packed ? double(scalar) / packed : 0.0,
+            rgb_kernel_benchmark_difference(kernel));
+    }
+
+    bench_tt_activity(spin, frame_ms);
+    return 0;
+}
@@ -0,0 +1,303 @@
+// Renders the LED effects for any settings without a controller, see
+// effect_render.h. Writes the frames as a PPM image (one row per frame) or
+// prints a hash of every frame, and compares them against a file written with
+// --hashes. Prints the render time per frame next to the strip transfer time;
+// --all-modes does that for every mode, to catch effects that blow the frame
+// budget.
+//
+//   arcinrgbrender --mode 9 --leds 60 --frames 300 --ppm pacifica.ppm
+//   arcinrgbrender --mode 3 --react-to-tt --spin 30:0,60:8,60:-8 --hashes > golden.txt
+//   arcinrgbrender --mode 3 --react-to-tt --spin 30:0,60:8,60:-8 --golden golden.txt
+//   arcinrgbrender --profile my.profile --strip 2 --all-modes
+//
+// This times the host, which is much faster than the controller; the ratios
+// between modes carry over. DEBUG_RGB_BENCHMARK has the cycles on the device.
+
+#include <fstream>
+#include <iterator>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "arcin_host.h"
+// last, arcin/ws2812b.h defines min and max
+#include "effect_render.h"
+
+static void usage() {
+    fprintf(stderr,
+        "usage: arcinrgbrender [OPTIONS]\n"
+        "\n"
+        "  --profile FILE [--strip 2]  start from a saved profile's settings\n"
+        "  --mode N  --leds N  --palette N  --multiplicity N\n"
+        "  --speed N                   idle animation speed\n"
+        "  --tt-speed N                turntable animation speed, [-100, 100]\n"
+        "  --darkness N  --idle-brightness N\n"
+        "  --primary RRGGBB  --secondary RRGGBB  --tertiary RRGGBB\n"
+        "  --react-to-tt  --flip  --fade-fast  --fade-slow\n"
+        "  --program FILE              effect program, from rgbprog.py --save\n"
+        "  --frames N                  number of frames (100)\n"
+        "  --frame-ms N                simulated frame period (16)\n"
+        "  --spin SCRIPT               turntable: frames:ticks_per_frame,...\n"
+        "  --ppm FILE                  write all frames, one row per frame\n"
+        "  --hashes                    print a hash of every frame\n"
+        "  --golden FILE               compare against a file from --hashes\n"
+        "  --all-modes                 render time of every mode\n");
+    exit(2);
+}
+
+static ColorRgb parse_color(const char* text) {
+    uint32_t value = strtoul(text, nullptr, 16);
+    return ColorRgb{uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value)};
+}
+
+static std::vector<SpinStep> parse_spin(const std::string& text) {
+    std::vector<SpinStep> spin;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+
+        std::string item = text.substr(start, end - start);
+        size_t colon = item.find(':');
+        if (colon == std::string::npos) {
+            throw ArcinError("bad spin step " + item + ", expected frames:ticks_per_frame");
+        }
+        spin.push_back({uint32_t(atoi(item.c_str())), atoi(item.c_str() + colon + 1)});
+        start = end + 1;
+    }
+    return spin;
+}
+
+// FNV-1a
+static uint32_t hash_frame(const CRGB* leds, uint8_t num_leds) {
+    uint32_t hash = 2166136261u;
+    for (uint8_t i = 0; i < num_leds; i++) {
+        for (uint8_t c = 0; c < 3; c++) {
+            hash = (hash ^ leds[i].raw[c]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+struct RenderOptions {
+    rgb_config rgb;
+    std::vector<uint8_t> program;
+    uint32_t frames = 100;
+    uint32_t frame_ms = 16;
+    std::vector<SpinStep> spin;
+};
+
+struct RenderResult {
+    uint8_t num_leds = 0;
+    std::vector<uint8_t> pixels;
+    std::vector<uint32_t> hashes;
+    uint64_t total_ns = 0;
+    uint32_t worst_ns = 0;
+};
+
+static RenderResult render(const RenderOptions& options) {
+    EffectRender render(options.rgb, options.frame_ms, options.spin);
+    if (!options.program.empty() &&
+        !render.load_program(options.program.data(), options.program.size())) {
+        throw ArcinError("the effect program was rejected");
+    }
+
+    RenderResult result;
+    for (uint32_t frame = 0; frame < options.frames; frame++) {
+        uint32_t ns = render.render_next();
+        result.total_ns += ns;
+        result.worst_ns = max(result.worst_ns, ns);
+
+        result.num_leds = render.num_leds();
+        const uint8_t* leds = (const uint8_t*)render.leds();
+        result.pixels.insert(result.pixels.end(), leds, leds + result.num_leds * sizeof(CRGB));
+        result.hashes.push_back(hash_frame(render.leds(), result.num_leds));
+    }
+    return result;
+}
+
+static void print_cost(const char* what, const RenderResult& result, uint32_t frames) {
+    fprintf(stderr, "%s%u LEDs: render %.1f us average, %.1f us worst, transfer %u us\n",
+        what, result.num_leds, result.total_ns / 1000.0 / max(frames, 1u),
+        result.worst_ns / 1000.0, result.num_leds * 30 + 50);
+}
+
+static void write_ppm(const std::string& path, const RenderResult& result) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) {
+        throw ArcinError("can't write " + path);
+    }
+    fprintf(f, "P6\n%u %zu\n255\n", result.num_leds, result.hashes.size());
+    fwrite(result.pixels.data(), 1, result.pixels.size(), f);
+    fclose(f);
+}
+
+static int compare_golden(const std::string& path, const RenderResult& result) {
+    std::ifstream in(path);
+    std::vector<uint32_t> expected;
+    uint32_t frame, hash;
+    while (in >> frame >> std::hex >> hash >> std::dec) {
+        expected.push_back(hash);
+    }
+
+    if (expected.size() != result.hashes.size()) {
+        fprintf(stderr, "Frame count differs: %zu, expected %zu\n",
+            result.hashes.size(), expected.size());
+        return 1;
+    }
+
+    size_t mismatches = 0;
+    size_t first = 0;
+    for (size_t i = 0; i < expected.size(); i++) {
+        if (expected[i] != result.hashes[i]) {
+            first = mismatches ? first : i;
+            mismatches++;
+        }
+    }
+    if (mismatches) {
+        fprintf(stderr, "%zu frames differ, first at frame %zu\n", mismatches, first);
+        return 1;
+    }
+
+    fprintf(stderr, "All %zu frames match.\n", expected.size());
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    RenderOptions options;
+    memset(&options.rgb, 0, sizeof(options.rgb));
+    options.rgb.NumberOfLeds = 12;
+    options.rgb.Multiplicity = 1;
+    options.rgb.RgbPrimary = parse_color("ff0000");
+    options.rgb.RgbSecondary = parse_color("00ff00");
+    options.rgb.RgbTertiary = parse_color("0000ff");
+
+    std::string ppm, golden;
+    bool hashes = false;
+    bool all_modes = false;
+
+    try {
+        // the profile goes first, the other options change its settings
+        for (int i = 1; i + 1 < argc; i++) {
+            if (!strcmp(argv[i], "--profile")) {
+                Profile profile = Profile::load(argv[i + 1]);
+                bool strip2 = false;
+                for (int j = 1; j + 1 < argc; j++) {
+                    strip2 |= !strcmp(argv[j], "--strip") && !strcmp(argv[j + 1], "2");
+                }
+                options.rgb = strip2 ? profile.config_ext.rgb2 : profile.config.rgb;
+            }
+        }
+
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+
+            if (arg == "--react-to-tt") {
+                options.rgb.Flags.ReactToTt = 1;
+                continue;
+            } else if (arg == "--flip") {
+                options.rgb.Flags.FlipDirection = 1;
+                continue;
+            } else if (arg == "--fade-fast") {
+                options.rgb.Flags.FadeOutFast = 1;
+                continue;
+            } else if (arg == "--fade-slow") {
+                options.rgb.Flags.FadeOutSlow = 1;
+                continue;
+            } else if (arg == "--hashes") {
+                hashes = true;
+                continue;
+            } else if (arg == "--all-modes") {
+                all_modes = true;
+                continue;
+            }
+
+            if (i + 1 == argc) {
+                usage();
+            }
+            const char* value = argv[++i];
+
+            if (arg == "--profile" || arg == "--strip") {
+                // read above
+            } else if (arg == "--mode") {
+                options.rgb.Mode = atoi(value);
+            } else if (arg == "--leds") {
+                options.rgb.NumberOfLeds = atoi(value);
+            } else if (arg == "--palette") {
+                options.rgb.ColorPalette = atoi(value);
+            } else if (arg == "--multiplicity") {
+                options.rgb.Multiplicity = atoi(value);
+            } else if (arg == "--speed") {
+                options.rgb.IdleAnimationSpeed = atoi(value);
+            } else if (arg == "--tt-speed") {
+                options.rgb.TtAnimationSpeed = atoi(value);
+            } else if (arg == "--darkness") {
+                options.rgb.Darkness = atoi(value);
+            } else if (arg == "--idle-brightness") {
+                options.rgb.IdleBrightness = atoi(value);
+            } else if (arg == "--primary") {
+                options.rgb.RgbPrimary = parse_color(value);
+            } else if (arg == "--secondary") {
+                options.rgb.RgbSecondary = parse_color(value);
+            } else if (arg == "--tertiary") {
+                options.rgb.RgbTertiary = parse_color(value);
+            } else if (arg == "--program") {
+                std::ifstream in(value, std::ios::binary);
+                if (!in) {
+                    throw ArcinError(std::string("can't read ") + value);
+                }
+                options.program.assign(std::istreambuf_iterator<char>(in), {});
+            } else if (arg == "--frames") {
+                options.frames = atoi(value);
+            } else if (arg == "--frame-ms") {
+                options.frame_ms = atoi(value);
+            } else if (arg == "--spin") {
+                options.spin = parse_spin(value);
+            } else if (arg == "--ppm") {
+                ppm = value;
+            } else if (arg == "--golden") {
+                golden = value;
+            } else {
+                usage();
+            }
+        }
+
+        if (all_modes) {
+            for (uint8_t mode = 0; mode < WS2812B_MODE_COUNT; mode++) {
+                RenderOptions each = options;
+                each.rgb.Mode = mode;
+
+                char what[16];
+                snprintf(what, sizeof(what), "mode %2u: ", mode);
+                print_cost(what, render(each), each.frames);
+            }
+            return 0;
+        }
+
+        RenderResult result = render(options);
+
+        if (!ppm.empty()) {
+            write_ppm(ppm, result);
+        }
+
+        if (hashes) {
+            for (size_t i = 0; i < result.hashes.size(); i++) {
+                printf("%zu %08x\n", i, result.hashes[i]);
+            }
+        }
+
+        // render cost goes to stderr so that hashes can be redirected to a file
+        print_cost("", result, options.frames);
+
+        if (!golden.empty()) {
+            return compare_golden(golden, result);
+        }
+    } catch (std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,464 @@
+// Tests of the LED effect code built for the host: the effect program VM
+// (arcin/rgb_program.h), turntable activity (arcin/rgb_tt_activity.h),
+// replaying spins from the test board's velocity curves, and every mode
+// through RGBManager (effect_render.h). Rendered frames are checked against
+// golden hashes; on a mismatch the new hash is printed, to be checked by eye
+// (with --dump, which prints the frames) and pasted in if the change was
+// intended.
+//
+//   arcinrgbtest [--dump]
+
+#include <initializer_list>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "color_palettes.h"
+#include "rgb_beat.h"
+#include "rgb_program.h"
+#include "rgb_tt_activity.h"
+#include "../test/qe_curve.h"
+// last, arcin/ws2812b.h defines min and max
+#include "effect_render.h"
+
+namespace {
+
+int failures = 0;
+bool dump = false;
+
+void check(bool ok, const char* what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// FNV-1a over a run of frames
+struct FrameHash {
+    uint32_t hash = 2166136261u;
+
+    void add(const CRGB* leds, uint8_t num_leds) {
+        for (uint8_t i = 0; i < num_leds; i++) {
+            for (uint8_t c = 0; c < 3; c++) {
+                hash = (hash ^ leds[i].raw[c]) * 16777619u;
+            }
+        }
+    }
+};
+
+void check_hash(const FrameHash& frames, uint32_t golden, const char* what) {
+    if (frames.hash != golden) {
+        printf("FAIL: %s: frames hash to 0x%08x, golden is 0x%08x\n", what, frames.hash, golden);
+        failures++;
+    }
+}
+
+void print_frame(const char* what, uint32_t ms, const CRGB* leds, uint8_t num_leds) {
+    if (!dump) {
+        return;
+    }
+    printf("%s @%u:", what, ms);
+    for (uint8_t i = 0; i < num_leds; i++) {
+        printf(" %02x%02x%02x", leds[i].red, leds[i].green, leds[i].blue);
+    }
+    printf("\n");
+}
+
+typedef rgb_program_instruction_t Op;
+
+// Builds a program blob
+std::vector<uint8_t> blob(std::initializer_list<Op> frame, std::initializer_list<Op> pixel) {
+    rgb_program_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = RGB_PROGRAM_MAGIC;
+    header.version = RGB_PROGRAM_VERSION;
+    header.frame_length = frame.size();
+    header.pixel_length = pixel.size();
+
+    std::vector<uint8_t> out((uint8_t*)&header, (uint8_t*)&header + sizeof(header));
+    for (const Op& op : frame) {
+        out.insert(out.end(), (const uint8_t*)&op, (const uint8_t*)&op + sizeof(op));
+    }
+    for (const Op& op : pixel) {
+        out.insert(out.end(), (const uint8_t*)&op, (const uint8_t*)&op + sizeof(op));
+    }
+    return out;
+}
+
+bool loads(const std::vector<uint8_t>& program, uint8_t num_leds = 60) {
+    RgbProgram vm;
+    bool valid = RgbProgram::validate(program.data(), program.size(), num_leds);
+    bool loaded = vm.load(program.data(), program.size(), num_leds);
+    check(valid == loaded, "validate() and load() disagree");
+    return loaded;
+}
+
+const Op red_from_index = {RGB_OP_MOVE, RGB_REG_RED, RGB_REG_INDEX, 0};
+
+void test_validation() {
+    std::vector<uint8_t> good = blob({}, {red_from_index});
+    check(loads(good), "a minimal program is rejected");
+
+    std::vector<uint8_t> bad_magic = good;
+    bad_magic[0] ^= 1;
+    check(!loads(bad_magic), "bad magic is accepted");
+
+    std::vector<uint8_t> bad_version = good;
+    bad_version[2]++;
+    check(!loads(bad_version), "unknown version is accepted");
+
+    std::vector<uint8_t> truncated(good.begin(), good.end() - 1);
+    check(!loads(truncated), "a truncated program is accepted");
+    check(!loads(std::vector<uint8_t>(good.begin(), good.begin() + 3)), "a truncated header is accepted");
+
+    check(!loads(blob({}, {{RGB_OP_TOTAL, 0, 0, 0}})), "an unknown op is accepted");
+    check(!loads(blob({}, {{RGB_OP_MOVE, RGB_REG_GLOBAL_0, RGB_REG_INDEX, 0}})),
+        "the pixel program may write a global");
+    check(!loads(blob({{RGB_OP_MOVE, RGB_REG_RED, RGB_REG_TIME, 0}}, {})),
+        "the frame program may write an output");
+    check(!loads(blob({}, {{RGB_OP_MOVE, RGB_REG_TIME, RGB_REG_INDEX, 0}})),
+        "an input may be written");
+    check(!loads(blob({}, {{RGB_OP_ADD, RGB_REG_RED, RGB_REG_TOTAL, 0}})),
+        "an out of range register may be read");
+    check(!loads(blob({}, {{RGB_OP_SHL, RGB_REG_RED, RGB_REG_INDEX, 16}})),
+        "a shift by 16 is accepted");
+    check(!loads(blob({{RGB_OP_PALETTE, 0, RGB_REG_TIME, RGB_REG_TIME}}, {})),
+        "the frame program may use the palette");
+    check(!loads(blob({}, {{RGB_OP_SKIP, 0, 0, 1}})), "a skip past the end is accepted");
+    check(loads(blob({}, {{RGB_OP_SKIP, 0, 0, 1}, red_from_index})), "a skip to the end is rejected");
+
+    std::vector<Op> longest(RGB_PROGRAM_MAX_INSTRUCTIONS + 1, Op{RGB_OP_END, 0, 0, 0});
+    rgb_program_header_t header = {RGB_PROGRAM_MAGIC, RGB_PROGRAM_VERSION, 0, 0, {0}};
+    header.frame_length = longest.size();
+    std::vector<uint8_t> too_long((uint8_t*)&header, (uint8_t*)&header + sizeof(header));
+    too_long.insert(too_long.end(), (uint8_t*)longest.data(), (uint8_t*)(longest.data() + longest.size()));
+    check(!loads(too_long, 1), "a program over the instruction limit is accepted");
+
+    // a rejected program leaves the loaded one running
+    RgbProgram vm;
+    check(vm.load(good.data(), good.size(), 60), "a minimal program is rejected");
+    check(!vm.load(bad_magic.data(), bad_magic.size(), 60), "bad magic is accepted");
+    check(vm.is_loaded(), "a rejected program unloaded the running one");
+}
+
+void test_cycle_budget() {
+    // 4 HSV (90 cycles) and 5 MOVE (8 cycles) come to 400 cycles per pixel,
+    // exactly the budget at 180 LEDs
+    const Op hsv = {RGB_OP_HSV, RGB_REG_INDEX, RGB_REG_INDEX, RGB_REG_INDEX};
+    std::vector<uint8_t> at_budget = blob({}, {
+        hsv, hsv, hsv, hsv,
+        red_from_index, red_from_index, red_from_index, red_from_index, red_from_index,
+    });
+    check(RGB_PROGRAM_CYCLE_BUDGET == 180 * 400, "the budget changed; update this test");
+    check(loads(at_budget, 180), "a program at the budget is rejected");
+
+    // one more END (4 cycles) in the frame program tips it over
+    std::vector<uint8_t> over_budget = blob({{RGB_OP_END, 0, 0, 0}}, {
+        hsv, hsv, hsv, hsv,
+        red_from_index, red_from_index, red_from_index, red_from_index, red_from_index,
+    });
+    check(!loads(over_budget, 180), "a program over the budget is accepted");
+    check(loads(over_budget, 179), "the budget does not scale with the LED count");
+
+    // skipped instructions still count
+    std::vector<uint8_t> skipped = blob({}, {
+        {RGB_OP_SKIP, 0, 0, 6},
+        hsv, hsv, hsv, hsv, hsv, hsv,
+    });
+    check(!loads(skipped, 180), "skipped instructions are left out of the budget");
+}
+
+void render(
+    const std::vector<uint8_t>& program, uint8_t num_leds, uint32_t frames,
+    FrameHash& hash, const char* what, uint16_t buttons = 0, int8_t tt = 0) {
+
+    RgbProgram vm;
+    PaletteSampler palette;
+    fill_from_palette(palette, WS2812B_PALETTE_RAINBOW, false);
+    check(vm.load(program.data(), program.size(), num_leds), what);
+
+    CRGB leds[UINT8_MAX];
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        rgb_program_inputs_t inputs;
+        inputs.time_ms = 1000 + frame * 20;
+        inputs.delta_ms = 20;
+        inputs.tt = tt;
+        inputs.buttons = buttons;
+        vm.render(leds, num_leds, inputs, palette);
+        hash.add(leds, num_leds);
+        print_frame(what, inputs.time_ms, leds, num_leds);
+    }
+}
+
+void test_beat8() {
+    // red = beat8(60 + index), green = sin8 of it
+    std::vector<uint8_t> program = blob({}, {
+        {RGB_OP_ADDI, 0, RGB_REG_INDEX, 60},
+        {RGB_OP_BEAT8, RGB_REG_RED, 0, 0},
+        {RGB_OP_SIN8, RGB_REG_GREEN, RGB_REG_RED, 0},
+    });
+
+    RgbProgram vm;
+    PaletteSampler palette;
+    check(vm.load(program.data(), program.size(), 8), "the BEAT8 program is rejected");
+    CRGB leds[8];
+    bool matches = true;
+    for (uint32_t ms = 0; ms < 100000; ms += 997) {
+        rgb_program_inputs_t inputs = {ms, 20, 0, 0};
+        vm.render(leds, 8, inputs, palette);
+        for (uint8_t i = 0; i < 8; i++) {
+            uint8_t beat = beat88_at(ms, 60 + i) & 0xFF;
+            matches = matches && leds[i].red == beat && leds[i].green == sin8(beat);
+        }
+    }
+    check(matches, "BEAT8 does not follow beat88 on the program's clock");
+
+    FrameHash hash;
+    render(program, 16, 50, hash, "BEAT8");
+    check_hash(hash, 0x29314e9c, "BEAT8 frames");
+}
+
+void test_rand8() {
+    // red = random8(), blue = random8() & 0x0F
+    std::vector<uint8_t> program = blob({}, {
+        {RGB_OP_RAND8, RGB_REG_RED, 0, 0},
+        {RGB_OP_LOAD, 0, 0x00, 0x0F},
+        {RGB_OP_RAND8, 1, 0, 0},
+        {RGB_OP_AND, RGB_REG_BLUE, 1, 0},
+    });
+
+    random16_set_seed(1337);
+    RgbProgram vm;
+    PaletteSampler palette;
+    check(vm.load(program.data(), program.size(), 8), "the RAND8 program is rejected");
+    CRGB leds[8];
+    rgb_program_inputs_t inputs = {0, 20, 0, 0};
+    vm.render(leds, 8, inputs, palette);
+
+    random16_set_seed(1337);
+    bool matches = true;
+    for (uint8_t i = 0; i < 8; i++) {
+        uint8_t red = random8();
+        uint8_t blue = random8() & 0x0F;
+        matches = matches && leds[i].red == red && leds[i].blue == blue;
+    }
+    check(matches, "RAND8 does not draw from random8()");
+
+    random16_set_seed(1337);
+    FrameHash hash;
+    render(program, 16, 50, hash, "RAND8");
+    check_hash(hash, 0x01c397aa, "RAND8 frames");
+}
+
+void test_shl() {
+    // -1 << 4, masked to 8 bits, is 0xF0
+    std::vector<uint8_t> program = blob({}, {
+        {RGB_OP_LOAD, 0, 0xFF, 0xFF},
+        {RGB_OP_SHL, 0, 0, 4},
+        {RGB_OP_LOAD, 1, 0x00, 0xFF},
+        {RGB_OP_AND, RGB_REG_RED, 0, 1},
+    });
+
+    RgbProgram vm;
+    PaletteSampler palette;
+    check(vm.load(program.data(), program.size(), 1), "the SHL program is rejected");
+    CRGB led;
+    rgb_program_inputs_t inputs = {0, 20, 0, 0};
+    vm.render(&led, 1, inputs, palette);
+    check(led.red == 0xF0, "SHL of a negative register");
+}
+
+void test_effect() {
+    // A turntable and key reactive palette wave: the frame program keeps a
+    // scrolling offset in a global, the pixel program samples the palette and
+    // turns white where the LED index shares a bit with the held buttons.
+    std::vector<uint8_t> program = blob({
+        {RGB_OP_SHR, 0, RGB_REG_DELTA, 2},
+        {RGB_OP_ADD, RGB_REG_GLOBAL_0, RGB_REG_GLOBAL_0, 0},
+        {RGB_OP_ADD, RGB_REG_GLOBAL_0, RGB_REG_GLOBAL_0, RGB_REG_TT},
+    }, {
+        {RGB_OP_SHL, 0, RGB_REG_INDEX, 3},
+        {RGB_OP_ADD, 0, 0, RGB_REG_GLOBAL_0},
+        {RGB_OP_QUAD8, 1, RGB_REG_TIME, 0},
+        {RGB_OP_MAX, 1, 1, 2},
+        {RGB_OP_PALETTE, 0, 0, 1},
+        {RGB_OP_AND, 4, RGB_REG_BUTTONS, RGB_REG_INDEX},
+        {RGB_OP_SKIPZ, 0, 4, 3},
+        {RGB_OP_LOAD, RGB_REG_RED, 0x00, 0xFF},
+        {RGB_OP_MOVE, RGB_REG_GREEN, RGB_REG_RED, 0},
+        {RGB_OP_MOVE, RGB_REG_BLUE, RGB_REG_RED, 0},
+    });
+
+    FrameHash hash;
+    render(program, 24, 50, hash, "effect", 0x0005, 40);
+    render(program, 24, 50, hash, "effect reversed", 0x0000, -40);
+    check_hash(hash, 0xeaefb9b4, "effect frames");
+}
+
+// A spin as the encoder would have seen it: QeCurve's steps, counted per ms.
+std::vector<int32_t> record_spin(uint8_t curve, int16_t velocity, uint16_t period, uint32_t ms) {
+    QeCurve qe;
+    qe.start(curve, velocity, period);
+
+    std::vector<int32_t> ticks;
+    int8_t slots[QE_CURVE_SLOTS_PER_MS];
+    for (uint32_t t = 0; t < ms; t++) {
+        int32_t before = qe.position;
+        qe.next_ms(slots);
+        ticks.push_back(qe.position - before);
+    }
+    return ticks;
+}
+
+// Replays a spin at one frame period, as RGBManager::update_colors() does:
+// the ticks are summed over each frame. Returns the activity at the end of
+// every frame, repeated for each of its ms.
+std::vector<int8_t> replay_spin(
+    const std::vector<int32_t>& spin, uint32_t frame_ms, uint16_t fade_out_ms) {
+
+    TurntableActivity tt;
+    std::vector<int8_t> activity;
+    for (size_t start = 0; start + frame_ms <= spin.size(); start += frame_ms) {
+        int32_t ticks = 0;
+        for (size_t t = start; t < start + frame_ms; t++) {
+            ticks += spin[t];
+        }
+        int8_t frame = tt.update(ticks, frame_ms, fade_out_ms);
+        activity.insert(activity.end(), frame_ms, frame);
+    }
+    return activity;
+}
+
+// Largest difference between a replay at a longer frame period and one at a
+// shorter, sampled every step ms. A longer frame only sees a change at its
+// end, so a is allowed to be up to lag ms ahead.
+int activity_difference(
+    const std::vector<int8_t>& a, const std::vector<int8_t>& b, uint32_t step, uint32_t lag) {
+
+    int difference = 0;
+    for (size_t t = lag; t < a.size() && t < b.size(); t += step) {
+        int closest = INT8_MAX * 2;
+        for (size_t d = 0; d <= lag; d++) {
+            int this_d = abs(a[t - d] - b[t]);
+            closest = (this_d < closest) ? this_d : closest;
+        }
+        difference = (difference < closest) ? closest : difference;
+    }
+    return difference;
+}
+
+void test_tt_activity() {
+    // a spin at full scale, then a stop
+    std::vector<int32_t> spin = record_spin(QE_CURVE_CONSTANT, TT_ACTIVITY_FULL_SCALE, 0, 300);
+    spin.resize(3000, 0);
+    std::vector<int8_t> activity = replay_spin(spin, 10, 800);
+    check(activity[99] >= 120, "a full scale spin is not at full activity after 100ms");
+    check(activity[299] >= 120, "a full scale spin loses activity");
+    check(activity[399] >= 64, "activity is gone right after the spin stops");
+    check(activity[2999] == 0, "activity does not decay to 0");
+
+    // reversing flips the sign right away
+    std::vector<int32_t> reverse = record_spin(QE_CURVE_CONSTANT, TT_ACTIVITY_FULL_SCALE, 0, 300);
+    std::vector<int32_t> back = record_spin(QE_CURVE_CONSTANT, -TT_ACTIVITY_FULL_SCALE, 0, 300);
+    reverse.insert(reverse.end(), back.begin(), back.end());
+    activity = replay_spin(reverse, 10, 800);
+    check(activity[299] > 0 && activity[379] < -64, "activity does not follow a reversal");
+
+    // the same scratches at 2 to 20ms frames stay within an eighth of the full
+    // range of each other, allowing for the longer frames' lag
+    std::vector<int32_t> scratch = record_spin(QE_CURVE_SCRATCH, 800, 400, 2000);
+    std::vector<int8_t> reference = replay_spin(scratch, 2, 400);
+    for (uint32_t frame_ms : {5, 10, 20}) {
+        int difference =
+            activity_difference(reference, replay_spin(scratch, frame_ms, 400), 20, frame_ms);
+        if (difference > 32) {
+            printf("FAIL: %ums frames are %d off 2ms frames\n", frame_ms, difference);
+            failures++;
+        }
+    }
+
+    // encoder jitter at rest barely lights up
+    activity = replay_spin(record_spin(QE_CURVE_JITTER, 0, 50, 2000), 10, 0);
+    int8_t jitter = 0;
+    for (int8_t a : activity) {
+        jitter = (jitter < abs(a)) ? abs(a) : jitter;
+    }
+    check(jitter <= 16, "jitter at rest shows as activity");
+
+    FrameHash hash;
+    for (const std::vector<int32_t>* recorded : {&spin, &reverse, &scratch}) {
+        for (uint32_t frame_ms : {3, 16}) {
+            std::vector<int8_t> frames = replay_spin(*recorded, frame_ms, 400);
+            for (int8_t a : frames) {
+                hash.hash = (hash.hash ^ (uint8_t)a) * 16777619u;
+            }
+        }
+    }
+    check_hash(hash, 0x1c5138d7, "turntable activity");
+}
+
+// Every mode through RGBManager, idle and following a scratch. Without a
+// program, the program mode shows the primary color like mode 0.
+void test_modes() {
+    static const uint32_t golden[WS2812B_MODE_COUNT] = {
+        0xe6f2d0cd, 0x2b96027d, 0x1504e709, 0xcee88779,
+        0x02a375cb, 0xc6d8b6a1, 0x5085b4b5, 0x35bc8aa9,
+        0xf7abf585, 0xbcc9bcab, 0xe6f2d0cd,
+    };
+
+    rgb_config config;
+    memset(&config, 0, sizeof(config));
+    config.Flags.ReactToTt = 1;
+    config.RgbPrimary = {0xff, 0x40, 0x00};
+    config.RgbSecondary = {0x00, 0xc0, 0xff};
+    config.RgbTertiary = {0x80, 0x00, 0xff};
+    config.NumberOfLeds = 60;
+    config.IdleAnimationSpeed = 30;
+    config.IdleBrightness = 128;
+    config.Multiplicity = 2;
+
+    for (uint8_t mode = 0; mode < WS2812B_MODE_COUNT; mode++) {
+        config.Mode = mode;
+        char what[32];
+        snprintf(what, sizeof(what), "mode %u", mode);
+
+        EffectRender render(config, 16, {{30, 0}, {40, 8}, {40, -8}});
+
+        FrameHash hash;
+        bool lit = false;
+        for (uint32_t frame = 0; frame < 150; frame++) {
+            render.render_next();
+            hash.add(render.leds(), render.num_leds());
+            print_frame(what, frame * 16, render.leds(), render.num_leds());
+            for (uint8_t i = 0; i < render.num_leds(); i++) {
+                lit |= render.leds()[i] != CRGB(CRGB::Black);
+            }
+        }
+
+        check(lit, what);
+        check_hash(hash, golden[mode], what);
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    dump = argc > 1 && !strcmp(argv[1], "--dump");
+
+    test_validation();
+    test_cycle_budget();
+    test_beat8();
+    test_rand8();
+    test_shl();
+    test_effect();
+    test_tt_activity();
+    test_modes();
+
+    if (failures) {
+        printf("%d failed\n", failures);
+        return 1;
+    }
+    printf("all passed\n");
+    return 0;
+}
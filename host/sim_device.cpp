@@ -0,0 +1,502 @@
+#include "sim_device.h"
+#include "config_validate.h"
+#include "image.h"
+#include "remap.h"
+#include "replay.h"
+#include "../bootloader/decompressor.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <thread>
+
+// Header written by the firmware's Configloader
+#define CONFIGLOADER_MAGIC 0xc0ff600d
+
+// Scripted player: presses the keys in turn, 100ms out of every 250ms, while
+// spinning the turntable.
+static void scripted_input(uint32_t ms, uint16_t& buttons, uint8_t& qe1) {
+    buttons = (ms % 250 < 100) ? (1 << ((ms / 250) % 7)) : 0;
+    qe1 = ms / 4;
+}
+
+// The bootloader's Flashloader programs the firmware region at its address on
+// the controller. The simulated controllers take turns at a mapping there: a
+// controller's region is copied in for each bootloader call and back out
+// after it, under firmware_logic_lock.
+static uint8_t* const flash_window = (uint8_t*)FIRMWARE_BASE;
+
+// Same as the bootloader's, for the controller in the window
+uint32_t page_crc(uint8_t page) {
+    return crc32(flash_window + page * FLASH_PAGE_SIZE, FLASH_PAGE_SIZE);
+}
+
+static void erase_page(uint32_t addr) {
+    memset((uint8_t*)(uintptr_t)(addr & ~(FLASH_PAGE_SIZE - 1)), 0xff, FLASH_PAGE_SIZE);
+}
+
+static bool map_flash_window() {
+    static bool mapped = false;
+    static bool failed = false;
+
+    if (!mapped && !failed) {
+        size_t size = FIRMWARE_END - FIRMWARE_BASE;
+        void* p = mmap(flash_window, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+        if (p == flash_window) {
+            FLASH.AR.erase = erase_page;
+            mapped = true;
+        } else {
+            if (p != MAP_FAILED) {
+                munmap(p, size);
+            }
+            fprintf(stderr, "sim: can't map the flash at %p\n", flash_window);
+            failed = true;
+        }
+    }
+
+    return mapped;
+}
+
+class FlashWindow {
+    private:
+        std::lock_guard<std::mutex> guard;
+        std::vector<uint8_t>& flash;
+
+    public:
+        const bool mapped;
+
+        explicit FlashWindow(std::vector<uint8_t>& flash) :
+            guard(firmware_logic_lock), flash(flash), mapped(map_flash_window()) {
+            if (mapped) {
+                memcpy(flash_window, flash.data(), flash.size());
+            }
+        }
+
+        ~FlashWindow() {
+            if (mapped) {
+                memcpy(flash.data(), flash_window, flash.size());
+            }
+        }
+};
+
+SimulatedArcin::SimulatedArcin(int index) :
+    index(index),
+    flash(FIRMWARE_END - FIRMWARE_BASE, 0xff) {
+
+    memset(&last_status, 0xff, sizeof(last_status));
+
+    // Factory image: just a vector table, without a trailer.
+    uint32_t vectors[2] = {0x20008000, FIRMWARE_BASE + 0x101};
+    memcpy(at(FIRMWARE_BASE), vectors, sizeof(vectors));
+
+    config_t defaults;
+    memset(&defaults, 0, sizeof(defaults));
+    snprintf((char*)defaults.label, sizeof(defaults.label), "sim %d", index);
+    config_save(CONFIG_ADDRESS, sizeof(defaults), &defaults);
+
+    boot();
+}
+
+SimulatedArcin::~SimulatedArcin() {}
+
+bool SimulatedArcin::config_load(uint32_t address, uint32_t size, void* data) {
+    uint32_t header[2];
+    memcpy(header, at(address), sizeof(header));
+
+    if (header[0] != CONFIGLOADER_MAGIC) {
+        return false;
+    }
+
+    memcpy(data, at(address + sizeof(header)), std::min(size, header[1]));
+    return true;
+}
+
+void SimulatedArcin::config_save(uint32_t address, uint32_t size, const void* data) {
+    uint32_t header[2] = {CONFIGLOADER_MAGIC, size};
+
+    memset(at(address), 0xff, FLASH_PAGE_SIZE);
+    memcpy(at(address), header, sizeof(header));
+    memcpy(at(address + sizeof(header)), data, size);
+}
+
+void SimulatedArcin::boot() {
+    if (!image_bootable()) {
+        start_bootloader();
+        return;
+    }
+
+    bootloader = false;
+
+    memset(&config, 0, sizeof(config));
+    memset(&config_ext, 0, sizeof(config_ext));
+    config_load(CONFIG_ADDRESS, sizeof(config), &config);
+    config_load(CONFIG_EXT_ADDRESS, sizeof(config_ext), &config_ext);
+    config_validate(&config, &config_ext);
+    config_read_segment = 0;
+
+    boot_time = next_poll = std::chrono::steady_clock::now();
+    input_trace = InputTrace();
+    trace_time = 0;
+}
+
+// Same checks as the bootloader's normal_boot() and verify_image().
+bool SimulatedArcin::image_bootable() {
+    uint32_t reset_vector;
+    memcpy(&reset_vector, at(FIRMWARE_BASE + 4), sizeof(reset_vector));
+    if (reset_vector < FIRMWARE_BASE || reset_vector >= FIRMWARE_END) {
+        return false;
+    }
+
+    image_trailer_t* t = trailer();
+    if (t->magic == IMAGE_TRAILER_MAGIC_INVALIDATED) {
+        return false;
+    }
+    if (t->magic != IMAGE_TRAILER_MAGIC) {
+        return true;
+    }
+    if (t->length > IMAGE_TRAILER_ADDRESS - FIRMWARE_BASE) {
+        return false;
+    }
+    if (t->verified == 0) {
+        return true;
+    }
+    if (crc32(at(FIRMWARE_BASE), t->length) != t->crc) {
+        return false;
+    }
+
+    t->verified = 0;
+    return true;
+}
+
+int SimulatedArcin::send_feature_report(const uint8_t* data, size_t size) {
+    if (bootloader) {
+        if (size != 2 || data[0] != 0) {
+            return -1;
+        }
+        return bootloader_function(data[1]);
+    }
+
+    return runtime_set_feature(data, size);
+}
+
+int SimulatedArcin::get_feature_report(uint8_t* data, size_t size) {
+    if (bootloader) {
+        return -1;
+    }
+
+    return runtime_get_feature(data, size);
+}
+
+int SimulatedArcin::write(const uint8_t* data, size_t size) {
+    // The runtime's output reports drive lights, which are not simulated.
+    if (!bootloader) {
+        return size;
+    }
+
+    if (size != 65 || data[0] != 0) {
+        return -1;
+    }
+
+    return bootloader_write(data + 1, 64) ? size : -1;
+}
+
+int SimulatedArcin::read(uint8_t* data, size_t size, int timeout_ms) {
+    if (!bootloader) {
+        return runtime_read(data, size, timeout_ms);
+    }
+
+    flash_status_t status;
+    {
+        FlashWindow window(flash);
+        if (!window.mapped) {
+            return -1;
+        }
+
+        // Programming advances by one page per read.
+        uint8_t written = flashloader->status().pages_written;
+        while ((flashloader->status().flags & FLASH_STATUS_BUSY) &&
+               flashloader->status().pages_written == written) {
+            flashloader->process();
+        }
+        status = flashloader->status();
+    }
+
+    // Like the bootloader, report on change and every 100ms.
+    using namespace std::chrono;
+    steady_clock::time_point now = steady_clock::now();
+    if (memcmp(&status, &last_status, sizeof(status)) == 0) {
+        steady_clock::time_point due = last_status_time + milliseconds(100);
+        if (timeout_ms >= 0 && due - now > milliseconds(timeout_ms)) {
+            std::this_thread::sleep_for(milliseconds(timeout_ms));
+            return 0;
+        }
+        std::this_thread::sleep_until(due);
+    }
+
+    last_status = status;
+    last_status_time = steady_clock::now();
+
+    size = std::min(size, sizeof(status));
+    memcpy(data, &status, size);
+    return size;
+}
+
+// [Runtime]
+
+uint32_t SimulatedArcin::runtime_ms() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now() - boot_time).count();
+}
+
+// Catches up with the firmware's main loop, which would have recorded every
+// ms since the last call.
+void SimulatedArcin::record_trace() {
+    uint32_t now = runtime_ms();
+
+    if (!input_trace.is_recording() && !input_trace.is_start_requested()) {
+        trace_time = now;
+        return;
+    }
+
+    while (trace_time != now) {
+        trace_time++;
+
+        if (input_trace.is_start_requested()) {
+            input_trace_header_t state;
+            memset(&state, 0, sizeof(state));
+            state.runtime_flags = config.flags;
+            state.qe1_sens = config.qe1_sens;
+            state.debounce_ticks = config.debounce_ticks;
+            state.qe1_range = 256;
+            state.qe2_range = 256;
+            input_trace.start(trace_time, state);
+        }
+
+        uint16_t buttons;
+        uint8_t qe1;
+        scripted_input(trace_time, buttons, qe1);
+        input_trace.record(trace_time, buttons, qe1, 0);
+    }
+}
+
+int SimulatedArcin::runtime_set_feature(const uint8_t* data, size_t size) {
+    record_trace();
+
+    if (size >= 2 && data[0] == BOOTLOADER_REPORT_ID) {
+        switch (data[1]) {
+            case RUNTIME_FUNC_RESET_BOOTLOADER:
+                start_bootloader();
+                return size;
+
+            case RUNTIME_FUNC_RESET:
+                boot();
+                return size;
+
+            default:
+                return -1;
+        }
+    }
+
+    if (size != sizeof(config_report_t) || data[0] != CONFIG_REPORT_ID) {
+        return -1;
+    }
+
+    // Same segment handling as set_feature_config() in arcin/main.cpp, except
+    // that effect programs are not simulated.
+    const config_report_t* report = (const config_report_t*)data;
+    if (report->size > CONFIG_SEGMENT_SIZE) {
+        return -1;
+    }
+
+    if (report->segment == INPUT_TRACE_SEGMENT_CONTROL) {
+        config_read_segment = report->segment;
+        bool ok = report->size == 0 ||
+            input_trace.control(report->data, report->size, runtime_ms());
+        return ok ? size : -1;
+    }
+
+    if (report->segment == INPUT_TRACE_SEGMENT_READ) {
+        config_read_segment = report->segment;
+        return input_trace.select(report->data, report->size) ? size : -1;
+    }
+
+    if (report->segment > sizeof(config_ext) / CONFIG_SEGMENT_SIZE) {
+        return -1;
+    }
+
+    config_read_segment = report->segment;
+    if (report->size == 0) {
+        return size;
+    }
+
+    if (report->segment == 0) {
+        config_save(CONFIG_ADDRESS, std::min<uint32_t>(report->size, CONFIG_SEGMENT_SIZE), report->data);
+        return size;
+    }
+
+    uint32_t offset = (report->segment - 1) * CONFIG_SEGMENT_SIZE;
+    memcpy(
+        (uint8_t*)&config_ext + offset,
+        report->data,
+        std::min<uint32_t>(report->size, CONFIG_SEGMENT_SIZE));
+    config_save(CONFIG_EXT_ADDRESS, sizeof(config_ext), &config_ext);
+
+    return size;
+}
+
+int SimulatedArcin::runtime_get_feature(uint8_t* data, size_t size) {
+    if (size < sizeof(config_report_t) || data[0] != CONFIG_REPORT_ID) {
+        return -1;
+    }
+
+    record_trace();
+
+    config_report_t report;
+    memset(&report, 0, sizeof(report));
+    report.report_id = CONFIG_REPORT_ID;
+    report.segment = config_read_segment;
+    report.size = CONFIG_SEGMENT_SIZE;
+
+    if (config_read_segment == 0) {
+        memcpy(report.data, &config, sizeof(config));
+    } else if (config_read_segment == INPUT_TRACE_SEGMENT_CONTROL) {
+        input_trace.read_header(report.data, runtime_ms());
+    } else if (config_read_segment == INPUT_TRACE_SEGMENT_READ) {
+        input_trace.read_chunk(report.data);
+    } else {
+        uint32_t offset = (config_read_segment - 1) * CONFIG_SEGMENT_SIZE;
+        memcpy(report.data, (uint8_t*)&config_ext + offset, CONFIG_SEGMENT_SIZE);
+    }
+
+    memcpy(data, &report, sizeof(report));
+    return sizeof(report);
+}
+
+int SimulatedArcin::runtime_read(uint8_t* data, size_t size, int timeout_ms) {
+    using namespace std::chrono;
+
+    // One input report per 1ms poll.
+    steady_clock::time_point now = steady_clock::now();
+    if (next_poll > now) {
+        if (timeout_ms >= 0 && next_poll - now > milliseconds(timeout_ms)) {
+            std::this_thread::sleep_for(milliseconds(timeout_ms));
+            return 0;
+        }
+        std::this_thread::sleep_until(next_poll);
+    }
+    next_poll = std::max(next_poll, now) + milliseconds(1);
+
+    record_trace();
+
+    uint32_t ms = runtime_ms();
+    uint16_t raw;
+    uint8_t qe1;
+    scripted_input(ms, raw, qe1);
+
+    input_report_t report;
+    report.report_id = INPUT_REPORT_ID;
+    {
+        std::lock_guard<std::mutex> guard(firmware_logic_lock);
+        remap_init(config, &config_ext.remap);
+        report.buttons = remap_buttons(raw);
+    }
+    report.axis_x = qe1;
+    report.axis_y = 127;
+
+    size = std::min(size, sizeof(report));
+    memcpy(data, &report, size);
+    return size;
+}
+
+// [Bootloader]
+
+// As after a reset into the bootloader, with nothing prepared or buffered.
+void SimulatedArcin::start_bootloader() {
+    bootloader = true;
+    flashloader.reset(new Flashloader());
+    decompressor.reset(new Decompressor(*flashloader));
+}
+
+int SimulatedArcin::bootloader_function(uint8_t func) {
+    // These work on the sim's own copy of the flash.
+    if (func == BOOTLOADER_FUNC_RESET) {
+        boot();
+        return 2;
+    }
+
+    if (func == BOOTLOADER_FUNC_VERIFY) {
+        bool ok = !flashloader->is_prepared() &&
+            trailer()->magic == IMAGE_TRAILER_MAGIC && image_bootable();
+        return ok ? 2 : -1;
+    }
+
+    FlashWindow window(flash);
+    return window.mapped && bootloader_set_feature(func) ? 2 : -1;
+}
+
+// Same as HID_bootloader::set_feature_report() in bootloader/main.cpp
+bool SimulatedArcin::bootloader_set_feature(uint8_t func) {
+    if ((func & ~BOOTLOADER_FUNC_PAGE_MASK) == BOOTLOADER_FUNC_SEEK) {
+        if (!flashloader->can_seek()) {
+            return false;
+        }
+
+        // The compressed stream restarts at the new page.
+        if (decompressor->active && !decompressor->flush()) {
+            return false;
+        }
+
+        return flashloader->seek(func & BOOTLOADER_FUNC_PAGE_MASK);
+    }
+
+    if ((func & ~BOOTLOADER_FUNC_PAGE_MASK) == BOOTLOADER_FUNC_PAGE_CRC) {
+        return flashloader->query_crc(func & BOOTLOADER_FUNC_PAGE_MASK);
+    }
+
+    switch (func) {
+        case 0:
+            return true;
+
+        case BOOTLOADER_FUNC_PREPARE:
+            decompressor->active = false;
+            return flashloader->prepare();
+
+        case BOOTLOADER_FUNC_FINISH:
+            if (decompressor->active) {
+                decompressor->active = false;
+                if (!decompressor->flush()) {
+                    flashloader->finish();
+                    return false;
+                }
+            }
+            return flashloader->finish();
+
+        case BOOTLOADER_FUNC_PREPARE_COMPRESSED:
+            decompressor->reset();
+            decompressor->active = true;
+            return flashloader->prepare();
+
+        default:
+            return false;
+    }
+}
+
+// Same as HID_bootloader::set_output_report()
+bool SimulatedArcin::bootloader_write(const uint8_t* data, size_t size) {
+    FlashWindow window(flash);
+    if (!window.mapped) {
+        return false;
+    }
+
+    uint32_t report[16];
+    memcpy(report, data, sizeof(report));
+
+    if (decompressor->active) {
+        uint8_t* stream = (uint8_t*)report;
+        return stream[0] < size && decompressor->write(stream[0], stream + 1);
+    }
+
+    return flashloader->write_block(size, report);
+}
@@ -0,0 +1,84 @@
+#ifndef ARCIN_HOST_SIM_DEVICE_H
+#define ARCIN_HOST_SIM_DEVICE_H
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "transport.h"
+#include "protocol.h"
+#include "input_trace.h"
+
+class Flashloader;
+class Decompressor;
+
+// An arcin simulated in-process, for testing host tools without hardware.
+// It emulates the flash (firmware region and config pages), the runtime's
+// config and input reports, input traces, and the bootloader's flashing
+// protocol. Button remapping runs the firmware's own remap.cpp, and flashing
+// the bootloader's own Flashloader and Decompressor.
+class SimulatedArcin : public Transport {
+    private:
+        int index;
+        bool bootloader;
+        std::vector<uint8_t> flash;
+
+        // runtime
+        config_t config;
+        config_ext_t config_ext;
+        uint8_t config_read_segment;
+        std::chrono::steady_clock::time_point boot_time;
+        std::chrono::steady_clock::time_point next_poll;
+        InputTrace input_trace;
+        // last ms the trace was recorded for
+        uint32_t trace_time;
+
+        // bootloader
+        std::unique_ptr<Flashloader> flashloader;
+        std::unique_ptr<Decompressor> decompressor;
+        flash_status_t last_status;
+        std::chrono::steady_clock::time_point last_status_time;
+
+        uint8_t* at(uint32_t address) {
+            return &flash[address - FIRMWARE_BASE];
+        }
+
+        image_trailer_t* trailer() {
+            return (image_trailer_t*)at(IMAGE_TRAILER_ADDRESS);
+        }
+
+        void boot();
+        bool config_load(uint32_t address, uint32_t size, void* data);
+        void config_save(uint32_t address, uint32_t size, const void* data);
+
+        int runtime_set_feature(const uint8_t* data, size_t size);
+        int runtime_get_feature(uint8_t* data, size_t size);
+        int runtime_read(uint8_t* data, size_t size, int timeout_ms);
+        uint32_t runtime_ms();
+        void record_trace();
+
+        void start_bootloader();
+        int bootloader_function(uint8_t func);
+        bool bootloader_set_feature(uint8_t func);
+        bool bootloader_write(const uint8_t* data, size_t size);
+        bool image_bootable();
+
+    public:
+        explicit SimulatedArcin(int index);
+        ~SimulatedArcin();
+
+        int send_feature_report(const uint8_t* data, size_t size);
+        int get_feature_report(uint8_t* data, size_t size);
+        int write(const uint8_t* data, size_t size);
+        int read(uint8_t* data, size_t size, int timeout_ms);
+
+        bool is_bootloader() const {
+            return bootloader;
+        }
+
+        std::string name() const {
+            return "sim:" + std::to_string(index);
+        }
+};
+
+#endif
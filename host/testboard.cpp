@@ -0,0 +1,110 @@
+#include "testboard.h"
+
+#include <stdexcept>
+#include <string>
+
+#ifdef ARCIN_HOST_LIBUSB
+
+#include <libusb.h>
+
+// Vendor requests, see USB_arcin_test::handle_setup() in test/main.cpp
+#define TEST_BOARD_SET_BUTTONS 0xf0
+#define TEST_BOARD_COUNT_QE 0xf2
+#define TEST_BOARD_SCHEDULE_STIMULUS 0xf3
+#define TEST_BOARD_GET_EVENT 0xf4
+#define TEST_BOARD_GET_FRAME_TIME 0xf5
+#define TEST_BOARD_PLAY_CURVE 0xf6
+#define TEST_BOARD_STOP_CURVE 0xf7
+#define TEST_BOARD_GET_CURVE_STATUS 0xf8
+
+#define TEST_BOARD_TIMEOUT_MS 1000
+
+class LibusbTestBoard : public TestBoard {
+    private:
+        libusb_context* ctx;
+        libusb_device_handle* dev;
+
+        void request(uint8_t request, uint16_t value, uint16_t index, void* data, uint16_t length) {
+            int r = libusb_control_transfer(
+                dev, 0xc0, request, value, index, (unsigned char*)data, length, TEST_BOARD_TIMEOUT_MS);
+
+            if (r != length) {
+                throw std::runtime_error("test board request " + std::to_string(request) + " failed");
+            }
+        }
+
+    public:
+        LibusbTestBoard(libusb_context* ctx, libusb_device_handle* dev) : ctx(ctx), dev(dev) {}
+
+        ~LibusbTestBoard() {
+            libusb_close(dev);
+            libusb_exit(ctx);
+        }
+
+        void set_buttons(uint16_t buttons) {
+            request(TEST_BOARD_SET_BUTTONS, buttons, 0, nullptr, 0);
+        }
+
+        void count_qe(int8_t steps) {
+            request(TEST_BOARD_COUNT_QE, uint8_t(steps), 0, nullptr, 0);
+        }
+
+        void schedule_stimulus(uint16_t buttons, int8_t steps, uint16_t delay_us) {
+            if (delay_us >= 1000 || steps < -32 || steps > 31) {
+                throw std::runtime_error("stimulus out of range");
+            }
+            request(TEST_BOARD_SCHEDULE_STIMULUS, buttons, ((steps & 0x3f) << 10) | delay_us, nullptr, 0);
+        }
+
+        test_board_event_t last_event() {
+            test_board_event_t event;
+            request(TEST_BOARD_GET_EVENT, 0, 0, &event, sizeof(event));
+            return event;
+        }
+
+        test_board_frame_time_t frame_time() {
+            test_board_frame_time_t t;
+            request(TEST_BOARD_GET_FRAME_TIME, 0, 0, &t, sizeof(t));
+            return t;
+        }
+
+        void play_curve(uint8_t curve, int16_t velocity, uint16_t period_ms) {
+            if (curve > 0xf || period_ms > 0xfff) {
+                throw std::runtime_error("curve out of range");
+            }
+            request(TEST_BOARD_PLAY_CURVE, uint16_t(velocity), (period_ms << 4) | curve, nullptr, 0);
+        }
+
+        void stop_curve() {
+            request(TEST_BOARD_STOP_CURVE, 0, 0, nullptr, 0);
+        }
+
+        test_board_curve_status_t curve_status() {
+            test_board_curve_status_t status;
+            request(TEST_BOARD_GET_CURVE_STATUS, 0, 0, &status, sizeof(status));
+            return status;
+        }
+};
+
+std::unique_ptr<TestBoard> open_test_board() {
+    libusb_context* ctx;
+    if (libusb_init(&ctx) != 0) {
+        throw std::runtime_error("libusb_init failed");
+    }
+
+    libusb_device_handle* dev = libusb_open_device_with_vid_pid(ctx, TEST_BOARD_VID, TEST_BOARD_PID);
+    if (!dev) {
+        libusb_exit(ctx);
+        return nullptr;
+    }
+
+    return std::unique_ptr<TestBoard>(new LibusbTestBoard(ctx, dev));
+}
+
+#else
+
+std::unique_ptr<TestBoard> open_test_board() {
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef ARCIN_HOST_TESTBOARD_H
+#define ARCIN_HOST_TESTBOARD_H
+
+#include <stdint.h>
+#include <memory>
+
+// The test board (test/main.cpp): a second arcin whose outputs drive the
+// inputs of the controller under test, through vendor control requests.
+#define TEST_BOARD_VID 0x1234
+#define TEST_BOARD_PID 0x5678
+
+// The stimulus that was applied last, see schedule_stimulus()
+struct test_board_event_t {
+    uint16_t frame;
+    uint16_t offset_us;
+    uint16_t buttons;
+    int8_t qe;
+    uint8_t sequence;
+} __attribute__((packed));
+
+struct test_board_frame_time_t {
+    uint16_t frame;
+    uint16_t offset_us;
+} __attribute__((packed));
+
+// Encoder curve playback, see play_curve()
+struct test_board_curve_status_t {
+    // net steps and total steps since the curve started, up to 2 ms ahead
+    // of the pins while it plays
+    int32_t position;
+    uint32_t steps;
+    uint32_t elapsed_ms;
+    uint8_t playing;
+} __attribute__((packed));
+
+class TestBoard {
+    public:
+        virtual ~TestBoard() {}
+
+        virtual void set_buttons(uint16_t buttons) = 0;
+        virtual void count_qe(int8_t steps) = 0;
+
+        // Sets the buttons and steps the encoders delay_us (< 1000) after the
+        // next start of frame. steps is -32 to 31.
+        virtual void schedule_stimulus(uint16_t buttons, int8_t steps, uint16_t delay_us) = 0;
+        virtual test_board_event_t last_event() = 0;
+
+        // USB frame number and us since it started
+        virtual test_board_frame_time_t frame_time() = 0;
+
+        // Plays a velocity curve on the encoders (test/qe_curve.h) until
+        // stop_curve(). period_ms is up to 4095.
+        virtual void play_curve(uint8_t curve, int16_t velocity, uint16_t period_ms) = 0;
+        virtual void stop_curve() = 0;
+        virtual test_board_curve_status_t curve_status() = 0;
+};
+
+// libusb backend. Returns nullptr if there is no test board, or without
+// libusb support compiled in.
+std::unique_ptr<TestBoard> open_test_board();
+
+#endif
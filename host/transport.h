@@ -0,0 +1,42 @@
+#ifndef ARCIN_HOST_TRANSPORT_H
+#define ARCIN_HOST_TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A connection to one arcin, in either runtime or bootloader mode. Buffers
+// follow hidapi: the first byte is the report ID (0 for the bootloader, which
+// has no report IDs), and reads return the report ID only when the device
+// uses them. All calls return the number of bytes transferred, or -1.
+class Transport {
+    public:
+        virtual ~Transport() {}
+
+        virtual int send_feature_report(const uint8_t* data, size_t size) = 0;
+        virtual int get_feature_report(uint8_t* data, size_t size) = 0;
+        virtual int write(const uint8_t* data, size_t size) = 0;
+
+        // Returns 0 if nothing arrived within timeout_ms.
+        virtual int read(uint8_t* data, size_t size, int timeout_ms) = 0;
+
+        virtual bool is_bootloader() const = 0;
+
+        // Stable name for messages, e.g. the hidraw path or "sim:3".
+        virtual std::string name() const = 0;
+};
+
+struct DeviceInfo {
+    std::string path;
+    std::string serial;
+    bool bootloader;
+};
+
+// hidapi backend. Without hidapi support compiled in, enumerate_devices()
+// finds nothing.
+std::vector<DeviceInfo> enumerate_devices();
+std::unique_ptr<Transport> open_device(const DeviceInfo& info);
+
+#endif
@@ -0,0 +1,131 @@
+#!/usr/bin/env python
+
+# Packer for the compressed flashing stream decoded by the bootloader's
+# Decompressor (bootloader/decompressor.h). The stream is a sequence of:
+#   0x00-0x7f: n + 1 literal bytes follow
+#   0x80-0xff: copy (n & 0x7f) + 3 bytes, starting (next two bytes, LE) + 1
+#              bytes back
+
+import sys
+
+WINDOW = 1024
+MIN_MATCH = 3
+MAX_MATCH = 0x7f + MIN_MATCH
+MAX_LITERALS = 0x80
+
+# Candidate positions remembered per 3 byte prefix
+MAX_CANDIDATES = 16
+
+def compress_pages(data, page_size):
+	'''Compresses data into one chunk per page. The window carries over from
+	page to page, but no token crosses a page boundary, so the decoder has
+	produced exactly one page after each chunk.'''
+	data = bytearray(data)
+	chunks = []
+	candidates = {}
+	
+	def insert(pos):
+		if pos + MIN_MATCH <= len(data):
+			key = bytes(data[pos:pos + MIN_MATCH])
+			positions = candidates.setdefault(key, [])
+			positions.append(pos)
+			if len(positions) > MAX_CANDIDATES:
+				del positions[0]
+	
+	for start in range(0, len(data), page_size):
+		end = min(start + page_size, len(data))
+		out = bytearray()
+		literals = bytearray()
+		
+		def flush_literals():
+			if literals:
+				out.append(len(literals) - 1)
+				out.extend(literals)
+				del literals[:]
+		
+		pos = start
+		while pos < end:
+			best_len = 0
+			best_offset = 0
+			limit = min(MAX_MATCH, end - pos)
+			
+			if limit >= MIN_MATCH:
+				for candidate in reversed(candidates.get(bytes(data[pos:pos + MIN_MATCH]), [])):
+					offset = pos - candidate
+					if offset > WINDOW:
+						break
+					
+					length = 0
+					while length < limit and data[candidate + length] == data[pos + length]:
+						length += 1
+					
+					if length > best_len:
+						best_len = length
+						best_offset = offset
+						if length == limit:
+							break
+			
+			if best_len >= MIN_MATCH:
+				flush_literals()
+				out.append(0x80 | (best_len - MIN_MATCH))
+				out.append((best_offset - 1) & 0xff)
+				out.append((best_offset - 1) >> 8)
+				
+				for p in range(pos, pos + best_len):
+					insert(p)
+				pos += best_len
+			
+			else:
+				literals.append(data[pos])
+				insert(pos)
+				pos += 1
+				
+				if len(literals) == MAX_LITERALS:
+					flush_literals()
+		
+		flush_literals()
+		chunks.append(out)
+	
+	return chunks
+
+def decompress(stream):
+	'''Reference decoder, matching the bootloader.'''
+	stream = bytearray(stream)
+	out = bytearray()
+	i = 0
+	
+	while i < len(stream):
+		token = stream[i]
+		i += 1
+		
+		if token < 0x80:
+			out.extend(stream[i:i + token + 1])
+			i += token + 1
+		else:
+			offset = (stream[i] | (stream[i + 1] << 8)) + 1
+			i += 2
+			if offset > WINDOW:
+				raise ValueError('offset out of range')
+			for n in range((token & 0x7f) + MIN_MATCH):
+				out.append(out[-offset])
+	
+	return out
+
+if __name__ == '__main__':
+	if len(sys.argv) < 2:
+		print('Usage: %s image.bin' % sys.argv[0])
+		sys.exit(1)
+	
+	data = bytearray(open(sys.argv[1], 'rb').read())
+	chunks = compress_pages(data, 2048)
+	stream = bytearray().join(chunks)
+	
+	if decompress(stream) != data:
+		raise RuntimeError('Round trip failed.')
+	
+	# 63 bytes of stream per 64 byte report
+	reports = sum((len(chunk) + 62) // 63 for chunk in chunks)
+	
+	print('%d -> %d bytes (%.1f%%), %d reports instead of %d' % (
+		len(data), len(stream), 100.0 * len(stream) / max(len(data), 1),
+		reports, (len(data) + 63) // 64))
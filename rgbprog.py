@@ -0,0 +1,168 @@
+#!/usr/bin/env python
+
+# Assembles a WS2812B effect program (see arcin/rgb_program.h) and uploads it
+# to the controller through the config feature report.
+#
+# usage: rgbprog.py program.txt [--dry-run] [--save FILE]
+#
+# --save writes the assembled program to FILE, for host/arcinrgbrender --program.
+#
+# A program has a frame section, run once per frame, and a pixel section, run
+# once for every LED:
+#
+#   frame:
+#       beat8   g0, l0          ; l0 is 0 here, so use a literal bpm instead:
+#       load    l0, 30
+#       beat8   g0, l0
+#   pixel:
+#       shl     l0, index, 4
+#       add     l0, l0, g0
+#       hsv     l0, l1, l2      ; hue = l0, saturation = l1, value = l2
+#
+# Registers: l0-l7 (scratch), g0-g7 (kept across frames, frame section only),
+# time, delta, tt, buttons, index, count (inputs), red, green, blue (outputs).
+
+from hidapi import hidapi
+
+import ctypes, struct, sys
+
+MAGIC = 0x5052
+VERSION = 1
+MAX_INSTRUCTIONS = 64
+SEGMENT_FIRST = 0x10
+SEGMENT_SIZE = 60
+
+REGISTERS = {
+	'time': 16, 'delta': 17, 'tt': 18, 'buttons': 19, 'index': 20, 'count': 21,
+	'red': 24, 'green': 25, 'blue': 26,
+}
+
+for n in range(8):
+	REGISTERS['l%d' % n] = n
+	REGISTERS['g%d' % n] = 8 + n
+
+# name: (opcode, operand kinds) - r = register, i = immediate; d/a/b in order
+OPS = {
+	'end':     (0,  ''),
+	'load':    (1,  'rw'),   # d, 16-bit immediate
+	'move':    (2,  'rr'),
+	'add':     (3,  'rrr'),
+	'sub':     (4,  'rrr'),
+	'mul':     (5,  'rrr'),
+	'addi':    (6,  'rri'),
+	'shr':     (7,  'rri'),
+	'shl':     (8,  'rri'),
+	'and':     (9,  'rrr'),
+	'or':      (10, 'rrr'),
+	'xor':     (11, 'rrr'),
+	'min':     (12, 'rrr'),
+	'max':     (13, 'rrr'),
+	'scale8':  (14, 'rrr'),
+	'qadd8':   (15, 'rrr'),
+	'sin8':    (16, 'rr'),
+	'quad8':   (17, 'rr'),
+	'beat8':   (18, 'rr'),
+	'rand8':   (19, 'r'),
+	'palette': (20, '_rr'),  # index, brightness
+	'hsv':     (21, 'rrr'),  # hue, saturation, value
+	'skip':    (22, '__i'),
+	'skipz':   (23, '_ri'),
+	'skipnz':  (24, '_ri'),
+}
+
+def parse_register(token):
+	if token not in REGISTERS:
+		raise ValueError('unknown register %s' % token)
+	return REGISTERS[token]
+
+def assemble_line(line):
+	parts = line.replace(',', ' ').split()
+	name = parts[0].lower()
+	
+	if name not in OPS:
+		raise ValueError('unknown instruction %s' % name)
+	
+	opcode, kinds = OPS[name]
+	operands = parts[1:]
+	fields = [0, 0, 0]
+	
+	if len(operands) != len(kinds.replace('_', '')):
+		raise ValueError('wrong number of operands for %s' % name)
+	
+	for slot, kind in enumerate(kinds):
+		if kind == '_':
+			continue
+		
+		token = operands.pop(0)
+		
+		if kind == 'r':
+			fields[slot] = parse_register(token.lower())
+		elif kind == 'i':
+			fields[slot] = int(token, 0) & 0xff
+		elif kind == 'w':
+			value = int(token, 0) & 0xffff
+			fields[1] = value >> 8
+			fields[2] = value & 0xff
+	
+	return struct.pack('<BBBB', opcode, *fields)
+
+def assemble(text):
+	sections = {'frame': [], 'pixel': []}
+	current = None
+	
+	for number, line in enumerate(text.splitlines(), 1):
+		line = line.split(';')[0].strip()
+		if not line:
+			continue
+		
+		if line.endswith(':'):
+			current = line[:-1].strip().lower()
+			if current not in sections:
+				raise ValueError('line %d: unknown section %s' % (number, current))
+			continue
+		
+		if current is None:
+			raise ValueError('line %d: instruction outside of a section' % number)
+		
+		try:
+			sections[current].append(assemble_line(line))
+		except ValueError as e:
+			raise ValueError('line %d: %s' % (number, e))
+	
+	for name in sections:
+		if len(sections[name]) > MAX_INSTRUCTIONS:
+			raise ValueError('%s section is too long' % name)
+	
+	header = struct.pack('<HBBB3x', MAGIC, VERSION, len(sections['frame']), len(sections['pixel']))
+	
+	return header + b''.join(sections['frame']) + b''.join(sections['pixel'])
+
+def upload(blob):
+	dev = hidapi.hid_open(0x1ccf, 0x8048, None)
+	
+	if not dev:
+		raise RuntimeError('Device not found.')
+	
+	segment = SEGMENT_FIRST
+	while blob:
+		chunk = blob[:SEGMENT_SIZE]
+		blob = blob[SEGMENT_SIZE:]
+		
+		report = struct.pack('<BBBB', 0xc0, segment, len(chunk), 0) + chunk.ljust(SEGMENT_SIZE, b'\0')
+		
+		if hidapi.hid_send_feature_report(dev, ctypes.c_char_p(report), len(report)) != len(report):
+			raise RuntimeError('Upload failed (program rejected?)')
+		
+		segment += 1
+
+if __name__ == '__main__':
+	blob = assemble(open(sys.argv[1]).read())
+	
+	print('Assembled %d bytes.' % len(blob))
+	
+	if '--save' in sys.argv:
+		open(sys.argv[sys.argv.index('--save') + 1], 'wb').write(blob)
+	
+	if '--dry-run' not in sys.argv:
+		upload(blob)
+		print('Uploaded.')
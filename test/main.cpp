@@ -2,9 +2,13 @@
 #include <gpio/gpio.h>
 #include <interrupt/interrupt.h>
 #include <timer/timer.h>
+#include <dma/dma.h>
 #include <os/time.h>
 #include <usb/usb.h>
 #include <usb/descriptor.h>
+#include <string.h>
+
+#include "qe_curve.h"
 
 auto dev_desc = device_desc(0x200, 0, 0, 0, 64, 0x1234, 0x5678, 0x110, 1, 2, 3, 1);
 auto conf_desc = configuration_desc(0, 1, 0, 0xc0, 0);
@@ -29,11 +33,189 @@ static Pin led2 = GPIOA[9];
 
 USB_f1 usb(USB, dev_desc_p, conf_desc_p);
 
+// Frame number of the last start of frame
+#define USB_FNR (*(volatile uint32_t*)0x40005c48)
+
+// Latency measurement: TIM2 counts microseconds and the main loop notes when
+// each frame starts, so a stimulus can be placed at a chosen point in a frame
+// and reported as frame + offset. The host matches it with the frame in which
+// the DUT's input report arrives; see host/latency.h.
+struct latency_event_t {
+	uint16_t frame;
+	uint16_t offset_us;
+	uint16_t buttons;
+	int8_t qe;
+	uint8_t sequence;
+} __attribute__((packed));
+
+struct frame_time_t {
+	uint16_t frame;
+	uint16_t offset_us;
+} __attribute__((packed));
+
+// Encoder generator. Single steps are made right away; curves are played by
+// TIM4 pacing DMA1 channel 7 into GPIOA.BSRR, one word per QE_CURVE_SLOT_HZ
+// slot, so edges are timed to 10 us whatever the main loop and USB are doing.
+// Each half of the buffer holds 1 ms and is refilled from the interrupt while
+// the other half plays. Both encoders get the same steps.
+#define GPIOA_BSRR_ADDRESS 0x48000018
+
+#define QE_A ((1 << 0) | (1 << 6)) // PA0, PA6
+#define QE_B ((1 << 1) | (1 << 7)) // PA1, PA7
+
+// BSRR words for a step up or down from each state
+static const uint32_t qe_inc[4] = {QE_B, QE_A, QE_B << 16, QE_A << 16};
+static const uint32_t qe_dec[4] = {QE_A, QE_B << 16, QE_A << 16, QE_B};
+
+struct qe_curve_status_t {
+	int32_t position;
+	uint32_t steps;
+	uint32_t elapsed_ms;
+	uint8_t playing;
+} __attribute__((packed));
+
+class QeGenerator {
+	private:
+		// The pins start high, which is state 2.
+		uint8_t state = 2;
+		
+		QeCurve curve;
+		uint32_t dmabuf[2 * QE_CURVE_SLOTS_PER_MS];
+		
+		volatile bool playing = false;
+		volatile bool stop_requested = false;
+		bool draining = false;
+		
+		uint32_t word(int8_t step) {
+			if(step > 0) {
+				return qe_inc[state++ & 3];
+			}
+			if(step < 0) {
+				return qe_dec[state-- & 3];
+			}
+			return 0;
+		}
+		
+		void fill(uint32_t* buf) {
+			if(stop_requested) {
+				memset(buf, 0, QE_CURVE_SLOTS_PER_MS * sizeof(*buf));
+				return;
+			}
+			
+			int8_t steps[QE_CURVE_SLOTS_PER_MS];
+			curve.next_ms(steps);
+			
+			for(uint32_t i = 0; i < QE_CURVE_SLOTS_PER_MS; i++) {
+				buf[i] = word(steps[i]);
+			}
+		}
+	
+	public:
+		bool is_playing() {
+			return playing;
+		}
+		
+		void step(int8_t n) {
+			while(n != 0) {
+				*(volatile uint32_t*)GPIOA_BSRR_ADDRESS = word(n > 0 ? 1 : -1);
+				n += (n > 0) ? -1 : 1;
+			}
+		}
+		
+		bool play(uint8_t curve_type, int16_t velocity, uint16_t period) {
+			if(playing || !curve.start(curve_type, velocity, period)) {
+				return false;
+			}
+			
+			stop_requested = false;
+			draining = false;
+			fill(&dmabuf[0]);
+			fill(&dmabuf[QE_CURVE_SLOTS_PER_MS]);
+			playing = true;
+			
+			DMA1.reg.C[6].NDTR = 2 * QE_CURVE_SLOTS_PER_MS;
+			DMA1.reg.C[6].MAR = (uint32_t)&dmabuf;
+			DMA1.reg.C[6].PAR = GPIOA_BSRR_ADDRESS;
+			// 32 bit, memory increment, circular, from memory, half and full transfer interrupts
+			DMA1.reg.C[6].CR =
+				(2 << 10) | (2 << 8) | (1 << 7) | (1 << 5) | (1 << 4) | (1 << 2) | (1 << 1) | (1 << 0);
+			
+			TIM4.CNT = 0;
+			TIM4.CR1 = 1 << 0;
+			return true;
+		}
+		
+		// Takes effect after the steps already in the buffer have played.
+		void stop() {
+			if(playing) {
+				stop_requested = true;
+			}
+		}
+		
+		qe_curve_status_t status() {
+			return {curve.position, curve.steps, curve.elapsed_ms(), playing};
+		}
+		
+		void irq() {
+			uint32_t isr = DMA1.reg.ISR;
+			DMA1.reg.IFCR = 0xf << 24; // channel 7 flags
+			
+			if(draining) {
+				// the last half with steps in it has played
+				TIM4.CR1 = 0;
+				DMA1.reg.C[6].CR = 0;
+				playing = false;
+				return;
+			}
+			
+			if(isr & (1 << 26)) { // HTIF7
+				fill(&dmabuf[0]);
+			}
+			if(isr & (1 << 25)) { // TCIF7
+				fill(&dmabuf[QE_CURVE_SLOTS_PER_MS]);
+			}
+			
+			draining = stop_requested;
+		}
+		
+		void init() {
+			RCC.enable(RCC.DMA1);
+			RCC.enable(RCC.TIM4);
+			
+			TIM4.PSC = 0;
+			TIM4.ARR = 72000000 / QE_CURVE_SLOT_HZ - 1;
+			TIM4.DIER = 1 << 8; // UDE
+			
+			Interrupt::enable(Interrupt::DMA1_Channel7);
+		}
+};
+
+QeGenerator qe_generator;
+
+template <>
+void interrupt<Interrupt::DMA1_Channel7>() {
+	qe_generator.irq();
+}
+
 class USB_arcin_test : public USB_class_driver {
 	private:
 		USB_generic& usb;
 		
-		uint8_t qe_state;
+		// start of the current frame
+		uint16_t sof_frame;
+		uint32_t sof_time;
+		
+		// scheduled stimulus, waiting for the next frame, then for its time
+		bool stimulus_pending;
+		bool stimulus_armed;
+		uint16_t stimulus_delay;
+		uint16_t stimulus_buttons;
+		int8_t stimulus_qe;
+		uint16_t stimulus_frame;
+		uint32_t stimulus_sof_time;
+		uint32_t stimulus_time;
+		
+		latency_event_t last_event;
 		
 		bool set_buttons(uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
 			button_inputs.set(~wValue);
@@ -53,75 +235,122 @@ class USB_arcin_test : public USB_class_driver {
 			return true;
 		}
 		
-		void inc_qe() {
-			switch(qe_state++ & 3) {
-				case 0:
-					qe1b.on();
-					qe2b.on();
-					break;
-				
-				case 1:
-					qe1a.on();
-					qe2a.on();
-					break;
-				
-				case 2:
-					qe1b.off();
-					qe2b.off();
-					break;
-				
-				case 3:
-					qe1a.off();
-					qe2a.off();
-					break;
+		bool count_qe(uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+			if(qe_generator.is_playing()) {
+				return false;
 			}
+			
+			qe_generator.step(wValue & 0xff);
+			
+			usb.write(0, nullptr, 0);
+			return true;
 		}
 		
-		void dec_qe() {
-			switch(qe_state-- & 3) {
-				case 0:
-					qe1a.on();
-					qe2a.on();
-					break;
-				
-				case 1:
-					qe1b.off();
-					qe2b.off();
-					break;
-				
-				case 2:
-					qe1a.off();
-					qe2a.off();
-					break;
-				
-				case 3:
-					qe1b.on();
-					qe2b.on();
-					break;
+		// wValue: buttons to set
+		// wIndex: bits 0-9 - delay after the next start of frame in us, up to 999
+		//         bits 10-15 - encoder steps, signed
+		bool schedule_stimulus(uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+			if((wIndex & 0x3ff) >= 1000 || ((wIndex >> 10) && qe_generator.is_playing())) {
+				return false;
 			}
+			
+			stimulus_buttons = wValue;
+			stimulus_delay = wIndex & 0x3ff;
+			stimulus_qe = int8_t(wIndex >> 8) >> 2;
+			stimulus_armed = false;
+			stimulus_pending = true;
+			
+			usb.write(0, nullptr, 0);
+			return true;
 		}
 		
-		bool count_qe(uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
-			int8_t n = wValue & 0xff;
+		bool get_event(uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+			if(wLength != sizeof(last_event)) {
+				return false;
+			}
 			
-			while(n != 0) {
-				if(n > 0) {
-					inc_qe();
-					n--;
-				} else {
-					dec_qe();
-					n++;
-				}
+			usb.write(0, (uint32_t*)&last_event, sizeof(last_event));
+			return true;
+		}
+		
+		bool get_frame_time(uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+			if(wLength != sizeof(frame_time_t)) {
+				return false;
+			}
+			
+			frame_time_t t = {sof_frame, uint16_t(TIM2.CNT - sof_time)};
+			
+			usb.write(0, (uint32_t*)&t, sizeof(t));
+			return true;
+		}
+		
+		// wValue: velocity in steps/s, signed
+		// wIndex: bits 0-3 - curve, see qe_curve.h
+		//         bits 4-15 - period in ms
+		bool play_curve(uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+			if(!qe_generator.play(wIndex & 0xf, int16_t(wValue), wIndex >> 4)) {
+				return false;
 			}
 			
 			usb.write(0, nullptr, 0);
 			return true;
 		}
+		
+		bool stop_curve(uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+			qe_generator.stop();
+			
+			usb.write(0, nullptr, 0);
+			return true;
+		}
+		
+		bool get_curve_status(uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+			if(wLength != sizeof(qe_curve_status_t)) {
+				return false;
+			}
+			
+			qe_curve_status_t status = qe_generator.status();
+			
+			usb.write(0, (uint32_t*)&status, sizeof(status));
+			return true;
+		}
 	
 	public:
 		USB_arcin_test(USB_generic& usbd) : usb(usbd) {
 			usb.register_driver(this);
 		}
+		
+		// Called from the main loop. Frame starts are seen to within a pass
+		// of the loop.
+		void poll() {
+			uint32_t now = TIM2.CNT;
+			uint16_t frame = USB_FNR & 0x7ff;
+			
+			if(frame != sof_frame) {
+				sof_frame = frame;
+				sof_time = now;
+				
+				if(stimulus_pending) {
+					stimulus_pending = false;
+					stimulus_armed = true;
+					stimulus_frame = frame;
+					stimulus_sof_time = now;
+					stimulus_time = now + stimulus_delay;
+				}
+			}
+			
+			if(stimulus_armed && int32_t(now - stimulus_time) >= 0) {
+				stimulus_armed = false;
+				
+				button_inputs.set(~stimulus_buttons);
+				qe_generator.step(stimulus_qe);
+				
+				last_event.frame = stimulus_frame;
+				last_event.offset_us = now - stimulus_sof_time;
+				last_event.buttons = stimulus_buttons;
+				last_event.qe = stimulus_qe;
+				last_event.sequence++;
+			}
+		}
 	
 	protected:
 		virtual SetupStatus handle_setup(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
@@ -137,6 +366,30 @@ class USB_arcin_test : public USB_class_driver {
 				return count_qe(wValue, wIndex, wLength) ? SetupStatus::Ok : SetupStatus::Stall;
 			}
 			
+			if(bmRequestType == 0xc0 && bRequest == 0xf3) {
+				return schedule_stimulus(wValue, wIndex, wLength) ? SetupStatus::Ok : SetupStatus::Stall;
+			}
+			
+			if(bmRequestType == 0xc0 && bRequest == 0xf4) {
+				return get_event(wValue, wIndex, wLength) ? SetupStatus::Ok : SetupStatus::Stall;
+			}
+			
+			if(bmRequestType == 0xc0 && bRequest == 0xf5) {
+				return get_frame_time(wValue, wIndex, wLength) ? SetupStatus::Ok : SetupStatus::Stall;
+			}
+			
+			if(bmRequestType == 0xc0 && bRequest == 0xf6) {
+				return play_curve(wValue, wIndex, wLength) ? SetupStatus::Ok : SetupStatus::Stall;
+			}
+			
+			if(bmRequestType == 0xc0 && bRequest == 0xf7) {
+				return stop_curve(wValue, wIndex, wLength) ? SetupStatus::Ok : SetupStatus::Stall;
+			}
+			
+			if(bmRequestType == 0xc0 && bRequest == 0xf8) {
+				return get_curve_status(wValue, wIndex, wLength) ? SetupStatus::Ok : SetupStatus::Stall;
+			}
+			
 			return SetupStatus::Unhandled;
 		}
 };
@@ -262,7 +515,17 @@ int main() {
 	qe2b.set_type(Pin::OpenDrain);
 	qe2b.set_mode(Pin::Output);
 	
+	qe_generator.init();
+	
+	// Free running microsecond timebase
+	RCC.enable(RCC.TIM2);
+	TIM2.PSC = 72 - 1;
+	TIM2.ARR = 0xffffffff;
+	TIM2.EGR = 1;
+	TIM2.CR1 = 1;
+	
 	while(1) {
 		usb.process();
+		usb_arcin_test.poll();
 	}
 }
@@ -0,0 +1,114 @@
+#ifndef QE_CURVE_H
+#define QE_CURVE_H
+
+#include <stdint.h>
+
+// Velocity curves for the test board's encoder generator. The generator has
+// QE_CURVE_SLOT_HZ slots per second and makes at most one step in a slot;
+// this decides which slots step. Plain C++, so the host can work out where
+// the encoder should be at any time (see host/encoder_test.h).
+
+#define QE_CURVE_SLOT_HZ 100000
+#define QE_CURVE_SLOTS_PER_MS (QE_CURVE_SLOT_HZ / 1000)
+
+enum {
+	// velocity steps/s
+	QE_CURVE_CONSTANT,
+	// velocity sweeps from +velocity to -velocity and back, every period ms
+	QE_CURVE_SCRATCH,
+	// one step every period ms, alternating direction, at rest
+	QE_CURVE_JITTER,
+	QE_CURVE_COUNT
+};
+
+class QeCurve {
+	private:
+		uint8_t curve = QE_CURVE_CONSTANT;
+		int16_t velocity = 0;
+		uint16_t period = 1;
+
+		uint32_t ms = 0;
+		// steps/s summed over slots; a step is due every QE_CURVE_SLOT_HZ
+		int32_t phase = 0;
+		int8_t jitter_direction = 1;
+
+	public:
+		// net steps and total steps made so far
+		int32_t position = 0;
+		uint32_t steps = 0;
+
+		bool start(uint8_t curve_, int16_t velocity_, uint16_t period_) {
+			if(curve_ >= QE_CURVE_COUNT || (curve_ != QE_CURVE_CONSTANT && period_ == 0)) {
+				return false;
+			}
+
+			curve = curve_;
+			velocity = velocity_;
+			period = period_;
+			ms = 0;
+			phase = 0;
+			jitter_direction = 1;
+			position = 0;
+			steps = 0;
+			return true;
+		}
+
+		uint32_t elapsed_ms() const {
+			return ms;
+		}
+
+		// Velocity in steps/s during ms t.
+		int32_t velocity_at(uint32_t t) const {
+			switch(curve) {
+				case QE_CURVE_SCRATCH: {
+					// triangle: +velocity at 0, -velocity at period / 2
+					int32_t x = t % period;
+					int32_t v = velocity;
+					if(2 * x < period) {
+						return v - 4 * v * x / period;
+					}
+					return 4 * v * x / period - 3 * v;
+				}
+
+				case QE_CURVE_JITTER:
+					return 0;
+
+				default:
+					return velocity;
+			}
+		}
+
+		// Fills the next ms: out[i] is the step in slot i, -1, 0 or 1.
+		void next_ms(int8_t* out) {
+			int32_t v = velocity_at(ms);
+
+			for(uint32_t i = 0; i < QE_CURVE_SLOTS_PER_MS; i++) {
+				out[i] = 0;
+				phase += v;
+
+				if(phase >= QE_CURVE_SLOT_HZ) {
+					phase -= QE_CURVE_SLOT_HZ;
+					out[i] = 1;
+				} else if(phase <= -QE_CURVE_SLOT_HZ) {
+					phase += QE_CURVE_SLOT_HZ;
+					out[i] = -1;
+				}
+			}
+
+			if(curve == QE_CURVE_JITTER && ms % period == 0) {
+				out[0] = jitter_direction;
+				jitter_direction = -jitter_direction;
+			}
+
+			for(uint32_t i = 0; i < QE_CURVE_SLOTS_PER_MS; i++) {
+				if(out[i]) {
+					position += out[i];
+					steps++;
+				}
+			}
+
+			ms++;
+		}
+};
+
+#endif